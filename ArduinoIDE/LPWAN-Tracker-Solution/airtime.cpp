@@ -0,0 +1,551 @@
+/**
+ * @file airtime.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief LoRa time on air, regional duty cycle budget and daily airtime budget
+ * @version 0.1
+ * @date 2022-09-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "airtime.h"
+
+/** Region numbers as used in g_lorawan_settings.lora_region */
+#define REGION_AS923 0
+#define REGION_AU915 1
+#define REGION_CN470 2
+#define REGION_CN779 3
+#define REGION_EU433 4
+#define REGION_EU868 5
+#define REGION_KR920 6
+#define REGION_IN865 7
+#define REGION_US915 8
+#define REGION_AS923_2 9
+#define REGION_AS923_3 10
+#define REGION_AS923_4 11
+#define REGION_RU864 12
+
+/**
+ * Sub-bands of EU868 with their duty cycle as 1/x, same as the bands of the LoRaMac region.
+ * Frequencies in kHz, the default channels 868.1, 868.3 and 868.5 MHz are in g1.
+ */
+struct eu868_band_s
+{
+	uint32_t min_khz;
+	uint32_t max_khz;
+	uint16_t limit;
+};
+static const eu868_band_s eu868_bands[AIRTIME_MAX_BANDS] = {
+	{863000, 868000, 100},	// g  1 %
+	{868000, 868600, 100},	// g1 1 %
+	{868700, 869200, 1000}, // g2 0.1 %
+	{869400, 869650, 10},	// g3 10 %
+	{869700, 870000, 100},	// g4 1 %
+};
+/** Band of the default channels of EU868 */
+#define EU868_DEFAULT_BAND 1
+
+/**
+ * @brief Calculate the time on air of a LoRa packet
+ *        Formula of the Semtech SX1276 datasheet, calculated in quarter symbols
+ *        so no floating point is needed.
+ *
+ * @param sf spreading factor 7 to 12
+ * @param bw_khz bandwidth in kHz
+ * @param cr coding rate 1 to 4 for 4/5 to 4/8
+ * @param phy_size size of the PHY payload in bytes
+ * @param preamble number of preamble symbols
+ * @param implicit_header true if the header is not sent
+ * @param crc true if the payload CRC is sent
+ * @return uint32_t time on air in us, 0 if the parameters are invalid
+ */
+uint32_t airtime_toa(uint8_t sf, uint16_t bw_khz, uint8_t cr, uint16_t phy_size,
+					 uint8_t preamble, bool implicit_header, bool crc)
+{
+	if ((sf < 7) || (sf > 12) || (bw_khz == 0) || (cr < 1) || (cr > 4))
+	{
+		return 0;
+	}
+
+	// Low data rate optimization is used if a symbol is longer than 16 ms
+	uint32_t symbol_us = ((uint32_t)1 << sf) * 1000 / bw_khz;
+	uint8_t ldro = symbol_us >= 16000 ? 1 : 0;
+
+	int32_t bits = 8 * (int32_t)phy_size - 4 * sf + 28 + (crc ? 16 : 0) - (implicit_header ? 20 : 0);
+	int32_t bits_per_block = 4 * (sf - 2 * ldro);
+	int32_t blocks = bits > 0 ? (bits + bits_per_block - 1) / bits_per_block : 0;
+	uint32_t payload_symbols = 8 + blocks * (cr + 4);
+
+	// Preamble has 4.25 symbols more than programmed
+	uint64_t quarter_symbols = 4 * (uint64_t)preamble + 17 + 4 * (uint64_t)payload_symbols;
+	return (uint32_t)((quarter_symbols * ((uint32_t)1 << sf) * 1000 + 2 * bw_khz) / (4 * (uint64_t)bw_khz));
+}
+
+/**
+ * @brief Get spreading factor and bandwidth of a LoRaWAN data rate
+ *
+ * @param region LoRaWAN region
+ * @param datarate data rate
+ * @param sf spreading factor
+ * @param bw_khz bandwidth in kHz
+ * @return true if the data rate is a LoRa data rate of the region
+ * @return false if the data rate is FSK, LR-FHSS or not available
+ */
+bool airtime_dr_params(uint8_t region, uint8_t datarate, uint8_t *sf, uint16_t *bw_khz)
+{
+	switch (region)
+	{
+	case REGION_US915:
+		if (datarate <= 3)
+		{
+			*sf = 10 - datarate;
+			*bw_khz = 125;
+			return true;
+		}
+		if (datarate == 4)
+		{
+			*sf = 8;
+			*bw_khz = 500;
+			return true;
+		}
+		break;
+	case REGION_AU915:
+		if (datarate == 6)
+		{
+			*sf = 8;
+			*bw_khz = 500;
+			return true;
+		}
+		break;
+	case REGION_CN470:
+	case REGION_KR920:
+		break;
+	default:
+		if (datarate == 6)
+		{
+			*sf = 7;
+			*bw_khz = 250;
+			return true;
+		}
+		break;
+	}
+	if ((region != REGION_US915) && (datarate <= 5))
+	{
+		*sf = 12 - datarate;
+		*bw_khz = 125;
+		return true;
+	}
+	if (((region == REGION_US915) || (region == REGION_AU915)) && (datarate >= 8) && (datarate <= 13))
+	{
+		// Downlink data rates
+		*sf = 20 - datarate;
+		*bw_khz = 500;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Calculate the time on air of a LoRaWAN uplink without FOpts
+ *
+ * @param region LoRaWAN region
+ * @param datarate data rate
+ * @param size application payload size
+ * @return uint32_t time on air in us, 0 if the data rate is not a LoRa data rate
+ */
+uint32_t airtime_uplink(uint8_t region, uint8_t datarate, uint8_t size)
+{
+	uint8_t sf;
+	uint16_t bw_khz;
+	if (!airtime_dr_params(region, datarate, &sf, &bw_khz))
+	{
+		return 0;
+	}
+	return airtime_toa(sf, bw_khz, 1, size + AIRTIME_LORAWAN_OVERHEAD);
+}
+
+/**
+ * @brief Data rate of a join request, as the LoRaMac stack selects it
+ *        The stack ignores the data rate set before the join, every join
+ *        starts with trial 1 again (RegionAlternateDr of LoRaMac-node 4.4).
+ *
+ * @param region LoRaWAN region
+ * @param trial number of the join request within the join, starting with 1
+ * @return uint8_t data rate
+ */
+uint8_t airtime_join_dr(uint8_t region, uint8_t trial)
+{
+	switch (region)
+	{
+	case REGION_AS923:
+	case REGION_AS923_2:
+	case REGION_AS923_3:
+	case REGION_AS923_4:
+		// Dwell time limit
+		return 2;
+	case REGION_US915:
+		return (trial & 0x01) ? 4 : 0;
+	case REGION_AU915:
+		return (trial & 0x01) ? 6 : 0;
+	default:
+		break;
+	}
+	if ((trial % 48) == 0)
+	{
+		return 0;
+	}
+	if ((trial % 32) == 0)
+	{
+		return 1;
+	}
+	if ((trial % 24) == 0)
+	{
+		return 2;
+	}
+	if ((trial % 16) == 0)
+	{
+		return 3;
+	}
+	if ((trial % 8) == 0)
+	{
+		return 4;
+	}
+	return 5;
+}
+
+/**
+ * @brief Data rate of the RX1 window of an uplink
+ *
+ * @param region LoRaWAN region
+ * @param datarate data rate of the uplink
+ * @param offset RX1 DR offset of the session
+ * @return uint8_t data rate of the downlink in RX1
+ */
+uint8_t airtime_rx1_dr(uint8_t region, uint8_t datarate, uint8_t offset)
+{
+	int16_t rx1;
+	switch (region)
+	{
+	case REGION_US915:
+		// Downlinks use the 500 kHz data rates DR8 to DR13
+		rx1 = (datarate >= 4 ? 13 : 10 + datarate) - offset;
+		return rx1 < 8 ? 8 : (uint8_t)rx1;
+	case REGION_AU915:
+		rx1 = (datarate >= 5 ? 13 : 8 + datarate) - offset;
+		return rx1 < 8 ? 8 : (uint8_t)rx1;
+	case REGION_AS923:
+	case REGION_AS923_2:
+	case REGION_AS923_3:
+	case REGION_AS923_4:
+		// Offsets 6 and 7 raise the data rate
+		rx1 = offset > 5 ? datarate + offset - 5 : datarate - offset;
+		return rx1 < 0 ? 0 : (rx1 > 5 ? 5 : (uint8_t)rx1);
+	default:
+		rx1 = datarate - offset;
+		return rx1 < 0 ? 0 : (uint8_t)rx1;
+	}
+}
+
+/**
+ * @brief Airtime of all join requests of a join
+ *
+ * @param region LoRaWAN region
+ * @param trials number of join requests, see AT+JOIN
+ * @return uint32_t airtime in us
+ */
+uint32_t airtime_join(uint8_t region, uint8_t trials)
+{
+	uint32_t toa = 0;
+	for (uint8_t trial = 1; trial <= trials; trial++)
+	{
+		toa += airtime_uplink(region, airtime_join_dr(region, trial), AIRTIME_JOIN_SIZE - AIRTIME_LORAWAN_OVERHEAD);
+	}
+	return toa;
+}
+
+/**
+ * @brief Get the sub-band of a frequency
+ *
+ * @param region LoRaWAN region
+ * @param frequency frequency in Hz, 0 for the default channels of the region
+ * @return uint8_t sub-band, 0 if the region has only one band
+ */
+uint8_t airtime_band(uint8_t region, uint32_t frequency)
+{
+	if (region != REGION_EU868)
+	{
+		return 0;
+	}
+	if (frequency == 0)
+	{
+		return EU868_DEFAULT_BAND;
+	}
+	uint32_t khz = frequency / 1000;
+	for (uint8_t band = 0; band < AIRTIME_MAX_BANDS; band++)
+	{
+		if ((khz >= eu868_bands[band].min_khz) && (khz < eu868_bands[band].max_khz))
+		{
+			return band;
+		}
+	}
+	return EU868_DEFAULT_BAND;
+}
+
+/**
+ * @brief Get the duty cycle limit of a sub-band
+ *        Only regions where the LoRaMac stack enforces the duty cycle by default have a limit.
+ *
+ * @param region LoRaWAN region
+ * @param band sub-band
+ * @return uint16_t duty cycle as 1/x (100 = 1 %), 0 if there is no limit
+ */
+uint16_t airtime_duty_limit(uint8_t region, uint8_t band)
+{
+	switch (region)
+	{
+	case REGION_EU868:
+		return band < AIRTIME_MAX_BANDS ? eu868_bands[band].limit : 0;
+	case REGION_CN779:
+	case REGION_EU433:
+	case REGION_RU864:
+		return band == 0 ? 100 : 0;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Forget the used airtime and set the region
+ *
+ * @param region LoRaWAN region
+ * @param now current time in ms
+ */
+void DutyCycle::begin(uint8_t region, uint32_t now)
+{
+	_region = region;
+	_slot = 0;
+	_slot_start = now;
+	for (uint8_t band = 0; band < AIRTIME_MAX_BANDS; band++)
+	{
+		for (uint8_t slot = 0; slot < AIRTIME_SLOTS; slot++)
+		{
+			_used[band][slot] = 0;
+		}
+	}
+}
+
+/**
+ * @brief Move to the slot of the current time, slots older than one hour are cleared
+ *
+ * @param now current time in ms
+ */
+void DutyCycle::advance(uint32_t now)
+{
+	if ((now - _slot_start) >= AIRTIME_WINDOW)
+	{
+		begin(_region, now);
+		return;
+	}
+	while ((now - _slot_start) >= AIRTIME_SLOT_TIME)
+	{
+		_slot = (_slot + 1) % AIRTIME_SLOTS;
+		_slot_start += AIRTIME_SLOT_TIME;
+		for (uint8_t band = 0; band < AIRTIME_MAX_BANDS; band++)
+		{
+			_used[band][_slot] = 0;
+		}
+	}
+}
+
+/**
+ * @brief Add the airtime of a packet that was sent
+ *
+ * @param now current time in ms
+ * @param band sub-band
+ * @param toa time on air in us
+ */
+void DutyCycle::add(uint32_t now, uint8_t band, uint32_t toa)
+{
+	if (band >= AIRTIME_MAX_BANDS)
+	{
+		return;
+	}
+	advance(now);
+	_used[band][_slot] += toa;
+}
+
+/**
+ * @brief Get the airtime used in the last hour
+ *
+ * @param now current time in ms
+ * @param band sub-band
+ * @return uint32_t used airtime in us
+ */
+uint32_t DutyCycle::used(uint32_t now, uint8_t band)
+{
+	if (band >= AIRTIME_MAX_BANDS)
+	{
+		return 0;
+	}
+	advance(now);
+	uint32_t sum = 0;
+	for (uint8_t slot = 0; slot < AIRTIME_SLOTS; slot++)
+	{
+		sum += _used[band][slot];
+	}
+	return sum;
+}
+
+/**
+ * @brief Get the airtime allowed per hour
+ *
+ * @param band sub-band
+ * @return uint32_t allowed airtime in us, 0 if there is no limit
+ */
+uint32_t DutyCycle::allowance(uint8_t band)
+{
+	uint16_t limit = airtime_duty_limit(_region, band);
+	if (limit == 0)
+	{
+		return 0;
+	}
+	return (uint32_t)((uint64_t)AIRTIME_WINDOW * 1000 / limit);
+}
+
+/**
+ * @brief Get the time until a packet can be sent without breaking the duty cycle
+ *
+ * @param now current time in ms
+ * @param band sub-band
+ * @param toa time on air of the packet in us
+ * @return uint32_t time to wait in ms, 0 if the packet can be sent now
+ */
+uint32_t DutyCycle::nextAllowed(uint32_t now, uint8_t band, uint32_t toa)
+{
+	uint32_t allowed = allowance(band);
+	if (allowed == 0)
+	{
+		return 0;
+	}
+	if (toa > allowed)
+	{
+		return AIRTIME_WINDOW;
+	}
+	uint32_t sum = used(now, band);
+	if (sum + toa <= allowed)
+	{
+		return 0;
+	}
+	// Oldest slots are freed one after the other
+	for (uint8_t step = 1; step <= AIRTIME_SLOTS; step++)
+	{
+		sum -= _used[band][(_slot + step) % AIRTIME_SLOTS];
+		if (sum + toa <= allowed)
+		{
+			return _slot_start + step * AIRTIME_SLOT_TIME - now;
+		}
+	}
+	return AIRTIME_WINDOW;
+}
+
+/**
+ * @brief Set the daily allowance and fill the bucket
+ *
+ * @param daily allowed airtime per day in ms, 0 = no limit
+ * @param now current time in ms
+ */
+void AirtimeBudget::begin(uint32_t daily, uint32_t now)
+{
+	_daily = daily;
+	_tokens = capacity();
+	_last = now;
+	_remainder = 0;
+}
+
+/**
+ * @brief Restore the fill level saved before a reset
+ *        The time the device was off is not known and not refilled.
+ *
+ * @param tokens saved fill level in us
+ * @param now current time in ms
+ */
+void AirtimeBudget::restore(uint32_t tokens, uint32_t now)
+{
+	_tokens = tokens < capacity() ? tokens : capacity();
+	_last = now;
+	_remainder = 0;
+}
+
+/**
+ * @brief Add the tokens for the time since the last refill
+ *
+ * @param now current time in ms
+ */
+void AirtimeBudget::refill(uint32_t now)
+{
+	uint32_t elapsed = now - _last;
+	_last = now;
+	// daily ms per 86400 s is daily us per 86400 ms
+	uint64_t added = (uint64_t)elapsed * _daily + _remainder;
+	_remainder = (uint32_t)(added % BUDGET_DAY);
+	added = added / BUDGET_DAY + _tokens;
+	_tokens = added < capacity() ? (uint32_t)added : capacity();
+}
+
+/**
+ * @brief Take the airtime of a packet that was sent from the bucket
+ *
+ * @param now current time in ms
+ * @param toa time on air in us
+ */
+void AirtimeBudget::spend(uint32_t now, uint32_t toa)
+{
+	refill(now);
+	_tokens = toa < _tokens ? _tokens - toa : 0;
+}
+
+/**
+ * @brief Get the fill level
+ *
+ * @param now current time in ms
+ * @return uint32_t airtime left in the bucket in us
+ */
+uint32_t AirtimeBudget::tokens(uint32_t now)
+{
+	refill(now);
+	return _tokens;
+}
+
+/**
+ * @brief Get the degradation level for the next uplink
+ *
+ * @param now current time in ms
+ * @param motion true if the uplink is triggered by motion
+ * @return uint8_t BUDGET_OK, BUDGET_COARSE, BUDGET_BATCH or BUDGET_STRETCH
+ */
+uint8_t AirtimeBudget::level(uint32_t now, bool motion)
+{
+	if (_daily == 0)
+	{
+		return BUDGET_OK;
+	}
+	// Fill level in 1/1000 of the capacity, motion uplinks may use twice as much
+	uint64_t fill = (uint64_t)tokens(now) * 1000 / capacity();
+	if (motion)
+	{
+		fill *= 2;
+	}
+	if (fill >= 500)
+	{
+		return BUDGET_OK;
+	}
+	if (fill >= 250)
+	{
+		return BUDGET_COARSE;
+	}
+	if (fill >= 100)
+	{
+		return BUDGET_BATCH;
+	}
+	return BUDGET_STRETCH;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file airtime.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief LoRa time on air, regional duty cycle budget and daily airtime budget
+ *        No Arduino dependencies
+ * @version 0.1
+ * @date 2022-09-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef AIRTIME_H
+#define AIRTIME_H
+
+#include <stdint.h>
+
+/** LoRaWAN overhead of an uplink, MHDR, FHDR without FOpts, FPort and MIC */
+#define AIRTIME_LORAWAN_OVERHEAD 13
+/** Size of a join request */
+#define AIRTIME_JOIN_SIZE 23
+/** Observation time of the duty cycle limits in ms */
+#define AIRTIME_WINDOW 3600000UL
+/** Number of slots the observation time is split into */
+#define AIRTIME_SLOTS 12
+/** Length of a slot in ms */
+#define AIRTIME_SLOT_TIME (AIRTIME_WINDOW / AIRTIME_SLOTS)
+/** Max number of sub-bands with their own duty cycle */
+#define AIRTIME_MAX_BANDS 5
+
+uint32_t airtime_toa(uint8_t sf, uint16_t bw_khz, uint8_t cr, uint16_t phy_size,
+					 uint8_t preamble = 8, bool implicit_header = false, bool crc = true);
+bool airtime_dr_params(uint8_t region, uint8_t datarate, uint8_t *sf, uint16_t *bw_khz);
+uint32_t airtime_uplink(uint8_t region, uint8_t datarate, uint8_t size);
+uint8_t airtime_join_dr(uint8_t region, uint8_t trial);
+uint8_t airtime_rx1_dr(uint8_t region, uint8_t datarate, uint8_t offset);
+uint32_t airtime_join(uint8_t region, uint8_t trials);
+uint8_t airtime_band(uint8_t region, uint32_t frequency);
+uint16_t airtime_duty_limit(uint8_t region, uint8_t band);
+
+/**
+ * @brief Airtime used per sub-band over the last hour.
+ *        The hour is split into AIRTIME_SLOTS slots, the airtime of a slot
+ *        counts until the slot is older than one hour, so the used airtime
+ *        is never underestimated.
+ *        Times are in ms and may wrap around, airtime is in us.
+ */
+class DutyCycle
+{
+public:
+	DutyCycle(void) { begin(0, 0); }
+
+	void begin(uint8_t region, uint32_t now);
+	void add(uint32_t now, uint8_t band, uint32_t toa);
+	uint32_t used(uint32_t now, uint8_t band);
+	uint32_t allowance(uint8_t band);
+	uint32_t nextAllowed(uint32_t now, uint8_t band, uint32_t toa);
+
+private:
+	void advance(uint32_t now);
+
+	uint8_t _region;
+	uint8_t _slot;
+	uint32_t _slot_start;
+	uint32_t _used[AIRTIME_MAX_BANDS][AIRTIME_SLOTS];
+};
+
+/** Seconds per day */
+#define BUDGET_DAY 86400UL
+/** The bucket holds the allowance of 6 hours */
+#define BUDGET_CAPACITY_DIV 4
+
+/** Degradation levels of the airtime budget */
+#define BUDGET_OK 0		 // send as configured
+#define BUDGET_COARSE 1	 // below 1/2, send locations with 4 digit precision
+#define BUDGET_BATCH 2	 // below 1/4, collect locations in batch frames
+#define BUDGET_STRETCH 3 // below 1/10, skip periodic locations
+
+/**
+ * @brief Token bucket for a daily airtime allowance, e.g. the fair use policy of a network.
+ *        Tokens are added continuously with 1/86400 of the daily allowance per second,
+ *        so the allowance is spread over the day. The bucket holds the allowance of
+ *        6 hours. The fill level decides how far the tracker degrades, uplinks
+ *        triggered by motion degrade only at half the fill level of periodic uplinks.
+ *        Times are in ms and may wrap around, airtime is in us.
+ */
+class AirtimeBudget
+{
+public:
+	AirtimeBudget(void) { begin(0, 0); }
+
+	void begin(uint32_t daily, uint32_t now);
+	void restore(uint32_t tokens, uint32_t now);
+	void spend(uint32_t now, uint32_t toa);
+	uint32_t tokens(uint32_t now);
+	uint32_t capacity(void) { return (uint32_t)((uint64_t)_daily * 1000 / BUDGET_CAPACITY_DIV); }
+	uint32_t daily(void) { return _daily; }
+	uint8_t level(uint32_t now, bool motion);
+
+private:
+	void refill(uint32_t now);
+
+	uint32_t _daily;
+	uint32_t _tokens;
+	uint32_t _last;
+	uint32_t _remainder;
+};
+
+#endif
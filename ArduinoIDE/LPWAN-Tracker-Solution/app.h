@@ -72,6 +72,8 @@ void lora_data_handler(void);
 #define N_ACC_TRIGGER 0b0111111111111111
 #define GNSS_FIN 0b0100000000000000
 #define N_GNSS_FIN 0b1011111111111111
+#define SCHED_DUE 0b0010000000000000
+#define N_SCHED_DUE 0b1101111111111111
 
 /** Accelerometer stuff */
 #include <SparkFunLIS3DH.h>
@@ -80,6 +82,7 @@ bool init_acc(void);
 void clear_acc_int(void);
 void read_acc(void);
 extern bool acc_ok;
+extern volatile uint16_t g_acc_events;
 
 // GNSS functions
 #define NO_GNSS_INIT 0
@@ -96,6 +99,17 @@ extern volatile bool last_read_ok;
 extern uint8_t gnss_option;
 extern bool gnss_ok;
 
+/** Last valid location */
+struct gnss_fix_s
+{
+	int32_t latitude = 0;
+	int32_t longitude = 0;
+	int32_t altitude = 0;
+	uint16_t accuracy = 0;
+	uint32_t time = 0;
+};
+extern gnss_fix_s g_last_fix;
+
 /** Temperature + Humidity stuff */
 #include <Adafruit_Sensor.h>
 #include <Adafruit_BME680.h>
@@ -104,15 +118,26 @@ bool read_bme(void);
 void start_bme(void);
 extern bool has_env_sensor;
 
+/** Environment fields for change detection */
+#define ENV_HUMID 0
+#define ENV_TEMP 1
+#define ENV_PRESS 2
+#define ENV_GAS 3
+#define ENV_FIELD_NUM 4
+/** Change detection settings of an environment field */
+struct env_filter_s
+{
+	uint16_t deadband; // in steps of the LPP value
+	uint16_t max_age;  // in minutes, 0 sends the field every time
+};
+extern env_filter_s g_env_filter[ENV_FIELD_NUM];
+void env_sent(const uint8_t *packet, uint8_t size);
+void read_env_settings(void);
+void save_env_settings(void);
+
 // LoRaWan functions
 #include "wisblock_cayenne.h"
 extern WisCayenne g_data_packet;
-#define LPP_CHANNEL_GPS 10
-#define LPP_CHANNEL_BATT 1
-#define LPP_CHANNEL_HUMID 6
-#define LPP_CHANNEL_TEMP 7
-#define LPP_CHANNEL_PRESS 8
-#define LPP_CHANNEL_GAS 9
 
 extern uint8_t g_last_fport;
 
@@ -124,19 +149,150 @@ void save_gps_settings(void);
 
 void init_user_at(void);
 
-extern bool battery_check_enabled;
+// Dead reckoning
+#include "dead_reckoning.h"
+extern DeadReckoning g_dr_predictor;
+extern uint16_t g_dr_tolerance;
+extern uint8_t g_dr_max_skip;
+extern uint8_t g_dr_anchor_every;
+void read_dr_settings(void);
+void save_dr_settings(void);
 
-/** Battery level uinion */
-union batt_s
-{
-	uint16_t batt16 = 0;
-	uint8_t batt8[2];
-};
-/** Latitude/Longitude value union */
-union latLong_s
-{
-	uint32_t val32;
-	uint8_t val8[4];
-};
+// Geofences
+#include "geofence.h"
+extern Geofence g_geofence;
+extern uint32_t g_zone_mask;
+void read_geofence_settings(void);
+void save_geofence_settings(void);
+
+// Helium Mapper cells
+#include "hex_cell.h"
+extern HexCellCache g_hex_cache;
+extern uint16_t g_hex_edge;
+extern uint16_t g_hex_stale;
+void read_hex_settings(void);
+void save_hex_settings(void);
+void save_hex_cells(void);
+
+// Payload planning
+#include "payload_plan.h"
+uint8_t max_payload(void);
+
+// Fragmentation
+#include "fragment.h"
+#define FPORT_FRAG 13
+extern bool g_frag_enabled;
+void read_frag_settings(void);
+void save_frag_settings(void);
+
+// Downlink quality per cell
+#include "link_map.h"
+#define FPORT_LINK_MAP 11
+extern LinkMap g_link_map;
+extern uint8_t g_link_batch;
+void read_link_settings(void);
+void save_link_settings(void);
+
+// Batch of locations
+#include "pos_codec.h"
+#define FPORT_BATCH 12
+#define BATCH_MAX_FIXES 32
+extern uint8_t g_batch_size;
+void read_batch_settings(void);
+void save_batch_settings(void);
+
+// Scheduler
+#include "scheduler.h"
+/** Jobs of the scheduler */
+#define SCHED_POSITION 0
+#define SCHED_FRAG 1
+#define SCHED_BUDGET 2
+#define SCHED_JOIN 3
+#define SCHED_SPREAD 4
+#define SCHED_SLOT 5
+#define SCHED_SEND 6
+/** Jobs due within this time are run together */
+#define SCHED_MERGE_WINDOW 5000
+extern Scheduler g_scheduler;
+void sched_update(void);
+void send_schedule(void);
+
+// Airtime and duty cycle
+#include "airtime.h"
+extern DutyCycle g_duty_cycle;
+uint8_t current_datarate(void);
+lmh_error_status send_uplink(uint8_t *data, uint8_t size, uint8_t fport = 0);
+extern AirtimeBudget g_airtime_budget;
+extern uint8_t g_budget_level;
+/** Batch size if the daily airtime budget is low */
+#define BUDGET_BATCH_SIZE 4
+#define BUDGET_STRETCH_BATCH_SIZE 8
+/** Save the airtime budget every hour */
+#define BUDGET_SAVE_TIME 3600000
+void read_budget_settings(void);
+void save_budget_settings(void);
+
+// Store and forward queue
+#include "uplink_queue.h"
+#define FPORT_QUEUE 14
+/** Max age of queued packets in seconds */
+#define QUEUE_AGE_ALARM (7 * 24 * 3600)
+#define QUEUE_AGE_MOTION (2 * 24 * 3600)
+#define QUEUE_AGE_PERIODIC (24 * 3600)
+extern UplinkQueue g_uplink_queue;
+uint32_t queue_time(void);
+void init_uplink_queue(void);
+
+// Link recovery
+#include "link_recovery.h"
+extern LinkRecovery g_link_recovery;
+extern uint32_t g_recovery_resets;
+void read_recovery_settings(void);
+void save_recovery_settings(void);
+
+// Saved LoRaWAN session
+/** The MIB of the stack has no RX1 DR offset, it is taken from the MAC parameters */
+extern LoRaMacParams_t LoRaMacParams;
+/** Uplinks between two saves of the session */
+#define SESSION_WRITE_AHEAD 100
+extern bool g_session_restored;
+extern bool g_session_stack;
+extern bool g_session_auto_join;
+void session_setup(void);
+bool restore_session(void);
+void save_session(void);
+void session_uplink(void);
+void forget_session(void);
+
+// Join backoff
+#include "join_backoff.h"
+extern JoinBackoff g_join_backoff;
+void start_join(void);
+void read_join_settings(void);
+void save_join_settings(void);
+
+// Confirmed uplink policy
+#include "confirm_policy.h"
+extern ConfirmPolicy g_confirm_policy;
+void read_confirm_settings(void);
+void save_confirm_settings(void);
+
+// Data rate and TX power controller
+#include "link_control.h"
+extern LinkControl g_link_control;
+void init_link_control(void);
+void read_linkctl_settings(void);
+void save_linkctl_settings(void);
+
+// Spread uplinks of trackers started together
+#include "uplink_spread.h"
+extern UplinkSpread g_uplink_spread;
+void gnss_time_sync(uint32_t seconds);
+bool gnss_time_of_day(uint32_t *time_of_day);
+bool gnss_utc_time(uint32_t *seconds);
+void read_spread_settings(void);
+void save_spread_settings(void);
+
+extern bool battery_check_enabled;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,147 @@
+/**
+ * @file confirm_policy.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Decide per uplink if it is sent confirmed
+ * @version 0.1
+ * @date 2022-10-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "confirm_policy.h"
+
+/**
+ * @brief Get the lowest SNR a LoRa packet can be received with
+ *
+ * @param sf spreading factor 7 to 12
+ * @return int8_t SNR in dB, rounded up
+ */
+int8_t confirm_snr_floor(uint8_t sf)
+{
+	// -7.5 dB at SF7, 2.5 dB lower per SF
+	if (sf < 7)
+	{
+		sf = 7;
+	}
+	if (sf > 12)
+	{
+		sf = 12;
+	}
+	return -(int8_t)((15 + (sf - 7) * 5) / 2);
+}
+
+/**
+ * @brief Set the policy and clear the link state and the counts
+ *
+ * @param mode CONFIRM_FIXED or CONFIRM_ADAPTIVE
+ * @param every confirm every Nth uplink without downlink, 0 never confirms for this reason
+ * @param min_margin confirm if the SNR margin is below this value in dB
+ */
+void ConfirmPolicy::begin(uint8_t mode, uint8_t every, int8_t min_margin)
+{
+	_mode = mode;
+	_every = every;
+	_min_margin = min_margin;
+	_since_link = 0;
+	_unacked = false;
+	_head = 0;
+	_count = 0;
+	_confirmed = 0;
+	_unconfirmed = 0;
+}
+
+/**
+ * @brief Decide if the next uplink is sent confirmed
+ *
+ * @param fixed_confirmed setting of the stack, used in fixed mode
+ * @return true if the uplink is sent confirmed
+ */
+bool ConfirmPolicy::confirm(bool fixed_confirmed)
+{
+	if (_mode != CONFIRM_ADAPTIVE)
+	{
+		return fixed_confirmed;
+	}
+	if (_unacked)
+	{
+		return true;
+	}
+	int8_t link_margin;
+	if (margin(&link_margin) && (link_margin < _min_margin))
+	{
+		return true;
+	}
+	return (_every != 0) && (_since_link + 1 >= _every);
+}
+
+/**
+ * @brief An uplink was sent
+ *
+ * @param confirmed true if it was sent confirmed
+ */
+void ConfirmPolicy::sent(bool confirmed)
+{
+	if (confirmed)
+	{
+		_confirmed++;
+	}
+	else
+	{
+		_unconfirmed++;
+	}
+	if (_since_link < 0xFF)
+	{
+		_since_link++;
+	}
+}
+
+/**
+ * @brief Result of a confirmed uplink
+ *
+ * @param ack true if the uplink was acknowledged
+ */
+void ConfirmPolicy::acked(bool ack)
+{
+	_unacked = !ack;
+	if (ack)
+	{
+		_since_link = 0;
+	}
+}
+
+/**
+ * @brief A downlink was received
+ *
+ * @param margin SNR above the lowest SNR of the data rate in dB
+ */
+void ConfirmPolicy::downlink(int8_t margin)
+{
+	_since_link = 0;
+	_margins[_head] = margin;
+	_head = (_head + 1) % CONFIRM_WINDOW;
+	if (_count < CONFIRM_WINDOW)
+	{
+		_count++;
+	}
+}
+
+/**
+ * @brief Get the average SNR margin of the last downlinks
+ *
+ * @param margin returns the margin in dB
+ * @return true if a downlink was received
+ */
+bool ConfirmPolicy::margin(int8_t *margin)
+{
+	if (_count == 0)
+	{
+		return false;
+	}
+	int16_t sum = 0;
+	for (uint8_t idx = 0; idx < _count; idx++)
+	{
+		sum += _margins[idx];
+	}
+	*margin = (int8_t)(sum / _count);
+	return true;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file confirm_policy.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Decide per uplink if it is sent confirmed
+ *        No Arduino dependencies
+ * @version 0.1
+ * @date 2022-10-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef CONFIRM_POLICY_H
+#define CONFIRM_POLICY_H
+
+#include <stdint.h>
+
+/** Policy modes */
+#define CONFIRM_FIXED 0	   // confirmed or unconfirmed as set with AT+CFM
+#define CONFIRM_ADAPTIVE 1 // confirmed only if needed
+
+/** Defaults of the adaptive mode */
+#define CONFIRM_EVERY 8		  // every 8th uplink without a downlink is confirmed
+#define CONFIRM_MIN_MARGIN 5  // uplinks are confirmed if the SNR margin is below 5 dB
+/** Number of downlinks in the SNR margin window */
+#define CONFIRM_WINDOW 4
+
+int8_t confirm_snr_floor(uint8_t sf);
+
+/**
+ * @brief Decides if the next uplink is sent confirmed.
+ *        In adaptive mode an uplink is confirmed if
+ *        - a confirmed uplink was not acknowledged, until the next acknowledge
+ *        - the SNR margin of the last downlinks is low
+ *        - no downlink was received for every Nth uplink
+ *        Any downlink shows the link works and restarts the count.
+ *        Counts the confirmed and unconfirmed uplinks to show the saved downlinks.
+ */
+class ConfirmPolicy
+{
+public:
+	ConfirmPolicy(void) { begin(CONFIRM_FIXED, CONFIRM_EVERY, CONFIRM_MIN_MARGIN); }
+
+	void begin(uint8_t mode, uint8_t every, int8_t min_margin);
+	bool confirm(bool fixed_confirmed);
+	void sent(bool confirmed);
+	void acked(bool ack);
+	void downlink(int8_t margin);
+	uint8_t mode(void) { return _mode; }
+	uint8_t every(void) { return _every; }
+	int8_t minMargin(void) { return _min_margin; }
+	bool margin(int8_t *margin);
+	bool escalated(void) { return _unacked; }
+	uint32_t confirmed(void) { return _confirmed; }
+	uint32_t unconfirmed(void) { return _unconfirmed; }
+
+private:
+	uint8_t _mode;
+	uint8_t _every;
+	int8_t _min_margin;
+	uint8_t _since_link;
+	bool _unacked;
+	int8_t _margins[CONFIRM_WINDOW];
+	uint8_t _head;
+	uint8_t _count;
+	uint32_t _confirmed;
+	uint32_t _unconfirmed;
+};
+
+#endif
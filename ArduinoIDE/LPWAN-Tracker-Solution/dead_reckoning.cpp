@@ -0,0 +1,180 @@
+/**
+ * @file dead_reckoning.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Constant velocity position predictor shared between
+ *        the tracker and the backend.
+ * @version 0.1
+ * @date 2022-09-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "dead_reckoning.h"
+#include "geo_math.h"
+#include "lpp_schema.h"
+#include "field_writer.h"
+
+/**
+ * @brief Forget all sent positions
+ *
+ */
+void DeadReckoning::reset(void)
+{
+	_count = 0;
+	_since_anchor = 0;
+	for (int idx = 0; idx < 2; idx++)
+	{
+		_lat[idx] = 0;
+		_lon[idx] = 0;
+		_time[idx] = 0;
+	}
+}
+
+/**
+ * @brief Add a position that was sent to the backend
+ *        Only anchor locations are added, after their confirmation.
+ *
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @param time Time of the fix in seconds
+ */
+void DeadReckoning::addSent(int32_t latitude, int32_t longitude, uint32_t time)
+{
+	_lat[0] = _lat[1];
+	_lon[0] = _lon[1];
+	_time[0] = _time[1];
+	_lat[1] = latitude;
+	_lon[1] = longitude;
+	_time[1] = time;
+	if (_count < 2)
+	{
+		_count++;
+	}
+	_since_anchor = 0;
+}
+
+/**
+ * @brief Check if the next sent location is an anchor
+ *        An anchor carries its time and is sent confirmed. Until the predictor
+ *        has two positions every location is an anchor, then every Nth.
+ *        If the confirmation of an anchor fails, the next location is an anchor.
+ *
+ * @param every every Nth sent location is an anchor, 0 or 1 for all
+ * @return true if the next location is an anchor
+ */
+bool DeadReckoning::anchorDue(uint8_t every)
+{
+	return (_count < 2) || ((uint16_t)_since_anchor + 1 >= every);
+}
+
+/**
+ * @brief Count a sent location, anchor or not
+ *
+ */
+void DeadReckoning::sent(void)
+{
+	if (_since_anchor < 0xFF)
+	{
+		_since_anchor++;
+	}
+}
+
+/**
+ * @brief Predict the position at a given time
+ *        With only one sent position the asset is assumed to stand still.
+ *
+ * @param time Time in seconds
+ * @param latitude Predicted latitude in 1/10'000'000 degree
+ * @param longitude Predicted longitude in 1/10'000'000 degree
+ * @return true if a prediction is available
+ * @return false if no position was sent yet
+ */
+bool DeadReckoning::predict(uint32_t time, int32_t *latitude, int32_t *longitude)
+{
+	if (_count == 0)
+	{
+		return false;
+	}
+
+	*latitude = _lat[1];
+	*longitude = _lon[1];
+
+	if ((_count < 2) || (_time[1] <= _time[0]))
+	{
+		return true;
+	}
+
+	// Integer division truncates towards zero, the backend has to do the same
+	int64_t span = (int64_t)_time[1] - _time[0];
+	int64_t elapsed = (int64_t)time - _time[1];
+	int64_t lat = _lat[1] + (((int64_t)_lat[1] - _lat[0]) * elapsed) / span;
+	int64_t lon = _lon[1] + (geo_wrap_lon((int64_t)_lon[1] - _lon[0]) * elapsed) / span;
+	*latitude = (int32_t)(lat > 900000000 ? 900000000 : (lat < -900000000 ? -900000000 : lat));
+	*longitude = (int32_t)geo_wrap_lon(lon);
+	return true;
+}
+
+/**
+ * @brief Distance between a position and the predicted position
+ *
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @param time Time of the fix in seconds
+ * @return uint32_t error in meters, UINT32_MAX if there is no prediction
+ */
+uint32_t DeadReckoning::error(int32_t latitude, int32_t longitude, uint32_t time)
+{
+	int32_t pred_lat;
+	int32_t pred_lon;
+	if (!predict(time, &pred_lat, &pred_lon))
+	{
+		return UINT32_MAX;
+	}
+	return geo_distance(pred_lat, pred_lon, latitude, longitude);
+}
+
+/**
+ * @brief Read the location and its time from a LPP packet
+ *        The location is returned in the resolution it was sent with.
+ *
+ * @param packet LPP packet
+ * @param size packet size
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @param time Time of the fix in seconds
+ * @return true if the packet has a location and its time
+ */
+bool dr_read_fix(const uint8_t *packet, uint8_t size, int32_t *latitude, int32_t *longitude, uint32_t *time)
+{
+	bool has_location = false;
+	bool has_time = false;
+	uint8_t cursor = 0;
+	while ((cursor + 2) <= size)
+	{
+		uint8_t data_size = lpp_type_size(packet[cursor + 1]);
+		if ((data_size == 0) || ((cursor + 2 + data_size) > size))
+		{
+			return false;
+		}
+		const uint8_t *data = &packet[cursor + 2];
+		if ((packet[cursor] == LPP_CHANNEL_GPS) && (packet[cursor + 1] == LPP_GPS6))
+		{
+			*latitude = (int32_t)get_be<4>(&data[0]) * 10;
+			*longitude = (int32_t)get_be<4>(&data[4]) * 10;
+			has_location = true;
+		}
+		else if ((packet[cursor] == LPP_CHANNEL_GPS) && (packet[cursor + 1] == LPP_GPS4))
+		{
+			*latitude = sign_extend<3>(get_be<3>(&data[0])) * 1000;
+			*longitude = sign_extend<3>(get_be<3>(&data[3])) * 1000;
+			has_location = true;
+		}
+		else if ((packet[cursor] == LPP_CHANNEL_TIME) && (packet[cursor + 1] == LPP_TIME))
+		{
+			*time = get_be<4>(data);
+			has_time = true;
+		}
+		cursor += 2 + data_size;
+	}
+	return has_location && has_time;
+}
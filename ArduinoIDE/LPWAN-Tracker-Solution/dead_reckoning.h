@@ -0,0 +1,61 @@
+/**
+ * @file dead_reckoning.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Constant velocity position predictor shared between
+ *        the tracker and the backend.
+ *        Uses only integer arithmetic and has no Arduino dependencies,
+ *        so the backend can compile the same files and reproduce
+ *        exactly the positions the tracker assumes it knows.
+ * @version 0.1
+ * @date 2022-09-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef DEAD_RECKONING_H
+#define DEAD_RECKONING_H
+
+#include <stdint.h>
+
+/** Every 4th sent location is an anchor for the predictor */
+#define DR_ANCHOR_EVERY 4
+
+/**
+ * @brief Predictor over the last two positions that were sent.
+ *        Latitude and longitude are in 1/10'000'000 degree as delivered
+ *        by the GNSS receiver, time is in seconds.
+ *        Both sides must feed the predictor only with fixes that were
+ *        actually sent and received. Only anchor locations carry their time,
+ *        they are sent confirmed and the tracker feeds them to the predictor
+ *        when the confirmation arrives, read from the packet with dr_read_fix().
+ *        The backend feeds it with the same function from the packets it
+ *        receives on the application port, locations without time are not
+ *        used. Queued packets are not used.
+ *        A sent location is an anchor while the predictor has less than two
+ *        positions and then every Nth, see anchorDue().
+ *        The time is the uptime of the tracker, if it goes back the
+ *        tracker was reset and the backend has to reset its predictor.
+ */
+class DeadReckoning
+{
+public:
+	DeadReckoning(void) { reset(); }
+
+	void reset(void);
+	void addSent(int32_t latitude, int32_t longitude, uint32_t time);
+	bool predict(uint32_t time, int32_t *latitude, int32_t *longitude);
+	uint32_t error(int32_t latitude, int32_t longitude, uint32_t time);
+	bool anchorDue(uint8_t every);
+	void sent(void);
+
+private:
+	int32_t _lat[2];
+	int32_t _lon[2];
+	uint32_t _time[2];
+	uint8_t _count;
+	uint8_t _since_anchor;
+};
+
+bool dr_read_fix(const uint8_t *packet, uint8_t size, int32_t *latitude, int32_t *longitude, uint32_t *time);
+
+#endif
@@ -10,10 +10,80 @@
  */
 
 #include "app.h"
+#include "lpp_schema.h"
+#include "field_writer.h"
 
 /** Instance of the BME680 class */
 Adafruit_BME680 bme;
 
+/** Change detection settings, default sends every field every time */
+env_filter_s g_env_filter[ENV_FIELD_NUM] = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+/** Last sent values in steps of the LPP value */
+int32_t env_last[ENV_FIELD_NUM];
+/** Time the fields were last sent in seconds */
+uint32_t env_last_time[ENV_FIELD_NUM];
+/** Flags if a field was sent since power up */
+bool env_last_valid[ENV_FIELD_NUM] = {false};
+/** LPP channels of the environment fields */
+static const uint8_t env_channels[ENV_FIELD_NUM] = {LPP_CHANNEL_HUMID, LPP_CHANNEL_TEMP, LPP_CHANNEL_PRESS, LPP_CHANNEL_GAS};
+
+/**
+ * @brief Check if an environment field has to be sent
+ *        A field is sent if it moved beyond its deadband since it was last sent
+ *        or if it was not sent for max age minutes.
+ *
+ * @param field ENV_HUMID, ENV_TEMP, ENV_PRESS or ENV_GAS
+ * @param value new value in steps of the LPP value
+ * @return true if the field has to be added to the packet
+ */
+static bool env_include(uint8_t field, int32_t value)
+{
+	env_filter_s *filter = &g_env_filter[field];
+	return (filter->max_age == 0) || !env_last_valid[field] || (abs(value - env_last[field]) > filter->deadband) || ((millis() / 1000 - env_last_time[field]) >= (uint32_t)filter->max_age * 60);
+}
+
+/**
+ * @brief Remember the environment fields of a packet that was sent
+ *        Only the values found in the sent packet are taken, fields that the
+ *        payload planner deferred or dropped are still due on the next packet.
+ *
+ * @param packet LPP packet as it was sent
+ * @param size packet size
+ */
+void env_sent(const uint8_t *packet, uint8_t size)
+{
+	uint8_t cursor = 0;
+	while ((cursor + 2) <= size)
+	{
+		uint8_t data_size = lpp_type_size(packet[cursor + 1]);
+		if ((data_size == 0) || ((cursor + 2 + data_size) > size))
+		{
+			return;
+		}
+		const uint8_t *data = &packet[cursor + 2];
+		for (uint8_t field = 0; field < ENV_FIELD_NUM; field++)
+		{
+			if ((packet[cursor] != env_channels[field]) || (packet[cursor + 1] != lpp_channel_type(env_channels[field])))
+			{
+				continue;
+			}
+			int32_t value;
+			if (data_size == 1)
+			{
+				value = lpp_type_signed(packet[cursor + 1]) ? sign_extend<1>(data[0]) : (int32_t)data[0];
+			}
+			else
+			{
+				value = lpp_type_signed(packet[cursor + 1]) ? sign_extend<2>(get_be<2>(data)) : (int32_t)get_be<2>(data);
+			}
+			env_last[field] = value;
+			env_last_time[field] = millis() / 1000;
+			env_last_valid[field] = true;
+		}
+		cursor += 2 + data_size;
+	}
+}
+
 /**
  * @brief Initialize the BME680 sensor
  * 
@@ -78,10 +148,28 @@ bool read_bme(void)
 	uint16_t gasres_int = (uint16_t)(bme.gas_resistance / 10);
 #endif
 
-	g_data_packet.addRelativeHumidity(LPP_CHANNEL_HUMID, bme.humidity);
-	g_data_packet.addTemperature(LPP_CHANNEL_TEMP, bme.temperature);
-	g_data_packet.addBarometricPressure(LPP_CHANNEL_PRESS, bme.pressure / 100);
-	g_data_packet.addAnalogInput(LPP_CHANNEL_GAS, (float)(bme.gas_resistance) / 1000.0);
+	// Unchanged fields are not sent, the backend keeps the last value
+	// The values are in steps of the LPP types, the same values are compared and sent
+	int32_t humidity = (int32_t)(bme.humidity * 2);
+	int32_t temperature = (int32_t)(bme.temperature * 10);
+	int32_t pressure = (int32_t)(bme.pressure / 10);
+	int32_t gas = (int32_t)(bme.gas_resistance / 10);
+	if (env_include(ENV_HUMID, humidity))
+	{
+		g_data_packet.addChannel<LPP_CHANNEL_HUMID>(humidity);
+	}
+	if (env_include(ENV_TEMP, temperature))
+	{
+		g_data_packet.addChannel<LPP_CHANNEL_TEMP>(temperature);
+	}
+	if (env_include(ENV_PRESS, pressure))
+	{
+		g_data_packet.addChannel<LPP_CHANNEL_PRESS>(pressure);
+	}
+	if (env_include(ENV_GAS, gas))
+	{
+		g_data_packet.addChannel<LPP_CHANNEL_GAS>(gas);
+	}
 
 #if MY_DEBUG > 0
 	MYLOG("BME", "RH= %.2f T= %.2f", (float)(humid_int / 2.0), (float)(temp_int / 10.0));
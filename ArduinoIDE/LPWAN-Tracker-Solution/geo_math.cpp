@@ -0,0 +1,159 @@
+/**
+ * @file geo_math.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Integer only helpers for distances between GNSS positions
+ * @version 0.1
+ * @date 2022-09-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "geo_math.h"
+
+/** cos() of 0 to 90 degrees in Q15 format */
+static const uint16_t cos_q15[91] = {
+	32767, 32763, 32748, 32723, 32688, 32643, 32588, 32524, 32449, 32365,
+	32270, 32166, 32052, 31928, 31795, 31651, 31499, 31336, 31164, 30983,
+	30792, 30592, 30382, 30163, 29935, 29698, 29452, 29197, 28932, 28660,
+	28378, 28088, 27789, 27482, 27166, 26842, 26510, 26170, 25822, 25466,
+	25102, 24730, 24351, 23965, 23571, 23170, 22763, 22348, 21926, 21498,
+	21063, 20622, 20174, 19720, 19261, 18795, 18324, 17847, 17364, 16877,
+	16384, 15886, 15384, 14876, 14365, 13848, 13328, 12803, 12275, 11743,
+	11207, 10668, 10126, 9580, 9032, 8481, 7927, 7371, 6813, 6252,
+	5690, 5126, 4560, 3993, 3425, 2856, 2286, 1715, 1144, 572,
+	0};
+
+/**
+ * @brief Wrap a longitude or a longitude difference into -180 to +180 degree
+ *
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @return int64_t longitude in -1'800'000'000 to 1'800'000'000
+ */
+int64_t geo_wrap_lon(int64_t longitude)
+{
+	longitude %= 3600000000LL;
+	if (longitude > 1800000000LL)
+	{
+		longitude -= 3600000000LL;
+	}
+	else if (longitude < -1800000000LL)
+	{
+		longitude += 3600000000LL;
+	}
+	return longitude;
+}
+
+/**
+ * @brief Cosine of a latitude, linear interpolated between full degrees
+ *
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @return int32_t cos(latitude) in Q15 format
+ */
+int32_t geo_cos_q15(int32_t latitude)
+{
+	uint32_t abs_lat = latitude < 0 ? -(int64_t)latitude : latitude;
+	if (abs_lat >= 900000000)
+	{
+		return 0;
+	}
+	uint32_t idx = abs_lat / 10000000;
+	int32_t frac = abs_lat % 10000000;
+	int32_t low = cos_q15[idx];
+	int32_t high = cos_q15[idx + 1];
+	return low + (int32_t)(((int64_t)(high - low) * frac) / 10000000);
+}
+
+/**
+ * @brief Cosine of a latitude with high precision
+ *        Taylor series up to x^12, error below 1e-8
+ *
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @return int32_t cos(latitude) in Q30 format
+ */
+int32_t geo_cos_q30(int32_t latitude)
+{
+	static const int64_t one = 1LL << 30;
+	static const uint8_t divisors[] = {132, 90, 56, 30, 12, 2};
+
+	int64_t abs_lat = latitude < 0 ? -(int64_t)latitude : latitude;
+	if (abs_lat >= 900000000)
+	{
+		return 0;
+	}
+	// Latitude in radian Q30, pi/180 * 2^30 = 18740330
+	int64_t x = (abs_lat * 18740330) / 10000000;
+	int64_t x2 = (x * x) >> 30;
+	int64_t term = one;
+	for (uint8_t idx = 0; idx < sizeof(divisors); idx++)
+	{
+		term = one - ((x2 * term) >> 30) / divisors[idx];
+	}
+	return (int32_t)term;
+}
+
+/**
+ * @brief Get the offset of a position from a reference position in meters
+ *        The longitude difference takes the short way over the 180 degree meridian.
+ *
+ * @param lat_ref Reference latitude in 1/10'000'000 degree
+ * @param lon_ref Reference longitude in 1/10'000'000 degree
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @param east Distance to the east in meters, negative is west
+ * @param north Distance to the north in meters, negative is south
+ */
+void geo_offset(int32_t lat_ref, int32_t lon_ref, int32_t latitude, int32_t longitude, int32_t *east, int32_t *north)
+{
+	int64_t d_lat = (int64_t)latitude - lat_ref;
+	int64_t d_lon = geo_wrap_lon((int64_t)longitude - lon_ref);
+	*north = (int32_t)((d_lat * GEO_M_PER_DEG) / 10000000);
+	// Scale by cos() first, |d_lon| * 32767 and the result * GEO_M_PER_DEG stay far below 2^63
+	*east = (int32_t)((((d_lon * geo_cos_q15(lat_ref)) / 32768) * GEO_M_PER_DEG) / 10000000);
+}
+
+/**
+ * @brief Distance between two positions
+ *
+ * @param lat_a Latitude of first position in 1/10'000'000 degree
+ * @param lon_a Longitude of first position in 1/10'000'000 degree
+ * @param lat_b Latitude of second position in 1/10'000'000 degree
+ * @param lon_b Longitude of second position in 1/10'000'000 degree
+ * @return uint32_t distance in meters
+ */
+uint32_t geo_distance(int32_t lat_a, int32_t lon_a, int32_t lat_b, int32_t lon_b)
+{
+	int32_t east;
+	int32_t north;
+	geo_offset(lat_a, lon_a, lat_b, lon_b, &east, &north);
+	return geo_isqrt((uint64_t)((int64_t)east * east) + (uint64_t)((int64_t)north * north));
+}
+
+/**
+ * @brief Integer square root, rounded down
+ *
+ * @param value
+ * @return uint32_t
+ */
+uint32_t geo_isqrt(uint64_t value)
+{
+	uint64_t result = 0;
+	uint64_t bit = 1ULL << 62;
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+	while (bit != 0)
+	{
+		if (value >= result + bit)
+		{
+			value -= result + bit;
+			result = (result >> 1) + bit;
+		}
+		else
+		{
+			result >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)result;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file geofence.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Polygon and circle geofences with a bounding box index
+ *        No Arduino dependencies, can be used in backend code as well.
+ * @version 0.1
+ * @date 2022-09-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef GEOFENCE_H
+#define GEOFENCE_H
+
+#include <stdint.h>
+
+/** Max number of zones, zone ID's are 0 to 31 */
+#define GEOFENCE_MAX_ZONES 32
+/** Max number of polygon points over all zones */
+#define GEOFENCE_MAX_POINTS 512
+
+/** Zone flag, no routine reports while inside this zone */
+#define GEOFENCE_HOME 0x01
+/** Zone flag, zone is a circle around its only point */
+#define GEOFENCE_CIRCLE 0x80
+
+/** Zone definition and its bounding box */
+struct geofence_zone_s
+{
+	uint8_t id;
+	uint8_t flags;
+	uint16_t first;
+	uint16_t count;
+	uint32_t radius;
+	int32_t min_lat;
+	int32_t max_lat;
+	int32_t min_lon;
+	int32_t max_lon;
+};
+
+/**
+ * @brief Set of polygon zones
+ *        Latitude and longitude are in 1/10'000'000 degree as delivered
+ *        by the GNSS receiver.
+ *        Zones are reported as bit mask, bit n is set if the position
+ *        is inside the zone with ID n.
+ */
+class Geofence
+{
+public:
+	Geofence(void) { clear(); }
+
+	void clear(void);
+	bool addPoint(uint8_t id, uint8_t flags, int32_t latitude, int32_t longitude);
+	bool addCircle(uint8_t id, uint8_t flags, int32_t latitude, int32_t longitude, uint32_t radius);
+	bool remove(uint8_t id);
+	uint32_t check(int32_t latitude, int32_t longitude);
+	uint32_t boundaryDistance(int32_t latitude, int32_t longitude);
+	uint32_t homeMask(void) { return _home_mask; }
+	uint8_t zones(void) { return _num_zones; }
+	uint16_t points(void) { return _num_points; }
+	const geofence_zone_s *getZone(uint8_t idx) { return &_zones[idx]; }
+	int32_t getLatitude(uint16_t idx) { return _lat[idx]; }
+	int32_t getLongitude(uint16_t idx) { return _lon[idx]; }
+
+private:
+	bool inside(const geofence_zone_s *zone, int32_t latitude, int32_t longitude);
+	uint32_t edgeDistance(int32_t latitude, int32_t longitude, uint16_t idx_a, uint16_t idx_b);
+	void updateBounds(void);
+
+	geofence_zone_s _zones[GEOFENCE_MAX_ZONES];
+	int32_t _lat[GEOFENCE_MAX_POINTS];
+	int32_t _lon[GEOFENCE_MAX_POINTS];
+	uint8_t _num_zones;
+	uint16_t _num_points;
+	uint32_t _home_mask;
+	int32_t _min_lat;
+	int32_t _max_lat;
+	int32_t _min_lon;
+	int32_t _max_lon;
+};
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * @file hex_cell.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Hexagon cell index of a location and a set of recently mapped cells
+ *        Cells are pointy top hexagons on a sinusoidal (equal area)
+ *        projection, so all cells cover about the same area, similar to
+ *        the H3 cells used by the Helium mapper.
+ *        Uses only integer arithmetic and has no Arduino dependencies,
+ *        so the backend can reproduce the same cell index.
+ * @version 0.1
+ * @date 2022-09-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef HEX_CELL_H
+#define HEX_CELL_H
+
+#include <stdint.h>
+
+/** Number of cells kept in the recently mapped set */
+#define HEX_CACHE_SIZE 64
+
+uint64_t hex_cell(int32_t latitude, int32_t longitude, uint16_t edge);
+int32_t hex_cell_q(uint64_t cell);
+int32_t hex_cell_r(uint64_t cell);
+
+/** Recently mapped cell */
+struct hex_entry_s
+{
+	uint64_t cell;
+	uint32_t time;
+};
+
+/**
+ * @brief Least recently used set of mapped cells
+ *        Time is in seconds.
+ */
+class HexCellCache
+{
+public:
+	HexCellCache(void) { clear(); }
+
+	void clear(void) { _count = 0; }
+	bool isFresh(uint64_t cell, uint32_t time, uint32_t stale_time);
+	void add(uint64_t cell, uint32_t time);
+	uint8_t count(void) { return _count; }
+	hex_entry_s *getEntry(uint8_t idx) { return &_entries[idx]; }
+
+private:
+	hex_entry_s _entries[HEX_CACHE_SIZE];
+	uint8_t _count;
+};
+
+#endif
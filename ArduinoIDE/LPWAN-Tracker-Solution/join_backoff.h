@@ -0,0 +1,85 @@
+/**
+ * @file join_backoff.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Backoff between failed joins
+ *        No Arduino dependencies, the application starts the joins
+ * @version 0.1
+ * @date 2022-10-03
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef JOIN_BACKOFF_H
+#define JOIN_BACKOFF_H
+
+#include <stdint.h>
+
+/** Number of joins kept in the history, also the max joins per hour */
+#define JOIN_HISTORY 8
+
+/** Default schedule */
+#define JOIN_BASE_DELAY 30	 // delay after the first failed join in s
+#define JOIN_MAX_DELAY 3600	 // max delay between joins in s
+#define JOIN_MAX_PER_HOUR 6	 // max joins started per hour
+
+/** Result of a join in the history */
+#define JOIN_PENDING 0
+#define JOIN_OK 1
+#define JOIN_FAILED 2
+
+/** A join of the history, time in ms */
+struct join_attempt_s
+{
+	uint32_t time;
+	uint8_t datarate;
+	uint8_t result;
+};
+
+/**
+ * @brief Schedule of the joins until one succeeds.
+ *        The delay doubles after every failed join up to the max delay and is
+ *        randomized between half and full delay, so devices that lost the
+ *        network together do not join together.
+ *        The join duty cycle of the LoRaWAN specification (1% in the first hour,
+ *        0.1% in the next 10 hours, 0.01% after) and the max joins per hour
+ *        can make the delay longer.
+ *        The stack selects the data rates of the join requests, the application
+ *        passes the airtime of the join requests and the last data rate.
+ *        Times are in ms and may wrap around, airtime is in us.
+ */
+class JoinBackoff
+{
+public:
+	JoinBackoff(void) { begin(1); }
+
+	void begin(uint32_t seed);
+	void setSchedule(uint16_t base_delay, uint16_t max_delay, uint8_t per_hour);
+	void started(uint32_t now, uint32_t toa, uint8_t datarate);
+	uint32_t failed(uint32_t now);
+	void joined(void);
+	uint16_t baseDelay(void) { return _base; }
+	uint16_t maxDelay(void) { return _max; }
+	uint8_t perHour(void) { return _per_hour; }
+	uint16_t attempts(void) { return _attempts; }
+	uint8_t historyCount(void) { return _count; }
+	bool history(uint8_t idx, join_attempt_s *attempt);
+
+private:
+	uint32_t random(void);
+	uint32_t dutyWait(uint32_t now);
+	uint32_t hourWait(uint32_t now);
+
+	uint32_t _seed;
+	uint16_t _base;
+	uint16_t _max;
+	uint8_t _per_hour;
+	uint16_t _attempts;
+	uint32_t _first;
+	bool _late;
+	uint32_t _last_toa;
+	join_attempt_s _history[JOIN_HISTORY];
+	uint8_t _head;
+	uint8_t _count;
+};
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * @file link_control.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Data rate and TX power from the SNR margin of the link
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "link_control.h"
+
+/** SNR difference of one data rate step in 0.5 dB */
+#define LINK_CTL_DR_STEP 5
+/** Difference of one TX power step in 0.5 dB */
+#define LINK_CTL_POWER_STEP 4
+
+/** Highest TX power index per region, region numbers as used in g_lorawan_settings.lora_region */
+static const uint8_t max_power_region[] = {
+	7,	// AS923
+	10, // AU915
+	7,	// CN470
+	5,	// CN779
+	5,	// EU433
+	7,	// EU868
+	7,	// KR920
+	10, // IN865
+	10, // US915
+	7,	// AS923-2
+	7,	// AS923-3
+	7,	// AS923-4
+	7,	// RU864
+};
+
+/**
+ * @brief Get the highest TX power index of a region, the lowest TX power
+ *
+ * @param region LoRaWAN region
+ * @return uint8_t TX power index, 0 if the region is not known
+ */
+uint8_t link_ctl_max_power(uint8_t region)
+{
+	if (region >= sizeof(max_power_region))
+	{
+		return 0;
+	}
+	return max_power_region[region];
+}
+
+/**
+ * @brief Set the controller settings
+ *
+ * @param mode LINK_CTL_OFF or LINK_CTL_ADAPTIVE
+ * @param target SNR margin kept in dB
+ * @param hysteresis extra margin in dB before the data rate is raised or the power lowered
+ */
+void LinkControl::begin(uint8_t mode, uint8_t target, uint8_t hysteresis)
+{
+	_mode = mode;
+	_target = target;
+	_hysteresis = hysteresis;
+	_missed = 0;
+	_count = 0;
+	_head = 0;
+}
+
+/**
+ * @brief Set the data rates and TX power steps the controller can use
+ *
+ * @param min_dr most robust data rate
+ * @param max_dr fastest data rate
+ * @param power_steps max TX power steps below full power
+ */
+void LinkControl::setRange(uint8_t min_dr, uint8_t max_dr, uint8_t power_steps)
+{
+	_min_dr = min_dr;
+	_max_dr = max_dr < min_dr ? min_dr : max_dr;
+	_power_steps = power_steps;
+	reset(_min_dr, 0);
+}
+
+/**
+ * @brief Set the data rate and TX power in use and clear the window
+ *
+ * @param datarate data rate in use
+ * @param power TX power steps below full power in use
+ */
+void LinkControl::reset(uint8_t datarate, uint8_t power)
+{
+	_dr = datarate < _min_dr ? _min_dr : (datarate > _max_dr ? _max_dr : datarate);
+	_power = power > _power_steps ? _power_steps : power;
+	_missed = 0;
+	_count = 0;
+	_head = 0;
+}
+
+/**
+ * @brief Add the SNR margin of a downlink received with the current settings
+ *
+ * @param margin SNR above the lowest SNR of the data rate in dB
+ */
+void LinkControl::sample(int8_t margin)
+{
+	// Margin at the lowest data rate and full power
+	_samples[_head] = margin * 2 + cost();
+	_head = (_head + 1) % LINK_CTL_WINDOW;
+	if (_count < LINK_CTL_WINDOW)
+	{
+		_count++;
+	}
+}
+
+/**
+ * @brief Result of a confirmed uplink
+ *
+ * @param ack true if the uplink was acknowledged
+ * @return true if the robust settings have to be used
+ */
+bool LinkControl::acked(bool ack)
+{
+	if (ack)
+	{
+		_missed = 0;
+		return false;
+	}
+	if (_missed < 0xFF)
+	{
+		_missed++;
+	}
+	if ((_mode != LINK_CTL_ADAPTIVE) || (_missed < LINK_CTL_MISSED) || ((_dr == _min_dr) && (_power == 0)))
+	{
+		return false;
+	}
+	// The margins in the window do not describe the link anymore
+	reset(_min_dr, 0);
+	return true;
+}
+
+/**
+ * @brief Select data rate and TX power for the next uplink
+ *
+ * @return true if data rate or TX power changed
+ */
+bool LinkControl::update(void)
+{
+	if ((_mode != LINK_CTL_ADAPTIVE) || (_count == 0))
+	{
+		return false;
+	}
+	uint8_t old_dr = _dr;
+	uint8_t old_power = _power;
+	int16_t spare = level() - _target * 2 - cost();
+	int16_t raise = _hysteresis * 2;
+
+	// Margin too low, first full power, then lower data rate
+	while ((spare < 0) && (_power > 0))
+	{
+		_power--;
+		spare += LINK_CTL_POWER_STEP;
+	}
+	while ((spare < 0) && (_dr > _min_dr))
+	{
+		_dr--;
+		spare += LINK_CTL_DR_STEP;
+	}
+
+	// Margin high enough, first higher data rate, then less power
+	while ((_dr < _max_dr) && (spare - LINK_CTL_DR_STEP >= raise))
+	{
+		_dr++;
+		spare -= LINK_CTL_DR_STEP;
+	}
+	while ((_dr == _max_dr) && (_power < _power_steps) && (spare - LINK_CTL_POWER_STEP >= raise))
+	{
+		_power++;
+		spare -= LINK_CTL_POWER_STEP;
+	}
+	return (_dr != old_dr) || (_power != old_power);
+}
+
+/**
+ * @brief Get the SNR margin expected with the current settings
+ *
+ * @param margin returns the margin in dB
+ * @return true if there are samples in the window
+ */
+bool LinkControl::estimate(int8_t *margin)
+{
+	if (_count == 0)
+	{
+		return false;
+	}
+	*margin = (int8_t)((level() - cost()) / 2);
+	return true;
+}
+
+/**
+ * @brief Margin used by the current settings compared to the lowest data rate and full power
+ *
+ * @return int16_t margin in 0.5 dB
+ */
+int16_t LinkControl::cost(void)
+{
+	return (_dr - _min_dr) * LINK_CTL_DR_STEP + _power * LINK_CTL_POWER_STEP;
+}
+
+/**
+ * @brief Estimated margin at the lowest data rate and full power,
+ *        the lower of the window average and the last sample
+ *
+ * @return int16_t margin in 0.5 dB
+ */
+int16_t LinkControl::level(void)
+{
+	int16_t sum = 0;
+	for (uint8_t idx = 0; idx < _count; idx++)
+	{
+		sum += _samples[idx];
+	}
+	int16_t average = sum / _count;
+	int16_t last = _samples[(_head + LINK_CTL_WINDOW - 1) % LINK_CTL_WINDOW];
+	return last < average ? last : average;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file link_map.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Per cell aggregates of the downlink RSSI and SNR
+ * @version 0.1
+ * @date 2022-09-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "link_map.h"
+#include "hex_cell.h"
+#include "field_writer.h"
+
+/**
+ * @brief Add a downlink to the aggregates of a cell
+ *
+ * @param cell Cell the uplink was sent from
+ * @param rssi RSSI of the downlink
+ * @param snr SNR of the downlink
+ * @return true if the downlink was added
+ * @return false if the table is full or the cell coordinates don't fit into the packet
+ */
+bool LinkMap::add(uint64_t cell, int16_t rssi, int8_t snr)
+{
+	// Only possible with cells smaller than 2m
+	int32_t q = hex_cell_q(cell);
+	int32_t r = hex_cell_r(cell);
+	if ((q > LINK_MAP_COORD_MAX) || (q < -LINK_MAP_COORD_MAX) || (r > LINK_MAP_COORD_MAX) || (r < -LINK_MAP_COORD_MAX))
+	{
+		return false;
+	}
+
+	uint8_t idx = 0;
+	for (; idx < _count; idx++)
+	{
+		if (_cells[idx].cell == cell)
+		{
+			break;
+		}
+	}
+	link_cell_s *entry = &_cells[idx];
+	if (idx == _count)
+	{
+		if (_count >= LINK_MAP_SIZE)
+		{
+			return false;
+		}
+		_count++;
+		entry->cell = cell;
+		entry->count = 0;
+		entry->rssi_min = rssi;
+		entry->rssi_max = rssi;
+		entry->rssi_sum = 0;
+		entry->snr_min = snr;
+		entry->snr_max = snr;
+		entry->snr_sum = 0;
+	}
+	entry->count++;
+	entry->rssi_min = rssi < entry->rssi_min ? rssi : entry->rssi_min;
+	entry->rssi_max = rssi > entry->rssi_max ? rssi : entry->rssi_max;
+	entry->rssi_sum += rssi;
+	entry->snr_min = snr < entry->snr_min ? snr : entry->snr_min;
+	entry->snr_max = snr > entry->snr_max ? snr : entry->snr_max;
+	entry->snr_sum += snr;
+	return true;
+}
+
+/**
+ * @brief Pack as many cells as fit into a packet and remove them from the table
+ *        Packet format, all values MSB first:
+ *        2 bytes cell edge length in meters, then per cell
+ *        3 bytes q, 3 bytes r (signed axial cell coordinates),
+ *        1 byte number of downlinks (max 255),
+ *        3 bytes RSSI min/mean/max as negative dBm (unsigned, 0 = 0dBm, 255 = -255dBm),
+ *        3 bytes SNR min/mean/max in dB (signed)
+ *
+ * @param buffer Packet buffer
+ * @param max_size Max packet size
+ * @param edge Edge length of the cells in meters
+ * @return uint8_t packet size, 0 if no cell fits
+ */
+uint8_t LinkMap::pack(uint8_t *buffer, uint8_t max_size, uint16_t edge)
+{
+	if ((_count == 0) || (max_size < LINK_MAP_HEADER_SIZE + LINK_MAP_ENTRY_SIZE))
+	{
+		return 0;
+	}
+
+	uint8_t size = 0;
+	size += put_be<2>(&buffer[size], edge);
+
+	uint8_t packed = 0;
+	while ((packed < _count) && ((size + LINK_MAP_ENTRY_SIZE) <= max_size))
+	{
+		link_cell_s *entry = &_cells[packed++];
+		size += put_be<3>(&buffer[size], (uint32_t)hex_cell_q(entry->cell));
+		size += put_be<3>(&buffer[size], (uint32_t)hex_cell_r(entry->cell));
+		buffer[size++] = entry->count > 255 ? 255 : (uint8_t)entry->count;
+		buffer[size++] = (uint8_t)(-entry->rssi_min);
+		buffer[size++] = (uint8_t)(-(entry->rssi_sum / entry->count));
+		buffer[size++] = (uint8_t)(-entry->rssi_max);
+		buffer[size++] = (uint8_t)entry->snr_min;
+		buffer[size++] = (uint8_t)(int8_t)(entry->snr_sum / entry->count);
+		buffer[size++] = (uint8_t)entry->snr_max;
+	}
+
+	// Remove the packed cells
+	for (uint8_t idx = packed; idx < _count; idx++)
+	{
+		_cells[idx - packed] = _cells[idx];
+	}
+	_count -= packed;
+	return size;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file link_recovery.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Graded recovery after failed confirmed uplinks
+ * @version 0.1
+ * @date 2022-09-29
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "link_recovery.h"
+
+/**
+ * @brief Start without failures and clear the statistics
+ *
+ * @param now current time in ms
+ */
+void LinkRecovery::begin(uint32_t now)
+{
+	_stage = RECOVERY_IDLE;
+	_fails = 0;
+	_since = now;
+	for (uint8_t stage = 0; stage < RECOVERY_STAGES; stage++)
+	{
+		_count[stage] = 0;
+		_time[stage] = 0;
+		_airtime[stage] = 0;
+	}
+}
+
+/**
+ * @brief Change the stage and add the time spent in the old stage
+ *
+ * @param stage new stage
+ * @param now current time in ms
+ */
+void LinkRecovery::enter(uint8_t stage, uint32_t now)
+{
+	_time[_stage] += now - _since;
+	_since = now;
+	_stage = stage;
+	_fails = 0;
+	_count[stage]++;
+}
+
+/**
+ * @brief An uplink was not confirmed
+ *
+ * @param now current time in ms
+ * @param lowest_datarate true if the data rate cannot be lowered anymore
+ * @return uint8_t the stage whose action has to be run, RECOVERY_IDLE if nothing has to be done
+ */
+uint8_t LinkRecovery::failed(uint32_t now, bool lowest_datarate)
+{
+	_fails++;
+	switch (_stage)
+	{
+	case RECOVERY_IDLE:
+		if (_fails >= RECOVERY_FAILS)
+		{
+			enter(RECOVERY_LINK_CHECK, now);
+			return RECOVERY_LINK_CHECK;
+		}
+		break;
+	case RECOVERY_LINK_CHECK:
+		if (_fails >= RECOVERY_LINK_CHECKS)
+		{
+			enter(lowest_datarate ? RECOVERY_REJOIN : RECOVERY_DR_DOWN, now);
+			return _stage;
+		}
+		break;
+	case RECOVERY_DR_DOWN:
+		if (lowest_datarate)
+		{
+			enter(RECOVERY_REJOIN, now);
+		}
+		return _stage;
+	default:
+		break;
+	}
+	return RECOVERY_IDLE;
+}
+
+/**
+ * @brief A join failed
+ *        Joins that are not part of the recovery are repeated without limit.
+ *
+ * @param now current time in ms
+ * @return uint8_t RECOVERY_REJOIN to join again or RECOVERY_RESET to reset the device
+ */
+uint8_t LinkRecovery::joinFailed(uint32_t now)
+{
+	if (_stage != RECOVERY_REJOIN)
+	{
+		return RECOVERY_REJOIN;
+	}
+	_fails++;
+	if (_fails >= RECOVERY_JOINS)
+	{
+		enter(RECOVERY_RESET, now);
+		return RECOVERY_RESET;
+	}
+	return RECOVERY_REJOIN;
+}
+
+/**
+ * @brief An uplink was confirmed, a downlink was received or the join succeeded
+ *
+ * @param now current time in ms
+ */
+void LinkRecovery::success(uint32_t now)
+{
+	if (_stage != RECOVERY_IDLE)
+	{
+		enter(RECOVERY_IDLE, now);
+	}
+	_fails = 0;
+}
+
+/**
+ * @brief Add the airtime of a packet sent in the current stage
+ *
+ * @param toa time on air in us
+ */
+void LinkRecovery::addAirtime(uint32_t toa)
+{
+	_airtime[_stage] += toa;
+}
+
+/**
+ * @brief Get the time spent in a stage
+ *
+ * @param stage stage
+ * @param now current time in ms
+ * @return uint32_t time in ms, including the time in the current stage
+ */
+uint32_t LinkRecovery::time(uint8_t stage, uint32_t now)
+{
+	if (stage >= RECOVERY_STAGES)
+	{
+		return 0;
+	}
+	return _time[stage] + (stage == _stage ? now - _since : 0);
+}
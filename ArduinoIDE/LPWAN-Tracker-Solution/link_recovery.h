@@ -0,0 +1,64 @@
+/**
+ * @file link_recovery.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Graded recovery after failed confirmed uplinks
+ *        No Arduino dependencies, the application runs the actions
+ * @version 0.1
+ * @date 2022-09-29
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef LINK_RECOVERY_H
+#define LINK_RECOVERY_H
+
+#include <stdint.h>
+
+/** Recovery stages, each stage is tried before the next one */
+#define RECOVERY_IDLE 0		  // link works
+#define RECOVERY_LINK_CHECK 1 // uplinks carry a link check request
+#define RECOVERY_DR_DOWN 2	  // data rate is lowered after every failed uplink
+#define RECOVERY_REJOIN 3	  // join again without reset
+#define RECOVERY_RESET 4	  // last resort, reset the device
+#define RECOVERY_STAGES 5
+
+/** Failed uplinks in a row before the recovery starts */
+#define RECOVERY_FAILS 3
+/** Failed uplinks with link check request before the data rate is lowered */
+#define RECOVERY_LINK_CHECKS 2
+/** Failed joins before the device is reset */
+#define RECOVERY_JOINS 3
+
+/**
+ * @brief State machine of the link recovery.
+ *        Counts for every stage how often it was entered, the time spent in it
+ *        and the airtime used in it, the airtime is the main energy cost.
+ *        Times are in ms and may wrap around, airtime is in us.
+ */
+class LinkRecovery
+{
+public:
+	LinkRecovery(void) { begin(0); }
+
+	void begin(uint32_t now);
+	uint8_t failed(uint32_t now, bool lowest_datarate);
+	uint8_t joinFailed(uint32_t now);
+	void success(uint32_t now);
+	void addAirtime(uint32_t toa);
+	uint8_t stage(void) { return _stage; }
+	uint16_t count(uint8_t stage) { return stage < RECOVERY_STAGES ? _count[stage] : 0; }
+	uint32_t time(uint8_t stage, uint32_t now);
+	uint32_t airtime(uint8_t stage) { return stage < RECOVERY_STAGES ? _airtime[stage] : 0; }
+
+private:
+	void enter(uint8_t stage, uint32_t now);
+
+	uint8_t _stage;
+	uint8_t _fails;
+	uint32_t _since;
+	uint16_t _count[RECOVERY_STAGES];
+	uint32_t _time[RECOVERY_STAGES];
+	uint32_t _airtime[RECOVERY_STAGES];
+};
+
+#endif
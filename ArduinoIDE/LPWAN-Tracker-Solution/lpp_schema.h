@@ -0,0 +1,229 @@
+/**
+ * @file lpp_schema.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Single source of the Cayenne LPP types and channels used by the tracker
+ *        The firmware checks the sizes at compile time and writes the single
+ *        value channels with lpp_put(), the decoders in ../../decoders get their
+ *        type table generated from this file with
+ *        ../../decoders/schema/generate_decoders.cpp
+ *        No Arduino dependencies.
+ * @version 0.1
+ * @date 2022-09-23
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef LPP_SCHEMA_H
+#define LPP_SCHEMA_H
+
+#include <stdint.h>
+
+#include "field_writer.h"
+
+/** Custom LPP types */
+#define LPP_GPS4 136 // 3 byte lon/lat 0.0001 °, 3 bytes alt 0.01 meter (Cayenne LPP default)
+#define LPP_GPS6 137 // 4 byte lon/lat 0.000001 °, 3 bytes alt 0.01 meter (Customized Cayenne LPP)
+#define LPP_TIME 133 // 4 byte time in seconds, unsigned
+
+// Only Data Size
+#define LPP_GPS4_SIZE 9
+#define LPP_GPS6_SIZE 11
+#define LPP_GPSH_SIZE 14
+#define LPP_ZONES_SIZE 4
+#define LPP_TIME_SIZE 4
+
+/** LPP channels */
+#define LPP_CHANNEL_GPS 10
+#define LPP_CHANNEL_BATT 1
+#define LPP_CHANNEL_HUMID 6
+#define LPP_CHANNEL_TEMP 7
+#define LPP_CHANNEL_PRESS 8
+#define LPP_CHANNEL_GAS 9
+#define LPP_CHANNEL_ZONES 11
+#define LPP_CHANNEL_TIME 12
+
+/** Size of the packet buffer */
+#define LPP_BUFFER_SIZE 255
+/** Max LoRaWAN application payload */
+#define LPP_MAX_PAYLOAD 242
+
+/** Description of a LPP type, values is 3 for types with 3 values and a divisor per value */
+struct lpp_type_s
+{
+	uint8_t type;
+	uint8_t size;
+	const char *name;
+	bool is_signed;
+	uint8_t values;
+	uint32_t divisor[3];
+};
+
+/** LPP types known by the decoders */
+static constexpr lpp_type_s lpp_types[] = {
+	{0, 1, "digital_in", false, 1, {1}},
+	{1, 1, "digital_out", false, 1, {1}},
+	{2, 2, "analog_in", true, 1, {100}},
+	{3, 2, "analog_out", true, 1, {100}},
+	{100, 4, "generic", false, 1, {1}},
+	{101, 2, "illuminance", false, 1, {1}},
+	{102, 1, "presence", false, 1, {1}},
+	{103, 2, "temperature", true, 1, {10}},
+	{104, 1, "humidity", false, 1, {2}},
+	{113, 6, "accelerometer", true, 3, {1000}},
+	{115, 2, "barometer", false, 1, {10}},
+	{116, 2, "voltage", false, 1, {100}},
+	{117, 2, "current", false, 1, {1000}},
+	{118, 4, "frequency", false, 1, {1}},
+	{120, 1, "percentage", false, 1, {1}},
+	{121, 2, "altitude", true, 1, {1}},
+	{125, 2, "concentration", false, 1, {1}},
+	{128, 2, "power", false, 1, {1}},
+	{130, 4, "distance", false, 1, {1000}},
+	{131, 4, "energy", false, 1, {1000}},
+	{132, 2, "direction", false, 1, {1}},
+	{133, 4, "time", false, 1, {1}},
+	{134, 6, "gyrometer", true, 3, {100}},
+	{135, 3, "colour", false, 3, {1}},
+	{LPP_GPS4, LPP_GPS4_SIZE, "gps", true, 3, {10000, 10000, 100}},
+	{LPP_GPS6, LPP_GPS6_SIZE, "gps", true, 3, {1000000, 1000000, 100}},
+	{138, 2, "voc", false, 1, {1}},
+	{142, 1, "switch", false, 1, {1}},
+};
+
+/** Number of known LPP types */
+#define LPP_TYPE_NUM (sizeof(lpp_types) / sizeof(lpp_types[0]))
+
+/** Channel and type of the values the tracker sends */
+struct lpp_channel_s
+{
+	uint8_t channel;
+	uint8_t type;
+};
+
+/** Channels of the tracker, the location channel with the bigger of the two formats */
+static constexpr lpp_channel_s lpp_channels[] = {
+	{LPP_CHANNEL_BATT, 116},
+	{LPP_CHANNEL_GPS, LPP_GPS6},
+	{LPP_CHANNEL_ZONES, 100},
+	{LPP_CHANNEL_TIME, LPP_TIME},
+	{LPP_CHANNEL_HUMID, 104},
+	{LPP_CHANNEL_TEMP, 103},
+	{LPP_CHANNEL_PRESS, 115},
+	{LPP_CHANNEL_GAS, 2},
+};
+
+/** Number of channels */
+#define LPP_CHANNEL_NUM (sizeof(lpp_channels) / sizeof(lpp_channels[0]))
+
+/**
+ * @brief Get the data size of a LPP type
+ *
+ * @param type LPP type
+ * @param idx start index for the search
+ * @return uint8_t data size without channel and type, 0 if the type is unknown
+ */
+constexpr uint8_t lpp_type_size(uint8_t type, uint8_t idx = 0)
+{
+	return idx >= LPP_TYPE_NUM ? 0 : (lpp_types[idx].type == type ? lpp_types[idx].size : lpp_type_size(type, idx + 1));
+}
+
+/**
+ * @brief Size of a packet with all channels
+ *
+ * @param idx start index
+ * @return uint16_t packet size including channel and type bytes
+ */
+constexpr uint16_t lpp_frame_size(uint8_t idx = 0)
+{
+	return idx >= LPP_CHANNEL_NUM ? 0 : 2 + lpp_type_size(lpp_channels[idx].type) + lpp_frame_size(idx + 1);
+}
+
+/**
+ * @brief Check that all channel types are known and no channel is used twice
+ *
+ * @param idx start index
+ * @param other index of the channel compared with idx
+ * @return true if the channels are valid
+ */
+constexpr bool lpp_channels_valid(uint8_t idx = 0, uint8_t other = 1)
+{
+	return idx >= LPP_CHANNEL_NUM ? true
+		   : other >= LPP_CHANNEL_NUM ? (lpp_type_size(lpp_channels[idx].type) != 0) && lpp_channels_valid(idx + 1, idx + 2)
+		   : (lpp_channels[idx].channel != lpp_channels[other].channel) && lpp_channels_valid(idx, other + 1);
+}
+
+/**
+ * @brief Get the LPP type of a channel
+ *
+ * @param channel LPP channel
+ * @param idx start index for the search
+ * @return uint8_t LPP type, 0 if the channel is unknown
+ */
+constexpr uint8_t lpp_channel_type(uint8_t channel, uint8_t idx = 0)
+{
+	return idx >= LPP_CHANNEL_NUM ? 0 : (lpp_channels[idx].channel == channel ? lpp_channels[idx].type : lpp_channel_type(channel, idx + 1));
+}
+
+/**
+ * @brief Get the number of values of a LPP type
+ *
+ * @param type LPP type
+ * @param idx start index for the search
+ * @return uint8_t number of values, 0 if the type is unknown
+ */
+constexpr uint8_t lpp_type_values(uint8_t type, uint8_t idx = 0)
+{
+	return idx >= LPP_TYPE_NUM ? 0 : (lpp_types[idx].type == type ? lpp_types[idx].values : lpp_type_values(type, idx + 1));
+}
+
+/**
+ * @brief Check if the values of a LPP type are signed
+ *
+ * @param type LPP type
+ * @param idx start index for the search
+ * @return true if the values are signed, false if unsigned or the type is unknown
+ */
+constexpr bool lpp_type_signed(uint8_t type, uint8_t idx = 0)
+{
+	return idx >= LPP_TYPE_NUM ? false : (lpp_types[idx].type == type ? lpp_types[idx].is_signed : lpp_type_signed(type, idx + 1));
+}
+
+/**
+ * @brief Size of a channel in the packet
+ *
+ * @param channel LPP channel
+ * @return uint8_t size including channel and type bytes
+ */
+constexpr uint8_t lpp_channel_size(uint8_t channel)
+{
+	return 2 + lpp_type_size(lpp_channel_type(channel));
+}
+
+/**
+ * @brief Write a single value channel with the type and size from lpp_channels
+ *        The buffer must have lpp_channel_size(CHANNEL) bytes left.
+ *
+ * @tparam CHANNEL LPP channel
+ * @param buffer buffer
+ * @param value value in steps of the LPP type, e.g. 0.1°C for a temperature
+ * @return uint8_t number of bytes written
+ */
+template <uint8_t CHANNEL>
+inline uint8_t lpp_put(uint8_t *buffer, int32_t value)
+{
+	static_assert(lpp_channel_type(CHANNEL) != 0, "Channel is not in lpp_channels");
+	static_assert(lpp_type_values(lpp_channel_type(CHANNEL)) == 1, "Channel type has more than one value");
+	buffer[0] = CHANNEL;
+	buffer[1] = lpp_channel_type(CHANNEL);
+	return 2 + put_be<lpp_type_size(lpp_channel_type(CHANNEL))>(&buffer[2], (uint32_t)value);
+}
+
+static_assert(lpp_type_size(LPP_GPS4) == LPP_GPS4_SIZE, "GPS4 size mismatch");
+static_assert(lpp_type_size(LPP_GPS6) == LPP_GPS6_SIZE, "GPS6 size mismatch");
+static_assert(lpp_type_size(100) == LPP_ZONES_SIZE, "Zones size mismatch");
+static_assert(lpp_type_size(LPP_TIME) == LPP_TIME_SIZE, "Time size mismatch");
+static_assert(lpp_channels_valid(), "Unknown LPP type or channel used twice");
+static_assert(lpp_frame_size() <= LPP_MAX_PAYLOAD, "Packet with all channels is bigger than the max LoRaWAN payload");
+static_assert(LPP_GPSH_SIZE <= LPP_MAX_PAYLOAD, "Helium Mapper packet too big");
+
+#endif
@@ -0,0 +1,169 @@
+/**
+ * @file payload_plan.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fit Cayenne LPP packets into the max payload of the current data rate
+ * @version 0.1
+ * @date 2022-09-19
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "payload_plan.h"
+#include "lpp_schema.h"
+#include "field_writer.h"
+
+/** Number of data rates in the tables */
+#define PLAN_DR_NUM 16
+
+/**
+ * Max application payload per data rate without FOpts,
+ * taken from the MaxPayloadOfDatarate tables of the LoRaMac regions.
+ * AS923 uses the tables for uplink dwell time on, the default of the stack.
+ */
+static const uint8_t max_payload_eu[PLAN_DR_NUM] = {51, 51, 51, 115, 242, 242, 242, 242};
+static const uint8_t max_payload_us[PLAN_DR_NUM] = {11, 53, 125, 242, 242, 0, 0, 0, 53, 129, 242, 242, 242, 242};
+static const uint8_t max_payload_au[PLAN_DR_NUM] = {51, 51, 51, 115, 242, 242, 242, 0, 53, 129, 242, 242, 242, 242};
+static const uint8_t max_payload_as[PLAN_DR_NUM] = {0, 0, 11, 53, 125, 242, 242, 242};
+static const uint8_t max_payload_cn470[PLAN_DR_NUM] = {51, 51, 51, 115, 242, 242};
+
+/** Region numbers as used in g_lorawan_settings.lora_region */
+static const uint8_t *const max_payload_region[] = {
+	max_payload_as,	   // AS923
+	max_payload_au,	   // AU915
+	max_payload_cn470, // CN470
+	max_payload_eu,	   // CN779
+	max_payload_eu,	   // EU433
+	max_payload_eu,	   // EU868
+	max_payload_cn470, // KR920
+	max_payload_eu,	   // IN865
+	max_payload_us,	   // US915
+	max_payload_as,	   // AS923-2
+	max_payload_as,	   // AS923-3
+	max_payload_as,	   // AS923-4
+	max_payload_eu,	   // RU864
+};
+
+/**
+ * @brief Get the max application payload for a region and data rate
+ *
+ * @param region LoRaWAN region
+ * @param datarate data rate
+ * @return uint8_t max payload size, 0 if the data rate is not available
+ */
+uint8_t plan_max_payload(uint8_t region, uint8_t datarate)
+{
+	if ((region >= sizeof(max_payload_region) / sizeof(max_payload_region[0])) || (datarate >= PLAN_DR_NUM))
+	{
+		return 0;
+	}
+	return max_payload_region[region][datarate];
+}
+
+/**
+ * @brief Append a field to a packet, precise locations are reduced
+ *        to the standard precision if they do not fit otherwise
+ *
+ * @param field field including channel and type
+ * @param packet packet
+ * @param size current packet size, increased by the bytes added
+ * @param max_size max packet size
+ * @return true if the field was added
+ */
+static bool add_field(const uint8_t *field, uint8_t *packet, uint8_t *size, uint8_t max_size)
+{
+	uint8_t field_size = 2 + lpp_type_size(field[1]);
+	if ((*size + field_size) <= max_size)
+	{
+		for (uint8_t idx = 0; idx < field_size; idx++)
+		{
+			packet[(*size)++] = field[idx];
+		}
+		return true;
+	}
+
+	if ((field[1] != LPP_GPS6) || ((*size + 2 + lpp_type_size(LPP_GPS4)) > max_size))
+	{
+		return false;
+	}
+	// 4 byte lat/lon in 0.000001 degree to 3 byte in 0.0001 degree, altitude is the same
+	packet[(*size)++] = field[0];
+	packet[(*size)++] = LPP_GPS4;
+	for (uint8_t value = 0; value < 2; value++)
+	{
+		*size += put_be_scaled<3, 100>(&packet[*size], (int32_t)get_be<4>(&field[2 + value * 4]));
+	}
+	for (uint8_t idx = 10; idx < 13; idx++)
+	{
+		packet[(*size)++] = field[idx];
+	}
+	return true;
+}
+
+/**
+ * @brief Split a LPP packet into a packet that fits into max_size and deferred fields
+ *        Fields are added in the order of the priority list, then the remaining fields
+ *        in their original order. Fields of the first channel in the priority list
+ *        are mandatory, if they do not fit the packet cannot be planned.
+ *
+ * @param packet LPP packet
+ * @param size size of the LPP packet
+ * @param max_size max payload size
+ * @param priority channels in order of priority
+ * @param priority_count number of channels in the priority list
+ * @param planned buffer for the planned packet, at least max_size bytes
+ * @param deferred buffer for the deferred fields, at least size bytes
+ * @param deferred_size size of the deferred fields
+ * @return uint8_t size of the planned packet, 0 if the packet cannot be planned
+ */
+uint8_t plan_lpp(const uint8_t *packet, uint8_t size, uint8_t max_size,
+				 const uint8_t *priority, uint8_t priority_count,
+				 uint8_t *planned, uint8_t *deferred, uint8_t *deferred_size)
+{
+	uint8_t field_start[PLAN_MAX_FIELDS];
+	uint8_t field_num = 0;
+	uint8_t cursor = 0;
+	while (cursor < size)
+	{
+		if (((cursor + 2) > size) || (field_num == PLAN_MAX_FIELDS))
+		{
+			return 0;
+		}
+		uint8_t data_size = lpp_type_size(packet[cursor + 1]);
+		if ((data_size == 0) || ((cursor + 2 + data_size) > size))
+		{
+			return 0;
+		}
+		field_start[field_num++] = cursor;
+		cursor += 2 + data_size;
+	}
+
+	uint8_t planned_size = 0;
+	*deferred_size = 0;
+	bool field_done[PLAN_MAX_FIELDS] = {false};
+	for (uint8_t prio = 0; prio <= priority_count; prio++)
+	{
+		for (uint8_t field = 0; field < field_num; field++)
+		{
+			const uint8_t *field_data = &packet[field_start[field]];
+			if (field_done[field] || ((prio < priority_count) && (field_data[0] != priority[prio])))
+			{
+				continue;
+			}
+			field_done[field] = true;
+			if (add_field(field_data, planned, &planned_size, max_size))
+			{
+				continue;
+			}
+			if ((prio == 0) && (priority_count != 0))
+			{
+				return 0;
+			}
+			uint8_t field_size = 2 + lpp_type_size(field_data[1]);
+			for (uint8_t idx = 0; idx < field_size; idx++)
+			{
+				deferred[(*deferred_size)++] = field_data[idx];
+			}
+		}
+	}
+	return planned_size;
+}
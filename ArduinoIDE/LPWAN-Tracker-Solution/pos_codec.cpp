@@ -0,0 +1,314 @@
+/**
+ * @file pos_codec.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Compact codec for a series of locations
+ * @version 0.1
+ * @date 2022-09-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "pos_codec.h"
+
+/** Ranges of the absolute values in 1e-7 degree and mm */
+#define LAT_RANGE 1800000000UL
+#define LON_RANGE 3600000000UL
+#define ALT_RANGE 10000000UL
+#define ALT_OFFSET 1000000L
+
+/** Powers of 10 for the resolutions */
+static const uint32_t res_steps[] = {1, 10, 100, 1000, 10000};
+
+/**
+ * @brief Number of bits needed for a value
+ *
+ * @param value max value
+ * @return uint8_t number of bits
+ */
+static uint8_t bit_width(uint32_t value)
+{
+	uint8_t bits = 0;
+	while (value != 0)
+	{
+		bits++;
+		value >>= 1;
+	}
+	return bits;
+}
+
+/**
+ * @brief Quantize an absolute value with offset, rounded to the nearest step
+ *
+ * @param value value
+ * @param offset offset to make the value positive
+ * @param range range of the value
+ * @param res step size
+ * @return uint32_t quantized value
+ */
+static uint32_t quantize(int32_t value, int64_t offset, uint32_t range, uint32_t res)
+{
+	int64_t shifted = (int64_t)value + offset;
+	if (shifted < 0)
+	{
+		shifted = 0;
+	}
+	if (shifted > range)
+	{
+		shifted = range;
+	}
+	return (uint32_t)((shifted + res / 2) / res);
+}
+
+/**
+ * @brief Write a varint, 7 bits per byte, LSB group first
+ *
+ * @param buffer buffer
+ * @param value value
+ * @return uint8_t bytes written
+ */
+static uint8_t put_varint(uint8_t *buffer, uint32_t value)
+{
+	uint8_t size = 0;
+	while (value >= 0x80)
+	{
+		buffer[size++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buffer[size++] = (uint8_t)value;
+	return size;
+}
+
+/**
+ * @brief Read a varint
+ *
+ * @param buffer buffer
+ * @param size buffer size
+ * @param cursor read position, advanced by the bytes read
+ * @param value decoded value
+ * @return true if a complete varint was read
+ */
+static bool get_varint(const uint8_t *buffer, uint8_t size, uint8_t *cursor, uint32_t *value)
+{
+	uint32_t result = 0;
+	for (uint8_t shift = 0; shift < 35; shift += 7)
+	{
+		if (*cursor >= size)
+		{
+			return false;
+		}
+		uint8_t byte = buffer[(*cursor)++];
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			*value = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Map signed to unsigned, small magnitudes give small values
+ */
+static uint32_t zigzag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/**
+ * @brief Reverse of zigzag()
+ */
+static int32_t unzigzag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * @brief Start a new encoding
+ *
+ * @param buffer buffer for the encoded data
+ * @param max_size size of the buffer
+ * @param pos_res latitude/longitude resolution POS_RES_xxx
+ * @param alt_res altitude resolution ALT_RES_xxx
+ */
+void PosEncoder::begin(uint8_t *buffer, uint8_t max_size, uint8_t pos_res, uint8_t alt_res)
+{
+	_buffer = buffer;
+	_max_size = max_size;
+	_size = 0;
+	_count = 0;
+	_pos_res = pos_res > POS_RES_1E4 ? POS_RES_1E4 : pos_res;
+	_alt_res = alt_res > ALT_RES_M ? ALT_RES_M : alt_res;
+	if ((_buffer != 0) && (_max_size > 0))
+	{
+		_buffer[_size++] = (uint8_t)(POS_CODEC_VERSION << 6 | _pos_res << 3 | _alt_res);
+	}
+}
+
+/**
+ * @brief Add a location
+ *
+ * @param point location
+ * @return true if the location was added
+ * @return false if the location does not fit, the encoded data is unchanged
+ */
+bool PosEncoder::add(const pos_point_s *point)
+{
+	if (_size == 0)
+	{
+		return false;
+	}
+
+	uint32_t values[4];
+	values[0] = quantize(point->latitude, LAT_RANGE / 2, LAT_RANGE, res_steps[_pos_res]);
+	values[1] = quantize(point->longitude, LON_RANGE / 2, LON_RANGE, res_steps[_pos_res]);
+	values[2] = quantize(point->altitude, ALT_OFFSET, ALT_RANGE, res_steps[_alt_res]);
+	values[3] = point->time;
+
+	uint8_t encoded[POS_CODEC_MAX_POINT];
+	uint8_t size = 0;
+	if (_count == 0)
+	{
+		uint8_t bits[3];
+		bits[0] = bit_width(LAT_RANGE / res_steps[_pos_res]);
+		bits[1] = bit_width(LON_RANGE / res_steps[_pos_res]);
+		bits[2] = bit_width(ALT_RANGE / res_steps[_alt_res]);
+
+		uint8_t bit_pos = 0;
+		for (int idx = 0; idx < POS_CODEC_MAX_POINT; idx++)
+		{
+			encoded[idx] = 0;
+		}
+		for (int field = 0; field < 3; field++)
+		{
+			for (int bit = bits[field] - 1; bit >= 0; bit--)
+			{
+				if ((values[field] >> bit) & 1)
+				{
+					encoded[bit_pos / 8] |= 0x80 >> (bit_pos % 8);
+				}
+				bit_pos++;
+			}
+		}
+		size = (bit_pos + 7) / 8;
+		size += put_varint(&encoded[size], values[3]);
+	}
+	else
+	{
+		for (int field = 0; field < 4; field++)
+		{
+			size += put_varint(&encoded[size], zigzag((int32_t)(values[field] - _last[field])));
+		}
+	}
+
+	if ((_size + size) > _max_size)
+	{
+		return false;
+	}
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		_buffer[_size++] = encoded[idx];
+	}
+	for (int field = 0; field < 4; field++)
+	{
+		_last[field] = values[field];
+	}
+	_count++;
+	return true;
+}
+
+/**
+ * @brief Start decoding
+ *
+ * @param buffer encoded data
+ * @param size size of the encoded data
+ * @return true if the header is valid
+ */
+bool PosDecoder::begin(const uint8_t *buffer, uint8_t size)
+{
+	_buffer = buffer;
+	_size = size;
+	_cursor = 0;
+	_count = 0;
+	if ((_size == 0) || ((_buffer[0] >> 6) != POS_CODEC_VERSION))
+	{
+		return false;
+	}
+	_pos_res = (_buffer[0] >> 3) & 0x07;
+	_alt_res = _buffer[0] & 0x07;
+	if ((_pos_res > POS_RES_1E4) || (_alt_res > ALT_RES_M))
+	{
+		return false;
+	}
+	_cursor = 1;
+	return true;
+}
+
+/**
+ * @brief Decode the next location
+ *
+ * @param point decoded location
+ * @return true if a location was decoded
+ * @return false if there are no more locations or the data is invalid
+ */
+bool PosDecoder::next(pos_point_s *point)
+{
+	if ((_cursor == 0) || (_cursor >= _size))
+	{
+		return false;
+	}
+
+	uint32_t values[4];
+	if (_count == 0)
+	{
+		uint8_t bits[3];
+		bits[0] = bit_width(LAT_RANGE / res_steps[_pos_res]);
+		bits[1] = bit_width(LON_RANGE / res_steps[_pos_res]);
+		bits[2] = bit_width(ALT_RANGE / res_steps[_alt_res]);
+		uint8_t bytes = (bits[0] + bits[1] + bits[2] + 7) / 8;
+		if ((_cursor + bytes) > _size)
+		{
+			return false;
+		}
+
+		uint16_t bit_pos = 0;
+		for (int field = 0; field < 3; field++)
+		{
+			values[field] = 0;
+			for (int bit = 0; bit < bits[field]; bit++)
+			{
+				values[field] = (values[field] << 1) | ((_buffer[_cursor + bit_pos / 8] >> (7 - bit_pos % 8)) & 1);
+				bit_pos++;
+			}
+		}
+		_cursor += bytes;
+		if (!get_varint(_buffer, _size, &_cursor, &values[3]))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		for (int field = 0; field < 4; field++)
+		{
+			uint32_t delta;
+			if (!get_varint(_buffer, _size, &_cursor, &delta))
+			{
+				return false;
+			}
+			values[field] = _last[field] + (uint32_t)unzigzag(delta);
+		}
+	}
+
+	for (int field = 0; field < 4; field++)
+	{
+		_last[field] = values[field];
+	}
+	_count++;
+
+	point->latitude = (int32_t)((int64_t)values[0] * res_steps[_pos_res] - LAT_RANGE / 2);
+	point->longitude = (int32_t)((int64_t)values[1] * res_steps[_pos_res] - LON_RANGE / 2);
+	point->altitude = (int32_t)((int64_t)values[2] * res_steps[_alt_res] - ALT_OFFSET);
+	point->time = values[3];
+	return true;
+}
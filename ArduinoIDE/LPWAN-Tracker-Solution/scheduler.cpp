@@ -0,0 +1,134 @@
+/**
+ * @file scheduler.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Deadline ordered job scheduler.
+ * @version 0.1
+ * @date 2022-09-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "scheduler.h"
+
+/**
+ * @brief Remove all jobs, the merge window and the exact jobs are kept
+ *
+ */
+void Scheduler::clear(void)
+{
+	_pending = 0;
+	for (int idx = 0; idx < SCHED_MAX_JOBS; idx++)
+	{
+		_deadline[idx] = 0;
+	}
+}
+
+/**
+ * @brief Set the deadline of a job
+ *
+ * @param job Job number
+ * @param deadline Time the job is due
+ */
+void Scheduler::at(uint8_t job, uint32_t deadline)
+{
+	if (job >= SCHED_MAX_JOBS)
+	{
+		return;
+	}
+	_deadline[job] = deadline;
+	_pending |= SCHED_BIT(job);
+}
+
+/**
+ * @brief Remove a job
+ *
+ * @param job Job number
+ */
+void Scheduler::cancel(uint8_t job)
+{
+	if (job >= SCHED_MAX_JOBS)
+	{
+		return;
+	}
+	_pending &= ~SCHED_BIT(job);
+}
+
+/**
+ * @brief Check if a job has a deadline
+ *
+ * @param job Job number
+ * @return true if the job is scheduled
+ */
+bool Scheduler::pending(uint8_t job)
+{
+	if (job >= SCHED_MAX_JOBS)
+	{
+		return false;
+	}
+	return (_pending & SCHED_BIT(job)) != 0;
+}
+
+/**
+ * @brief Get the time until the next job is due
+ *
+ * @param now Current time
+ * @param delay Time until the earliest deadline, 0 if a job is overdue
+ * @return true if a job is scheduled
+ * @return false if no job is scheduled
+ */
+bool Scheduler::nextWake(uint32_t now, uint32_t *delay)
+{
+	bool found = false;
+	int32_t earliest = 0;
+	for (uint8_t job = 0; job < SCHED_MAX_JOBS; job++)
+	{
+		if ((_pending & SCHED_BIT(job)) == 0)
+		{
+			continue;
+		}
+		int32_t remaining = (int32_t)(_deadline[job] - now);
+		if (!found || (remaining < earliest))
+		{
+			earliest = remaining;
+			found = true;
+		}
+	}
+	if (found)
+	{
+		*delay = earliest > 0 ? (uint32_t)earliest : 0;
+	}
+	return found;
+}
+
+/**
+ * @brief Take the jobs that are due
+ *        If a job is due, all jobs due within the merge window are taken as well,
+ *        except the jobs set with setExact(), they are only taken at their deadline.
+ *
+ * @param now Current time
+ * @return uint32_t mask of the jobs to run, see SCHED_BIT(), 0 if no job is due
+ */
+uint32_t Scheduler::due(uint32_t now)
+{
+	uint32_t wake;
+	if (!nextWake(now, &wake) || (wake != 0))
+	{
+		return 0;
+	}
+
+	uint32_t jobs = 0;
+	for (uint8_t job = 0; job < SCHED_MAX_JOBS; job++)
+	{
+		if ((_pending & SCHED_BIT(job)) == 0)
+		{
+			continue;
+		}
+		int32_t remaining = (int32_t)(_deadline[job] - now);
+		if ((remaining <= 0) || ((remaining <= (int32_t)_window) && ((_exact & SCHED_BIT(job)) == 0)))
+		{
+			jobs |= SCHED_BIT(job);
+		}
+	}
+	_pending &= ~jobs;
+	return jobs;
+}
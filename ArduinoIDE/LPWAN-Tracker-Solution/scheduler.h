@@ -0,0 +1,57 @@
+/**
+ * @file scheduler.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Deadline ordered job scheduler.
+ *        Jobs with deadlines close to each other are run together,
+ *        so the MCU wakes up once for several jobs.
+ *        Has no Arduino dependencies, the time is passed in by the caller.
+ * @version 0.1
+ * @date 2022-09-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+/** Max number of jobs, jobs are numbered 0 to SCHED_MAX_JOBS - 1 */
+#define SCHED_MAX_JOBS 16
+
+/** Bit of a job in the mask returned by Scheduler::due() */
+#define SCHED_BIT(job) ((uint32_t)1 << (job))
+
+/**
+ * @brief Deadlines of up to SCHED_MAX_JOBS jobs.
+ *        Times are in milliseconds and may wrap around.
+ *        Each job has at most one deadline, setting it again replaces it.
+ */
+class Scheduler
+{
+public:
+	Scheduler(void)
+	{
+		_window = 0;
+		_exact = 0;
+		clear();
+	}
+
+	void clear(void);
+	void setMergeWindow(uint32_t window) { _window = window; }
+	void setExact(uint32_t jobs) { _exact = jobs; }
+	void at(uint8_t job, uint32_t deadline);
+	void in(uint8_t job, uint32_t now, uint32_t delay) { at(job, now + delay); }
+	void cancel(uint8_t job);
+	bool pending(uint8_t job);
+	bool nextWake(uint32_t now, uint32_t *delay);
+	uint32_t due(uint32_t now);
+
+private:
+	uint32_t _deadline[SCHED_MAX_JOBS];
+	uint32_t _pending;
+	uint32_t _window;
+	uint32_t _exact;
+};
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ * @file session.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Save the LoRaWAN session in the flash and restore it after a reset
+ * @version 0.1
+ * @date 2022-09-30
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "app.h"
+#include "field_writer.h"
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+using namespace Adafruit_LittleFS_Namespace;
+
+/** Filename to save the session */
+static const char session_name[] = "SESSION";
+
+/** File to save the session */
+File session_file(InternalFS);
+
+/** Format version of the session file */
+#define SESSION_VERSION 2
+/** First channel after the default channels, the CFList adds channels from here */
+#define SESSION_CHANNEL_FIRST 3
+/** Number of saved channels */
+#define SESSION_CHANNELS 13
+/** Size of the session file */
+#define SESSION_SIZE (68 + SESSION_CHANNELS * 5)
+
+/**
+ * Session file
+ * 0      version
+ * 1      region
+ * 2..9   DevEUI
+ * 10..13 DevAddr
+ * 14..17 NetID
+ * 18..33 NwkSKey
+ * 34..49 AppSKey
+ * 50..53 uplink frame counter, written ahead
+ * 54..57 downlink frame counter
+ * 58..61 RX2 frequency
+ * 62     RX2 data rate
+ * 63..64 RX1 delay in ms
+ * 65..66 RX2 delay in ms
+ * 67     RX1 DR offset
+ * 68..   channels 3 to 15, 4 bytes frequency, 0 if not used, 1 byte DR range
+ */
+
+/** Flag if the session was restored after a reset */
+bool g_session_restored = false;
+/** Flag if the stack was started with the restored session, it has no OTAA keys then */
+bool g_session_stack = false;
+/** Flag if the application joins instead of the WisBlock API */
+bool g_session_auto_join = false;
+/** Uplink frame counter saved in the flash */
+uint32_t session_fcnt = 0;
+
+/**
+ * @brief Save the current session
+ *        The uplink frame counter is saved SESSION_WRITE_AHEAD ahead,
+ *        so the flash is written only every SESSION_WRITE_AHEAD uplinks
+ *        and a restored counter is never lower than a used one.
+ *
+ */
+void save_session(void)
+{
+	uint8_t buffer[SESSION_SIZE];
+	MibRequestConfirm_t mib_req;
+
+	buffer[0] = SESSION_VERSION;
+	buffer[1] = g_lorawan_settings.lora_region;
+	memcpy(&buffer[2], g_lorawan_settings.node_device_eui, 8);
+	mib_req.Type = MIB_DEV_ADDR;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	put_be<4>(&buffer[10], mib_req.Param.DevAddr);
+	mib_req.Type = MIB_NET_ID;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	put_be<4>(&buffer[14], mib_req.Param.NetID);
+	mib_req.Type = MIB_NWK_SKEY;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	memcpy(&buffer[18], mib_req.Param.NwkSKey, 16);
+	mib_req.Type = MIB_APP_SKEY;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	memcpy(&buffer[34], mib_req.Param.AppSKey, 16);
+	mib_req.Type = MIB_UPLINK_COUNTER;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	session_fcnt = mib_req.Param.UpLinkCounter + SESSION_WRITE_AHEAD;
+	put_be<4>(&buffer[50], session_fcnt);
+	mib_req.Type = MIB_DOWNLINK_COUNTER;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	put_be<4>(&buffer[54], mib_req.Param.DownLinkCounter);
+	mib_req.Type = MIB_RX2_CHANNEL;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	put_be<4>(&buffer[58], mib_req.Param.Rx2Channel.Frequency);
+	buffer[62] = mib_req.Param.Rx2Channel.Datarate;
+	// RX delay and RX1 DR offset of the Join-Accept, without them no downlink is received
+	mib_req.Type = MIB_RECEIVE_DELAY_1;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	put_be<2>(&buffer[63], mib_req.Param.ReceiveDelay1);
+	mib_req.Type = MIB_RECEIVE_DELAY_2;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	put_be<2>(&buffer[65], mib_req.Param.ReceiveDelay2);
+	buffer[67] = LoRaMacParams.Rx1DrOffset;
+	// Channels of the CFList, a region with fixed channels has them from the settings
+	mib_req.Type = MIB_CHANNELS;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	for (uint8_t idx = 0; idx < SESSION_CHANNELS; idx++)
+	{
+		const ChannelParams_t *channel = &mib_req.Param.ChannelList[SESSION_CHANNEL_FIRST + idx];
+		put_be<4>(&buffer[68 + idx * 5], channel->Frequency);
+		buffer[68 + idx * 5 + 4] = (uint8_t)channel->DrRange.Value;
+	}
+
+	InternalFS.remove(session_name);
+	session_file.open(session_name, FILE_O_WRITE);
+	session_file.write(buffer, SESSION_SIZE);
+	session_file.close();
+	MYLOG("SESS", "Session saved, FCnt %ld", (long)session_fcnt);
+}
+
+/**
+ * @brief Save the session again if the uplink frame counter reached the saved one
+ *        Called after every uplink.
+ *
+ */
+void session_uplink(void)
+{
+	if (!g_lpwan_has_joined || !g_lorawan_settings.otaa_enabled)
+	{
+		return;
+	}
+	MibRequestConfirm_t mib_req;
+	mib_req.Type = MIB_UPLINK_COUNTER;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	if (mib_req.Param.UpLinkCounter >= session_fcnt)
+	{
+		save_session();
+	}
+}
+
+/**
+ * @brief Forget the saved session, the next reset joins again
+ *
+ */
+void forget_session(void)
+{
+	InternalFS.remove(session_name);
+	session_fcnt = 0;
+	g_session_restored = false;
+	MYLOG("SESS", "Session removed");
+}
+
+/**
+ * @brief Take over the auto join from the WisBlock API
+ *        Called from setup_app(), before the WisBlock API reads the settings and joins.
+ *        The auto join flag is cleared only in RAM, init_app() joins or restores the
+ *        saved session instead, so a restored session does not send a join request.
+ *
+ */
+void session_setup(void)
+{
+	api_read_credentials();
+	g_session_auto_join = g_lorawan_settings.lorawan_enable && g_lorawan_settings.otaa_enabled && g_lorawan_settings.auto_join;
+	if (g_session_auto_join)
+	{
+		g_lorawan_settings.auto_join = false;
+	}
+}
+
+/**
+ * @brief Restore the saved session
+ *        The session is used only if it was saved for the same DevEUI and region.
+ *        The stack is started with the saved DevAddr and session keys the way it is
+ *        started for ABP, then the frame counters, NetID, RX windows and channels are restored.
+ *        A session of an older version is not used, it has no RX delays and channels.
+ *        The stack sends no join request.
+ *        Must be called instead of the join of the WisBlock API, see session_setup().
+ *
+ * @return true if the session was restored
+ * @return false if there is no valid session
+ */
+bool restore_session(void)
+{
+	if (!g_session_auto_join || !InternalFS.exists(session_name))
+	{
+		return false;
+	}
+
+	uint8_t buffer[SESSION_SIZE];
+	session_file.open(session_name, FILE_O_READ);
+	bool valid = session_file.read(buffer, SESSION_SIZE) == SESSION_SIZE;
+	session_file.close();
+	valid = valid && (buffer[0] == SESSION_VERSION) && (buffer[1] == g_lorawan_settings.lora_region) && (memcmp(&buffer[2], g_lorawan_settings.node_device_eui, 8) == 0);
+	// Frame counter must not roll over
+	valid = valid && (get_be<4>(&buffer[50]) < (0xFFFFFFFF - SESSION_WRITE_AHEAD));
+	if (!valid)
+	{
+		MYLOG("SESS", "Saved session not valid");
+		forget_session();
+		return false;
+	}
+
+	// Start the stack with the saved session instead of the ABP settings
+	s_lorawan_settings settings = g_lorawan_settings;
+	g_lorawan_settings.otaa_enabled = false;
+	g_lorawan_settings.node_dev_addr = get_be<4>(&buffer[10]);
+	memcpy(g_lorawan_settings.node_nws_key, &buffer[18], 16);
+	memcpy(g_lorawan_settings.node_apps_key, &buffer[34], 16);
+	init_lorawan();
+	g_lorawan_settings = settings;
+
+	MibRequestConfirm_t mib_req;
+	mib_req.Type = MIB_NET_ID;
+	mib_req.Param.NetID = get_be<4>(&buffer[14]);
+	LoRaMacMibSetRequestConfirm(&mib_req);
+	mib_req.Type = MIB_UPLINK_COUNTER;
+	mib_req.Param.UpLinkCounter = get_be<4>(&buffer[50]);
+	LoRaMacMibSetRequestConfirm(&mib_req);
+	mib_req.Type = MIB_DOWNLINK_COUNTER;
+	mib_req.Param.DownLinkCounter = get_be<4>(&buffer[54]);
+	LoRaMacMibSetRequestConfirm(&mib_req);
+	mib_req.Type = MIB_RX2_CHANNEL;
+	mib_req.Param.Rx2Channel.Frequency = get_be<4>(&buffer[58]);
+	mib_req.Param.Rx2Channel.Datarate = buffer[62];
+	LoRaMacMibSetRequestConfirm(&mib_req);
+	mib_req.Type = MIB_RECEIVE_DELAY_1;
+	mib_req.Param.ReceiveDelay1 = get_be<2>(&buffer[63]);
+	LoRaMacMibSetRequestConfirm(&mib_req);
+	mib_req.Type = MIB_RECEIVE_DELAY_2;
+	mib_req.Param.ReceiveDelay2 = get_be<2>(&buffer[65]);
+	LoRaMacMibSetRequestConfirm(&mib_req);
+	LoRaMacParams.Rx1DrOffset = buffer[67];
+	for (uint8_t idx = 0; idx < SESSION_CHANNELS; idx++)
+	{
+		ChannelParams_t channel = {0};
+		channel.Frequency = get_be<4>(&buffer[68 + idx * 5]);
+		channel.DrRange.Value = (int8_t)buffer[68 + idx * 5 + 4];
+		// Fails in regions with fixed channels, they keep the channels of the settings
+		if (channel.Frequency != 0)
+		{
+			LoRaMacChannelAdd(SESSION_CHANNEL_FIRST + idx, channel);
+		}
+	}
+	mib_req.Type = MIB_NETWORK_JOINED;
+	mib_req.Param.IsNetworkJoined = true;
+	LoRaMacMibSetRequestConfirm(&mib_req);
+
+	g_lpwan_has_joined = true;
+	g_session_restored = true;
+	g_session_stack = true;
+
+	// Move the saved counter ahead before the first uplink
+	save_session();
+	MYLOG("SESS", "Session restored, DevAddr %08lX", (unsigned long)get_be<4>(&buffer[10]));
+	return true;
+}
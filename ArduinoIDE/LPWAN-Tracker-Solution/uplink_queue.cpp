@@ -0,0 +1,278 @@
+/**
+ * @file uplink_queue.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Priority ordered uplink queue kept in a circular log in flash
+ * @version 0.1
+ * @date 2022-09-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "uplink_queue.h"
+#include "field_writer.h"
+
+/** State of a slot */
+#define QUEUE_STATE_EMPTY 0xFF
+#define QUEUE_STATE_VALID 0x7F
+#define QUEUE_STATE_SENT 0x00
+
+/** No slot peeked */
+#define QUEUE_NO_SLOT 0xFF
+
+/**
+ * Slot header
+ * 0      state
+ * 1..4   sequence number
+ * 5      priority
+ * 6      fPort
+ * 7      size
+ * 8..11  creation time
+ * 12..13 max age in minutes
+ */
+
+/**
+ * @brief Forget the index in RAM
+ *
+ */
+void UplinkQueue::reset(void)
+{
+	for (uint8_t slot = 0; slot < QUEUE_SLOTS; slot++)
+	{
+		_valid[slot] = false;
+		_seq[slot] = 0;
+	}
+	_next_seq = 0;
+	_head = 0;
+	_peeked = QUEUE_NO_SLOT;
+	_last_time = 0;
+}
+
+/**
+ * @brief Rebuild the index from the log
+ *
+ * @param read function to read from the log
+ * @param write function to write to the log
+ */
+void UplinkQueue::begin(queue_read_t read, queue_write_t write)
+{
+	_read = read;
+	_write = write;
+	reset();
+
+	bool found = false;
+	for (uint8_t slot = 0; slot < QUEUE_SLOTS; slot++)
+	{
+		uint8_t header[QUEUE_HEADER_SIZE];
+		if (!_read(slot * QUEUE_SLOT_SIZE, header, QUEUE_HEADER_SIZE) || (header[0] == QUEUE_STATE_EMPTY))
+		{
+			continue;
+		}
+		_seq[slot] = get_be<4>(&header[1]);
+		_priority[slot] = header[5];
+		_created[slot] = get_be<4>(&header[8]);
+		_max_age[slot] = (uint32_t)get_be<2>(&header[12]) * 60;
+		_valid[slot] = header[0] == QUEUE_STATE_VALID;
+
+		// The newest slot is the head of the log
+		if (!found || ((int32_t)(_seq[slot] - _next_seq) >= 0))
+		{
+			_next_seq = _seq[slot] + 1;
+			_head = (slot + 1) % QUEUE_SLOTS;
+			found = true;
+		}
+		if ((int32_t)(_created[slot] - _last_time) > 0)
+		{
+			_last_time = _created[slot];
+		}
+	}
+}
+
+/**
+ * @brief Mark a slot as sent
+ *
+ * @param slot slot number
+ */
+void UplinkQueue::drop(uint8_t slot)
+{
+	uint8_t state = QUEUE_STATE_SENT;
+	_write(slot * QUEUE_SLOT_SIZE, &state, 1);
+	_valid[slot] = false;
+}
+
+/**
+ * @brief Add a packet to the queue
+ *        If the log is full, the oldest packet with the lowest priority
+ *        not higher than the new one is overwritten.
+ *
+ * @param now current time in seconds
+ * @param priority QUEUE_PRIO_PERIODIC, QUEUE_PRIO_MOTION or QUEUE_PRIO_ALARM
+ * @param fport fPort of the packet
+ * @param data packet
+ * @param size packet size
+ * @param max_age time in seconds after which the packet is dropped, rounded up to minutes
+ * @return true if the packet was queued
+ * @return false if the packet is too big or the log is full with packets of higher priority
+ */
+bool UplinkQueue::push(uint32_t now, uint8_t priority, uint8_t fport, const uint8_t *data, uint8_t size, uint32_t max_age)
+{
+	if ((_write == 0) || (size > QUEUE_MAX_DATA))
+	{
+		return false;
+	}
+
+	// Use the next slot of the log if it is free
+	uint8_t slot = _head;
+	if (_valid[slot])
+	{
+		slot = QUEUE_NO_SLOT;
+		for (uint8_t step = 0; step < QUEUE_SLOTS; step++)
+		{
+			uint8_t check = (_head + step) % QUEUE_SLOTS;
+			if (!_valid[check])
+			{
+				slot = check;
+				break;
+			}
+			if ((_priority[check] <= priority) && ((slot == QUEUE_NO_SLOT) || (_priority[check] < _priority[slot])))
+			{
+				slot = check;
+			}
+		}
+		if (slot == QUEUE_NO_SLOT)
+		{
+			return false;
+		}
+	}
+	if (slot == _peeked)
+	{
+		_peeked = QUEUE_NO_SLOT;
+	}
+
+	uint32_t age_minutes = (max_age + 59) / 60;
+	uint8_t buffer[QUEUE_HEADER_SIZE + QUEUE_MAX_DATA];
+	buffer[0] = QUEUE_STATE_VALID;
+	put_be<4>(&buffer[1], _next_seq);
+	buffer[5] = priority;
+	buffer[6] = fport;
+	buffer[7] = size;
+	put_be<4>(&buffer[8], now);
+	put_be<2>(&buffer[12], age_minutes > 0xFFFF ? 0xFFFF : age_minutes);
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		buffer[QUEUE_HEADER_SIZE + idx] = data[idx];
+	}
+	if (!_write(slot * QUEUE_SLOT_SIZE, buffer, QUEUE_HEADER_SIZE + size))
+	{
+		return false;
+	}
+
+	_seq[slot] = _next_seq++;
+	_priority[slot] = priority;
+	_created[slot] = now;
+	_max_age[slot] = (age_minutes > 0xFFFF ? 0xFFFF : age_minutes) * 60;
+	_valid[slot] = true;
+	_head = (slot + 1) % QUEUE_SLOTS;
+	_last_time = now;
+	return true;
+}
+
+/**
+ * @brief Get the packet to send next, highest priority first, oldest first
+ *        Expired packets are dropped.
+ *
+ * @param now current time in seconds
+ * @param fport fPort of the packet
+ * @param data buffer for the packet, QUEUE_MAX_DATA bytes
+ * @param age age of the packet in seconds
+ * @return uint8_t size of the packet, 0 if the queue is empty
+ */
+uint8_t UplinkQueue::peek(uint32_t now, uint8_t *fport, uint8_t *data, uint32_t *age)
+{
+	_peeked = QUEUE_NO_SLOT;
+	if (_read == 0)
+	{
+		return 0;
+	}
+
+	for (uint8_t slot = 0; slot < QUEUE_SLOTS; slot++)
+	{
+		if (!_valid[slot])
+		{
+			continue;
+		}
+		if ((now - _created[slot]) > _max_age[slot])
+		{
+			drop(slot);
+			continue;
+		}
+		if ((_peeked == QUEUE_NO_SLOT) || (_priority[slot] > _priority[_peeked]) ||
+			((_priority[slot] == _priority[_peeked]) && ((int32_t)(_seq[slot] - _seq[_peeked]) < 0)))
+		{
+			_peeked = slot;
+		}
+	}
+	if (_peeked == QUEUE_NO_SLOT)
+	{
+		return 0;
+	}
+
+	uint8_t header[QUEUE_HEADER_SIZE];
+	if (!_read(_peeked * QUEUE_SLOT_SIZE, header, QUEUE_HEADER_SIZE) || (header[7] > QUEUE_MAX_DATA) ||
+		!_read(_peeked * QUEUE_SLOT_SIZE + QUEUE_HEADER_SIZE, data, header[7]))
+	{
+		// Broken slot, do not try again
+		drop(_peeked);
+		_peeked = QUEUE_NO_SLOT;
+		return 0;
+	}
+	*fport = header[6];
+	*age = now - _created[_peeked];
+	return header[7];
+}
+
+/**
+ * @brief Mark the packet returned by the last peek() as sent
+ *
+ */
+void UplinkQueue::pop(void)
+{
+	if (_peeked != QUEUE_NO_SLOT)
+	{
+		drop(_peeked);
+		_peeked = QUEUE_NO_SLOT;
+	}
+}
+
+/**
+ * @brief Drop all packets
+ *
+ */
+void UplinkQueue::clear(void)
+{
+	for (uint8_t slot = 0; slot < QUEUE_SLOTS; slot++)
+	{
+		if (_valid[slot])
+		{
+			drop(slot);
+		}
+	}
+	_peeked = QUEUE_NO_SLOT;
+}
+
+/**
+ * @brief Get the number of queued packets, expired packets are included
+ *
+ * @return uint8_t number of packets
+ */
+uint8_t UplinkQueue::count(void)
+{
+	uint8_t num = 0;
+	for (uint8_t slot = 0; slot < QUEUE_SLOTS; slot++)
+	{
+		if (_valid[slot])
+		{
+			num++;
+		}
+	}
+	return num;
+}
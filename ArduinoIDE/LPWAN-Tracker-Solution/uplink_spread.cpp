@@ -0,0 +1,112 @@
+/**
+ * @file uplink_spread.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Spread the uplinks of trackers that were started together
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "uplink_spread.h"
+
+/**
+ * @brief Get the start value of the delays from the DevEUI (FNV-1a hash)
+ *
+ * @param dev_eui 8 bytes DevEUI
+ * @return uint32_t start value, never 0
+ */
+uint32_t spread_seed(const uint8_t *dev_eui)
+{
+	uint32_t hash = 2166136261UL;
+	for (uint8_t idx = 0; idx < 8; idx++)
+	{
+		hash ^= dev_eui[idx];
+		hash *= 16777619UL;
+	}
+	return hash == 0 ? 1 : hash;
+}
+
+/**
+ * @brief Start the random sequence, jitter and slots are disabled
+ *
+ * @param seed start value, from spread_seed()
+ */
+void UplinkSpread::begin(uint32_t seed)
+{
+	_seed = seed == 0 ? 1 : seed;
+	_random = _seed;
+	_max_jitter = 0;
+	_frame = 0;
+	_slots = 0;
+}
+
+/**
+ * @brief Set the max jitter
+ *
+ * @param max_jitter max delay in s, 0 disables the jitter
+ */
+void UplinkSpread::setJitter(uint16_t max_jitter)
+{
+	_max_jitter = max_jitter;
+}
+
+/**
+ * @brief Set the slots
+ *
+ * @param frame length of a frame in s, must divide one day, 0 disables the slots
+ * @param slots number of slots per frame
+ */
+void UplinkSpread::setSlots(uint16_t frame, uint8_t slots)
+{
+	if ((frame == 0) || (slots == 0) || (SPREAD_DAY % frame != 0))
+	{
+		_frame = 0;
+		_slots = 0;
+		return;
+	}
+	_frame = frame;
+	_slots = slots;
+}
+
+/**
+ * @brief Get the delay of the next periodic uplink
+ *
+ * @param limit max delay in ms, e.g. half of the send interval
+ * @return uint32_t delay in ms
+ */
+uint32_t UplinkSpread::jitter(uint32_t limit)
+{
+	uint32_t max_delay = (uint32_t)_max_jitter * 1000;
+	if (max_delay > limit)
+	{
+		max_delay = limit;
+	}
+	if (max_delay == 0)
+	{
+		return 0;
+	}
+	// xorshift, a new delay every time
+	_random ^= _random << 13;
+	_random ^= _random >> 17;
+	_random ^= _random << 5;
+	return _random % (max_delay + 1);
+}
+
+/**
+ * @brief Get the time until the own slot starts
+ *
+ * @param time_of_day UTC time of day in ms
+ * @return uint32_t wait time in ms, 0 if the slot starts now or slots are disabled
+ */
+uint32_t UplinkSpread::slotWait(uint32_t time_of_day)
+{
+	if (!slotted())
+	{
+		return 0;
+	}
+	uint32_t frame_ms = (uint32_t)_frame * 1000;
+	uint32_t start = slot() * (frame_ms / _slots);
+	uint32_t pos = time_of_day % frame_ms;
+	return (start + frame_ms - pos) % frame_ms;
+}
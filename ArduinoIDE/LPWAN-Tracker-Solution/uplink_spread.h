@@ -0,0 +1,54 @@
+/**
+ * @file uplink_spread.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Spread the uplinks of trackers that were started together
+ *        No Arduino dependencies
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef UPLINK_SPREAD_H
+#define UPLINK_SPREAD_H
+
+#include <stdint.h>
+
+/** Seconds per day, the slot frame has to divide it */
+#define SPREAD_DAY 86400UL
+
+uint32_t spread_seed(const uint8_t *dev_eui);
+
+/**
+ * @brief Delays for periodic uplinks, different on every device.
+ *        The jitter is a random delay up to the max jitter, the random sequence
+ *        starts from the DevEUI, so it is the same after every reset but
+ *        different between devices.
+ *        For P2P the time of day is split into frames with a number of slots,
+ *        every device sends in its slot. The slot is selected from the DevEUI.
+ */
+class UplinkSpread
+{
+public:
+	UplinkSpread(void) { begin(1); }
+
+	void begin(uint32_t seed);
+	void setJitter(uint16_t max_jitter);
+	void setSlots(uint16_t frame, uint8_t slots);
+	uint32_t jitter(uint32_t limit);
+	uint32_t slotWait(uint32_t time_of_day);
+	bool slotted(void) { return (_frame != 0) && (_slots != 0); }
+	uint16_t maxJitter(void) { return _max_jitter; }
+	uint16_t frame(void) { return _frame; }
+	uint8_t slots(void) { return _slots; }
+	uint8_t slot(void) { return slotted() ? _seed % _slots : 0; }
+
+private:
+	uint32_t _seed;
+	uint32_t _random;
+	uint16_t _max_jitter;
+	uint16_t _frame;
+	uint8_t _slots;
+};
+
+#endif
@@ -9,19 +9,7 @@
  * 
  */
 #include "wisblock_cayenne.h"
-
-/** Battery level uinion */
-union batt_s
-{
-	uint16_t batt16 = 0;
-	uint8_t batt8[2];
-};
-/** Latitude/Longitude value union */
-union latLong_s
-{
-	int32_t val32;
-	int8_t val8[4];
-};
+#include "field_writer.h"
 
 /**
  * @brief Add GNSS data in Cayenne LPP standard format
@@ -43,23 +31,10 @@ uint8_t WisCayenne::addGNSS_4(uint8_t channel, int32_t latitude, int32_t longitu
 	_buffer[_cursor++] = channel;
 	_buffer[_cursor++] = LPP_GPS4;
 
-	latLong_s pos_union;
-
 	// Save default Cayenne LPP precision
-	pos_union.val32 = latitude / 1000; // Cayenne LPP 0.0001 ° Signed MSB
-	_buffer[_cursor++] = pos_union.val8[2];
-	_buffer[_cursor++] = pos_union.val8[1];
-	_buffer[_cursor++] = pos_union.val8[0];
-
-	pos_union.val32 = longitude / 1000; // Cayenne LPP 0.0001 ° Signed MSB
-	_buffer[_cursor++] = pos_union.val8[2];
-	_buffer[_cursor++] = pos_union.val8[1];
-	_buffer[_cursor++] = pos_union.val8[0];
-
-	pos_union.val32 = altitude / 10; // Cayenne LPP 0.01 meter Signed MSB
-	_buffer[_cursor++] = pos_union.val8[2];
-	_buffer[_cursor++] = pos_union.val8[1];
-	_buffer[_cursor++] = pos_union.val8[0];
+	_cursor += put_be_scaled<3, 1000>(&_buffer[_cursor], latitude);	 // Cayenne LPP 0.0001 ° Signed MSB
+	_cursor += put_be_scaled<3, 1000>(&_buffer[_cursor], longitude); // Cayenne LPP 0.0001 ° Signed MSB
+	_cursor += put_be_scaled<3, 10>(&_buffer[_cursor], altitude);	 // Cayenne LPP 0.01 meter Signed MSB
 
 	return _cursor;
 }
@@ -86,24 +61,9 @@ uint8_t WisCayenne::addGNSS_6(uint8_t channel, int32_t latitude, int32_t longitu
 	_buffer[_cursor++] = channel;
 	_buffer[_cursor++] = LPP_GPS6;
 
-	latLong_s pos_union;
-
-	pos_union.val32 = latitude / 10; // Custom 0.000001 ° Signed MSB
-	_buffer[_cursor++] = pos_union.val8[3];
-	_buffer[_cursor++] = pos_union.val8[2];
-	_buffer[_cursor++] = pos_union.val8[1];
-	_buffer[_cursor++] = pos_union.val8[0];
-
-	pos_union.val32 = longitude / 10; // Custom 0.000001 ° Signed MSB
-	_buffer[_cursor++] = pos_union.val8[3];
-	_buffer[_cursor++] = pos_union.val8[2];
-	_buffer[_cursor++] = pos_union.val8[1];
-	_buffer[_cursor++] = pos_union.val8[0];
-
-	pos_union.val32 = altitude / 10; // Cayenne LPP 0.01 meter Signed MSB
-	_buffer[_cursor++] = pos_union.val8[2];
-	_buffer[_cursor++] = pos_union.val8[1];
-	_buffer[_cursor++] = pos_union.val8[0];
+	_cursor += put_be_scaled<4, 10>(&_buffer[_cursor], latitude);	// Custom 0.000001 ° Signed MSB
+	_cursor += put_be_scaled<4, 10>(&_buffer[_cursor], longitude); // Custom 0.000001 ° Signed MSB
+	_cursor += put_be_scaled<3, 10>(&_buffer[_cursor], altitude);	// Cayenne LPP 0.01 meter Signed MSB
 
 	return _cursor;
 }
@@ -120,7 +80,7 @@ uint8_t WisCayenne::addGNSS_6(uint8_t channel, int32_t latitude, int32_t longitu
  * @return uint8_t bytes added to the data packet
  */
 
-uint8_t WisCayenne::addGNSS_H(int32_t latitude, int32_t longitude, int16_t altitude, uint16_t accuracy, uint16_t battery)
+uint8_t WisCayenne::addGNSS_H(int32_t latitude, int32_t longitude, int32_t altitude, uint16_t accuracy, uint16_t battery)
 {
 	// check buffer overflow
 	if ((_cursor + LPP_GPSH_SIZE) > _maxsize)
@@ -129,33 +89,11 @@ uint8_t WisCayenne::addGNSS_H(int32_t latitude, int32_t longitude, int16_t altit
 		return 0;
 	}
 
-	latLong_s pos_union;
-
-	pos_union.val32 = latitude / 100; // Custom 0.00001 ° Signed MSB
-	_buffer[_cursor++] = pos_union.val8[0];
-	_buffer[_cursor++] = pos_union.val8[1];
-	_buffer[_cursor++] = pos_union.val8[2];
-	_buffer[_cursor++] = pos_union.val8[3];
-
-	pos_union.val32 = longitude / 100; // Custom 0.00001 ° Signed MSB
-	_buffer[_cursor++] = pos_union.val8[0];
-	_buffer[_cursor++] = pos_union.val8[1];
-	_buffer[_cursor++] = pos_union.val8[2];
-	_buffer[_cursor++] = pos_union.val8[3];
-
-	pos_union.val32 = altitude / 1000;
-	_buffer[_cursor++] = pos_union.val8[0];
-	_buffer[_cursor++] = pos_union.val8[1];
-
-	pos_union.val32 = accuracy;
-	_buffer[_cursor++] = pos_union.val8[0];
-	_buffer[_cursor++] = pos_union.val8[1];
-
-	batt_s batt_level;
-
-	batt_level.batt16 = battery;
-	_buffer[_cursor++] = batt_level.batt8[1];
-	_buffer[_cursor++] = batt_level.batt8[0];
+	_cursor += put_le_scaled<4, 100>(&_buffer[_cursor], latitude);	// Custom 0.00001 ° Signed LSB
+	_cursor += put_le_scaled<4, 100>(&_buffer[_cursor], longitude); // Custom 0.00001 ° Signed LSB
+	_cursor += put_le_scaled<2, 1000>(&_buffer[_cursor], altitude); // 1 meter Signed LSB
+	_cursor += put_le<2>(&_buffer[_cursor], accuracy);
+	_cursor += put_be<2>(&_buffer[_cursor], battery);
 
 	return _cursor;
 }
@@ -15,13 +15,7 @@
 #include <ArduinoJson.h>
 #include <CayenneLPP.h>
 
-#define LPP_GPS4 136 // 3 byte lon/lat 0.0001 °, 3 bytes alt 0.01 meter (Cayenne LPP default)
-#define LPP_GPS6 137 // 4 byte lon/lat 0.000001 °, 3 bytes alt 0.01 meter (Customized Cayenne LPP)
-
-// Only Data Size
-#define LPP_GPS4_SIZE 9
-#define LPP_GPS6_SIZE 11
-#define LPP_GPSH_SIZE 14
+#include "lpp_schema.h"
 
 class WisCayenne : public CayenneLPP
 {
@@ -30,7 +24,27 @@ public:
 
 	uint8_t addGNSS_4(uint8_t channel, int32_t latitude, int32_t longitude, int32_t altitude);
 	uint8_t addGNSS_6(uint8_t channel, int32_t latitude, int32_t longitude, int32_t altitude);
-	uint8_t addGNSS_H(int32_t latitude, int32_t longitude, int16_t altitude, uint16_t accuracy, uint16_t battery);
+	uint8_t addGNSS_H(int32_t latitude, int32_t longitude, int32_t altitude, uint16_t accuracy, uint16_t battery);
+
+	/**
+	 * @brief Add a single value channel of lpp_schema.h
+	 *
+	 * @tparam CHANNEL LPP channel
+	 * @param value value in steps of the LPP type of the channel
+	 * @return uint8_t bytes added to the data packet
+	 */
+	template <uint8_t CHANNEL>
+	uint8_t addChannel(int32_t value)
+	{
+		// check buffer overflow
+		if ((_cursor + lpp_channel_size(CHANNEL)) > _maxsize)
+		{
+			_error = LPP_ERROR_OVERFLOW;
+			return 0;
+		}
+		_cursor += lpp_put<CHANNEL>(&_buffer[_cursor], value);
+		return _cursor;
+	}
 
 private:
 };
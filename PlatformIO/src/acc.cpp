@@ -15,6 +15,9 @@ void acc_int_callback(void);
 /** The LIS3DH sensor */
 LIS3DH acc_sensor(I2C_MODE, 0x18);
 
+/** Number of movement interrupts since the last GNSS fix */
+volatile uint16_t g_acc_events = 0;
+
 /**
  * @brief Initialize LIS3DH 3-axis 
  * acceleration sensor
@@ -128,6 +131,7 @@ void read_acc(void)
  */
 void acc_int_callback(void)
 {
+	g_acc_events++;
 	api_wake_loop(ACC_TRIGGER);
 }
 
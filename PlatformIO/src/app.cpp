@@ -12,30 +12,89 @@
  */
 
 #include "app.h"
+#include "field_writer.h"
 
 /** Set the device name, max length is 10 characters */
 char g_ble_dev_name[10] = "RAK-GNSS";
 
 /** Timer since last position message was sent */
 time_t last_pos_send = 0;
-/** Timer for delayed sending to keep duty cycle */
-SoftwareTimer delayed_sending;
 
-/** Battery level uinion */
-batt_s batt_level;
-
-/** Flag if delayed sending is already activated */
-bool delayed_active = false;
-
-/** Minimum delay between sending new locations, set to 45 seconds */
+/** Airtime used per sub-band in the last hour */
+DutyCycle g_duty_cycle;
+/** Size of the last uplink, used to estimate the airtime of the next one */
+uint8_t last_uplink_size = 0;
+/** Start time, data rate and airtime of the last uplink, to find the RX window of its downlink */
+uint32_t last_uplink_time = 0;
+uint8_t last_uplink_dr = 0;
+uint32_t last_uplink_toa = 0;
+/** Daily airtime allowance */
+AirtimeBudget g_airtime_budget;
+/** Degradation level of the current location */
+uint8_t g_budget_level = BUDGET_OK;
+/** Flag if the next location is triggered by motion */
+bool motion_uplink = false;
+/** Flag if the current location was triggered by motion */
+bool location_motion = false;
+
+/** Packets that could not be sent */
+UplinkQueue g_uplink_queue;
+/** Queue time at boot, the queue clock continues after the newest queued packet */
+uint32_t queue_time_base = 0;
+/** Queue priority of the packet that is sent, QUEUE_PRIO_NONE if it is not queued on failure */
+uint8_t uplink_priority = QUEUE_PRIO_NONE;
+/** Copy of the last uplink, queued if the confirmation fails */
+uint8_t last_uplink[QUEUE_MAX_DATA];
+uint8_t last_uplink_fport = 0;
+uint8_t last_uplink_priority = QUEUE_PRIO_NONE;
+/** Flag if the last uplink was taken from the queue */
+bool queue_sent = false;
+
+/** Deadlines of delayed jobs */
+Scheduler g_scheduler;
+/** Timer to wake up for the next job of the scheduler */
+SoftwareTimer sched_timer;
+
+/** Battery level in 0.01V */
+uint16_t batt_level = 0;
+
+/** Minimum delay between sending new locations in regions without duty cycle limit, set to 45 seconds */
 time_t min_delay = 45000;
 
 // Forward declaration
-void send_delayed(TimerHandle_t unused);
+void sched_wake(TimerHandle_t unused);
+time_t send_wait(void);
+void apply_link_control(void);
+bool spread_uplink(void);
+uint32_t join_airtime(uint8_t *datarate);
+bool downlink_datarate(uint8_t *datarate);
 void at_settings(void);
 
-/** Send Fail counter **/
-uint8_t send_fail = 0;
+/** Recovery after failed confirmed uplinks */
+LinkRecovery g_link_recovery;
+/** Number of resets by the link recovery */
+uint32_t g_recovery_resets = 0;
+
+/** Delays between failed joins */
+JoinBackoff g_join_backoff;
+
+/** Decides which uplinks are confirmed */
+ConfirmPolicy g_confirm_policy;
+/** Flag if the last uplink was sent confirmed */
+bool last_uplink_confirmed = false;
+
+/** Selects data rate and TX power from the link margin */
+LinkControl g_link_control;
+
+/** Delays of periodic uplinks, different on every device */
+UplinkSpread g_uplink_spread;
+/** Flag if the delay of the periodic uplink is over */
+bool spread_due = false;
+/** Flag if the STATUS event was raised by the SCHED_SEND job */
+bool send_due = false;
+/** P2P packet waiting for the slot */
+uint8_t slot_packet[LPP_BUFFER_SIZE];
+uint8_t slot_packet_size = 0;
 
 /** Flag for low battery protection */
 bool low_batt_protection = false;
@@ -59,7 +118,96 @@ bool has_env_sensor = false;
 bool battery_check_enabled = false;
 
 /** Packet buffer */
-WisCayenne g_data_packet(255);
+WisCayenne g_data_packet(LPP_BUFFER_SIZE);
+
+/** Position predictor, runs the same calculation as the backend */
+DeadReckoning g_dr_predictor;
+/** Allowed prediction error in meters, 0 disables dead reckoning */
+uint16_t g_dr_tolerance = 0;
+/** Max number of positions skipped in a row */
+uint8_t g_dr_max_skip = 10;
+/** Every Nth sent location is an anchor for the predictor */
+uint8_t g_dr_anchor_every = DR_ANCHOR_EVERY;
+/** Number of positions skipped in a row */
+uint8_t pos_skipped = 0;
+/** Anchor location of the last uplink, fed to the predictor when its confirmation arrives */
+int32_t dr_pending_lat;
+int32_t dr_pending_lon;
+uint32_t dr_pending_time;
+bool dr_pending = false;
+
+/** Geofence zones */
+Geofence g_geofence;
+/** Zones the tracker was in at the last location */
+uint32_t g_zone_mask = 0;
+/** Flag if the zones of the last location are known */
+bool zone_mask_valid = false;
+
+/** Recently mapped cells in Helium Mapper format */
+HexCellCache g_hex_cache;
+/** Edge length of the mapper cells in meters, 0 sends every location */
+uint16_t g_hex_edge = 0;
+/** Time in minutes after which a mapped cell is mapped again */
+uint16_t g_hex_stale = 60;
+/** Number of cells added since the cells were saved */
+uint8_t hex_unsaved = 0;
+/** Save the mapped cells after this number of new cells */
+#define HEX_SAVE_COUNT 8
+
+/** Downlink RSSI and SNR per cell */
+LinkMap g_link_map;
+/** Number of cells after which the link quality is sent, 0 disables the link map */
+uint8_t g_link_batch = 0;
+/** Cell of the last sent location */
+uint64_t link_cell = 0;
+/** Flag if link_cell is valid */
+bool link_cell_valid = false;
+/** Flag if the last packet was a link quality packet */
+bool link_map_sent = false;
+/** Cell edge length in meters for the link map if no mapper cells are set */
+#define LINK_MAP_EDGE 460
+/** Max size of a link quality packet */
+#define LINK_MAP_MAX_SIZE 242
+
+/** LPP channels in order of priority if the packet does not fit, the location is mandatory */
+const uint8_t lpp_priority[] = {LPP_CHANNEL_GPS, LPP_CHANNEL_TIME, LPP_CHANNEL_ZONES, LPP_CHANNEL_BATT};
+/** Fields that did not fit into the last packet */
+uint8_t deferred_packet[LPP_BUFFER_SIZE];
+/** Size of the deferred fields */
+uint8_t deferred_size = 0;
+
+/** Flag if packets too big for the current DR are sent in fragments instead of being split */
+bool g_frag_enabled = false;
+/** Fragments of the current packet */
+Fragmenter fragmenter;
+/** Time to wait before a fragment is retried */
+#define FRAG_RETRY_TIME 10000
+
+/** Number of locations sent in one batch frame, 0 sends every location in its own packet */
+uint8_t g_batch_size = 0;
+/** Buffered locations, oldest first */
+pos_point_s batch_fixes[BATCH_MAX_FIXES];
+/** Number of buffered locations */
+uint8_t batch_count = 0;
+/** Max size of a batch frame */
+#define BATCH_MAX_SIZE 242
+
+// Forward declaration
+bool check_geofence(void);
+bool skip_position(void);
+void position_sent(void);
+void record_link_quality(void);
+void send_link_map(void);
+bool batch_location(bool *frame_sent);
+lmh_error_status send_planned(void);
+bool send_deferred(void);
+bool send_queued(void);
+void run_recovery(uint8_t action);
+void start_gnss_task(void);
+void queue_packet(uint8_t *data, uint8_t size, uint8_t fport, uint8_t priority);
+lmh_error_status send_fragment(void);
+lmh_error_status send_batch(void);
+uint8_t batch_size(void);
 
 /**
  * @brief Application specific setup functions
@@ -69,6 +217,9 @@ void setup_app(void)
 {
 	// Enable BLE
 	g_enable_ble = true;
+
+	// The join is started in init_app(), after the saved session was checked
+	session_setup();
 }
 
 /**
@@ -104,6 +255,34 @@ bool init_app(void)
 	// Get precision settings
 	read_gps_settings();
 
+	// Get dead reckoning settings
+	read_dr_settings();
+
+	// Get geofence zones
+	read_geofence_settings();
+
+	// Get Helium Mapper cell settings and mapped cells
+	read_hex_settings();
+	read_link_settings();
+	read_batch_settings();
+	read_frag_settings();
+	read_env_settings();
+	read_budget_settings();
+	read_recovery_settings();
+	// Random join delays are different on every device
+	g_join_backoff.begin(get_be<4>(&g_lorawan_settings.node_device_eui[4]) ^ millis());
+	read_join_settings();
+	read_confirm_settings();
+	read_linkctl_settings();
+	init_link_control();
+	// Jitter and slot are selected from the DevEUI
+	g_uplink_spread.begin(spread_seed(g_lorawan_settings.node_device_eui));
+	read_spread_settings();
+
+	// Restore the packets that could not be sent before the reset
+	init_uplink_queue();
+	queue_time_base = g_uplink_queue.lastTime() + 1;
+
 	AT_PRINTF("============================\n");
 	if (g_is_helium)
 	{
@@ -135,19 +314,26 @@ bool init_app(void)
 	// If P2P mode GNSS task needs to be started here
 	if (!g_lorawan_settings.lorawan_enable)
 	{
-		// Prepare GNSS task
-		// Create the GNSS event semaphore
-		g_gnss_sem = xSemaphoreCreateBinary();
-		// Initialize semaphore
-		xSemaphoreGive(g_gnss_sem);
-		// Take semaphore
-		xSemaphoreTake(g_gnss_sem, 10);
-		if (!xTaskCreate(gnss_task, "LORA", 4096, NULL, TASK_PRIO_LOW, &gnss_task_handle))
+		start_gnss_task();
+		g_lpwan_has_joined = true;
+	}
+	else if (g_session_auto_join)
+	{
+		g_lorawan_settings.auto_join = true;
+		// With a saved session the tracker sends without a join
+		if (restore_session())
 		{
-			MYLOG("APP", "Failed to start GNSS task");
+			AT_PRINTF("+EVT:SESSION RESTORED\n");
+			start_gnss_task();
+		}
+		else
+		{
+			// Start the stack and join the same way the WisBlock API does with auto join
+			init_lorawan();
+			uint8_t datarate;
+			uint32_t toa = join_airtime(&datarate);
+			g_join_backoff.started(millis(), toa, datarate);
 		}
-		last_pos_send = millis();
-		g_lpwan_has_joined = true;
 	}
 
 	// Initialize ACC sensor
@@ -167,8 +353,24 @@ bool init_app(void)
 		min_delay = 30000;
 	}
 
-	// Set delayed sending to 1/2 of programmed send interval or 30 seconds
-	delayed_sending.begin(min_delay, send_delayed, NULL, false);
+	// Start counting the airtime
+	g_duty_cycle.begin(g_lorawan_settings.lora_region, millis());
+
+	// Single timer for all delayed jobs and the periodic sending, restarted for the next deadline.
+	// A join must wait for the duty cycle, it is not merged into earlier jobs.
+	g_scheduler.setMergeWindow(SCHED_MERGE_WINDOW);
+	g_scheduler.setExact(SCHED_BIT(SCHED_JOIN));
+	sched_timer.begin(SCHED_MERGE_WINDOW, sched_wake, NULL, false);
+	if (g_airtime_budget.daily() != 0)
+	{
+		g_scheduler.in(SCHED_BUDGET, millis(), BUDGET_SAVE_TIME);
+		sched_update();
+	}
+	// In LoRa P2P mode or with a restored session the tracker sends without a join
+	if (!g_lorawan_settings.lorawan_enable || g_session_restored)
+	{
+		send_schedule();
+	}
 
 	AT_PRINTF("============================\n");
 	AT_PRINTF("GNSS Precision:\n");
@@ -233,6 +435,31 @@ bool init_app(void)
  */
 void app_event_handler(void)
 {
+	// The periodic sending runs as SCHED_SEND job. The API timer is started again
+	// on a join or with AT+SENDFREQ, its wakeup moves the periodic sending back to the scheduler.
+	if ((g_task_event_type & STATUS) == STATUS)
+	{
+		if (!send_due && !motion_uplink && !spread_due)
+		{
+			api_timer_stop();
+			if (g_scheduler.pending(SCHED_SEND))
+			{
+				g_task_event_type &= N_STATUS;
+			}
+			else
+			{
+				send_schedule();
+			}
+		}
+		send_due = false;
+	}
+
+	// Periodic locations are spread, the reading starts when the delay is over
+	if (((g_task_event_type & STATUS) == STATUS) && spread_uplink())
+	{
+		g_task_event_type &= N_STATUS;
+	}
+
 	// Timer triggered event
 	if ((g_task_event_type & STATUS) == STATUS)
 	{
@@ -251,7 +478,17 @@ void app_event_handler(void)
 			restart_advertising(15);
 		}
 
-		if (!low_batt_protection)
+		// Periodic locations are skipped if the airtime budget is almost used up
+		g_budget_level = g_airtime_budget.level(millis(), motion_uplink);
+		bool stretched = (g_budget_level == BUDGET_STRETCH) && !motion_uplink;
+		location_motion = motion_uplink;
+		motion_uplink = false;
+		if (stretched)
+		{
+			MYLOG("APP", "Airtime budget low, periodic location skipped");
+		}
+
+		if (!low_batt_protection && !stretched)
 		{
 			if (init_result)
 			{
@@ -269,27 +506,27 @@ void app_event_handler(void)
 		}
 
 		// Get battery level
-		batt_level.batt16 = read_batt() / 10;
+		batt_level = read_batt() / 10;
 		if (!g_is_helium)
 		{
-			g_data_packet.addVoltage(LPP_CHANNEL_BATT, read_batt() / 1000);
+			g_data_packet.addChannel<LPP_CHANNEL_BATT>((int32_t)(read_batt() / 10));
 		}
 
 		// Protection against battery drain if battery check is enabled
 		if (battery_check_enabled)
 		{
-			if (batt_level.batt16 < 290)
+			if (batt_level < 290)
 			{
 				// Battery is very low, change send time to 1 hour to protect battery
-				low_batt_protection = true;			   // Set low_batt_protection active
-				api_timer_restart(1 * 60 * 60 * 1000); // Set send time to one hour
+				low_batt_protection = true; // Set low_batt_protection active
+				send_schedule();			// Set send time to one hour
 				MYLOG("APP", "Battery protection activated");
 			}
-			else if ((batt_level.batt16 > 410) && low_batt_protection)
+			else if ((batt_level > 410) && low_batt_protection)
 			{
 				// Battery is higher than 4V, change send time back to original setting
 				low_batt_protection = false;
-				api_timer_restart(g_lorawan_settings.send_repeat_time); // Set send time to original setting
+				send_schedule(); // Set send time to original setting
 				MYLOG("APP", "Battery protection deactivated");
 			}
 }
@@ -300,7 +537,7 @@ void app_event_handler(void)
 				if (g_lorawan_settings.lorawan_enable)
 				{
 					// Send only the battery level over LoRaWAN
-					lmh_error_status result = send_lora_packet(g_data_packet.getBuffer(), g_data_packet.getSize());
+					lmh_error_status result = send_uplink(g_data_packet.getBuffer(), g_data_packet.getSize());
 					switch (result)
 					{
 					case LMH_SUCCESS:
@@ -344,21 +581,15 @@ void app_event_handler(void)
 		bool send_now = true;
 		if (g_lorawan_settings.send_repeat_time != 0)
 		{
-			if ((millis() - last_pos_send) < min_delay)
+			time_t wait_time = send_wait();
+			if (wait_time != 0)
 			{
 				send_now = false;
-				if (!delayed_active)
+				if (!g_scheduler.pending(SCHED_POSITION))
 				{
-					delayed_sending.stop();
-					MYLOG("APP", "Expired time %d", (int)(millis() - last_pos_send));
-					MYLOG("APP", "Max delay time %d", (int)min_delay);
-					time_t wait_time = abs(min_delay - (millis() - last_pos_send) >= 0) ? (min_delay - (millis() - last_pos_send)) : min_delay;
-					MYLOG("APP", "Wait time %ld", (long)wait_time);
-
 					MYLOG("APP", "Only %lds since last position message, send delayed in %lds", (long)((millis() - last_pos_send) / 1000), (long)(wait_time / 1000));
-					delayed_sending.setPeriod(wait_time);
-					delayed_sending.start();
-					delayed_active = true;
+					g_scheduler.in(SCHED_POSITION, millis(), wait_time);
+					sched_update();
 				}
 			}
 		}
@@ -366,16 +597,14 @@ void app_event_handler(void)
 		{
 			// Remember last send time
 			last_pos_send = millis();
+			motion_uplink = true;
 
 			// Trigger a GNSS reading and packet sending
 			g_task_event_type |= STATUS;
 		}
 
-		// Reset the standard timer
-		if (g_lorawan_settings.send_repeat_time != 0)
-		{
-			api_timer_restart(g_lorawan_settings.send_repeat_time);
-		}
+		// Reset the periodic sending
+		send_schedule();
 	}
 
 	// GNSS location search finished
@@ -383,13 +612,48 @@ void app_event_handler(void)
 	{
 		g_task_event_type &= N_GNSS_FIN;
 
+		// Zone changes are sent immediately, otherwise check if the location can be skipped
+		bool zone_changed = check_geofence();
+		if (!zone_changed && skip_position())
+		{
+			MYLOG("APP", "Position skipped %d", pos_skipped);
+			last_pos_send = millis();
+			g_scheduler.cancel(SCHED_POSITION);
+			g_data_packet.reset();
+			return;
+		}
+
+		// In batch mode the location is buffered and sent with the next batch frame
+		bool frame_sent = false;
+		if (!zone_changed && batch_location(&frame_sent))
+		{
+			if (frame_sent)
+			{
+				// Battery and environment values follow the batch frame in their own packet
+				read_bme();
+				memcpy(deferred_packet, g_data_packet.getBuffer(), g_data_packet.getSize());
+				deferred_size = g_data_packet.getSize();
+			}
+			last_pos_send = millis();
+			g_scheduler.cancel(SCHED_POSITION);
+			g_data_packet.reset();
+			return;
+		}
+
+		// Anchors carry the time of the fix, the backend feeds its predictor with them.
+		// An uplink that the policy confirms anyway is used as anchor too.
+		if ((g_dr_tolerance != 0) && last_read_ok && !g_is_helium && g_lorawan_settings.lorawan_enable &&
+			(g_dr_predictor.anchorDue(g_dr_anchor_every) || g_confirm_policy.confirm(g_lorawan_settings.confirmed_msg_enabled)))
+		{
+			g_data_packet.addChannel<LPP_CHANNEL_TIME>(g_last_fix.time);
+		}
+
 		// Get Environment data
 		read_bme();
 
-		// Remember last time sending
+		// Remember last time sending, a delayed position is not needed anymore
 		last_pos_send = millis();
-		// Just in case
-		delayed_active = false;
+		g_scheduler.cancel(SCHED_POSITION);
 
 #if MY_DEBUG == 1
 		uint8_t *packet_buff = g_data_packet.getBuffer();
@@ -403,54 +667,68 @@ void app_event_handler(void)
 
 		if (g_lorawan_settings.lorawan_enable)
 		{
-			// Check payload size
-			if (g_lorawan_settings.lora_region == 8)
+			// Zone changes are alarms, they are sent first from the queue
+			uint8_t priority = zone_changed ? QUEUE_PRIO_ALARM : (location_motion ? QUEUE_PRIO_MOTION : QUEUE_PRIO_PERIODIC);
+
+			// Send packet over LoRaWAN, retry once if the max payload changed
+			uplink_priority = priority;
+			lmh_error_status result = send_planned();
+			if (result == LMH_ERROR)
 			{
-				if (g_lorawan_settings.data_rate == 0)
-				{
-					AT_PRINTF("+EVT:DR_ERROR\n");
-					return;
-				}
+				AT_PRINTF("+EVT:SIZE_ERROR RETRY\n");
+				result = send_planned();
 			}
-
-			// Send packet over LoRaWAN
-			lmh_error_status result;
-			result = send_lora_packet(g_data_packet.getBuffer(), g_data_packet.getSize());
+			uplink_priority = QUEUE_PRIO_NONE;
 			switch (result)
 			{
 			case LMH_SUCCESS:
 				MYLOG("APP", "Packet enqueued");
+				position_sent();
 				break;
 			case LMH_BUSY:
 				AT_PRINTF("+EVT:BUSY\n");
 				MYLOG("APP", "LoRa transceiver is busy");
+				// A fragmented packet is retried by SCHED_FRAG, queueing it would send it twice
+				if (!fragmenter.pending())
+				{
+					queue_packet(g_data_packet.getBuffer(), g_data_packet.getSize(), g_lorawan_settings.app_port, priority);
+				}
 				break;
 			case LMH_ERROR:
-				result = send_lora_packet(g_data_packet.getBuffer(), g_data_packet.getSize());
-				switch (result)
+				AT_PRINTF("+EVT:SIZE_ERROR\n");
+				MYLOG("APP", "Packet error, too big to send with current DR");
+				if (!fragmenter.pending())
 				{
-				case LMH_SUCCESS:
-					MYLOG("APP", "Packet enqueued");
-					break;
-				case LMH_BUSY:
-					AT_PRINTF("+EVT:BUSY\n");
-					MYLOG("APP", "LoRa transceiver is busy");
-					break;
-				case LMH_ERROR:
-					AT_PRINTF("+EVT:SIZE_ERROR RETRY\n");
-					result = send_lora_packet(g_data_packet.getBuffer(), g_data_packet.getSize());
-					AT_PRINTF("+EVT:SIZE_ERROR\n");
-					MYLOG("APP", "Packet error, too big to send with current DR");
+					queue_packet(g_data_packet.getBuffer(), g_data_packet.getSize(), g_lorawan_settings.app_port, priority);
 				}
 				break;
 			}
 		}
 		else
 		{
+			// In the slotted schedule the packet waits for the slot of the device
+			uint32_t time_of_day;
+			uint32_t slot_wait = 0;
+			if (g_uplink_spread.slotted() && gnss_time_of_day(&time_of_day))
+			{
+				slot_wait = g_uplink_spread.slotWait(time_of_day);
+			}
+			if (slot_wait != 0)
+			{
+				// A newer location replaces a waiting one
+				MYLOG("APP", "Packet waits %ldms for slot %d", (long)slot_wait, g_uplink_spread.slot());
+				memcpy(slot_packet, g_data_packet.getBuffer(), g_data_packet.getSize());
+				slot_packet_size = g_data_packet.getSize();
+				g_scheduler.in(SCHED_SLOT, millis(), slot_wait);
+				sched_update();
+				position_sent();
+			}
 			// Send packet over LoRa
-			if (send_p2p_packet(g_data_packet.getBuffer(), g_data_packet.getSize()))
+			else if (send_p2p_packet(g_data_packet.getBuffer(), g_data_packet.getSize()))
 			{
 				MYLOG("APP", "Packet enqueued");
+				env_sent(g_data_packet.getBuffer(), g_data_packet.getSize());
+				position_sent();
 			}
 			else
 			{
@@ -497,30 +775,46 @@ void lora_data_handler(void)
 	if ((g_task_event_type & LORA_JOIN_FIN) == LORA_JOIN_FIN)
 	{
 		g_task_event_type &= N_LORA_JOIN_FIN;
-		if (g_join_result)
+		if (g_session_restored)
+		{
+			// The stack was started with the restored session, no join was sent
+			MYLOG("APP", "Restored session active");
+			send_schedule();
+		}
+		else if (g_join_result)
 		{
 			MYLOG("APP", "Successfully joined network");
 			AT_PRINTF("+EVT:JOINED\n");
 
-			// Prepare GNSS task
-			// Create the GNSS event semaphore
-			g_gnss_sem = xSemaphoreCreateBinary();
-			// Initialize semaphore
-			xSemaphoreGive(g_gnss_sem);
-			// Take semaphore
-			xSemaphoreTake(g_gnss_sem, 10);
-			if (!xTaskCreate(gnss_task, "LORA", 4096, NULL, TASK_PRIO_LOW, &gnss_task_handle))
-			{
-				MYLOG("APP", "Failed to start GNSS task");
-			}
-			last_pos_send = millis();
+			g_link_recovery.success(millis());
+			g_join_backoff.joined();
+			g_scheduler.cancel(SCHED_JOIN);
+			// The join may have used a lower data rate
+			lmh_datarate_set(g_lorawan_settings.data_rate, g_lorawan_settings.adr_enabled);
+			g_link_control.reset(g_lorawan_settings.data_rate, 0);
+			g_session_restored = false;
+			save_session();
+
+			// The GNSS task is already running after a rejoin
+			start_gnss_task();
+			send_schedule();
 		}
 		else
 		{
 			MYLOG("APP", "Join network failed");
 			AT_PRINTF("+EVT:JOIN FAILED\n");
-			/// \todo here join could be restarted.
-			lmh_join();
+			// Join again after the backoff, a failed rejoin of the link recovery ends with a reset
+			if (g_link_recovery.joinFailed(millis()) == RECOVERY_RESET)
+			{
+				run_recovery(RECOVERY_RESET);
+			}
+			else
+			{
+				uint32_t wait_time = g_join_backoff.failed(millis());
+				MYLOG("APP", "Join again in %lds", (long)(wait_time / 1000));
+				g_scheduler.in(SCHED_JOIN, millis(), wait_time);
+				sched_update();
+			}
 		}
 	}
 
@@ -531,7 +825,7 @@ void lora_data_handler(void)
 
 		MYLOG("APP", "LPWAN TX cycle %s", g_rx_fin_result ? "finished ACK" : "failed NAK");
 
-		if ((g_lorawan_settings.confirmed_msg_enabled) && (g_lorawan_settings.lorawan_enable))
+		if ((last_uplink_confirmed) && (g_lorawan_settings.lorawan_enable))
 		{
 			AT_PRINTF("+EVT:SEND CONFIRMED %s\n", g_rx_fin_result ? "SUCCESS" : "FAIL");
 		}
@@ -540,18 +834,58 @@ void lora_data_handler(void)
 			AT_PRINTF("+EVT:SEND OK\n");
 		}
 
-		if (!g_rx_fin_result)
+		if (queue_sent)
+		{
+			// A queued packet is removed only when its ACK was received
+			if (g_rx_fin_result && last_uplink_confirmed)
+			{
+				g_uplink_queue.pop();
+			}
+			queue_sent = false;
+		}
+		else if (!g_rx_fin_result && last_uplink_confirmed && (last_uplink_priority != QUEUE_PRIO_NONE))
 		{
-			// Increase fail send counter
-			send_fail++;
+			// Confirmation failed, keep the packet for later
+			queue_packet(last_uplink, last_uplink_size, last_uplink_fport, last_uplink_priority);
+		}
 
-			if (send_fail == 10)
+		// Only a confirmed uplink shows if the link works
+		if (g_lorawan_settings.lorawan_enable && last_uplink_confirmed)
+		{
+			if (dr_pending && g_rx_fin_result)
+			{
+				// The backend has the location, both predictors use it now
+				g_dr_predictor.addSent(dr_pending_lat, dr_pending_lon, dr_pending_time);
+			}
+			dr_pending = false;
+			g_confirm_policy.acked(g_rx_fin_result);
+			if (g_link_control.acked(g_rx_fin_result))
+			{
+				// Missed ACKs, back to the most robust settings
+				apply_link_control();
+			}
+			if (g_rx_fin_result)
+			{
+				g_link_recovery.success(millis());
+			}
+			else
 			{
-				// Too many failed sendings, reset node and try to rejoin
-				delay(100);
-				sd_nvic_SystemReset();
+				// Too many failed sendings, try to recover the link
+				uint8_t datarate = current_datarate();
+				bool lowest = (datarate == 0) || (plan_max_payload(g_lorawan_settings.lora_region, datarate - 1) == 0);
+				run_recovery(g_link_recovery.failed(millis(), lowest));
 			}
 		}
+
+		// Radio is free, send the next fragment, the deferred fields, a queued packet or the link quality if it is due
+		if (fragmenter.pending())
+		{
+			send_fragment();
+		}
+		else if (!send_deferred() && !send_queued())
+		{
+			send_link_map();
+		}
 	}
 
 	// LoRa data handling
@@ -566,6 +900,12 @@ void lora_data_handler(void)
 		g_task_event_type &= N_LORA_DATA;
 		MYLOG("APP", "Received package over LoRa");
 
+		// A downlink shows the link works
+		if (g_lorawan_settings.lorawan_enable)
+		{
+			g_link_recovery.success(millis());
+		}
+
 		if (g_lorawan_settings.lorawan_enable)
 		{
 			AT_PRINTF("+EVT:RX_1, RSSI %d, SNR %d\n", g_last_rssi, g_last_snr);
@@ -575,6 +915,20 @@ void lora_data_handler(void)
 				AT_PRINTF("%02X", g_rx_lora_data[idx]);
 			}
 			AT_PRINTF("\n");
+
+			record_link_quality();
+
+			// SNR margin of the downlink decides if the next uplinks are confirmed and their data rate,
+			// only downlinks with a known data rate count
+			uint8_t datarate;
+			uint8_t sf;
+			uint16_t bw_khz;
+			if (downlink_datarate(&datarate) && airtime_dr_params(g_lorawan_settings.lora_region, datarate, &sf, &bw_khz))
+			{
+				int8_t margin = g_last_snr - confirm_snr_floor(sf);
+				g_confirm_policy.downlink(margin);
+				g_link_control.sample(margin);
+			}
 		}
 		else
 		{
@@ -597,16 +951,986 @@ void lora_data_handler(void)
 
 		MYLOG("APP", "%s", log_buff);
 	}
+
+	// Delayed jobs are due
+	if ((g_task_event_type & SCHED_DUE) == SCHED_DUE)
+	{
+		g_task_event_type &= N_SCHED_DUE;
+		uint32_t jobs = g_scheduler.due(millis());
+		MYLOG("APP", "Scheduled jobs %04lX", (unsigned long)jobs);
+		if ((jobs & SCHED_BIT(SCHED_FRAG)) && fragmenter.pending())
+		{
+			send_fragment();
+		}
+		if (jobs & SCHED_BIT(SCHED_POSITION))
+		{
+			// Trigger a GNSS reading and packet sending
+			motion_uplink = true;
+			g_task_event_type |= STATUS;
+		}
+		if (jobs & SCHED_BIT(SCHED_SEND))
+		{
+			// Periodic location, the next one is scheduled from now
+			send_due = true;
+			g_task_event_type |= STATUS;
+			send_schedule();
+		}
+		if (jobs & SCHED_BIT(SCHED_BUDGET))
+		{
+			save_budget_settings();
+			g_scheduler.in(SCHED_BUDGET, millis(), BUDGET_SAVE_TIME);
+		}
+		if ((jobs & SCHED_BIT(SCHED_JOIN)) && !g_lpwan_has_joined)
+		{
+			start_join();
+		}
+		if (jobs & SCHED_BIT(SCHED_SPREAD))
+		{
+			// Start the delayed periodic location
+			spread_due = true;
+			g_task_event_type |= STATUS;
+		}
+		if ((jobs & SCHED_BIT(SCHED_SLOT)) && (slot_packet_size != 0))
+		{
+			// Merged jobs run up to the merge window early, wait for the slot
+			uint32_t time_of_day;
+			uint32_t slot_wait = 0;
+			if (gnss_time_of_day(&time_of_day))
+			{
+				slot_wait = g_uplink_spread.slotWait(time_of_day);
+			}
+			if ((slot_wait != 0) && (slot_wait <= SCHED_MERGE_WINDOW))
+			{
+				g_scheduler.in(SCHED_SLOT, millis(), slot_wait);
+			}
+			else
+			{
+				if (send_p2p_packet(slot_packet, slot_packet_size))
+				{
+					env_sent(slot_packet, slot_packet_size);
+				}
+				else
+				{
+					AT_PRINTF("+EVT:SIZE_ERROR\n");
+				}
+				slot_packet_size = 0;
+			}
+		}
+		sched_update();
+	}
+}
+
+/**
+ * @brief Restart the scheduler timer for the next deadline
+ *        Must be called after a job was added to g_scheduler.
+ *
+ */
+void sched_update(void)
+{
+	sched_timer.stop();
+	uint32_t wait_time;
+	if (g_scheduler.nextWake(millis(), &wait_time))
+	{
+		// The timer cannot be started with 0
+		sched_timer.setPeriod(wait_time == 0 ? 1 : wait_time);
+		sched_timer.start();
+	}
+}
+
+/**
+ * @brief Schedule the next periodic location
+ *        Replaces the API timer, so the periodic sending merges with the other jobs.
+ *        The API timer is stopped, it is started by the WisBlock API on a join.
+ *
+ */
+void send_schedule(void)
+{
+	api_timer_stop();
+	if (g_lorawan_settings.send_repeat_time == 0)
+	{
+		g_scheduler.cancel(SCHED_SEND);
+	}
+	else
+	{
+		// Low battery protection sends only once per hour
+		g_scheduler.in(SCHED_SEND, millis(), low_batt_protection ? 1 * 60 * 60 * 1000 : g_lorawan_settings.send_repeat_time);
+	}
+	sched_update();
 }
 
 /**
- * @brief Timer function used to avoid sending packages too often.
- * 			Delays the next package by 10 seconds
+ * @brief Timer function to run the scheduled jobs
  *
  * @param unused
  * 			Timer handle, not used
  */
-void send_delayed(TimerHandle_t unused)
+void sched_wake(TimerHandle_t unused)
+{
+	api_wake_loop(SCHED_DUE);
+}
+
+/**
+ * @brief Check the new location against the geofence zones
+ *        Adds the zones to the data packet if they changed
+ *
+ * @return true if the tracker entered or left a zone
+ * @return false if the zones are unchanged
+ */
+bool check_geofence(void)
+{
+	if (g_is_helium || !last_read_ok || (g_geofence.zones() == 0))
+	{
+		return false;
+	}
+
+	uint32_t new_mask = g_geofence.check(g_last_fix.latitude, g_last_fix.longitude);
+	bool zone_changed = zone_mask_valid && (new_mask != g_zone_mask);
+	g_zone_mask = new_mask;
+	zone_mask_valid = true;
+
+	if (zone_changed)
+	{
+		AT_PRINTF("+EVT:ZONE %08lX\n", (unsigned long)new_mask);
+		g_data_packet.addChannel<LPP_CHANNEL_ZONES>(new_mask);
+	}
+	return zone_changed;
+}
+
+/**
+ * @brief Check if the new location can be skipped
+ *        In Helium Mapper format, locations in recently mapped cells are skipped.
+ *        Inside home zones routine reports are skipped.
+ *        Outside, the location is skipped if the backend can predict it.
+ *        After g_dr_max_skip skipped locations one is sent anyway.
+ *
+ * @return true if the location can be skipped
+ * @return false if the location has to be sent
+ */
+bool skip_position(void)
+{
+	if (!last_read_ok)
+	{
+		return false;
+	}
+
+	if (g_is_helium)
+	{
+		// Cells are saved with the GNSS time, so the time the device was off is counted
+		uint32_t now;
+		if ((g_hex_edge == 0) || !gnss_utc_time(&now))
+		{
+			return false;
+		}
+		uint64_t cell = hex_cell(g_last_fix.latitude, g_last_fix.longitude, g_hex_edge);
+		if (!g_hex_cache.isFresh(cell, now, (uint32_t)g_hex_stale * 60))
+		{
+			return false;
+		}
+		AT_PRINTF("+EVT:CELL MAPPED\n");
+		return true;
+	}
+
+	if (pos_skipped >= g_dr_max_skip)
+	{
+		return false;
+	}
+
+	if ((g_zone_mask & g_geofence.homeMask()) != 0)
+	{
+		AT_PRINTF("+EVT:HOME\n");
+		pos_skipped++;
+		return true;
+	}
+
+	// Without confirmations in LoRa P2P the predictor is never fed
+	if ((g_dr_tolerance == 0) || !g_lorawan_settings.lorawan_enable)
+	{
+		return false;
+	}
+
+	uint32_t dr_error = g_dr_predictor.error(g_last_fix.latitude, g_last_fix.longitude, g_last_fix.time);
+	MYLOG("APP", "Prediction error %lum", (unsigned long)dr_error);
+
+	if (dr_error > g_dr_tolerance)
+	{
+		return false;
+	}
+	AT_PRINTF("+EVT:PREDICTED\n");
+	pos_skipped++;
+	return true;
+}
+/**
+ * @brief Remember a sent location
+ *        The predictor is fed when the confirmation of the location arrives.
+ *        In Helium Mapper format the cell of the location is marked as mapped.
+ *
+ */
+void position_sent(void)
+{
+	if (!last_read_ok)
+	{
+		link_cell_valid = false;
+		return;
+	}
+
+	if (g_link_batch != 0)
+	{
+		link_cell = hex_cell(g_last_fix.latitude, g_last_fix.longitude, g_hex_edge != 0 ? g_hex_edge : LINK_MAP_EDGE);
+		link_cell_valid = true;
+	}
+
+	if (g_is_helium)
+	{
+		uint32_t now;
+		if ((g_hex_edge != 0) && gnss_utc_time(&now))
+		{
+			g_hex_cache.add(hex_cell(g_last_fix.latitude, g_last_fix.longitude, g_hex_edge), now);
+			hex_unsaved++;
+			if (hex_unsaved >= HEX_SAVE_COUNT)
+			{
+				// Limit flash writes
+				save_hex_cells();
+				hex_unsaved = 0;
+			}
+		}
+		return;
+	}
+
+	pos_skipped = 0;
+	if ((g_dr_tolerance != 0) && g_lorawan_settings.lorawan_enable)
+	{
+		g_dr_predictor.sent();
+	}
+}
+
+/**
+ * @brief Add the RSSI and SNR of a downlink to the cell
+ *        the last location was sent from
+ *
+ */
+void record_link_quality(void)
 {
-	api_wake_loop(STATUS);
+	if ((g_link_batch == 0) || !link_cell_valid)
+	{
+		return;
+	}
+	if (!g_link_map.add(link_cell, g_last_rssi, g_last_snr))
+	{
+		MYLOG("APP", "Link map full or cell out of range");
+	}
+}
+
+/**
+ * @brief Send the link quality of the cells if enough cells are collected
+ *        Only one link quality packet is sent after each location packet
+ *
+ */
+void send_link_map(void)
+{
+	if (link_map_sent)
+	{
+		link_map_sent = false;
+		return;
+	}
+	if ((g_link_batch == 0) || !g_lorawan_settings.lorawan_enable)
+	{
+		return;
+	}
+
+	// A packet that could not be sent is kept for the next try
+	static uint8_t link_packet[LINK_MAP_MAX_SIZE];
+	static uint8_t link_packet_size = 0;
+	if (link_packet_size == 0)
+	{
+		if (g_link_map.count() < g_link_batch)
+		{
+			return;
+		}
+		uint8_t max_size = max_payload();
+		link_packet_size = g_link_map.pack(link_packet, max_size < LINK_MAP_MAX_SIZE ? max_size : LINK_MAP_MAX_SIZE, g_hex_edge != 0 ? g_hex_edge : LINK_MAP_EDGE);
+		if (link_packet_size == 0)
+		{
+			// Not even one cell fits with the current DR
+			return;
+		}
+	}
+	switch (send_uplink(link_packet, link_packet_size, FPORT_LINK_MAP))
+	{
+	case LMH_SUCCESS:
+		MYLOG("APP", "Link map enqueued");
+		link_packet_size = 0;
+		link_map_sent = true;
+		break;
+	case LMH_BUSY:
+		break;
+	case LMH_ERROR:
+		MYLOG("APP", "Link map too big for current DR, dropped");
+		link_packet_size = 0;
+		break;
+	}
+}
+
+/**
+ * @brief Buffer the location for a batch frame
+ *        Sends the batch frame when enough locations are buffered
+ *
+ * @param frame_sent set to true if a batch frame was enqueued
+ * @return true if the location was buffered
+ * @return false if batch mode is off
+ */
+bool batch_location(bool *frame_sent)
+{
+	uint8_t size = batch_size();
+	if ((size == 0) || g_is_helium || !g_lorawan_settings.lorawan_enable || !last_read_ok)
+	{
+		return false;
+	}
+
+	if (batch_count == BATCH_MAX_FIXES)
+	{
+		// Buffer full, drop the oldest location
+		for (uint8_t idx = 1; idx < batch_count; idx++)
+		{
+			batch_fixes[idx - 1] = batch_fixes[idx];
+		}
+		batch_count--;
+	}
+	batch_fixes[batch_count].latitude = g_last_fix.latitude;
+	batch_fixes[batch_count].longitude = g_last_fix.longitude;
+	batch_fixes[batch_count].altitude = g_last_fix.altitude;
+	batch_fixes[batch_count].time = g_last_fix.time;
+	batch_count++;
+	MYLOG("APP", "Location buffered %d", batch_count);
+
+	if (batch_count >= size)
+	{
+		*frame_sent = send_batch() == LMH_SUCCESS;
+	}
+	return true;
+}
+
+/**
+ * @brief Send as many buffered locations as fit into one frame
+ *        The time of each location is its age in seconds when the frame was sent,
+ *        the backend gets the base time from the reception time of the frame.
+ *
+ * @return lmh_error_status result of send_uplink(), LMH_ERROR if no location fits
+ */
+lmh_error_status send_batch(void)
+{
+	uint8_t frame[BATCH_MAX_SIZE];
+	uint8_t max_size = max_payload();
+	PosEncoder encoder;
+	encoder.begin(frame, max_size < BATCH_MAX_SIZE ? max_size : BATCH_MAX_SIZE, POS_RES_1E6, ALT_RES_M);
+
+	uint32_t now = millis() / 1000;
+	for (uint8_t idx = 0; idx < batch_count; idx++)
+	{
+		pos_point_s point = batch_fixes[idx];
+		point.time = now - point.time;
+		if (!encoder.add(&point))
+		{
+			break;
+		}
+	}
+	if (encoder.count() == 0)
+	{
+		// Not even one location fits with the current DR, keep them for a higher DR
+		AT_PRINTF("+EVT:SIZE_ERROR\n");
+		MYLOG("APP", "Batch location too big for current DR");
+		return LMH_ERROR;
+	}
+
+	// Batch frames are queued if the confirmation fails
+	uplink_priority = QUEUE_PRIO_PERIODIC;
+	lmh_error_status result = send_uplink(frame, encoder.getSize(), FPORT_BATCH);
+	uplink_priority = QUEUE_PRIO_NONE;
+	switch (result)
+	{
+	case LMH_SUCCESS:
+		MYLOG("APP", "Batch of %d locations enqueued", encoder.count());
+		for (uint8_t idx = encoder.count(); idx < batch_count; idx++)
+		{
+			batch_fixes[idx - encoder.count()] = batch_fixes[idx];
+		}
+		batch_count -= encoder.count();
+		if (batch_count == 0)
+		{
+			position_sent();
+		}
+		break;
+	case LMH_BUSY:
+		AT_PRINTF("+EVT:BUSY\n");
+		MYLOG("APP", "LoRa transceiver is busy");
+		break;
+	case LMH_ERROR:
+		AT_PRINTF("+EVT:SIZE_ERROR\n");
+		MYLOG("APP", "Packet error, too big to send with current DR");
+		break;
+	}
+	return result;
+}
+
+/**
+ * @brief Get the current data rate
+ *        The data rate is read from the stack, because ADR might have changed it.
+ *
+ * @return uint8_t data rate
+ */
+uint8_t current_datarate(void)
+{
+	MibRequestConfirm_t mib_req;
+	mib_req.Type = MIB_CHANNELS_DATARATE;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	return mib_req.Param.ChannelsDatarate;
+}
+
+/**
+ * @brief Get the number of locations per batch frame
+ *        With a low airtime budget more locations are collected.
+ *
+ * @return uint8_t locations per batch frame, 0 if every location is sent on its own
+ */
+uint8_t batch_size(void)
+{
+	uint8_t size = g_batch_size;
+	if ((g_budget_level == BUDGET_BATCH) && (size < BUDGET_BATCH_SIZE))
+	{
+		size = BUDGET_BATCH_SIZE;
+	}
+	else if ((g_budget_level == BUDGET_STRETCH) && (size < BUDGET_STRETCH_BATCH_SIZE))
+	{
+		size = BUDGET_STRETCH_BATCH_SIZE;
+	}
+	return size;
+}
+
+/**
+ * @brief Send a LoRaWAN packet and count its airtime
+ *        The channel used by the stack is not known, the airtime is
+ *        counted for the sub-band of the default channels.
+ *
+ * @param data packet
+ * @param size packet size
+ * @param fport fPort, 0 for the application port
+ * @return lmh_error_status result of send_lora_packet()
+ */
+lmh_error_status send_uplink(uint8_t *data, uint8_t size, uint8_t fport)
+{
+	if (g_link_recovery.stage() == RECOVERY_LINK_CHECK)
+	{
+		// The answer comes with the downlink of this uplink
+		MlmeReq_t mlme_req;
+		mlme_req.Type = MLME_LINK_CHECK;
+		LoRaMacMlmeRequest(&mlme_req);
+	}
+
+	// Data rate and TX power for the margin of the link
+	if (g_link_control.update())
+	{
+		apply_link_control();
+	}
+
+	// Anchor locations for the predictor are sent confirmed, the predictor is fed when the confirmation arrives
+	int32_t dr_lat = 0;
+	int32_t dr_lon = 0;
+	uint32_t dr_time = 0;
+	bool dr_fix = (g_dr_tolerance != 0) && !g_is_helium && (fport == 0) && dr_read_fix(data, size, &dr_lat, &dr_lon, &dr_time);
+
+	// The stack takes the confirmed flag from the settings.
+	// A queued packet is sent confirmed, it is removed from the queue only with the ACK.
+	bool fixed_confirmed = g_lorawan_settings.confirmed_msg_enabled;
+	bool confirmed = g_confirm_policy.confirm(fixed_confirmed) || dr_fix || (fport == FPORT_QUEUE);
+	g_lorawan_settings.confirmed_msg_enabled = confirmed;
+	uint32_t send_time = millis();
+	lmh_error_status result = send_lora_packet(data, size, fport);
+	g_lorawan_settings.confirmed_msg_enabled = fixed_confirmed;
+	if (result == LMH_SUCCESS)
+	{
+		dr_pending = dr_fix;
+		dr_pending_lat = dr_lat;
+		dr_pending_lon = dr_lon;
+		dr_pending_time = dr_time;
+
+		g_confirm_policy.sent(confirmed);
+		last_uplink_confirmed = confirmed;
+
+		// Keep a copy to queue it if the confirmation fails
+		last_uplink_priority = size <= QUEUE_MAX_DATA ? uplink_priority : QUEUE_PRIO_NONE;
+		if (last_uplink_priority != QUEUE_PRIO_NONE)
+		{
+			memcpy(last_uplink, data, size);
+			last_uplink_fport = fport == 0 ? g_lorawan_settings.app_port : fport;
+		}
+
+		last_uplink_dr = current_datarate();
+		uint32_t toa = airtime_uplink(g_lorawan_settings.lora_region, last_uplink_dr, size);
+		g_duty_cycle.add(millis(), airtime_band(g_lorawan_settings.lora_region, 0), toa);
+		g_airtime_budget.spend(millis(), toa);
+		g_link_recovery.addAirtime(toa);
+		session_uplink();
+		last_uplink_size = size;
+		last_uplink_time = send_time;
+		last_uplink_toa = toa;
+		MYLOG("APP", "Airtime %ldms", (long)(toa / 1000));
+
+		// Only the environment fields that made it into this packet count as sent,
+		// queued copies are not taken, newer packets carry the fields again
+		if ((fport == 0) && !g_is_helium)
+		{
+			env_sent(data, size);
+		}
+	}
+	return result;
+}
+
+/**
+ * @brief Start the GNSS task if it is not running yet
+ *
+ */
+void start_gnss_task(void)
+{
+	if (gnss_task_handle != NULL)
+	{
+		return;
+	}
+	// Prepare GNSS task
+	// Create the GNSS event semaphore
+	g_gnss_sem = xSemaphoreCreateBinary();
+	// Initialize semaphore
+	xSemaphoreGive(g_gnss_sem);
+	// Take semaphore
+	xSemaphoreTake(g_gnss_sem, 10);
+	if (!xTaskCreate(gnss_task, "LORA", 4096, NULL, TASK_PRIO_LOW, &gnss_task_handle))
+	{
+		MYLOG("APP", "Failed to start GNSS task");
+	}
+	last_pos_send = millis();
+}
+
+/**
+ * @brief Run the action of a link recovery stage
+ *
+ * @param action stage returned by g_link_recovery
+ */
+void run_recovery(uint8_t action)
+{
+	uint8_t datarate = current_datarate();
+	switch (action)
+	{
+	case RECOVERY_LINK_CHECK:
+		MYLOG("APP", "Link recovery, link check");
+		AT_PRINTF("+EVT:LINK_CHECK\n");
+		break;
+	case RECOVERY_DR_DOWN:
+		MYLOG("APP", "Link recovery, DR %d", datarate - 1);
+		AT_PRINTF("+EVT:DR_DOWN\n");
+		lmh_datarate_set(datarate - 1, g_lorawan_settings.adr_enabled);
+		g_link_control.reset(datarate - 1, 0);
+		break;
+	case RECOVERY_REJOIN:
+		MYLOG("APP", "Link recovery, join");
+		AT_PRINTF("+EVT:REJOIN\n");
+		// The saved session does not work anymore
+		forget_session();
+		if (g_session_stack)
+		{
+			// The stack runs the restored session without the OTAA keys, join after a reset
+			save_recovery_settings();
+			save_budget_settings();
+			delay(100);
+			sd_nvic_SystemReset();
+			break;
+		}
+		g_lpwan_has_joined = false;
+		start_join();
+		break;
+	case RECOVERY_RESET:
+		MYLOG("APP", "Link recovery, reset");
+		AT_PRINTF("+EVT:RESET\n");
+		g_recovery_resets++;
+		save_recovery_settings();
+		save_budget_settings();
+		delay(100);
+		sd_nvic_SystemReset();
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Get the data rate of the last downlink
+ *        The stack does not report the RX window of a downlink. A downlink that
+ *        arrived before RX2 of the last uplink could open was received in RX1.
+ *        Delays of the transmission and of the loop only make a downlink later,
+ *        a late RX1 downlink is not used unless RX1 and RX2 have the same data rate.
+ *
+ * @param datarate returns the data rate of the downlink
+ * @return true if the data rate is known
+ */
+bool downlink_datarate(uint8_t *datarate)
+{
+	MibRequestConfirm_t mib_req;
+	mib_req.Type = MIB_RX2_CHANNEL;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	uint8_t rx2_dr = mib_req.Param.Rx2Channel.Datarate;
+	*datarate = airtime_rx1_dr(g_lorawan_settings.lora_region, last_uplink_dr, LoRaMacParams.Rx1DrOffset);
+	if (*datarate == rx2_dr)
+	{
+		return true;
+	}
+	mib_req.Type = MIB_RECEIVE_DELAY_2;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	return (millis() - last_uplink_time) < (last_uplink_toa / 1000 + mib_req.Param.ReceiveDelay2);
+}
+
+/**
+ * @brief Estimate the airtime of a join
+ *        The stack sends the join request up to join_trials times and selects
+ *        the data rate of each one itself, a data rate set before the join is not used.
+ *
+ * @param datarate returns the data rate of the last join request
+ * @return uint32_t airtime in us
+ */
+uint32_t join_airtime(uint8_t *datarate)
+{
+	uint8_t trials = g_lorawan_settings.join_trials == 0 ? 1 : g_lorawan_settings.join_trials;
+	*datarate = airtime_join_dr(g_lorawan_settings.lora_region, trials);
+	return airtime_join(g_lorawan_settings.lora_region, trials);
+}
+
+/**
+ * @brief Start a join and count its airtime for the backoff
+ *
+ */
+void start_join(void)
+{
+	uint8_t datarate;
+	uint32_t toa = join_airtime(&datarate);
+	MYLOG("APP", "Join, airtime %ldms", (long)(toa / 1000));
+	g_join_backoff.started(millis(), toa, datarate);
+	g_link_recovery.addAirtime(toa);
+	lmh_join();
+}
+
+/**
+ * @brief Set the data rates and TX power steps the link controller can use
+ *        Only 125 kHz data rates allowed in the region are used, the TX power
+ *        is lowered from the TX power set with AT+TXP.
+ *
+ */
+void init_link_control(void)
+{
+	uint8_t region = g_lorawan_settings.lora_region;
+	uint8_t min_dr = 0xFF;
+	uint8_t max_dr = 0;
+	for (uint8_t datarate = 0; datarate < 8; datarate++)
+	{
+		uint8_t sf;
+		uint16_t bw_khz;
+		if ((plan_max_payload(region, datarate) != 0) && airtime_dr_params(region, datarate, &sf, &bw_khz) && (bw_khz == 125))
+		{
+			if (min_dr == 0xFF)
+			{
+				min_dr = datarate;
+			}
+			max_dr = datarate;
+		}
+	}
+	if (min_dr == 0xFF)
+	{
+		min_dr = 0;
+	}
+	uint8_t max_power = link_ctl_max_power(region);
+	uint8_t steps = max_power > g_lorawan_settings.tx_power ? max_power - g_lorawan_settings.tx_power : 0;
+	g_link_control.setRange(min_dr, max_dr, steps < LINK_CTL_POWER_STEPS ? steps : LINK_CTL_POWER_STEPS);
+	g_link_control.reset(g_lorawan_settings.data_rate, 0);
+}
+
+/**
+ * @brief Set data rate and TX power selected by the link controller
+ *        ADR of the stack is disabled while the controller is used.
+ *
+ */
+void apply_link_control(void)
+{
+	MYLOG("APP", "Link control DR %d TX power %d", g_link_control.datarate(), g_lorawan_settings.tx_power + g_link_control.power());
+	lmh_datarate_set(g_link_control.datarate(), false);
+	MibRequestConfirm_t mib_req;
+	mib_req.Type = MIB_CHANNELS_TX_POWER;
+	mib_req.Param.ChannelsTxPower = g_lorawan_settings.tx_power + g_link_control.power();
+	LoRaMacMibSetRequestConfirm(&mib_req);
+}
+
+/**
+ * @brief Delay a periodic location by the jitter of the device
+ *        Locations triggered by motion are not delayed.
+ *
+ * @return true if the location was delayed
+ */
+bool spread_uplink(void)
+{
+	if (motion_uplink || spread_due)
+	{
+		// A location triggered by motion replaces a delayed periodic one
+		g_scheduler.cancel(SCHED_SPREAD);
+		spread_due = false;
+		return false;
+	}
+	// The delay must be over before the next periodic location
+	uint32_t wait_time = g_uplink_spread.jitter(g_lorawan_settings.send_repeat_time / 2);
+	if (wait_time == 0)
+	{
+		return false;
+	}
+	MYLOG("APP", "Periodic location delayed %ldms", (long)wait_time);
+	g_scheduler.in(SCHED_SPREAD, millis(), wait_time);
+	sched_update();
+	return true;
+}
+
+/**
+ * @brief Get the time of the uplink queue
+ *        Continues after a reset with the time of the newest queued packet,
+ *        the time the device was off is not counted.
+ *
+ * @return uint32_t queue time in seconds
+ */
+uint32_t queue_time(void)
+{
+	return queue_time_base + millis() / 1000;
+}
+
+/**
+ * @brief Keep a packet that could not be sent in the queue
+ *
+ * @param data packet
+ * @param size packet size
+ * @param fport fPort of the packet
+ * @param priority QUEUE_PRIO_PERIODIC, QUEUE_PRIO_MOTION or QUEUE_PRIO_ALARM
+ */
+void queue_packet(uint8_t *data, uint8_t size, uint8_t fport, uint8_t priority)
+{
+	// Queued packets go out with 4 bytes age and fPort in front
+	if ((size + 4) > max_payload())
+	{
+		MYLOG("APP", "Packet too big for the queue, dropped");
+		return;
+	}
+	uint32_t max_age = QUEUE_AGE_PERIODIC;
+	if (priority == QUEUE_PRIO_ALARM)
+	{
+		max_age = QUEUE_AGE_ALARM;
+	}
+	else if (priority == QUEUE_PRIO_MOTION)
+	{
+		max_age = QUEUE_AGE_MOTION;
+	}
+	if (g_uplink_queue.push(queue_time(), priority, fport, data, size, max_age))
+	{
+		MYLOG("APP", "Packet queued, %d in queue", g_uplink_queue.count());
+	}
+	else
+	{
+		MYLOG("APP", "Queue full, packet dropped");
+	}
+}
+
+/**
+ * @brief Send the next queued packet if the link works and airtime is left
+ *        The packet is sent on FPORT_QUEUE with 3 bytes age in seconds
+ *        and 1 byte original fPort in front.
+ *
+ * @return true if a queued packet was sent
+ * @return false if nothing was sent
+ */
+bool send_queued(void)
+{
+	if (!g_rx_fin_result || (g_uplink_queue.count() == 0) || (g_budget_level >= BUDGET_BATCH))
+	{
+		return false;
+	}
+
+	uint8_t frame[QUEUE_MAX_DATA + 4];
+	uint32_t age;
+	uint8_t size = g_uplink_queue.peek(queue_time(), &frame[3], &frame[4], &age);
+	if (size == 0)
+	{
+		return false;
+	}
+	if ((size + 4) > max_payload())
+	{
+		// The data rate went down since the packet was queued, it would block the queue
+		MYLOG("APP", "Queued packet does not fit, dropped");
+		g_uplink_queue.pop();
+		return false;
+	}
+	if (g_duty_cycle.nextAllowed(millis(), airtime_band(g_lorawan_settings.lora_region, 0), airtime_uplink(g_lorawan_settings.lora_region, current_datarate(), size + 4)) != 0)
+	{
+		return false;
+	}
+	put_be<3>(frame, age > 0xFFFFFF ? 0xFFFFFF : age);
+
+	if (send_uplink(frame, size + 4, FPORT_QUEUE) != LMH_SUCCESS)
+	{
+		return false;
+	}
+	MYLOG("APP", "Queued packet sent, age %lds", (long)age);
+	queue_sent = true;
+	return true;
+}
+
+/**
+ * @brief Get the time until the next location can be sent
+ *        Over LoRaWAN in regions with duty cycle limit the airtime of the
+ *        last uplink must fit into the remaining budget, otherwise
+ *        min_delay is kept between locations.
+ *
+ * @return time_t time to wait in ms, 0 if a location can be sent now
+ */
+time_t send_wait(void)
+{
+	uint8_t band = airtime_band(g_lorawan_settings.lora_region, 0);
+	if (!g_lorawan_settings.lorawan_enable || (g_duty_cycle.allowance(band) == 0))
+	{
+		time_t expired = millis() - last_pos_send;
+		return expired < min_delay ? min_delay - expired : 0;
+	}
+	uint32_t toa = airtime_uplink(g_lorawan_settings.lora_region, current_datarate(), last_uplink_size);
+	return g_duty_cycle.nextAllowed(millis(), band, toa);
+}
+
+/**
+ * @brief Get the max application payload for the current data rate
+ *        Pending MAC commands in FOpts reduce the available payload.
+ *
+ * @return uint8_t max payload size
+ */
+uint8_t max_payload(void)
+{
+	uint8_t datarate = current_datarate();
+	uint8_t max_size = plan_max_payload(g_lorawan_settings.lora_region, datarate);
+
+	LoRaMacTxInfo_t tx_info;
+	LoRaMacQueryTxPossible(0, &tx_info);
+	if (tx_info.MaxPossiblePayload < max_size)
+	{
+		max_size = tx_info.MaxPossiblePayload;
+	}
+	MYLOG("APP", "DR %d max payload %d", datarate, max_size);
+	return max_size;
+}
+
+/**
+ * @brief Send the data packet, if it is too big for the current DR
+ *        it is sent in fragments or the location is sent first
+ *        and the other fields are deferred
+ *
+ * @return lmh_error_status result of send_uplink()
+ */
+lmh_error_status send_planned(void)
+{
+	uint8_t max_size = max_payload();
+	deferred_size = 0;
+	if (g_data_packet.getSize() <= max_size)
+	{
+		return send_uplink(g_data_packet.getBuffer(), g_data_packet.getSize());
+	}
+	if (g_frag_enabled && fragmenter.begin(g_lorawan_settings.app_port, g_data_packet.getBuffer(), g_data_packet.getSize(), max_size))
+	{
+		MYLOG("APP", "Packet sent in fragments");
+		return send_fragment();
+	}
+	if (g_is_helium)
+	{
+		// Helium Mapper packet cannot be split
+		AT_PRINTF("+EVT:DR_ERROR\n");
+		return LMH_ERROR;
+	}
+
+	uint8_t planned[LPP_BUFFER_SIZE];
+	uint8_t planned_size = plan_lpp(g_data_packet.getBuffer(), g_data_packet.getSize(), max_size,
+									lpp_priority, sizeof(lpp_priority), planned, deferred_packet, &deferred_size);
+	if (planned_size == 0)
+	{
+		AT_PRINTF("+EVT:DR_ERROR\n");
+		deferred_size = 0;
+		return LMH_ERROR;
+	}
+	MYLOG("APP", "Packet planned %d bytes, %d bytes deferred", planned_size, deferred_size);
+	lmh_error_status result = send_uplink(planned, planned_size);
+	if (result != LMH_SUCCESS)
+	{
+		deferred_size = 0;
+	}
+	return result;
+}
+
+/**
+ * @brief Send the fields deferred from the last packet
+ *        Fields that still do not fit are dropped, newer values come with the next packet
+ *
+ * @return true if a packet with deferred fields was sent
+ */
+bool send_deferred(void)
+{
+	if ((deferred_size == 0) || !g_lorawan_settings.lorawan_enable)
+	{
+		return false;
+	}
+
+	uint8_t max_size = max_payload();
+	uint8_t planned[LPP_BUFFER_SIZE];
+	uint8_t dropped[LPP_BUFFER_SIZE];
+	uint8_t dropped_size = 0;
+	uint8_t planned_size = plan_lpp(deferred_packet, deferred_size, max_size, NULL, 0, planned, dropped, &dropped_size);
+	deferred_size = 0;
+	if (planned_size == 0)
+	{
+		return false;
+	}
+	MYLOG("APP", "Deferred fields %d bytes, %d bytes dropped", planned_size, dropped_size);
+	return send_uplink(planned, planned_size) == LMH_SUCCESS;
+}
+
+/**
+ * @brief Send the next fragment
+ *        The following fragments are sent when TX is finished,
+ *        if the transceiver is busy or the duty cycle does not allow to send,
+ *        the fragment is retried after FRAG_RETRY_TIME.
+ *
+ * @return lmh_error_status result of send_uplink()
+ */
+lmh_error_status send_fragment(void)
+{
+	uint8_t fragment[FRAG_MAX_SIZE];
+	uint8_t size = fragmenter.next(fragment);
+	if (size == 0)
+	{
+		return LMH_SUCCESS;
+	}
+
+	lmh_error_status result = send_uplink(fragment, size, FPORT_FRAG);
+	switch (result)
+	{
+	case LMH_SUCCESS:
+		MYLOG("APP", "Fragment %d/%d enqueued", (fragment[1] >> 4) + 1, (fragment[1] & 0x0F) + 1);
+		if (!fragmenter.pending() && (fragmenter.getFport() == g_lorawan_settings.app_port) && !g_is_helium)
+		{
+			env_sent(fragmenter.getData(), fragmenter.getSize());
+		}
+		break;
+	case LMH_BUSY:
+		fragmenter.retry();
+		g_scheduler.in(SCHED_FRAG, millis(), FRAG_RETRY_TIME);
+		sched_update();
+		break;
+	case LMH_ERROR:
+		// Data rate went down, the remaining fragments do not fit
+		AT_PRINTF("+EVT:SIZE_ERROR\n");
+		fragmenter.cancel();
+		break;
+	}
+	return result;
 }
@@ -0,0 +1,143 @@
+/**
+ * @file field_writer.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Write and read N byte integer fields in big or little endian
+ *        Works on the values, not on their memory layout, so the result
+ *        is the same on every host. Negative values are written in two's
+ *        complement, truncated to N bytes.
+ *        No Arduino dependencies.
+ * @version 0.1
+ * @date 2022-09-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef FIELD_WRITER_H
+#define FIELD_WRITER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Write N bytes, MSB first
+ *
+ * @tparam N number of bytes, 1 to 4
+ * @param buffer buffer
+ * @param value value, signed values are passed as their two's complement
+ * @return uint8_t number of bytes written
+ */
+template <uint8_t N>
+inline uint8_t put_be(uint8_t *buffer, uint32_t value)
+{
+	static_assert((N >= 1) && (N <= 4), "Field size must be 1 to 4 bytes");
+	for (uint8_t idx = 0; idx < N; idx++)
+	{
+		buffer[idx] = (uint8_t)(value >> (8 * (N - 1 - idx)));
+	}
+	return N;
+}
+
+/**
+ * @brief Write N bytes, LSB first
+ *
+ * @tparam N number of bytes, 1 to 4
+ * @param buffer buffer
+ * @param value value, signed values are passed as their two's complement
+ * @return uint8_t number of bytes written
+ */
+template <uint8_t N>
+inline uint8_t put_le(uint8_t *buffer, uint32_t value)
+{
+	static_assert((N >= 1) && (N <= 4), "Field size must be 1 to 4 bytes");
+	for (uint8_t idx = 0; idx < N; idx++)
+	{
+		buffer[idx] = (uint8_t)(value >> (8 * idx));
+	}
+	return N;
+}
+
+/**
+ * @brief Write a value divided by DIV, N bytes MSB first
+ *        The division truncates towards zero like the LPP encoders always did.
+ *
+ * @tparam N number of bytes, 1 to 4
+ * @tparam DIV divisor
+ * @param buffer buffer
+ * @param value value before scaling
+ * @return uint8_t number of bytes written
+ */
+template <uint8_t N, int32_t DIV>
+inline uint8_t put_be_scaled(uint8_t *buffer, int32_t value)
+{
+	static_assert(DIV > 0, "Divisor must be positive");
+	return put_be<N>(buffer, (uint32_t)(value / DIV));
+}
+
+/**
+ * @brief Write a value divided by DIV, N bytes LSB first
+ *
+ * @tparam N number of bytes, 1 to 4
+ * @tparam DIV divisor
+ * @param buffer buffer
+ * @param value value before scaling
+ * @return uint8_t number of bytes written
+ */
+template <uint8_t N, int32_t DIV>
+inline uint8_t put_le_scaled(uint8_t *buffer, int32_t value)
+{
+	static_assert(DIV > 0, "Divisor must be positive");
+	return put_le<N>(buffer, (uint32_t)(value / DIV));
+}
+
+/**
+ * @brief Read N bytes, MSB first, as unsigned value
+ *
+ * @tparam N number of bytes, 1 to 4
+ * @param buffer buffer
+ * @return uint32_t value
+ */
+template <uint8_t N>
+inline uint32_t get_be(const uint8_t *buffer)
+{
+	static_assert((N >= 1) && (N <= 4), "Field size must be 1 to 4 bytes");
+	uint32_t value = 0;
+	for (uint8_t idx = 0; idx < N; idx++)
+	{
+		value = (value << 8) | buffer[idx];
+	}
+	return value;
+}
+
+/**
+ * @brief Read N bytes, LSB first, as unsigned value
+ *
+ * @tparam N number of bytes, 1 to 4
+ * @param buffer buffer
+ * @return uint32_t value
+ */
+template <uint8_t N>
+inline uint32_t get_le(const uint8_t *buffer)
+{
+	static_assert((N >= 1) && (N <= 4), "Field size must be 1 to 4 bytes");
+	uint32_t value = 0;
+	for (uint8_t idx = 0; idx < N; idx++)
+	{
+		value |= (uint32_t)buffer[idx] << (8 * idx);
+	}
+	return value;
+}
+
+/**
+ * @brief Sign extend a N byte value
+ *
+ * @tparam N number of bytes, 1 to 4
+ * @param value value read with get_be() or get_le()
+ * @return int32_t signed value
+ */
+template <uint8_t N>
+inline int32_t sign_extend(uint32_t value)
+{
+	static_assert((N >= 1) && (N <= 4), "Field size must be 1 to 4 bytes");
+	return (int32_t)(value << (32 - 8 * N)) >> (32 - 8 * N);
+}
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ * @file fragment.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Split packets into fragments and put them together again
+ * @version 0.1
+ * @date 2022-09-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "fragment.h"
+
+/**
+ * @brief Start a new fragmented packet
+ *
+ * @param fport fPort of the original packet
+ * @param data packet data
+ * @param size packet size
+ * @param max_fragment max size of a fragment including the header
+ * @return true if the packet can be split
+ * @return false if the packet needs more than FRAG_MAX_COUNT fragments
+ */
+bool Fragmenter::begin(uint8_t fport, const uint8_t *data, uint8_t size, uint8_t max_fragment)
+{
+	_count = 0;
+	_next = 0;
+	if (max_fragment <= FRAG_HEADER_SIZE)
+	{
+		return false;
+	}
+	_size = size + 1;
+	_frag_len = max_fragment - FRAG_HEADER_SIZE;
+	uint16_t count = (_size + _frag_len - 1) / _frag_len;
+	if (count > FRAG_MAX_COUNT)
+	{
+		return false;
+	}
+
+	_data[0] = fport;
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		_data[idx + 1] = data[idx];
+	}
+	_seq++;
+	_count = count;
+	return true;
+}
+
+/**
+ * @brief Get the next fragment
+ *
+ * @param buffer buffer for the fragment, at least max_fragment bytes
+ * @return uint8_t size of the fragment, 0 if all fragments are done
+ */
+uint8_t Fragmenter::next(uint8_t *buffer)
+{
+	if (_next >= _count)
+	{
+		return 0;
+	}
+	uint16_t start = _next * _frag_len;
+	uint16_t len = (_size - start) < _frag_len ? (_size - start) : _frag_len;
+	buffer[0] = _seq;
+	buffer[1] = (uint8_t)(_next << 4 | (_count - 1));
+	for (uint16_t idx = 0; idx < len; idx++)
+	{
+		buffer[FRAG_HEADER_SIZE + idx] = _data[start + idx];
+	}
+	_next++;
+	return FRAG_HEADER_SIZE + len;
+}
+
+/**
+ * @brief Repeat the last fragment with the next call of next()
+ *
+ */
+void Fragmenter::retry(void)
+{
+	if (_next > 0)
+	{
+		_next--;
+	}
+}
+
+/**
+ * @brief Forget all fragments
+ *
+ */
+void FragReassembler::clear(void)
+{
+	for (uint8_t idx = 0; idx < FRAG_SLOTS; idx++)
+	{
+		_slots[idx].used = false;
+	}
+	_done_num = 0;
+	_done_next = 0;
+	_size = 0;
+	_has_newest = false;
+	_lost = 0;
+}
+
+/**
+ * @brief Give up a packet with missing fragments
+ *
+ * @param slot slot of the packet
+ */
+void FragReassembler::release(frag_slot_s *slot)
+{
+	slot->used = false;
+	_lost++;
+}
+
+/**
+ * @brief Add a fragment
+ *
+ * @param fragment received fragment including the header
+ * @param size size of the fragment
+ * @return true if a packet is complete, get it with getFport(), getData() and getSize()
+ * @return false if fragments are missing or the fragment is invalid
+ */
+bool FragReassembler::add(const uint8_t *fragment, uint8_t size)
+{
+	if (size <= FRAG_HEADER_SIZE)
+	{
+		return false;
+	}
+	uint8_t seq = fragment[0];
+	uint8_t index = fragment[1] >> 4;
+	uint8_t count = (fragment[1] & 0x0F) + 1;
+	uint8_t len = size - FRAG_HEADER_SIZE;
+	if (index >= count)
+	{
+		return false;
+	}
+
+	// Give up packets that are too old
+	if (!_has_newest || ((uint8_t)(seq - _newest) < 128))
+	{
+		_newest = seq;
+		_has_newest = true;
+	}
+	for (uint8_t idx = 0; idx < FRAG_SLOTS; idx++)
+	{
+		if (_slots[idx].used && ((uint8_t)(_newest - _slots[idx].seq) >= FRAG_SEQ_WINDOW))
+		{
+			release(&_slots[idx]);
+		}
+	}
+	if ((uint8_t)(_newest - seq) >= FRAG_SEQ_WINDOW)
+	{
+		return false;
+	}
+	// Ignore repeated fragments of completed packets
+	for (uint8_t idx = 0; idx < _done_num; idx++)
+	{
+		if (_done[idx] == seq)
+		{
+			return false;
+		}
+	}
+
+	// Find the slot of the packet, or the oldest slot for a new one
+	frag_slot_s *slot = 0;
+	frag_slot_s *oldest = &_slots[0];
+	for (uint8_t idx = 0; idx < FRAG_SLOTS; idx++)
+	{
+		if (_slots[idx].used && (_slots[idx].seq == seq))
+		{
+			slot = &_slots[idx];
+			break;
+		}
+		if (!_slots[idx].used)
+		{
+			oldest = &_slots[idx];
+		}
+		else if (oldest->used && ((uint8_t)(_newest - _slots[idx].seq) > (uint8_t)(_newest - oldest->seq)))
+		{
+			oldest = &_slots[idx];
+		}
+	}
+	if (slot == 0)
+	{
+		slot = oldest;
+		if (slot->used)
+		{
+			release(slot);
+		}
+		slot->used = true;
+		slot->seq = seq;
+		slot->count = count;
+		slot->received = 0;
+		slot->frag_len = 0;
+		slot->last_len = 0;
+	}
+	if (slot->count != count)
+	{
+		return false;
+	}
+
+	const uint8_t *data = &fragment[FRAG_HEADER_SIZE];
+	if (index == count - 1)
+	{
+		// Last fragment, its position is known only with the length of the other fragments
+		slot->last_len = len;
+		for (uint8_t idx = 0; idx < len; idx++)
+		{
+			slot->last[idx] = data[idx];
+		}
+	}
+	else
+	{
+		if ((slot->frag_len != 0) && (slot->frag_len != len))
+		{
+			return false;
+		}
+		if ((uint16_t)(index + 1) * len > FRAG_MAX_SIZE)
+		{
+			return false;
+		}
+		slot->frag_len = len;
+		for (uint8_t idx = 0; idx < len; idx++)
+		{
+			slot->data[index * len + idx] = data[idx];
+		}
+	}
+	slot->received |= 1 << index;
+
+	if (slot->received != (uint16_t)((1UL << count) - 1))
+	{
+		return false;
+	}
+
+	// Complete
+	uint16_t start = (uint16_t)(count - 1) * slot->frag_len;
+	if ((start + slot->last_len) > FRAG_MAX_SIZE)
+	{
+		slot->used = false;
+		_lost++;
+		return false;
+	}
+	for (uint16_t idx = 0; idx < start; idx++)
+	{
+		_packet[idx] = slot->data[idx];
+	}
+	for (uint8_t idx = 0; idx < slot->last_len; idx++)
+	{
+		_packet[start + idx] = slot->last[idx];
+	}
+	_fport = _packet[0];
+	_size = start + slot->last_len - 1;
+	slot->used = false;
+	_done[_done_next] = seq;
+	_done_next = (_done_next + 1) % FRAG_SLOTS;
+	if (_done_num < FRAG_SLOTS)
+	{
+		_done_num++;
+	}
+	return true;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file fragment.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Split packets that do not fit the current data rate into fragments
+ *        and put them together again on the backend.
+ *        No Arduino dependencies.
+ * @version 0.1
+ * @date 2022-09-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef FRAGMENT_H
+#define FRAGMENT_H
+
+#include <stdint.h>
+
+/** Size of the fragment header */
+#define FRAG_HEADER_SIZE 2
+/** Max number of fragments of one packet */
+#define FRAG_MAX_COUNT 16
+/** Max size of a packet, including the fPort byte */
+#define FRAG_MAX_SIZE 256
+/** Number of packets the reassembler works on at the same time */
+#define FRAG_SLOTS 4
+/** Packets older than this number of sequences are given up */
+#define FRAG_SEQ_WINDOW 8
+
+/**
+ * @brief Splits a packet into fragments
+ *        Fragment format:
+ *        1 byte sequence number of the packet
+ *        1 byte fragment index (bits 7-4) and number of fragments - 1 (bits 3-0)
+ *        fragment data, all fragments except the last have the same size
+ *        The packet data starts with the fPort of the original packet.
+ */
+class Fragmenter
+{
+public:
+	Fragmenter(void) : _seq(0), _count(0), _next(0) {}
+
+	bool begin(uint8_t fport, const uint8_t *data, uint8_t size, uint8_t max_fragment);
+	uint8_t next(uint8_t *buffer);
+	void retry(void);
+	void cancel(void) { _next = _count; }
+	bool pending(void) { return _next < _count; }
+	uint8_t getFport(void) { return _data[0]; }
+	const uint8_t *getData(void) { return _data + 1; }
+	uint8_t getSize(void) { return _size - 1; }
+
+private:
+	uint8_t _data[FRAG_MAX_SIZE];
+	uint16_t _size;
+	uint8_t _frag_len;
+	uint8_t _seq;
+	uint8_t _count;
+	uint8_t _next;
+};
+
+/** State of one packet in the reassembler */
+struct frag_slot_s
+{
+	bool used;
+	uint8_t seq;
+	uint8_t count;
+	uint16_t received;
+	uint8_t frag_len;
+	uint8_t last_len;
+	uint8_t data[FRAG_MAX_SIZE];
+	uint8_t last[FRAG_MAX_SIZE];
+};
+
+/**
+ * @brief Puts fragments together, fragments can arrive in any order.
+ *        Packets with missing fragments are given up when FRAG_SEQ_WINDOW
+ *        newer packets arrived or the slot is needed for a new packet.
+ */
+class FragReassembler
+{
+public:
+	FragReassembler(void) { clear(); }
+
+	void clear(void);
+	bool add(const uint8_t *fragment, uint8_t size);
+	uint8_t getFport(void) { return _fport; }
+	const uint8_t *getData(void) { return _packet + 1; }
+	uint16_t getSize(void) { return _size; }
+	uint32_t lost(void) { return _lost; }
+
+private:
+	void release(frag_slot_s *slot);
+
+	frag_slot_s _slots[FRAG_SLOTS];
+	uint8_t _done[FRAG_SLOTS];
+	uint8_t _done_num;
+	uint8_t _done_next;
+	uint8_t _packet[FRAG_MAX_SIZE];
+	uint16_t _size;
+	uint8_t _fport;
+	uint8_t _newest;
+	bool _has_newest;
+	uint32_t _lost;
+};
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * @file geo_math.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Integer only helpers for distances between GNSS positions
+ *        Local equirectangular approximation, good enough for the
+ *        distances a tracker moves between two position messages.
+ *        No Arduino dependencies, can be used in backend code as well.
+ * @version 0.1
+ * @date 2022-09-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef GEO_MATH_H
+#define GEO_MATH_H
+
+#include <stdint.h>
+
+/** Meters per 1/10'000'000 degree latitude, scaled by 10'000'000 */
+#define GEO_M_PER_DEG 111319
+
+int64_t geo_wrap_lon(int64_t longitude);
+int32_t geo_cos_q15(int32_t latitude);
+int32_t geo_cos_q30(int32_t latitude);
+void geo_offset(int32_t lat_ref, int32_t lon_ref, int32_t latitude, int32_t longitude, int32_t *east, int32_t *north);
+uint32_t geo_distance(int32_t lat_a, int32_t lon_a, int32_t lat_b, int32_t lon_b);
+uint32_t geo_isqrt(uint64_t value);
+
+#endif
@@ -0,0 +1,378 @@
+/**
+ * @file geofence.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Polygon and circle geofences with a bounding box index
+ * @version 0.1
+ * @date 2022-09-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "geofence.h"
+#include "geo_math.h"
+
+/**
+ * @brief Remove all zones
+ *
+ */
+void Geofence::clear(void)
+{
+	_num_zones = 0;
+	_num_points = 0;
+	updateBounds();
+}
+
+/**
+ * @brief Add a polygon point to a zone
+ *        The zone is created if it doesn't exist yet.
+ *        The polygon is closed automatically, the last point
+ *        connects to the first point.
+ *
+ * @param id Zone ID 0 to 31
+ * @param flags Zone flags, e.g. GEOFENCE_HOME
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @return true if the point was added
+ * @return false if the ID is invalid or there is no space left
+ */
+bool Geofence::addPoint(uint8_t id, uint8_t flags, int32_t latitude, int32_t longitude)
+{
+	if ((id >= GEOFENCE_MAX_ZONES) || (_num_points >= GEOFENCE_MAX_POINTS))
+	{
+		return false;
+	}
+
+	uint8_t idx = 0;
+	for (; idx < _num_zones; idx++)
+	{
+		if (_zones[idx].id == id)
+		{
+			break;
+		}
+	}
+	if (idx == _num_zones)
+	{
+		if (_num_zones >= GEOFENCE_MAX_ZONES)
+		{
+			return false;
+		}
+		_zones[idx].id = id;
+		_zones[idx].first = _num_points;
+		_zones[idx].count = 0;
+		_zones[idx].radius = 0;
+		_num_zones++;
+	}
+	else if (_zones[idx].flags & GEOFENCE_CIRCLE)
+	{
+		// Circles have only one point
+		return false;
+	}
+	geofence_zone_s *zone = &_zones[idx];
+	zone->flags = flags & ~GEOFENCE_CIRCLE;
+
+	// Make space at the end of this zone's points
+	uint16_t insert = zone->first + zone->count;
+	for (uint16_t point = _num_points; point > insert; point--)
+	{
+		_lat[point] = _lat[point - 1];
+		_lon[point] = _lon[point - 1];
+	}
+	_lat[insert] = latitude;
+	_lon[insert] = longitude;
+	_num_points++;
+	zone->count++;
+	for (uint8_t other = 0; other < _num_zones; other++)
+	{
+		if (_zones[other].first > zone->first)
+		{
+			_zones[other].first++;
+		}
+	}
+
+	updateBounds();
+	return true;
+}
+
+/**
+ * @brief Add a circle zone
+ *        An existing zone with the same ID is replaced.
+ *
+ * @param id Zone ID 0 to 31
+ * @param flags Zone flags, e.g. GEOFENCE_HOME
+ * @param latitude Latitude of the center in 1/10'000'000 degree
+ * @param longitude Longitude of the center in 1/10'000'000 degree
+ * @param radius Radius in meters
+ * @return true if the zone was added
+ * @return false if the ID is invalid or there is no space left
+ */
+bool Geofence::addCircle(uint8_t id, uint8_t flags, int32_t latitude, int32_t longitude, uint32_t radius)
+{
+	if ((id >= GEOFENCE_MAX_ZONES) || (radius == 0))
+	{
+		return false;
+	}
+	remove(id);
+	if (!addPoint(id, flags, latitude, longitude))
+	{
+		return false;
+	}
+	for (uint8_t idx = 0; idx < _num_zones; idx++)
+	{
+		if (_zones[idx].id == id)
+		{
+			_zones[idx].flags |= GEOFENCE_CIRCLE;
+			_zones[idx].radius = radius;
+		}
+	}
+	updateBounds();
+	return true;
+}
+
+/**
+ * @brief Remove a zone
+ *
+ * @param id Zone ID
+ * @return true if the zone was removed
+ * @return false if the zone doesn't exist
+ */
+bool Geofence::remove(uint8_t id)
+{
+	for (uint8_t idx = 0; idx < _num_zones; idx++)
+	{
+		if (_zones[idx].id != id)
+		{
+			continue;
+		}
+		uint16_t first = _zones[idx].first;
+		uint16_t count = _zones[idx].count;
+		for (uint16_t point = first; point + count < _num_points; point++)
+		{
+			_lat[point] = _lat[point + count];
+			_lon[point] = _lon[point + count];
+		}
+		_num_points -= count;
+		for (uint8_t other = idx; other + 1 < _num_zones; other++)
+		{
+			_zones[other] = _zones[other + 1];
+		}
+		_num_zones--;
+		for (uint8_t other = 0; other < _num_zones; other++)
+		{
+			if (_zones[other].first > first)
+			{
+				_zones[other].first -= count;
+			}
+		}
+		updateBounds();
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Check in which zones a position is
+ *
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @return uint32_t bit mask of the zone ID's the position is in
+ */
+uint32_t Geofence::check(int32_t latitude, int32_t longitude)
+{
+	uint32_t mask = 0;
+
+	// Outside of all zones
+	if ((latitude < _min_lat) || (latitude > _max_lat) || (longitude < _min_lon) || (longitude > _max_lon))
+	{
+		return mask;
+	}
+
+	for (uint8_t idx = 0; idx < _num_zones; idx++)
+	{
+		const geofence_zone_s *zone = &_zones[idx];
+		if ((latitude < zone->min_lat) || (latitude > zone->max_lat) || (longitude < zone->min_lon) || (longitude > zone->max_lon))
+		{
+			continue;
+		}
+		if (inside(zone, latitude, longitude))
+		{
+			mask |= 1UL << zone->id;
+		}
+	}
+	return mask;
+}
+
+/**
+ * @brief Distance from a position to the nearest zone boundary
+ *        No zone can be entered or left before the asset has moved
+ *        at least this distance.
+ *
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @return uint32_t distance in meters, UINT32_MAX if there are no zones
+ */
+uint32_t Geofence::boundaryDistance(int32_t latitude, int32_t longitude)
+{
+	uint32_t min_distance = UINT32_MAX;
+	for (uint8_t idx = 0; idx < _num_zones; idx++)
+	{
+		const geofence_zone_s *zone = &_zones[idx];
+		uint32_t distance;
+		if (zone->flags & GEOFENCE_CIRCLE)
+		{
+			uint32_t center = geo_distance(_lat[zone->first], _lon[zone->first], latitude, longitude);
+			distance = center > zone->radius ? center - zone->radius : zone->radius - center;
+			min_distance = distance < min_distance ? distance : min_distance;
+			continue;
+		}
+		uint16_t last = zone->first + zone->count - 1;
+		for (uint16_t point = zone->first, prev = last; point <= last; prev = point++)
+		{
+			distance = edgeDistance(latitude, longitude, prev, point);
+			min_distance = distance < min_distance ? distance : min_distance;
+		}
+	}
+	return min_distance;
+}
+
+/**
+ * @brief Distance from a position to a polygon edge
+ *
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @param idx_a Index of the first point of the edge
+ * @param idx_b Index of the second point of the edge
+ * @return uint32_t distance in meters
+ */
+uint32_t Geofence::edgeDistance(int32_t latitude, int32_t longitude, uint16_t idx_a, uint16_t idx_b)
+{
+	int32_t a_east;
+	int32_t a_north;
+	int32_t b_east;
+	int32_t b_north;
+	geo_offset(latitude, longitude, _lat[idx_a], _lon[idx_a], &a_east, &a_north);
+	geo_offset(latitude, longitude, _lat[idx_b], _lon[idx_b], &b_east, &b_north);
+
+	int64_t edge_east = (int64_t)b_east - a_east;
+	int64_t edge_north = (int64_t)b_north - a_north;
+	int64_t edge_len2 = edge_east * edge_east + edge_north * edge_north;
+	// Projection of the position (the origin) onto the edge
+	int64_t dot = -((int64_t)a_east * edge_east + (int64_t)a_north * edge_north);
+	if ((dot <= 0) || (edge_len2 == 0))
+	{
+		return geo_isqrt((uint64_t)((int64_t)a_east * a_east + (int64_t)a_north * a_north));
+	}
+	if (dot >= edge_len2)
+	{
+		return geo_isqrt((uint64_t)((int64_t)b_east * b_east + (int64_t)b_north * b_north));
+	}
+	int64_t cross = (int64_t)a_east * edge_north - (int64_t)a_north * edge_east;
+	if (cross < 0)
+	{
+		cross = -cross;
+	}
+	return (uint32_t)(cross / geo_isqrt((uint64_t)edge_len2));
+}
+
+/**
+ * @brief Crossing number test of a position against a zone polygon
+ *
+ * @param zone Zone to test
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @return true if the position is inside the polygon
+ * @return false if the position is outside the polygon
+ */
+bool Geofence::inside(const geofence_zone_s *zone, int32_t latitude, int32_t longitude)
+{
+	if (zone->flags & GEOFENCE_CIRCLE)
+	{
+		return geo_distance(_lat[zone->first], _lon[zone->first], latitude, longitude) <= zone->radius;
+	}
+
+	if (zone->count < 3)
+	{
+		return false;
+	}
+
+	bool is_inside = false;
+	uint16_t last = zone->first + zone->count - 1;
+	for (uint16_t idx = zone->first, prev = last; idx <= last; prev = idx++)
+	{
+		int64_t lat_i = _lat[idx];
+		int64_t lat_j = _lat[prev];
+		if ((lat_i > latitude) == (lat_j > latitude))
+		{
+			continue;
+		}
+		int64_t lon_i = _lon[idx];
+		int64_t lon_j = _lon[prev];
+		// Side of the edge the position is on, without division
+		int64_t cross = (lon_j - lon_i) * (latitude - lat_i) - (longitude - lon_i) * (lat_j - lat_i);
+		if ((lat_j > lat_i) ? (cross > 0) : (cross < 0))
+		{
+			is_inside = !is_inside;
+		}
+	}
+	return is_inside;
+}
+
+/**
+ * @brief Recalculate the bounding boxes of all zones
+ *
+ */
+void Geofence::updateBounds(void)
+{
+	_home_mask = 0;
+	_min_lat = INT32_MAX;
+	_max_lat = INT32_MIN;
+	_min_lon = INT32_MAX;
+	_max_lon = INT32_MIN;
+
+	for (uint8_t idx = 0; idx < _num_zones; idx++)
+	{
+		geofence_zone_s *zone = &_zones[idx];
+		zone->min_lat = INT32_MAX;
+		zone->max_lat = INT32_MIN;
+		zone->min_lon = INT32_MAX;
+		zone->max_lon = INT32_MIN;
+		for (uint16_t point = zone->first; point < zone->first + zone->count; point++)
+		{
+			zone->min_lat = _lat[point] < zone->min_lat ? _lat[point] : zone->min_lat;
+			zone->max_lat = _lat[point] > zone->max_lat ? _lat[point] : zone->max_lat;
+			zone->min_lon = _lon[point] < zone->min_lon ? _lon[point] : zone->min_lon;
+			zone->max_lon = _lon[point] > zone->max_lon ? _lon[point] : zone->max_lon;
+		}
+		if (zone->flags & GEOFENCE_CIRCLE)
+		{
+			int32_t cos_lat = geo_cos_q15(_lat[zone->first]);
+			int64_t d_lat = ((int64_t)zone->radius * 10000000) / GEO_M_PER_DEG + 1;
+			int64_t d_lon = cos_lat > 0 ? (d_lat * 32768) / cos_lat + 1 : 1800000000;
+			// Extend in 64 bit, the box of a circle near the poles or the antimeridian leaves the int32 range
+			int64_t min_lat = (int64_t)zone->min_lat - d_lat;
+			int64_t max_lat = (int64_t)zone->max_lat + d_lat;
+			int64_t min_lon = (int64_t)zone->min_lon - d_lon;
+			int64_t max_lon = (int64_t)zone->max_lon + d_lon;
+			zone->min_lat = (int32_t)(min_lat < -900000000 ? -900000000 : min_lat);
+			zone->max_lat = (int32_t)(max_lat > 900000000 ? 900000000 : max_lat);
+			// A circle across the antimeridian or around a pole covers all longitudes in the box
+			if ((min_lon < -1800000000) || (max_lon > 1800000000) || (min_lat < -900000000) || (max_lat > 900000000))
+			{
+				zone->min_lon = -1800000000;
+				zone->max_lon = 1800000000;
+			}
+			else
+			{
+				zone->min_lon = (int32_t)min_lon;
+				zone->max_lon = (int32_t)max_lon;
+			}
+		}
+		_min_lat = zone->min_lat < _min_lat ? zone->min_lat : _min_lat;
+		_max_lat = zone->max_lat > _max_lat ? zone->max_lat : _max_lat;
+		_min_lon = zone->min_lon < _min_lon ? zone->min_lon : _min_lon;
+		_max_lon = zone->max_lon > _max_lon ? zone->max_lon : _max_lon;
+		if (zone->flags & GEOFENCE_HOME)
+		{
+			_home_mask |= 1UL << zone->id;
+		}
+	}
+}
@@ -25,9 +25,35 @@ SemaphoreHandle_t g_gnss_sem;
 /** GNSS polling function */
 bool poll_gnss(void);
 
+/** Add last location to data packet */
+static void pack_location(void);
+
 /** Flag if location was found */
 volatile bool last_read_ok = false;
 
+/** Last valid location */
+gnss_fix_s g_last_fix;
+/** Flag if a location was found since power up */
+bool has_fix = false;
+/** Time of the last location fix in seconds */
+uint32_t last_acquisition = 0;
+
+/** UTC time in seconds since 1970 at the last GNSS time */
+uint32_t gnss_time_base = 0;
+/** millis() at the last GNSS time */
+uint32_t gnss_time_millis = 0;
+/** Flag if the GNSS time was received since power up */
+bool gnss_time_valid = false;
+
+/** Assumed max speed in m/s if the accelerometer reported no movement */
+#define GNSS_HOLD_SPEED_IDLE 2
+/** Assumed max speed in m/s if the accelerometer reported a little movement */
+#define GNSS_HOLD_SPEED_LOW 5
+/** Max number of movement interrupts to count as a little movement */
+#define GNSS_HOLD_MAX_EVENTS 5
+/** Max time in seconds to skip GNSS acquisitions */
+#define GNSS_HOLD_MAX_TIME 3600
+
 /** Flag if GNSS is serial or I2C */
 bool i2c_gnss = false;
 
@@ -163,6 +189,161 @@ bool init_gnss(void)
 	}
 }
 
+/**
+ * @brief Remember a valid location and add it to the data packet
+ *
+ * @param latitude Latitude as read from the GNSS receiver
+ * @param longitude Longitude as read from the GNSS receiver
+ * @param altitude Altitude as read from the GNSS receiver
+ * @param accuracy Accuracy of reading from the GNSS receiver
+ */
+static void add_location(int64_t latitude, int64_t longitude, int32_t altitude, int32_t accuracy)
+{
+	g_last_fix.latitude = latitude;
+	g_last_fix.longitude = longitude;
+	g_last_fix.altitude = altitude;
+	g_last_fix.accuracy = accuracy;
+	g_last_fix.time = millis() / 1000;
+
+	has_fix = true;
+	last_acquisition = g_last_fix.time;
+	g_acc_events = 0;
+
+	pack_location();
+}
+
+/**
+ * @brief Days since 1970-01-01 of a date
+ *
+ * @param year Year, 1970 or later
+ * @param month Month 1 to 12
+ * @param day Day 1 to 31
+ * @return uint32_t days since 1970-01-01
+ */
+static uint32_t days_since_1970(uint16_t year, uint8_t month, uint8_t day)
+{
+	// Years start in March, so the leap day is the last day of the year
+	uint32_t shifted_year = month <= 2 ? year - 1 : year;
+	uint32_t era = shifted_year / 400;
+	uint32_t year_of_era = shifted_year - era * 400;
+	uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	return era * 146097 + day_of_era - 719468;
+}
+
+/**
+ * @brief Set the UTC time from the GNSS time
+ *
+ * @param seconds UTC time in seconds since 1970
+ */
+void gnss_time_sync(uint32_t seconds)
+{
+	gnss_time_base = seconds;
+	gnss_time_millis = millis();
+	gnss_time_valid = true;
+}
+
+/**
+ * @brief Get the UTC time from the last GNSS time
+ *
+ * @param seconds returns the UTC time in seconds since 1970
+ * @return true if the GNSS time was received since power up
+ */
+bool gnss_utc_time(uint32_t *seconds)
+{
+	if (!gnss_time_valid)
+	{
+		return false;
+	}
+	*seconds = gnss_time_base + (millis() - gnss_time_millis) / 1000;
+	return true;
+}
+
+/**
+ * @brief Get the UTC time of day from the last GNSS time
+ *
+ * @param time_of_day returns the time of day in ms
+ * @return true if the GNSS time was received since power up
+ */
+bool gnss_time_of_day(uint32_t *time_of_day)
+{
+	if (!gnss_time_valid)
+	{
+		return false;
+	}
+	uint64_t day_ms = (uint64_t)(gnss_time_base % SPREAD_DAY) * 1000 + (millis() - gnss_time_millis);
+	*time_of_day = (uint32_t)(day_ms % (SPREAD_DAY * 1000));
+	return true;
+}
+
+/**
+ * @brief Add the last valid location to the data packet
+ *
+ */
+static void pack_location(void)
+{
+	if (!g_is_helium)
+	{
+		// With a low airtime budget the location is sent with 4 digit precision
+		if (g_gps_prec_6 && (g_budget_level < BUDGET_COARSE))
+		{
+			// Save extended precision, not Cayenne LPP compatible
+			g_data_packet.addGNSS_6(LPP_CHANNEL_GPS, g_last_fix.latitude, g_last_fix.longitude, g_last_fix.altitude);
+		}
+		else
+		{
+			// Save default Cayenne LPP precision
+			g_data_packet.addGNSS_4(LPP_CHANNEL_GPS, g_last_fix.latitude, g_last_fix.longitude, g_last_fix.altitude);
+		}
+	}
+	else
+	{
+		// Save default Cayenne LPP precision
+		g_data_packet.addGNSS_H(g_last_fix.latitude, g_last_fix.longitude, g_last_fix.altitude, g_last_fix.accuracy, read_batt());
+	}
+}
+
+/**
+ * @brief Check if the next GNSS acquisition can be skipped
+ *        If the last location is inside a zone and the accelerometer
+ *        shows only small movement, the asset cannot have reached a
+ *        zone boundary yet. The hold time is the distance to the nearest
+ *        boundary divided by the max speed the activity allows.
+ *
+ * @return true if the last location can be used again
+ * @return false if a new location is required
+ */
+static bool gnss_on_hold(void)
+{
+	if (g_is_helium || !has_fix || (g_zone_mask == 0))
+	{
+		return false;
+	}
+
+	uint32_t max_speed;
+	if (g_acc_events == 0)
+	{
+		max_speed = GNSS_HOLD_SPEED_IDLE;
+	}
+	else if (g_acc_events <= GNSS_HOLD_MAX_EVENTS)
+	{
+		max_speed = GNSS_HOLD_SPEED_LOW;
+	}
+	else
+	{
+		return false;
+	}
+
+	uint32_t hold_time = g_geofence.boundaryDistance(g_last_fix.latitude, g_last_fix.longitude) / max_speed;
+	if (hold_time > GNSS_HOLD_MAX_TIME)
+	{
+		hold_time = GNSS_HOLD_MAX_TIME;
+	}
+	uint32_t elapsed = (millis() / 1000) - last_acquisition;
+	MYLOG("GNSS", "Hold %lds, elapsed %lds, %d ACC events", (long)hold_time, (long)elapsed, g_acc_events);
+	return elapsed < hold_time;
+}
+
 /**
  * @brief Check GNSS module for position
  *
@@ -237,6 +418,10 @@ bool poll_gnss(void)
 				if (fix_type >= 3) /** Fix type 3D */
 				{
 					last_read_ok = true;
+					if (my_gnss.getTimeValid())
+					{
+						gnss_time_sync(my_gnss.getUnixEpoch());
+					}
 					latitude = my_gnss.getLatitude();
 					longitude = my_gnss.getLongitude();
 					altitude = my_gnss.getAltitude();
@@ -269,6 +454,11 @@ bool poll_gnss(void)
 					{
 						MYLOG("GNSS", "Location valid");
 						has_pos = true;
+						if (my_rak1910_gnss.time.isValid() && my_rak1910_gnss.date.isValid() && (my_rak1910_gnss.date.year() >= 2020))
+						{
+							gnss_time_sync(days_since_1970(my_rak1910_gnss.date.year(), my_rak1910_gnss.date.month(), my_rak1910_gnss.date.day()) * SPREAD_DAY +
+										   my_rak1910_gnss.time.hour() * 3600UL + my_rak1910_gnss.time.minute() * 60 + my_rak1910_gnss.time.second());
+						}
 						latitude = (uint64_t)(my_rak1910_gnss.location.lat() * 10000000.0);
 						longitude = (uint64_t)(my_rak1910_gnss.location.lng() * 10000000.0);
 					}
@@ -315,24 +505,7 @@ bool poll_gnss(void)
 			last_read_ok = false;
 			return false;
 		}
-		if (!g_is_helium)
-		{
-			if (g_gps_prec_6)
-			{
-				// Save extended precision, not Cayenne LPP compatible
-				g_data_packet.addGNSS_6(LPP_CHANNEL_GPS, latitude, longitude, altitude);
-			}
-			else
-			{
-				// Save default Cayenne LPP precision
-				g_data_packet.addGNSS_4(LPP_CHANNEL_GPS, latitude, longitude, altitude);
-			}
-		}
-		else
-		{
-			// Save default Cayenne LPP precision
-			g_data_packet.addGNSS_H(latitude, longitude, altitude, accuracy, read_batt());
-		}
+		add_location(latitude, longitude, altitude, accuracy);
 
 		if (g_is_helium)
 		{
@@ -359,24 +532,7 @@ bool poll_gnss(void)
 		altitude = 35000;
 		accuracy = 100;
 
-		if (!g_is_helium)
-		{
-			if (g_gps_prec_6)
-			{
-				// Save extended precision, not Cayenne LPP compatible
-				g_data_packet.addGNSS_6(LPP_CHANNEL_GPS, latitude, longitude, altitude);
-			}
-			else
-			{
-				// Save default Cayenne LPP precision
-				g_data_packet.addGNSS_4(LPP_CHANNEL_GPS, latitude, longitude, altitude);
-			}
-		}
-		else
-		{
-			// Save default Cayenne LPP precision
-			g_data_packet.addGNSS_H(latitude, longitude, altitude, accuracy, read_batt());
-		}
+		add_location(latitude, longitude, altitude, accuracy);
 		last_read_ok = true;
 		return true;
 #endif
@@ -418,6 +574,18 @@ void gnss_task(void *pvParameters)
 		if (xSemaphoreTake(g_gnss_sem, portMAX_DELAY) == pdTRUE)
 		{
 			MYLOG("GNSS", "GNSS Task wake up");
+			if (gnss_on_hold())
+			{
+				// Asset cannot have left the zone yet, use the last location
+				AT_PRINTF("+EVT:LOCATION HOLD\n");
+				pack_location();
+				last_read_ok = true;
+				if (g_task_sem != NULL)
+				{
+					api_wake_loop(GNSS_FIN);
+				}
+				continue;
+			}
 			AT_PRINTF("+EVT:START_LOCATION\n");
 			// Get location
 			bool got_location = poll_gnss();
@@ -0,0 +1,153 @@
+/**
+ * @file hex_cell.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Hexagon cell index of a location and a set of recently mapped cells
+ * @version 0.1
+ * @date 2022-09-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "hex_cell.h"
+#include "geo_math.h"
+
+/** sqrt(3)/3 in Q30 */
+#define HEX_SQRT3_3 619925131LL
+/** 1/3 in Q30 */
+#define HEX_1_3 357913941LL
+/** 2/3 in Q30 */
+#define HEX_2_3 715827883LL
+/** 1.0 in Q30 */
+#define HEX_ONE (1LL << 30)
+
+/**
+ * @brief Round a Q30 value to the nearest integer, halves away from zero
+ *
+ * @param value Q30 value
+ * @return int64_t rounded value
+ */
+static int64_t round_q30(int64_t value)
+{
+	return value >= 0 ? (value + HEX_ONE / 2) / HEX_ONE : -((-value + HEX_ONE / 2) / HEX_ONE);
+}
+
+/**
+ * @brief Get the hexagon cell of a location
+ *
+ * @param latitude Latitude in 1/10'000'000 degree
+ * @param longitude Longitude in 1/10'000'000 degree
+ * @param edge Edge length of the hexagons in meters
+ * @return uint64_t cell index, axial coordinates q (upper 32 bit) and r (lower 32 bit)
+ */
+uint64_t hex_cell(int32_t latitude, int32_t longitude, uint16_t edge)
+{
+	if (edge == 0)
+	{
+		edge = 1;
+	}
+	int64_t edge_cm = (int64_t)edge * 100;
+
+	// Sinusoidal projection in centimeters
+	int64_t y = ((int64_t)latitude * GEO_M_PER_DEG * 100) / 10000000;
+	int64_t x = ((int64_t)longitude * GEO_M_PER_DEG * 100) / 10000000;
+	x = (x * geo_cos_q30(latitude)) >> 30;
+
+	// Fractional axial coordinates in Q30
+	int64_t frac_q = (HEX_SQRT3_3 * x - HEX_1_3 * y) / edge_cm;
+	int64_t frac_r = (HEX_2_3 * y) / edge_cm;
+	int64_t frac_s = -frac_q - frac_r;
+
+	// Cube rounding, the component with the largest rounding error is recalculated
+	int64_t q = round_q30(frac_q);
+	int64_t r = round_q30(frac_r);
+	int64_t s = round_q30(frac_s);
+	int64_t diff_q = q * HEX_ONE - frac_q;
+	int64_t diff_r = r * HEX_ONE - frac_r;
+	int64_t diff_s = s * HEX_ONE - frac_s;
+	diff_q = diff_q < 0 ? -diff_q : diff_q;
+	diff_r = diff_r < 0 ? -diff_r : diff_r;
+	diff_s = diff_s < 0 ? -diff_s : diff_s;
+	if ((diff_q > diff_r) && (diff_q > diff_s))
+	{
+		q = -r - s;
+	}
+	else if (diff_r > diff_s)
+	{
+		r = -q - s;
+	}
+
+	return ((uint64_t)(uint32_t)(int32_t)q << 32) | (uint32_t)(int32_t)r;
+}
+
+/**
+ * @brief Get the q axial coordinate of a cell
+ *
+ * @param cell Cell index
+ * @return int32_t q
+ */
+int32_t hex_cell_q(uint64_t cell)
+{
+	return (int32_t)(uint32_t)(cell >> 32);
+}
+
+/**
+ * @brief Get the r axial coordinate of a cell
+ *
+ * @param cell Cell index
+ * @return int32_t r
+ */
+int32_t hex_cell_r(uint64_t cell)
+{
+	return (int32_t)(uint32_t)(cell);
+}
+
+/**
+ * @brief Check if a cell was mapped recently
+ *
+ * @param cell Cell index
+ * @param time Current time in seconds
+ * @param stale_time Time in seconds after which a cell is mapped again
+ * @return true if the cell was mapped within stale_time
+ * @return false if the cell is new or stale
+ */
+bool HexCellCache::isFresh(uint64_t cell, uint32_t time, uint32_t stale_time)
+{
+	for (uint8_t idx = 0; idx < _count; idx++)
+	{
+		if (_entries[idx].cell == cell)
+		{
+			return (time - _entries[idx].time) < stale_time;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Add or refresh a mapped cell
+ *        If the set is full, the least recently mapped cell is replaced
+ *
+ * @param cell Cell index
+ * @param time Current time in seconds
+ */
+void HexCellCache::add(uint64_t cell, uint32_t time)
+{
+	uint8_t oldest = 0;
+	for (uint8_t idx = 0; idx < _count; idx++)
+	{
+		if (_entries[idx].cell == cell)
+		{
+			_entries[idx].time = time;
+			return;
+		}
+		if ((time - _entries[idx].time) > (time - _entries[oldest].time))
+		{
+			oldest = idx;
+		}
+	}
+	if (_count < HEX_CACHE_SIZE)
+	{
+		oldest = _count++;
+	}
+	_entries[oldest].cell = cell;
+	_entries[oldest].time = time;
+}
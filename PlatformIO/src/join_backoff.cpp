@@ -0,0 +1,197 @@
+/**
+ * @file join_backoff.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Backoff between failed joins
+ * @version 0.1
+ * @date 2022-10-03
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "join_backoff.h"
+
+/** One hour in ms */
+#define JOIN_HOUR 3600000UL
+
+/**
+ * @brief Start with the default schedule and an empty history
+ *
+ * @param seed start value of the random delays, should be different on every device
+ */
+void JoinBackoff::begin(uint32_t seed)
+{
+	_seed = seed == 0 ? 1 : seed;
+	_base = JOIN_BASE_DELAY;
+	_max = JOIN_MAX_DELAY;
+	_per_hour = JOIN_MAX_PER_HOUR;
+	_attempts = 0;
+	_first = 0;
+	_late = false;
+	_last_toa = 0;
+	_head = 0;
+	_count = 0;
+}
+
+/**
+ * @brief Set the schedule
+ *
+ * @param base_delay delay after the first failed join in s
+ * @param max_delay max delay between joins in s
+ * @param per_hour max joins per hour, 1 to JOIN_HISTORY
+ */
+void JoinBackoff::setSchedule(uint16_t base_delay, uint16_t max_delay, uint8_t per_hour)
+{
+	_base = base_delay == 0 ? 1 : base_delay;
+	_max = max_delay < _base ? _base : max_delay;
+	_per_hour = per_hour == 0 ? 1 : (per_hour > JOIN_HISTORY ? JOIN_HISTORY : per_hour);
+}
+
+/**
+ * @brief A join was started
+ *
+ * @param now current time in ms
+ * @param toa airtime of all join requests of the join in us
+ * @param datarate data rate of the last join request, for the history
+ */
+void JoinBackoff::started(uint32_t now, uint32_t toa, uint8_t datarate)
+{
+	if (_attempts == 0)
+	{
+		// First join of a new series, the join duty cycle starts again
+		_first = now;
+		_late = false;
+	}
+	_history[_head].time = now;
+	_history[_head].datarate = datarate;
+	_history[_head].result = JOIN_PENDING;
+	_head = (_head + 1) % JOIN_HISTORY;
+	if (_count < JOIN_HISTORY)
+	{
+		_count++;
+	}
+	if (_attempts < 0xFFFF)
+	{
+		_attempts++;
+	}
+	_last_toa = toa;
+}
+
+/**
+ * @brief The last join failed
+ *
+ * @param now current time in ms
+ * @return uint32_t time until the next join in ms
+ */
+uint32_t JoinBackoff::failed(uint32_t now)
+{
+	if (_count != 0)
+	{
+		_history[(_head + JOIN_HISTORY - 1) % JOIN_HISTORY].result = JOIN_FAILED;
+	}
+
+	// Exponential delay, randomized between half and full delay
+	uint8_t shift = _attempts > 0 ? _attempts - 1 : 0;
+	uint32_t delay = (uint32_t)_max * 1000;
+	if (shift < 16 && ((uint32_t)_base << shift) < _max)
+	{
+		delay = ((uint32_t)_base << shift) * 1000;
+	}
+	delay = delay / 2 + random() % (delay / 2 + 1);
+
+	uint32_t wait = dutyWait(now);
+	if (wait > delay)
+	{
+		delay = wait;
+	}
+	wait = hourWait(now);
+	if (wait > delay)
+	{
+		delay = wait;
+	}
+	return delay;
+}
+
+/**
+ * @brief The last join succeeded, the next join starts a new series
+ *
+ */
+void JoinBackoff::joined(void)
+{
+	if (_count != 0)
+	{
+		_history[(_head + JOIN_HISTORY - 1) % JOIN_HISTORY].result = JOIN_OK;
+	}
+	_attempts = 0;
+}
+
+/**
+ * @brief Get a join of the history
+ *
+ * @param idx 0 is the last join
+ * @param attempt returns the join
+ * @return true if the join exists
+ */
+bool JoinBackoff::history(uint8_t idx, join_attempt_s *attempt)
+{
+	if (idx >= _count)
+	{
+		return false;
+	}
+	*attempt = _history[(_head + JOIN_HISTORY - 1 - idx) % JOIN_HISTORY];
+	return true;
+}
+
+/**
+ * @brief Next value of the random delays (xorshift)
+ *
+ * @return uint32_t random value
+ */
+uint32_t JoinBackoff::random(void)
+{
+	_seed ^= _seed << 13;
+	_seed ^= _seed >> 17;
+	_seed ^= _seed << 5;
+	return _seed;
+}
+
+/**
+ * @brief Time until the join duty cycle allows the next join
+ *        The airtime of the last join has to be followed by a pause of
+ *        100, 1000 or 10000 times the airtime.
+ *
+ * @param now current time in ms
+ * @return uint32_t wait time in ms
+ */
+uint32_t JoinBackoff::dutyWait(uint32_t now)
+{
+	if (_count == 0)
+	{
+		return 0;
+	}
+	uint32_t elapsed = now - _first;
+	// Latched, the time since the first join may wrap around
+	if (elapsed >= 11 * JOIN_HOUR)
+	{
+		_late = true;
+	}
+	uint32_t factor = _late ? 10000 : (elapsed >= JOIN_HOUR ? 1000 : 100);
+	uint32_t pause = (_last_toa / 1000) * factor;
+	uint32_t since = now - _history[(_head + JOIN_HISTORY - 1) % JOIN_HISTORY].time;
+	return pause > since ? pause - since : 0;
+}
+
+/**
+ * @brief Time until the oldest of the max joins per hour is one hour old
+ *
+ * @param now current time in ms
+ * @return uint32_t wait time in ms
+ */
+uint32_t JoinBackoff::hourWait(uint32_t now)
+{
+	if (_count < _per_hour)
+	{
+		return 0;
+	}
+	uint32_t age = now - _history[(_head + JOIN_HISTORY - _per_hour) % JOIN_HISTORY].time;
+	return age < JOIN_HOUR ? JOIN_HOUR - age : 0;
+}
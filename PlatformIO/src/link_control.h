@@ -0,0 +1,85 @@
+/**
+ * @file link_control.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Data rate and TX power from the SNR margin of the link
+ *        No Arduino dependencies
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef LINK_CONTROL_H
+#define LINK_CONTROL_H
+
+#include <stdint.h>
+
+/** Controller modes */
+#define LINK_CTL_OFF 0		// data rate and TX power as set with AT+DR and AT+TXP or by ADR
+#define LINK_CTL_ADAPTIVE 1 // data rate and TX power from the SNR margin
+
+/** Defaults */
+#define LINK_CTL_TARGET 10	   // SNR margin kept in dB
+#define LINK_CTL_HYSTERESIS 3  // extra margin in dB before the data rate is raised or the power lowered
+/** Number of margin samples in the window */
+#define LINK_CTL_WINDOW 6
+/** Max number of TX power steps below the TX power set with AT+TXP */
+#define LINK_CTL_POWER_STEPS 5
+/** Missed ACKs in a row before the robust settings are used */
+#define LINK_CTL_MISSED 2
+
+uint8_t link_ctl_max_power(uint8_t region);
+
+/**
+ * @brief Selects data rate and TX power for the next uplink.
+ *        The SNR margins of the last downlinks are kept in a window, converted to
+ *        the margin at the lowest data rate and full power. One data rate step is
+ *        2.5 dB, one TX power step is 2 dB. The estimate is the lower of the window
+ *        average and the last sample, so a falling link is followed at once.
+ *        The data rate is raised first, the power is lowered only at the highest
+ *        data rate. Raising needs the target margin plus the hysteresis, lowering
+ *        starts when the margin falls below the target.
+ *        After missed ACKs the lowest data rate and full power are used.
+ *        Margins are in 0.5 dB steps internally.
+ */
+class LinkControl
+{
+public:
+	LinkControl(void)
+	{
+		begin(LINK_CTL_OFF, LINK_CTL_TARGET, LINK_CTL_HYSTERESIS);
+		setRange(0, 0, 0);
+	}
+
+	void begin(uint8_t mode, uint8_t target, uint8_t hysteresis);
+	void setRange(uint8_t min_dr, uint8_t max_dr, uint8_t power_steps);
+	void reset(uint8_t datarate, uint8_t power);
+	void sample(int8_t margin);
+	bool acked(bool ack);
+	bool update(void);
+	bool estimate(int8_t *margin);
+	uint8_t mode(void) { return _mode; }
+	uint8_t target(void) { return _target; }
+	uint8_t hysteresis(void) { return _hysteresis; }
+	uint8_t datarate(void) { return _dr; }
+	uint8_t power(void) { return _power; }
+
+private:
+	int16_t cost(void);
+	int16_t level(void);
+
+	uint8_t _mode;
+	uint8_t _target;
+	uint8_t _hysteresis;
+	uint8_t _min_dr;
+	uint8_t _max_dr;
+	uint8_t _power_steps;
+	uint8_t _dr;
+	uint8_t _power;
+	uint8_t _missed;
+	int16_t _samples[LINK_CTL_WINDOW];
+	uint8_t _head;
+	uint8_t _count;
+};
+
+#endif
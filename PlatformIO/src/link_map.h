@@ -0,0 +1,58 @@
+/**
+ * @file link_map.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Per cell aggregates of the downlink RSSI and SNR
+ *        No Arduino dependencies, the packet format is documented
+ *        in LinkMap::pack()
+ * @version 0.1
+ * @date 2022-09-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef LINK_MAP_H
+#define LINK_MAP_H
+
+#include <stdint.h>
+
+/** Max number of cells in the table */
+#define LINK_MAP_SIZE 32
+/** Size of the packet header, cell edge length */
+#define LINK_MAP_HEADER_SIZE 2
+/** Size of one cell in the packet */
+#define LINK_MAP_ENTRY_SIZE 13
+/** Max magnitude of the cell coordinates, they are packed as 3 byte signed values */
+#define LINK_MAP_COORD_MAX 0x7FFFFF
+
+/** Link quality aggregates of one cell */
+struct link_cell_s
+{
+	uint64_t cell;
+	uint16_t count;
+	int16_t rssi_min;
+	int16_t rssi_max;
+	int32_t rssi_sum;
+	int8_t snr_min;
+	int8_t snr_max;
+	int32_t snr_sum;
+};
+
+/**
+ * @brief Table of link quality per cell
+ */
+class LinkMap
+{
+public:
+	LinkMap(void) { clear(); }
+
+	void clear(void) { _count = 0; }
+	bool add(uint64_t cell, int16_t rssi, int8_t snr);
+	uint8_t count(void) { return _count; }
+	uint8_t pack(uint8_t *buffer, uint8_t max_size, uint16_t edge);
+
+private:
+	link_cell_s _cells[LINK_MAP_SIZE];
+	uint8_t _count;
+};
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * @file payload_plan.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fit Cayenne LPP packets into the max payload of the current data rate
+ *        No Arduino dependencies
+ * @version 0.1
+ * @date 2022-09-19
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef PAYLOAD_PLAN_H
+#define PAYLOAD_PLAN_H
+
+#include <stdint.h>
+
+/** Max number of fields in a planned packet */
+#define PLAN_MAX_FIELDS 16
+
+uint8_t plan_max_payload(uint8_t region, uint8_t datarate);
+uint8_t plan_lpp(const uint8_t *packet, uint8_t size, uint8_t max_size,
+				 const uint8_t *priority, uint8_t priority_count,
+				 uint8_t *planned, uint8_t *deferred, uint8_t *deferred_size);
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file pos_codec.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Compact codec for a series of locations
+ *        The first location is bit packed with absolute values,
+ *        the following locations are zigzag varint deltas.
+ *        No Arduino dependencies, the same files decode the data on the backend.
+ * @version 0.1
+ * @date 2022-09-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef POS_CODEC_H
+#define POS_CODEC_H
+
+#include <stdint.h>
+
+/** Codec version in the header byte */
+#define POS_CODEC_VERSION 0
+/** Max number of bytes of one encoded location */
+#define POS_CODEC_MAX_POINT 20
+
+/** Latitude/longitude resolution, steps of 10^n * 1e-7 degree */
+#define POS_RES_1E7 0
+#define POS_RES_1E6 1
+#define POS_RES_1E5 2
+#define POS_RES_1E4 3
+/** Altitude resolution, steps of 10^n mm */
+#define ALT_RES_MM 0
+#define ALT_RES_CM 1
+#define ALT_RES_DM 2
+#define ALT_RES_M 3
+
+/** One location, latitude/longitude in 1e-7 degree, altitude in mm, time in seconds */
+struct pos_point_s
+{
+	int32_t latitude;
+	int32_t longitude;
+	int32_t altitude;
+	uint32_t time;
+};
+
+/**
+ * @brief Encoder for a series of locations
+ *        Format:
+ *        1 byte header: version (bits 7-6), lat/lon resolution (bits 5-3), altitude resolution (bits 2-0)
+ *        First location, bit packed MSB first and padded to a full byte:
+ *          latitude + 90°, longitude + 180°, altitude + 1000m as unsigned values
+ *          in the selected resolution, with as many bits as the range needs,
+ *          then the time as varint
+ *        Following locations: zigzag varint deltas of latitude, longitude, altitude and time
+ *        Deltas are taken between the quantized values, so rounding errors do not add up.
+ */
+class PosEncoder
+{
+public:
+	PosEncoder(void) { begin(0, 0); }
+
+	void begin(uint8_t *buffer, uint8_t max_size, uint8_t pos_res = POS_RES_1E6, uint8_t alt_res = ALT_RES_M);
+	bool add(const pos_point_s *point);
+	uint8_t getSize(void) { return _size; }
+	uint8_t count(void) { return _count; }
+
+private:
+	uint8_t *_buffer;
+	uint8_t _max_size;
+	uint8_t _size;
+	uint8_t _count;
+	uint8_t _pos_res;
+	uint8_t _alt_res;
+	uint32_t _last[4];
+};
+
+/**
+ * @brief Decoder for data created by PosEncoder
+ */
+class PosDecoder
+{
+public:
+	bool begin(const uint8_t *buffer, uint8_t size);
+	bool next(pos_point_s *point);
+
+private:
+	const uint8_t *_buffer;
+	uint8_t _size;
+	uint8_t _cursor;
+	uint8_t _count;
+	uint8_t _pos_res;
+	uint8_t _alt_res;
+	uint32_t _last[4];
+};
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file uplink_queue.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Priority ordered uplink queue kept in a circular log in flash
+ *        No Arduino dependencies, the application provides the storage functions
+ * @version 0.1
+ * @date 2022-09-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef UPLINK_QUEUE_H
+#define UPLINK_QUEUE_H
+
+#include <stdint.h>
+
+/** Number of slots in the log */
+#define QUEUE_SLOTS 16
+/** Max size of a queued packet */
+#define QUEUE_MAX_DATA 242
+/** Size of the header of a slot */
+#define QUEUE_HEADER_SIZE 14
+/** Size of a slot */
+#define QUEUE_SLOT_SIZE (QUEUE_HEADER_SIZE + QUEUE_MAX_DATA)
+/** Size of the log */
+#define QUEUE_LOG_SIZE (QUEUE_SLOTS * QUEUE_SLOT_SIZE)
+
+/** Priorities, higher priorities are sent first and dropped last */
+#define QUEUE_PRIO_NONE 0
+#define QUEUE_PRIO_PERIODIC 1
+#define QUEUE_PRIO_MOTION 2
+#define QUEUE_PRIO_ALARM 3
+
+/** Read or write a part of the log, returns false on failure */
+typedef bool (*queue_read_t)(uint32_t offset, uint8_t *data, uint16_t size);
+typedef bool (*queue_write_t)(uint32_t offset, const uint8_t *data, uint16_t size);
+
+/**
+ * @brief Uplink queue in a log of QUEUE_SLOTS fixed size slots.
+ *        New packets are appended in the slot after the newest one, only if the
+ *        log is full a packet with lower priority is overwritten.
+ *        A sent packet is marked in the state byte of its slot.
+ *        A slot filled with 0xFF is empty.
+ *        Times are in seconds of a clock that continues after a reset,
+ *        see lastTime().
+ */
+class UplinkQueue
+{
+public:
+	UplinkQueue(void) : _read(0), _write(0) { reset(); }
+
+	void begin(queue_read_t read, queue_write_t write);
+	bool push(uint32_t now, uint8_t priority, uint8_t fport, const uint8_t *data, uint8_t size, uint32_t max_age);
+	uint8_t peek(uint32_t now, uint8_t *fport, uint8_t *data, uint32_t *age);
+	void pop(void);
+	void clear(void);
+	uint8_t count(void);
+	uint32_t lastTime(void) { return _last_time; }
+
+private:
+	void reset(void);
+	void drop(uint8_t slot);
+
+	queue_read_t _read;
+	queue_write_t _write;
+	uint32_t _seq[QUEUE_SLOTS];
+	uint32_t _created[QUEUE_SLOTS];
+	uint32_t _max_age[QUEUE_SLOTS];
+	uint8_t _priority[QUEUE_SLOTS];
+	bool _valid[QUEUE_SLOTS];
+	uint32_t _next_seq;
+	uint8_t _head;
+	uint8_t _peeked;
+	uint32_t _last_time;
+};
+
+#endif
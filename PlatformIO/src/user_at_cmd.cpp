@@ -10,6 +10,7 @@
  */
 
 #include "app.h"
+#include "field_writer.h"
 #include <Adafruit_LittleFS.h>
 #include <InternalFileSystem.h>
 using namespace Adafruit_LittleFS_Namespace;
@@ -26,12 +27,99 @@ static const char helium_format[] = "HELIUM";
 /** Filename to save Battery check setting */
 static const char batt_name[] = "BATT";
 
+/** Filename to save dead reckoning settings */
+static const char dr_name[] = "DRPRED";
+
+/** Filename to save geofence zones */
+static const char geofence_name[] = "GEOF";
+
+/** Filename to save Helium Mapper cell settings */
+static const char hex_name[] = "HEXMAP";
+
+/** Filename to save mapped Helium Mapper cells */
+static const char hex_cells_name[] = "HEXCELLS";
+
+/** Filename to save the link map setting */
+static const char link_name[] = "LINKMAP";
+
+/** Filename to save the batch setting */
+static const char batch_name[] = "BATCH";
+
+/** Filename to save the fragmentation setting */
+static const char frag_name[] = "FRAG";
+
+/** Filename to save the environment change detection settings */
+static const char env_name[] = "ENVFILT";
+
+/** Filename to save the daily airtime budget */
+static const char budget_name[] = "DAYAIR";
+
+/** Filename of the uplink queue log */
+static const char queue_name[] = "UPQUEUE";
+
+/** Filename to save the number of resets by the link recovery */
+static const char recovery_name[] = "RECOVERY";
+
+/** Filename to save the join backoff schedule */
+static const char join_name[] = "JOINBO";
+
+/** Filename to save the confirmed uplink policy */
+static const char confirm_name[] = "CONFPOL";
+
+/** Filename to save the data rate and TX power controller settings */
+static const char linkctl_name[] = "LINKCTL";
+
+/** Filename to save the uplink jitter and slot settings */
+static const char spread_name[] = "SPREAD";
+
 /** File to save GPS precision setting */
 File gps_file(InternalFS);
 
 /** File to save battery check status */
 File batt_check(InternalFS);
 
+/** File to save dead reckoning settings */
+File dr_file(InternalFS);
+
+/** File to save geofence zones */
+File geofence_file(InternalFS);
+
+/** File to save Helium Mapper cells */
+File hex_file(InternalFS);
+
+/** File to save the link map setting */
+File link_file(InternalFS);
+
+/** File to save the batch setting */
+File batch_file(InternalFS);
+
+/** File to save the fragmentation setting */
+File frag_file(InternalFS);
+
+/** File to save the environment change detection settings */
+File env_file(InternalFS);
+
+/** File to save the daily airtime budget */
+File budget_file(InternalFS);
+
+/** File of the uplink queue log */
+File queue_file(InternalFS);
+
+/** File to save the number of resets by the link recovery */
+File recovery_file(InternalFS);
+
+/** File to save the join backoff schedule */
+File join_file(InternalFS);
+
+/** File to save the confirmed uplink policy */
+File confirm_file(InternalFS);
+
+/** File to save the data rate and TX power controller settings */
+File linkctl_file(InternalFS);
+
+/** File to save the uplink jitter and slot settings */
+File spread_file(InternalFS);
+
 #define AT_PRINTF(...)                  \
 	Serial.printf(__VA_ARGS__);         \
 	if (g_ble_uart_is_connected)        \
@@ -317,47 +405,1921 @@ atcmd_t g_user_at_cmd_list_batt[] = {
 	{"+BATCHK", "Enable/Disable the battery charge check", at_query_batt_check, at_set_batt_check, at_query_batt_check},
 };
 
-/** Number of user defined AT commands */
-uint8_t g_user_at_cmd_num = 0;
+/*****************************************
+ * Dead reckoning AT commands
+ *****************************************/
 
-/** Pointer to the combined user AT command structure */
-atcmd_t *g_user_at_cmd_list;
+/**
+ * @brief Returns in g_at_query_buf the current dead reckoning settings
+ *
+ * @return int always 0
+ */
+static int at_query_dr(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Tolerance %dm, max skip %d, anchor every %d", g_dr_tolerance, g_dr_max_skip, g_dr_anchor_every);
+	return 0;
+}
 
 /**
- * @brief Initialize the user defined AT command list
+ * @brief Command to set the dead reckoning settings
  *
+ * @param str <tolerance>,<max skip>,<anchor every>
+ *  tolerance is the allowed prediction error in meters, 0 disables dead reckoning
+ *  max skip is the number of positions that can be skipped in a row
+ *  anchor every is the interval of sent locations that are confirmed and feed the predictor
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
  */
-void init_user_at(void)
+static int at_exec_dr(char *str)
 {
-	uint16_t index_next_cmds = 0;
-	uint16_t required_structure_size = sizeof(g_user_at_cmd_list_gps);
-	MYLOG("USR_AT", "Structure size %d GNSS", required_structure_size);
-	required_structure_size += sizeof(g_user_at_cmd_list_batt);
-	MYLOG("USR_AT", "Structure size %d Battery", required_structure_size);
-	required_structure_size += sizeof(g_user_at_cmd_list_modules);
-	MYLOG("USR_AT", "Structure size %d Modules", required_structure_size);
+	char *next_param;
+	long tolerance = strtol(str, &next_param, 0);
+	if ((next_param == str) || (tolerance < 0) || (tolerance > 65535))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	long max_skip = g_dr_max_skip;
+	if (*next_param == ',')
+	{
+		char *param = next_param + 1;
+		max_skip = strtol(param, &next_param, 0);
+		if ((next_param == param) || (max_skip < 1) || (max_skip > 255))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+	}
+	long anchor_every = g_dr_anchor_every;
+	if (*next_param == ',')
+	{
+		char *param = next_param + 1;
+		anchor_every = strtol(param, &next_param, 0);
+		if ((next_param == param) || (anchor_every < 1) || (anchor_every > 255))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+	}
+	g_dr_tolerance = tolerance;
+	g_dr_max_skip = max_skip;
+	g_dr_anchor_every = anchor_every;
+	save_dr_settings();
+	return 0;
+}
 
-	// Reserve memory for the structure
-	g_user_at_cmd_list = (atcmd_t *)malloc(required_structure_size);
+/**
+ * @brief Read saved dead reckoning settings
+ *
+ */
+void read_dr_settings(void)
+{
+	if (InternalFS.exists(dr_name))
+	{
+		uint8_t dr_settings[4];
+		dr_file.open(dr_name, FILE_O_READ);
+		// Files of older versions have no anchor interval
+		int read = dr_file.read(dr_settings, 4);
+		if (read >= 3)
+		{
+			g_dr_tolerance = (uint16_t)(dr_settings[0] << 8) | dr_settings[1];
+			g_dr_max_skip = dr_settings[2];
+			g_dr_anchor_every = ((read == 4) && (dr_settings[3] != 0)) ? dr_settings[3] : DR_ANCHOR_EVERY;
+		}
+		dr_file.close();
+		MYLOG("USR_AT", "File found, dead reckoning tolerance %d", g_dr_tolerance);
+	}
+	else
+	{
+		g_dr_tolerance = 0;
+		MYLOG("USR_AT", "File not found, dead reckoning disabled");
+	}
+}
 
-	// Add AT commands to structure
-	MYLOG("USR_AT", "Adding battery check AT commands");
-	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_batt) / sizeof(atcmd_t);
-	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_batt, sizeof(g_user_at_cmd_list_batt));
-	index_next_cmds += sizeof(g_user_at_cmd_list_batt) / sizeof(atcmd_t);
-	MYLOG("USR_AT", "Index after adding battery check %d", index_next_cmds);
+/**
+ * @brief Save the dead reckoning settings
+ *
+ */
+void save_dr_settings(void)
+{
+	InternalFS.remove(dr_name);
+	if (g_dr_tolerance != 0)
+	{
+		uint8_t dr_settings[4];
+		dr_settings[0] = (uint8_t)(g_dr_tolerance >> 8);
+		dr_settings[1] = (uint8_t)(g_dr_tolerance);
+		dr_settings[2] = g_dr_max_skip;
+		dr_settings[3] = g_dr_anchor_every;
+		dr_file.open(dr_name, FILE_O_WRITE);
+		dr_file.write(dr_settings, 4);
+		dr_file.close();
+		MYLOG("USR_AT", "Created File for dead reckoning");
+	}
+	else
+	{
+		MYLOG("USR_AT", "Remove File for dead reckoning");
+	}
+}
 
-	MYLOG("USR_AT", "Adding module AT commands");
-	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_modules) / sizeof(atcmd_t);
-	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_modules, sizeof(g_user_at_cmd_list_modules));
-	index_next_cmds += sizeof(g_user_at_cmd_list_modules) / sizeof(atcmd_t);
-	MYLOG("USR_AT", "Index after adding modules %d", index_next_cmds);
+atcmd_t g_user_at_cmd_list_dr[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Dead reckoning commands
+	{"+DRPRED", "Get/Set dead reckoning <tolerance m>,<max skip>,<anchor every>, 0 = off", at_query_dr, at_exec_dr, NULL},
+};
 
-	MYLOG("USR_AT", "Adding GNSS user AT commands");
-	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_gps) / sizeof(atcmd_t);
-	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_gps, sizeof(g_user_at_cmd_list_gps));
-	index_next_cmds += sizeof(g_user_at_cmd_list_gps) / sizeof(atcmd_t);
-	MYLOG("USR_AT", "Index after adding GNSS %d", index_next_cmds);
+/*****************************************
+ * Geofence AT commands
+ *****************************************/
+
+/**
+ * @brief Parse a coordinate in degrees
+ *
+ * @param str String with the coordinate, e.g. 14.421373
+ * @param end Pointer to the character after the coordinate
+ * @param value Coordinate in 1/10'000'000 degree
+ * @param limit Max absolute value in degrees, 90 for latitudes, 180 for longitudes
+ * @return true if a coordinate was found
+ * @return false if the string is not a valid coordinate
+ */
+static bool parse_coordinate(char *str, char **end, int32_t *value, double limit)
+{
+	double degree = strtod(str, end);
+	if ((*end == str) || (degree < -limit) || (degree > limit))
+	{
+		return false;
+	}
+	*value = (int32_t)lround(degree * 10000000.0);
+	return true;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the number of zones
+ *        and lists the zones over AT_PRINTF
+ *
+ * @return int always 0
+ */
+static int at_query_geofence(void)
+{
+	for (uint8_t idx = 0; idx < g_geofence.zones(); idx++)
+	{
+		const geofence_zone_s *zone = g_geofence.getZone(idx);
+		if (zone->flags & GEOFENCE_CIRCLE)
+		{
+			AT_PRINTF("Zone %d: circle %ldm%s\n", zone->id, (long)zone->radius, (zone->flags & GEOFENCE_HOME) ? ", home" : "");
+		}
+		else
+		{
+			AT_PRINTF("Zone %d: %d points%s\n", zone->id, zone->count, (zone->flags & GEOFENCE_HOME) ? ", home" : "");
+		}
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Zones %d, points %d of %d, inside %08lX", g_geofence.zones(), g_geofence.points(), GEOFENCE_MAX_POINTS, (unsigned long)g_zone_mask);
+	return 0;
+}
+
+/**
+ * @brief Command to add points to a polygon zone
+ *        Large polygons can be added with several commands,
+ *        the points are appended to the existing zone.
+ *
+ * @param str <id>,<flags>,<lat>,<lon>[,<lat>,<lon>...]
+ *  id is the zone ID 0 to 31
+ *  flags 0 = normal zone, 1 = home zone, no routine reports inside
+ *  lat/lon are in degrees, e.g. 14.421373,121.006914
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_geofence(char *str)
+{
+	char *next_param;
+	long id = strtol(str, &next_param, 0);
+	if ((next_param == str) || (*next_param != ',') || (id < 0) || (id >= GEOFENCE_MAX_ZONES))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	char *param = next_param + 1;
+	long flags = strtol(param, &next_param, 0);
+	if ((next_param == param) || (*next_param != ','))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+
+	// Check all points before adding any
+	int32_t latitude;
+	int32_t longitude;
+	uint16_t new_points = 0;
+	char *points = next_param;
+	while (*next_param == ',')
+	{
+		if (!parse_coordinate(next_param + 1, &next_param, &latitude, 90.0) || (*next_param != ','))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		if (!parse_coordinate(next_param + 1, &next_param, &longitude, 180.0))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		new_points++;
+	}
+	if ((new_points == 0) || ((g_geofence.points() + new_points) > GEOFENCE_MAX_POINTS))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+
+	next_param = points;
+	while (*next_param == ',')
+	{
+		parse_coordinate(next_param + 1, &next_param, &latitude, 90.0);
+		parse_coordinate(next_param + 1, &next_param, &longitude, 180.0);
+		// Only the first point can fail, on a circle ID or a full zone list, nothing was added then
+		if (!g_geofence.addPoint(id, flags, latitude, longitude))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+	}
+	save_geofence_settings();
+	return 0;
+}
+
+/**
+ * @brief Command to add a circle zone
+ *        An existing zone with the same ID is replaced.
+ *
+ * @param str <id>,<flags>,<lat>,<lon>,<radius>
+ *  id is the zone ID 0 to 31
+ *  flags 0 = normal zone, 1 = home zone, no routine reports inside
+ *  lat/lon of the center are in degrees, e.g. 14.421373,121.006914
+ *  radius is in meters
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_geofence_circle(char *str)
+{
+	char *next_param;
+	long id = strtol(str, &next_param, 0);
+	if ((next_param == str) || (*next_param != ',') || (id < 0) || (id >= GEOFENCE_MAX_ZONES))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	char *param = next_param + 1;
+	long flags = strtol(param, &next_param, 0);
+	if ((next_param == param) || (*next_param != ','))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	int32_t latitude;
+	int32_t longitude;
+	if (!parse_coordinate(next_param + 1, &next_param, &latitude, 90.0) || (*next_param != ','))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	if (!parse_coordinate(next_param + 1, &next_param, &longitude, 180.0) || (*next_param != ','))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	param = next_param + 1;
+	long radius = strtol(param, &next_param, 0);
+	if ((next_param == param) || (radius <= 0))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	if (!g_geofence.addCircle(id, flags, latitude, longitude, radius))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	save_geofence_settings();
+	return 0;
+}
+
+/**
+ * @brief Command to delete a zone
+ *
+ * @param str Zone ID
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_geofence_del(char *str)
+{
+	char *next_param;
+	long id = strtol(str, &next_param, 0);
+	if ((next_param == str) || (id < 0) || (id >= GEOFENCE_MAX_ZONES))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	if (!g_geofence.remove(id))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	save_geofence_settings();
+	return 0;
+}
+
+/**
+ * @brief Command to delete all zones
+ *
+ * @return int always 0
+ */
+static int at_exec_geofence_clear(void)
+{
+	g_geofence.clear();
+	save_geofence_settings();
+	return 0;
+}
+
+/**
+ * @brief Read saved geofence zones
+ *        Format per zone: ID, flags, number of points (2 bytes),
+ *        for circles the radius (4 bytes),
+ *        then latitude and longitude of each point (4 bytes each, MSB first)
+ *
+ */
+void read_geofence_settings(void)
+{
+	g_geofence.clear();
+	if (!InternalFS.exists(geofence_name))
+	{
+		MYLOG("USR_AT", "File not found, no geofence zones");
+		return;
+	}
+
+	uint8_t zone_header[4];
+	uint8_t point[8];
+	geofence_file.open(geofence_name, FILE_O_READ);
+	while (geofence_file.read(zone_header, 4) == 4)
+	{
+		uint16_t count = (uint16_t)(zone_header[2] << 8) | zone_header[3];
+		uint32_t radius = 0;
+		if (zone_header[1] & GEOFENCE_CIRCLE)
+		{
+			if (geofence_file.read(point, 4) != 4)
+			{
+				break;
+			}
+			radius = (uint32_t)point[0] << 24 | (uint32_t)point[1] << 16 | (uint32_t)point[2] << 8 | point[3];
+		}
+		for (uint16_t idx = 0; idx < count; idx++)
+		{
+			if (geofence_file.read(point, 8) != 8)
+			{
+				break;
+			}
+			int32_t latitude = (int32_t)((uint32_t)point[0] << 24 | (uint32_t)point[1] << 16 | (uint32_t)point[2] << 8 | point[3]);
+			int32_t longitude = (int32_t)((uint32_t)point[4] << 24 | (uint32_t)point[5] << 16 | (uint32_t)point[6] << 8 | point[7]);
+			if (zone_header[1] & GEOFENCE_CIRCLE)
+			{
+				g_geofence.addCircle(zone_header[0], zone_header[1], latitude, longitude, radius);
+			}
+			else
+			{
+				g_geofence.addPoint(zone_header[0], zone_header[1], latitude, longitude);
+			}
+		}
+	}
+	geofence_file.close();
+	MYLOG("USR_AT", "File found, %d geofence zones", g_geofence.zones());
+}
+
+/**
+ * @brief Save the geofence zones
+ *
+ */
+void save_geofence_settings(void)
+{
+	InternalFS.remove(geofence_name);
+	if (g_geofence.zones() == 0)
+	{
+		MYLOG("USR_AT", "Remove File for geofence zones");
+		return;
+	}
+
+	uint8_t zone_header[4];
+	uint8_t point[8];
+	geofence_file.open(geofence_name, FILE_O_WRITE);
+	for (uint8_t idx = 0; idx < g_geofence.zones(); idx++)
+	{
+		const geofence_zone_s *zone = g_geofence.getZone(idx);
+		zone_header[0] = zone->id;
+		zone_header[1] = zone->flags;
+		zone_header[2] = (uint8_t)(zone->count >> 8);
+		zone_header[3] = (uint8_t)(zone->count);
+		geofence_file.write(zone_header, 4);
+		if (zone->flags & GEOFENCE_CIRCLE)
+		{
+			point[0] = (uint8_t)(zone->radius >> 24);
+			point[1] = (uint8_t)(zone->radius >> 16);
+			point[2] = (uint8_t)(zone->radius >> 8);
+			point[3] = (uint8_t)(zone->radius);
+			geofence_file.write(point, 4);
+		}
+		for (uint16_t point_idx = zone->first; point_idx < zone->first + zone->count; point_idx++)
+		{
+			uint32_t latitude = (uint32_t)g_geofence.getLatitude(point_idx);
+			uint32_t longitude = (uint32_t)g_geofence.getLongitude(point_idx);
+			point[0] = (uint8_t)(latitude >> 24);
+			point[1] = (uint8_t)(latitude >> 16);
+			point[2] = (uint8_t)(latitude >> 8);
+			point[3] = (uint8_t)(latitude);
+			point[4] = (uint8_t)(longitude >> 24);
+			point[5] = (uint8_t)(longitude >> 16);
+			point[6] = (uint8_t)(longitude >> 8);
+			point[7] = (uint8_t)(longitude);
+			geofence_file.write(point, 8);
+		}
+	}
+	geofence_file.close();
+	MYLOG("USR_AT", "Created File for geofence zones");
+}
+
+atcmd_t g_user_at_cmd_list_geofence[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Geofence commands
+	{"+GEOF", "Get zones/Add points to zone <id>,<flags>,<lat>,<lon>[,<lat>,<lon>...], flags 1 = home", at_query_geofence, at_exec_geofence, NULL},
+	{"+GEOFC", "Add circle zone <id>,<flags>,<lat>,<lon>,<radius m>, flags 1 = home", NULL, at_exec_geofence_circle, NULL},
+	{"+GEOFDEL", "Delete zone <id>, without parameter delete all zones", NULL, at_exec_geofence_del, at_exec_geofence_clear},
+};
+
+/*****************************************
+ * Helium Mapper cell AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the current cell settings
+ *
+ * @return int always 0
+ */
+static int at_query_hex(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Cell edge %dm, stale after %dmin, %d cells mapped", g_hex_edge, g_hex_stale, g_hex_cache.count());
+	return 0;
+}
+
+/**
+ * @brief Command to set the Helium Mapper cell settings
+ *
+ * @param str <edge>,<stale>
+ *  edge is the edge length of the cells in meters, 0 sends every location
+ *  stale is the time in minutes after which a cell is mapped again
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_hex(char *str)
+{
+	char *next_param;
+	long edge = strtol(str, &next_param, 0);
+	if ((next_param == str) || (edge < 0) || (edge > 65535))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	long stale = g_hex_stale;
+	if (*next_param == ',')
+	{
+		char *param = next_param + 1;
+		stale = strtol(param, &next_param, 0);
+		if ((next_param == param) || (stale < 1) || (stale > 65535))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+	}
+	if (edge != g_hex_edge)
+	{
+		// Cells of a different size are not comparable
+		g_hex_cache.clear();
+		save_hex_cells();
+	}
+	g_hex_edge = edge;
+	g_hex_stale = stale;
+	save_hex_settings();
+	return 0;
+}
+
+/**
+ * @brief Command to forget all mapped cells
+ *
+ * @return int always 0
+ */
+static int at_clear_hex(void)
+{
+	g_hex_cache.clear();
+	save_hex_cells();
+	return 0;
+}
+
+/**
+ * @brief Read saved Helium Mapper cell settings and mapped cells
+ *        The cells have the GNSS time they were mapped, so they get
+ *        stale while the device is off as well
+ *
+ */
+void read_hex_settings(void)
+{
+	uint8_t buffer[12];
+	g_hex_cache.clear();
+	if (!InternalFS.exists(hex_name))
+	{
+		g_hex_edge = 0;
+		MYLOG("USR_AT", "File not found, send every location");
+		return;
+	}
+	hex_file.open(hex_name, FILE_O_READ);
+	if (hex_file.read(buffer, 4) == 4)
+	{
+		g_hex_edge = (uint16_t)(buffer[0] << 8) | buffer[1];
+		g_hex_stale = (uint16_t)(buffer[2] << 8) | buffer[3];
+	}
+	hex_file.close();
+	MYLOG("USR_AT", "File found, cell edge %dm", g_hex_edge);
+
+	if (!InternalFS.exists(hex_cells_name))
+	{
+		return;
+	}
+	hex_file.open(hex_cells_name, FILE_O_READ);
+	while (hex_file.read(buffer, 12) == 12)
+	{
+		uint64_t cell = 0;
+		for (int idx = 0; idx < 8; idx++)
+		{
+			cell = (cell << 8) | buffer[idx];
+		}
+		g_hex_cache.add(cell, get_be<4>(&buffer[8]));
+	}
+	hex_file.close();
+	MYLOG("USR_AT", "%d mapped cells restored", g_hex_cache.count());
+}
+
+/**
+ * @brief Save the Helium Mapper cell settings
+ *
+ */
+void save_hex_settings(void)
+{
+	InternalFS.remove(hex_name);
+	if (g_hex_edge == 0)
+	{
+		MYLOG("USR_AT", "Remove File for mapper cells");
+		return;
+	}
+	uint8_t buffer[4];
+	buffer[0] = (uint8_t)(g_hex_edge >> 8);
+	buffer[1] = (uint8_t)(g_hex_edge);
+	buffer[2] = (uint8_t)(g_hex_stale >> 8);
+	buffer[3] = (uint8_t)(g_hex_stale);
+	hex_file.open(hex_name, FILE_O_WRITE);
+	hex_file.write(buffer, 4);
+	hex_file.close();
+	MYLOG("USR_AT", "Created File for mapper cells");
+}
+
+/**
+ * @brief Save the mapped cells with the time they were mapped
+ *        Format per cell: cell index (8 bytes), UTC time in seconds since 1970 (4 bytes), MSB first
+ *
+ */
+void save_hex_cells(void)
+{
+	InternalFS.remove(hex_cells_name);
+	if (g_hex_cache.count() == 0)
+	{
+		return;
+	}
+	uint8_t buffer[12];
+	hex_file.open(hex_cells_name, FILE_O_WRITE);
+	for (uint8_t idx = 0; idx < g_hex_cache.count(); idx++)
+	{
+		hex_entry_s *entry = g_hex_cache.getEntry(idx);
+		for (int byte_idx = 0; byte_idx < 8; byte_idx++)
+		{
+			buffer[byte_idx] = (uint8_t)(entry->cell >> (56 - byte_idx * 8));
+		}
+		put_be<4>(&buffer[8], entry->time);
+		hex_file.write(buffer, 12);
+	}
+	hex_file.close();
+	MYLOG("USR_AT", "Saved %d mapped cells", g_hex_cache.count());
+}
+
+atcmd_t g_user_at_cmd_list_hex[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Helium Mapper cell commands
+	{"+HEXMAP", "Get/Set Helium Mapper cells <edge m>,<stale min>, 0 = off, without parameter forget mapped cells", at_query_hex, at_exec_hex, at_clear_hex},
+};
+
+/*****************************************
+ * Link map AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the current link map settings
+ *
+ * @return int always 0
+ */
+static int at_query_link(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Send after %d cells, %d cells collected", g_link_batch, g_link_map.count());
+	return 0;
+}
+
+/**
+ * @brief Command to set the number of cells after which the link quality is sent
+ *
+ * @param str number of cells, 0 disables the link map
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_link(char *str)
+{
+	char *next_param;
+	long batch = strtol(str, &next_param, 0);
+	if ((next_param == str) || (batch < 0) || (batch > LINK_MAP_SIZE))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_link_batch = batch;
+	save_link_settings();
+	return 0;
+}
+
+/**
+ * @brief Command to forget the collected link quality
+ *
+ * @return int always 0
+ */
+static int at_clear_link(void)
+{
+	g_link_map.clear();
+	return 0;
+}
+
+/**
+ * @brief Read saved link map setting
+ *
+ */
+void read_link_settings(void)
+{
+	if (InternalFS.exists(link_name))
+	{
+		link_file.open(link_name, FILE_O_READ);
+		link_file.read(&g_link_batch, 1);
+		link_file.close();
+		MYLOG("USR_AT", "File found, send link map after %d cells", g_link_batch);
+	}
+	else
+	{
+		g_link_batch = 0;
+		MYLOG("USR_AT", "File not found, link map off");
+	}
+}
+
+/**
+ * @brief Save the link map setting
+ *
+ */
+void save_link_settings(void)
+{
+	InternalFS.remove(link_name);
+	if (g_link_batch == 0)
+	{
+		MYLOG("USR_AT", "Remove File for link map");
+		return;
+	}
+	link_file.open(link_name, FILE_O_WRITE);
+	link_file.write(&g_link_batch, 1);
+	link_file.close();
+	MYLOG("USR_AT", "Created File for link map");
+}
+
+atcmd_t g_user_at_cmd_list_link[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Link map commands
+	{"+LINKMAP", "Get/Set link quality upload after <cells>, 0 = off, without parameter forget collected cells", at_query_link, at_exec_link, at_clear_link},
+};
+
+/*****************************************
+ * Batch frame AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the current batch setting
+ *
+ * @return int always 0
+ */
+static int at_query_batch(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Batch of %d locations", g_batch_size);
+	return 0;
+}
+
+/**
+ * @brief Command to set the number of locations per batch frame
+ *
+ * @param str number of locations, 0 sends every location in its own packet
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_batch(char *str)
+{
+	char *next_param;
+	long batch = strtol(str, &next_param, 0);
+	if ((next_param == str) || (batch < 0) || (batch > BATCH_MAX_FIXES))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_batch_size = batch;
+	save_batch_settings();
+	return 0;
+}
+
+/**
+ * @brief Read saved batch setting
+ *
+ */
+void read_batch_settings(void)
+{
+	if (InternalFS.exists(batch_name))
+	{
+		batch_file.open(batch_name, FILE_O_READ);
+		batch_file.read(&g_batch_size, 1);
+		batch_file.close();
+		MYLOG("USR_AT", "File found, batch of %d locations", g_batch_size);
+	}
+	else
+	{
+		g_batch_size = 0;
+		MYLOG("USR_AT", "File not found, batch off");
+	}
+}
+
+/**
+ * @brief Save the batch setting
+ *
+ */
+void save_batch_settings(void)
+{
+	InternalFS.remove(batch_name);
+	if (g_batch_size == 0)
+	{
+		MYLOG("USR_AT", "Remove File for batch");
+		return;
+	}
+	batch_file.open(batch_name, FILE_O_WRITE);
+	batch_file.write(&g_batch_size, 1);
+	batch_file.close();
+	MYLOG("USR_AT", "Created File for batch");
+}
+
+atcmd_t g_user_at_cmd_list_batch[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Batch frame commands
+	{"+BATCH", "Get/Set number of locations per batch frame <locations>, 0 = off", at_query_batch, at_exec_batch, NULL},
+};
+
+/*****************************************
+ * Fragmentation AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the current fragmentation setting
+ *
+ * @return int always 0
+ */
+static int at_query_frag(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Fragmentation: %d", g_frag_enabled ? 1 : 0);
+	return 0;
+}
+
+/**
+ * @brief Command to enable or disable fragmentation
+ *
+ * @param str 0 = split packets by priority, 1 = send packets in fragments
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_frag(char *str)
+{
+	if (str[0] == '0')
+	{
+		g_frag_enabled = false;
+	}
+	else if (str[0] == '1')
+	{
+		g_frag_enabled = true;
+	}
+	else
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	save_frag_settings();
+	return 0;
+}
+
+/**
+ * @brief Read saved fragmentation setting
+ *
+ */
+void read_frag_settings(void)
+{
+	g_frag_enabled = InternalFS.exists(frag_name);
+	MYLOG("USR_AT", "Fragmentation %s", g_frag_enabled ? "on" : "off");
+}
+
+/**
+ * @brief Save the fragmentation setting
+ *        The file exists only if fragmentation is enabled
+ *
+ */
+void save_frag_settings(void)
+{
+	if (g_frag_enabled)
+	{
+		frag_file.open(frag_name, FILE_O_WRITE);
+		frag_file.write("1");
+		frag_file.close();
+		MYLOG("USR_AT", "Created File for fragmentation");
+	}
+	else
+	{
+		InternalFS.remove(frag_name);
+		MYLOG("USR_AT", "Remove File for fragmentation");
+	}
+}
+
+atcmd_t g_user_at_cmd_list_frag[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Fragmentation commands
+	{"+FRAG", "Get/Set fragmentation of packets too big for the DR, 0 = split by priority, 1 = fragments", at_query_frag, at_exec_frag, NULL},
+};
+
+/*****************************************
+ * Environment change detection AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the current change detection settings
+ *
+ * @return int always 0
+ */
+static int at_query_env(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "H:%d/%d T:%d/%d P:%d/%d G:%d/%d",
+			 g_env_filter[ENV_HUMID].deadband, g_env_filter[ENV_HUMID].max_age,
+			 g_env_filter[ENV_TEMP].deadband, g_env_filter[ENV_TEMP].max_age,
+			 g_env_filter[ENV_PRESS].deadband, g_env_filter[ENV_PRESS].max_age,
+			 g_env_filter[ENV_GAS].deadband, g_env_filter[ENV_GAS].max_age);
+	return 0;
+}
+
+/**
+ * @brief Command to set the change detection of an environment field
+ *
+ * @param str <field>,<deadband>,<max age>
+ *  field 0 = humidity, 1 = temperature, 2 = pressure, 3 = gas resistance
+ *  deadband in steps of the LPP value (0.5 %RH, 0.1 °C, 0.1 hPa, 0.01 kOhm)
+ *  max age in minutes, 0 sends the field every time
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_env(char *str)
+{
+	long values[3];
+	char *param = str;
+	for (int idx = 0; idx < 3; idx++)
+	{
+		char *next_param;
+		values[idx] = strtol(param, &next_param, 0);
+		if ((next_param == param) || (values[idx] < 0) || (values[idx] > 65535))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		if (idx < 2)
+		{
+			if (*next_param != ',')
+			{
+				return AT_ERRNO_PARA_VAL;
+			}
+			param = next_param + 1;
+		}
+	}
+	if (values[0] >= ENV_FIELD_NUM)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_env_filter[values[0]].deadband = values[1];
+	g_env_filter[values[0]].max_age = values[2];
+	save_env_settings();
+	return 0;
+}
+
+/**
+ * @brief Read saved change detection settings
+ *
+ */
+void read_env_settings(void)
+{
+	if (!InternalFS.exists(env_name))
+	{
+		MYLOG("USR_AT", "File not found, send all environment values");
+		return;
+	}
+	uint8_t buffer[ENV_FIELD_NUM * 4];
+	env_file.open(env_name, FILE_O_READ);
+	if (env_file.read(buffer, sizeof(buffer)) == sizeof(buffer))
+	{
+		for (uint8_t field = 0; field < ENV_FIELD_NUM; field++)
+		{
+			g_env_filter[field].deadband = (uint16_t)(buffer[field * 4] << 8) | buffer[field * 4 + 1];
+			g_env_filter[field].max_age = (uint16_t)(buffer[field * 4 + 2] << 8) | buffer[field * 4 + 3];
+		}
+	}
+	env_file.close();
+	MYLOG("USR_AT", "File found, environment change detection set");
+}
+
+/**
+ * @brief Save the change detection settings
+ *
+ */
+void save_env_settings(void)
+{
+	InternalFS.remove(env_name);
+	uint8_t buffer[ENV_FIELD_NUM * 4];
+	for (uint8_t field = 0; field < ENV_FIELD_NUM; field++)
+	{
+		buffer[field * 4] = (uint8_t)(g_env_filter[field].deadband >> 8);
+		buffer[field * 4 + 1] = (uint8_t)(g_env_filter[field].deadband);
+		buffer[field * 4 + 2] = (uint8_t)(g_env_filter[field].max_age >> 8);
+		buffer[field * 4 + 3] = (uint8_t)(g_env_filter[field].max_age);
+	}
+	env_file.open(env_name, FILE_O_WRITE);
+	env_file.write(buffer, sizeof(buffer));
+	env_file.close();
+	MYLOG("USR_AT", "Created File for environment change detection");
+}
+
+atcmd_t g_user_at_cmd_list_env[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Environment change detection commands
+	{"+ENVFILT", "Get/Set environment change detection <field>,<deadband>,<max age min>, field 0 = humidity, 1 = temperature, 2 = pressure, 3 = gas, max age 0 = always send", at_query_env, at_exec_env, NULL},
+};
+
+/*****************************************
+ * Airtime AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the airtime used in the last hour,
+ *        the duty cycle budget and the time until the next location can be sent
+ *
+ * @return int always 0
+ */
+static int at_query_airtime(void)
+{
+	uint8_t band = airtime_band(g_lorawan_settings.lora_region, 0);
+	uint32_t used = g_duty_cycle.used(millis(), band) / 1000;
+	uint32_t allowed = g_duty_cycle.allowance(band) / 1000;
+	uint32_t toa = airtime_uplink(g_lorawan_settings.lora_region, current_datarate(), 0);
+	if (allowed == 0)
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "Used:%lums No limit", (unsigned long)used);
+	}
+	else
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "Used:%lums Budget:%lums Remaining:%lums Next:%lus",
+				 (unsigned long)used, (unsigned long)allowed, (unsigned long)(used < allowed ? allowed - used : 0),
+				 (unsigned long)(g_duty_cycle.nextAllowed(millis(), band, toa) / 1000));
+	}
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the daily airtime budget and its fill level
+ *
+ * @return int always 0
+ */
+static int at_query_budget(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Budget:%lus/day Left:%lums/%lums Level:%d",
+			 (unsigned long)(g_airtime_budget.daily() / 1000),
+			 (unsigned long)(g_airtime_budget.tokens(millis()) / 1000),
+			 (unsigned long)(g_airtime_budget.capacity() / 1000),
+			 g_airtime_budget.level(millis(), false));
+	return 0;
+}
+
+/**
+ * @brief Command to set the daily airtime budget
+ *
+ * @param str airtime in seconds per day, 0 = no limit
+ * @return int 0 if the command was succesfull, 5 if the parameter was wrong
+ */
+static int at_exec_budget(char *str)
+{
+	char *end;
+	long seconds = strtol(str, &end, 0);
+	if ((end == str) || (seconds < 0) || (seconds > 3600))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_airtime_budget.begin(seconds * 1000, millis());
+	save_budget_settings();
+	if (seconds != 0)
+	{
+		g_scheduler.in(SCHED_BUDGET, millis(), BUDGET_SAVE_TIME);
+	}
+	else
+	{
+		g_scheduler.cancel(SCHED_BUDGET);
+	}
+	sched_update();
+	return 0;
+}
+
+/**
+ * @brief Read the saved daily airtime budget and its fill level
+ *
+ */
+void read_budget_settings(void)
+{
+	if (!InternalFS.exists(budget_name))
+	{
+		MYLOG("USR_AT", "File not found, no daily airtime budget");
+		return;
+	}
+	uint8_t buffer[8];
+	budget_file.open(budget_name, FILE_O_READ);
+	if (budget_file.read(buffer, sizeof(buffer)) == sizeof(buffer))
+	{
+		g_airtime_budget.begin(get_be<4>(buffer), millis());
+		g_airtime_budget.restore(get_be<4>(&buffer[4]), millis());
+	}
+	budget_file.close();
+	MYLOG("USR_AT", "File found, daily airtime budget %lds", (long)(g_airtime_budget.daily() / 1000));
+}
+
+/**
+ * @brief Save the daily airtime budget and its fill level
+ *
+ */
+void save_budget_settings(void)
+{
+	InternalFS.remove(budget_name);
+	if (g_airtime_budget.daily() == 0)
+	{
+		MYLOG("USR_AT", "Removed File for daily airtime budget");
+		return;
+	}
+	uint8_t buffer[8];
+	put_be<4>(buffer, g_airtime_budget.daily());
+	put_be<4>(&buffer[4], g_airtime_budget.tokens(millis()));
+	budget_file.open(budget_name, FILE_O_WRITE);
+	budget_file.write(buffer, sizeof(buffer));
+	budget_file.close();
+	MYLOG("USR_AT", "Saved daily airtime budget");
+}
+
+atcmd_t g_user_at_cmd_list_airtime[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Airtime commands
+	{"+AIRTIME", "Get airtime used in the last hour and the duty cycle budget", at_query_airtime, NULL, NULL},
+	{"+DAYAIR", "Get/Set the daily airtime budget <seconds per day>, 0 = no limit", at_query_budget, at_exec_budget, NULL},
+};
+
+/*****************************************
+ * Uplink queue AT commands
+ *****************************************/
+
+/**
+ * @brief Read a part of the uplink queue log
+ *
+ * @param offset position in the log
+ * @param data buffer
+ * @param size number of bytes
+ * @return true if the bytes were read
+ */
+static bool queue_read(uint32_t offset, uint8_t *data, uint16_t size)
+{
+	if (!queue_file.open(queue_name, FILE_O_READ))
+	{
+		return false;
+	}
+	bool result = queue_file.seek(offset) && (queue_file.read(data, size) == size);
+	queue_file.close();
+	return result;
+}
+
+/**
+ * @brief Overwrite a part of the uplink queue log
+ *
+ * @param offset position in the log
+ * @param data bytes to write
+ * @param size number of bytes
+ * @return true if the bytes were written
+ */
+static bool queue_write(uint32_t offset, const uint8_t *data, uint16_t size)
+{
+	if (!queue_file.open(queue_name, FILE_O_WRITE))
+	{
+		return false;
+	}
+	bool result = queue_file.seek(offset) && (queue_file.write(data, size) == size);
+	queue_file.close();
+	return result;
+}
+
+/**
+ * @brief Create the uplink queue log if it does not exist and read the queued packets
+ *
+ */
+void init_uplink_queue(void)
+{
+	if (!InternalFS.exists(queue_name))
+	{
+		// All slots empty
+		uint8_t empty[QUEUE_SLOT_SIZE];
+		memset(empty, 0xFF, QUEUE_SLOT_SIZE);
+		queue_file.open(queue_name, FILE_O_WRITE);
+		for (uint8_t slot = 0; slot < QUEUE_SLOTS; slot++)
+		{
+			queue_file.write(empty, QUEUE_SLOT_SIZE);
+		}
+		queue_file.close();
+		MYLOG("USR_AT", "Created File for uplink queue");
+	}
+	g_uplink_queue.begin(queue_read, queue_write);
+	MYLOG("USR_AT", "Uplink queue has %d packets", g_uplink_queue.count());
+}
+
+/**
+ * @brief Returns in g_at_query_buf the number of queued packets
+ *
+ * @return int always 0
+ */
+static int at_query_queue(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Queued packets: %d", g_uplink_queue.count());
+	return 0;
+}
+
+/**
+ * @brief Drop all queued packets
+ *
+ * @return int always 0
+ */
+static int at_clear_queue(void)
+{
+	g_uplink_queue.clear();
+	return 0;
+}
+
+atcmd_t g_user_at_cmd_list_queue[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Uplink queue commands
+	{"+QUEUE", "Get number of queued packets, without parameter drop all queued packets", at_query_queue, NULL, at_clear_queue},
+};
+
+/*****************************************
+ * Link recovery AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the recovery stage and for each stage
+ *        how often it was entered, the time spent in it and the airtime used in it
+ *
+ * @return int always 0
+ */
+static int at_query_recovery(void)
+{
+	uint32_t now = millis();
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Stage:%d LC:%d/%lus/%lums DR:%d/%lus/%lums RJ:%d/%lus/%lums Resets:%lu",
+			 g_link_recovery.stage(),
+			 g_link_recovery.count(RECOVERY_LINK_CHECK), (unsigned long)(g_link_recovery.time(RECOVERY_LINK_CHECK, now) / 1000), (unsigned long)(g_link_recovery.airtime(RECOVERY_LINK_CHECK) / 1000),
+			 g_link_recovery.count(RECOVERY_DR_DOWN), (unsigned long)(g_link_recovery.time(RECOVERY_DR_DOWN, now) / 1000), (unsigned long)(g_link_recovery.airtime(RECOVERY_DR_DOWN) / 1000),
+			 g_link_recovery.count(RECOVERY_REJOIN), (unsigned long)(g_link_recovery.time(RECOVERY_REJOIN, now) / 1000), (unsigned long)(g_link_recovery.airtime(RECOVERY_REJOIN) / 1000),
+			 (unsigned long)g_recovery_resets);
+	return 0;
+}
+
+/**
+ * @brief Clear the link recovery statistics
+ *
+ * @return int always 0
+ */
+static int at_clear_recovery(void)
+{
+	g_link_recovery.begin(millis());
+	g_recovery_resets = 0;
+	save_recovery_settings();
+	return 0;
+}
+
+/**
+ * @brief Read the saved number of resets by the link recovery
+ *
+ */
+void read_recovery_settings(void)
+{
+	if (!InternalFS.exists(recovery_name))
+	{
+		MYLOG("USR_AT", "File not found, no resets by link recovery");
+		return;
+	}
+	uint8_t buffer[4];
+	recovery_file.open(recovery_name, FILE_O_READ);
+	if (recovery_file.read(buffer, sizeof(buffer)) == sizeof(buffer))
+	{
+		g_recovery_resets = get_be<4>(buffer);
+	}
+	recovery_file.close();
+	MYLOG("USR_AT", "File found, %ld resets by link recovery", (long)g_recovery_resets);
+}
+
+/**
+ * @brief Save the number of resets by the link recovery
+ *
+ */
+void save_recovery_settings(void)
+{
+	InternalFS.remove(recovery_name);
+	if (g_recovery_resets == 0)
+	{
+		MYLOG("USR_AT", "Removed File for link recovery");
+		return;
+	}
+	uint8_t buffer[4];
+	put_be<4>(buffer, g_recovery_resets);
+	recovery_file.open(recovery_name, FILE_O_WRITE);
+	recovery_file.write(buffer, sizeof(buffer));
+	recovery_file.close();
+	MYLOG("USR_AT", "Saved resets by link recovery");
+}
+
+atcmd_t g_user_at_cmd_list_recovery[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Link recovery commands
+	{"+RECOVERY", "Get link recovery stage and statistics <entered>/<time>/<airtime> per stage, without parameter clear the statistics", at_query_recovery, NULL, at_clear_recovery},
+};
+
+/*****************************************
+ * LoRaWAN session AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf if the session was restored after a reset
+ *
+ * @return int always 0
+ */
+static int at_query_session(void)
+{
+	if (!g_lpwan_has_joined)
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "Session: not joined");
+	}
+	else
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "Session: %s", g_session_restored ? "restored" : "joined");
+	}
+	return 0;
+}
+
+/**
+ * @brief Forget the saved session, the next reset joins again
+ *
+ * @return int always 0
+ */
+static int at_clear_session(void)
+{
+	forget_session();
+	return 0;
+}
+
+atcmd_t g_user_at_cmd_list_session[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Session commands
+	{"+SESSION", "Get if the LoRaWAN session was restored, without parameter forget the saved session", at_query_session, NULL, at_clear_session},
+};
+
+/*****************************************
+ * Join backoff AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the join backoff schedule
+ *
+ * @return int always 0
+ */
+static int at_query_join(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Base:%ds Max:%ds PerHour:%d Attempts:%d",
+			 g_join_backoff.baseDelay(), g_join_backoff.maxDelay(), g_join_backoff.perHour(), g_join_backoff.attempts());
+	return 0;
+}
+
+/**
+ * @brief Command to set the join backoff schedule
+ *
+ * @param str <base delay s>,<max delay s>,<max joins per hour>
+ * @return int 0 if the command was successful, 5 if the parameter was wrong
+ */
+static int at_exec_join(char *str)
+{
+	long values[3];
+	char *param = str;
+	for (int idx = 0; idx < 3; idx++)
+	{
+		char *next_param;
+		values[idx] = strtol(param, &next_param, 0);
+		if ((next_param == param) || (values[idx] < 1) || (values[idx] > 65535))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		if (idx < 2)
+		{
+			if (*next_param != ',')
+			{
+				return AT_ERRNO_PARA_VAL;
+			}
+			param = next_param + 1;
+		}
+	}
+	if ((values[1] < values[0]) || (values[2] > JOIN_HISTORY))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_join_backoff.setSchedule(values[0], values[1], values[2]);
+	save_join_settings();
+	return 0;
+}
+
+/**
+ * @brief Returns in g_at_query_buf the last joins <age>:<data rate>:<result>,
+ *        result P = pending, O = joined, F = failed
+ *
+ * @return int always 0
+ */
+static int at_query_join_history(void)
+{
+	join_attempt_s attempt;
+	uint8_t len = 0;
+	g_at_query_buf[0] = 0;
+	for (uint8_t idx = 0; g_join_backoff.history(idx, &attempt); idx++)
+	{
+		len += snprintf(&g_at_query_buf[len], ATQUERY_SIZE - len, "%s%lus:DR%d:%c",
+						idx == 0 ? "" : " ",
+						(unsigned long)((millis() - attempt.time) / 1000), attempt.datarate,
+						attempt.result == JOIN_OK ? 'O' : (attempt.result == JOIN_FAILED ? 'F' : 'P'));
+		if (len >= ATQUERY_SIZE)
+		{
+			break;
+		}
+	}
+	if (len == 0)
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "No joins");
+	}
+	return 0;
+}
+
+/**
+ * @brief Read the saved join backoff schedule
+ *
+ */
+void read_join_settings(void)
+{
+	if (!InternalFS.exists(join_name))
+	{
+		MYLOG("USR_AT", "File not found, default join backoff");
+		return;
+	}
+	uint8_t buffer[5];
+	join_file.open(join_name, FILE_O_READ);
+	if (join_file.read(buffer, sizeof(buffer)) == sizeof(buffer))
+	{
+		g_join_backoff.setSchedule(get_be<2>(buffer), get_be<2>(&buffer[2]), buffer[4]);
+	}
+	join_file.close();
+	MYLOG("USR_AT", "File found, join backoff %d-%ds", g_join_backoff.baseDelay(), g_join_backoff.maxDelay());
+}
+
+/**
+ * @brief Save the join backoff schedule
+ *
+ */
+void save_join_settings(void)
+{
+	InternalFS.remove(join_name);
+	uint8_t buffer[5];
+	put_be<2>(buffer, g_join_backoff.baseDelay());
+	put_be<2>(&buffer[2], g_join_backoff.maxDelay());
+	buffer[4] = g_join_backoff.perHour();
+	join_file.open(join_name, FILE_O_WRITE);
+	join_file.write(buffer, sizeof(buffer));
+	join_file.close();
+	MYLOG("USR_AT", "Created File for join backoff");
+}
+
+atcmd_t g_user_at_cmd_list_join[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Join backoff commands
+	{"+JOINBO", "Get/Set join backoff <base delay s>,<max delay s>,<max joins per hour 1-8>", at_query_join, at_exec_join, NULL},
+	{"+JOINHIST", "Get last joins <age>:<data rate>:<result>, result O = joined, F = failed, P = pending", at_query_join_history, NULL, NULL},
+};
+
+/*****************************************
+ * Confirmed uplink policy AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the policy, the SNR margin of the last downlinks,
+ *        the number of confirmed and unconfirmed uplinks and the saved ACK airtime
+ *
+ * @return int always 0
+ */
+static int at_query_confirm(void)
+{
+	// Airtime of the ACK downlinks the unconfirmed uplinks did not need
+	uint32_t ack = airtime_uplink(g_lorawan_settings.lora_region, current_datarate(), 0);
+	uint32_t saved = (uint32_t)(((uint64_t)g_confirm_policy.unconfirmed() * ack) / 1000);
+	int8_t margin;
+	char link[8];
+	if (g_confirm_policy.margin(&margin))
+	{
+		snprintf(link, sizeof(link), "%ddB", margin);
+	}
+	else
+	{
+		snprintf(link, sizeof(link), "-");
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Mode:%d Every:%d MinMargin:%ddB Link:%s%s Confirmed:%lu Unconfirmed:%lu Saved:%lums",
+			 g_confirm_policy.mode(), g_confirm_policy.every(), g_confirm_policy.minMargin(), link,
+			 g_confirm_policy.escalated() ? " NAK" : "",
+			 (unsigned long)g_confirm_policy.confirmed(), (unsigned long)g_confirm_policy.unconfirmed(), (unsigned long)saved);
+	return 0;
+}
+
+/**
+ * @brief Command to set the confirmed uplink policy
+ *
+ * @param str <mode>,<every N>,<min SNR margin dB>
+ * @return int 0 if the command was successful, 5 if the parameter was wrong
+ */
+static int at_exec_confirm(char *str)
+{
+	long values[3];
+	char *param = str;
+	for (int idx = 0; idx < 3; idx++)
+	{
+		char *next_param;
+		values[idx] = strtol(param, &next_param, 0);
+		if (next_param == param)
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		if (idx < 2)
+		{
+			if (*next_param != ',')
+			{
+				return AT_ERRNO_PARA_VAL;
+			}
+			param = next_param + 1;
+		}
+	}
+	if ((values[0] < CONFIRM_FIXED) || (values[0] > CONFIRM_ADAPTIVE) || (values[1] < 0) || (values[1] > 255) || (values[2] < -20) || (values[2] > 30))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_confirm_policy.begin(values[0], values[1], values[2]);
+	save_confirm_settings();
+	return 0;
+}
+
+/**
+ * @brief Read the saved confirmed uplink policy
+ *
+ */
+void read_confirm_settings(void)
+{
+	if (!InternalFS.exists(confirm_name))
+	{
+		MYLOG("USR_AT", "File not found, confirmed uplinks as set with AT+CFM");
+		return;
+	}
+	uint8_t buffer[3];
+	confirm_file.open(confirm_name, FILE_O_READ);
+	if (confirm_file.read(buffer, sizeof(buffer)) == sizeof(buffer))
+	{
+		g_confirm_policy.begin(buffer[0], buffer[1], (int8_t)buffer[2]);
+	}
+	confirm_file.close();
+	MYLOG("USR_AT", "File found, confirmed uplink policy %d", g_confirm_policy.mode());
+}
+
+/**
+ * @brief Save the confirmed uplink policy
+ *
+ */
+void save_confirm_settings(void)
+{
+	InternalFS.remove(confirm_name);
+	if (g_confirm_policy.mode() == CONFIRM_FIXED)
+	{
+		MYLOG("USR_AT", "Removed File for confirmed uplink policy");
+		return;
+	}
+	uint8_t buffer[3];
+	buffer[0] = g_confirm_policy.mode();
+	buffer[1] = g_confirm_policy.every();
+	buffer[2] = (uint8_t)g_confirm_policy.minMargin();
+	confirm_file.open(confirm_name, FILE_O_WRITE);
+	confirm_file.write(buffer, sizeof(buffer));
+	confirm_file.close();
+	MYLOG("USR_AT", "Created File for confirmed uplink policy");
+}
+
+atcmd_t g_user_at_cmd_list_confirm[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Confirmed uplink policy commands
+	{"+CONFPOL", "Get/Set confirmed uplink policy <mode>,<every N>,<min SNR margin dB>, mode 0 = as set with AT+CFM, 1 = adaptive", at_query_confirm, at_exec_confirm, NULL},
+};
+
+/*****************************************
+ * Data rate and TX power controller AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the controller settings, the selected
+ *        data rate and TX power and the expected SNR margin
+ *
+ * @return int always 0
+ */
+static int at_query_linkctl(void)
+{
+	int8_t margin;
+	char link[8];
+	if (g_link_control.estimate(&margin))
+	{
+		snprintf(link, sizeof(link), "%ddB", margin);
+	}
+	else
+	{
+		snprintf(link, sizeof(link), "-");
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Mode:%d Target:%ddB Hysteresis:%ddB DR:%d TXP:%d Margin:%s",
+			 g_link_control.mode(), g_link_control.target(), g_link_control.hysteresis(),
+			 g_link_control.datarate(), g_lorawan_settings.tx_power + g_link_control.power(), link);
+	return 0;
+}
+
+/**
+ * @brief Command to set the data rate and TX power controller
+ *
+ * @param str <mode>,<target margin dB>,<hysteresis dB>
+ * @return int 0 if the command was successful, 5 if the parameter was wrong
+ */
+static int at_exec_linkctl(char *str)
+{
+	long values[3];
+	char *param = str;
+	for (int idx = 0; idx < 3; idx++)
+	{
+		char *next_param;
+		values[idx] = strtol(param, &next_param, 0);
+		if ((next_param == param) || (values[idx] < 0) || (values[idx] > 30))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		if (idx < 2)
+		{
+			if (*next_param != ',')
+			{
+				return AT_ERRNO_PARA_VAL;
+			}
+			param = next_param + 1;
+		}
+	}
+	if (values[0] > LINK_CTL_ADAPTIVE)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	bool was_adaptive = g_link_control.mode() == LINK_CTL_ADAPTIVE;
+	g_link_control.begin(values[0], values[1], values[2]);
+	init_link_control();
+	if (was_adaptive && (values[0] == LINK_CTL_OFF))
+	{
+		// Back to the settings of the stack
+		lmh_datarate_set(g_lorawan_settings.data_rate, g_lorawan_settings.adr_enabled);
+		MibRequestConfirm_t mib_req;
+		mib_req.Type = MIB_CHANNELS_TX_POWER;
+		mib_req.Param.ChannelsTxPower = g_lorawan_settings.tx_power;
+		LoRaMacMibSetRequestConfirm(&mib_req);
+	}
+	save_linkctl_settings();
+	return 0;
+}
+
+/**
+ * @brief Read the saved data rate and TX power controller settings
+ *
+ */
+void read_linkctl_settings(void)
+{
+	if (!InternalFS.exists(linkctl_name))
+	{
+		MYLOG("USR_AT", "File not found, data rate and TX power as set");
+		return;
+	}
+	uint8_t buffer[3];
+	linkctl_file.open(linkctl_name, FILE_O_READ);
+	if (linkctl_file.read(buffer, sizeof(buffer)) == sizeof(buffer))
+	{
+		g_link_control.begin(buffer[0], buffer[1], buffer[2]);
+	}
+	linkctl_file.close();
+	MYLOG("USR_AT", "File found, link controller %d", g_link_control.mode());
+}
+
+/**
+ * @brief Save the data rate and TX power controller settings
+ *
+ */
+void save_linkctl_settings(void)
+{
+	InternalFS.remove(linkctl_name);
+	if (g_link_control.mode() == LINK_CTL_OFF)
+	{
+		MYLOG("USR_AT", "Removed File for link controller");
+		return;
+	}
+	uint8_t buffer[3];
+	buffer[0] = g_link_control.mode();
+	buffer[1] = g_link_control.target();
+	buffer[2] = g_link_control.hysteresis();
+	linkctl_file.open(linkctl_name, FILE_O_WRITE);
+	linkctl_file.write(buffer, sizeof(buffer));
+	linkctl_file.close();
+	MYLOG("USR_AT", "Created File for link controller");
+}
+
+atcmd_t g_user_at_cmd_list_linkctl[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Data rate and TX power controller commands
+	{"+LINKCTL", "Get/Set data rate and TX power controller <mode>,<target margin dB>,<hysteresis dB>, mode 0 = off, 1 = adaptive", at_query_linkctl, at_exec_linkctl, NULL},
+};
+
+/*****************************************
+ * Uplink jitter and slot AT commands
+ *****************************************/
+
+/**
+ * @brief Returns in g_at_query_buf the jitter and slot settings,
+ *        the slot of the device and if the GNSS time is known
+ *
+ * @return int always 0
+ */
+static int at_query_spread(void)
+{
+	uint32_t time_of_day;
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "Jitter:%ds Frame:%ds Slots:%d Slot:%d Time:%s",
+			 g_uplink_spread.maxJitter(), g_uplink_spread.frame(), g_uplink_spread.slots(), g_uplink_spread.slot(),
+			 gnss_time_of_day(&time_of_day) ? "GNSS" : "none");
+	return 0;
+}
+
+/**
+ * @brief Command to set the uplink jitter and slots
+ *
+ * @param str <max jitter s>,<slot frame s>,<slots>
+ * @return int 0 if the command was successful, 5 if the parameter was wrong
+ */
+static int at_exec_spread(char *str)
+{
+	long values[3];
+	char *param = str;
+	for (int idx = 0; idx < 3; idx++)
+	{
+		char *next_param;
+		values[idx] = strtol(param, &next_param, 0);
+		if ((next_param == param) || (values[idx] < 0) || (values[idx] > 65535))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		if (idx < 2)
+		{
+			if (*next_param != ',')
+			{
+				return AT_ERRNO_PARA_VAL;
+			}
+			param = next_param + 1;
+		}
+	}
+	// The frame has to divide a day, the slots need at least one second
+	if ((values[1] != 0) && ((SPREAD_DAY % values[1] != 0) || (values[2] == 0) || (values[2] > 255) || (values[2] > values[1])))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	g_uplink_spread.setJitter(values[0]);
+	g_uplink_spread.setSlots(values[1], values[2]);
+	save_spread_settings();
+	return 0;
+}
+
+/**
+ * @brief Read the saved uplink jitter and slot settings
+ *
+ */
+void read_spread_settings(void)
+{
+	if (!InternalFS.exists(spread_name))
+	{
+		MYLOG("USR_AT", "File not found, no uplink jitter");
+		return;
+	}
+	uint8_t buffer[5];
+	spread_file.open(spread_name, FILE_O_READ);
+	if (spread_file.read(buffer, sizeof(buffer)) == sizeof(buffer))
+	{
+		g_uplink_spread.setJitter(get_be<2>(buffer));
+		g_uplink_spread.setSlots(get_be<2>(&buffer[2]), buffer[4]);
+	}
+	spread_file.close();
+	MYLOG("USR_AT", "File found, uplink jitter %ds", g_uplink_spread.maxJitter());
+}
+
+/**
+ * @brief Save the uplink jitter and slot settings
+ *
+ */
+void save_spread_settings(void)
+{
+	InternalFS.remove(spread_name);
+	if ((g_uplink_spread.maxJitter() == 0) && !g_uplink_spread.slotted())
+	{
+		MYLOG("USR_AT", "Removed File for uplink jitter");
+		return;
+	}
+	uint8_t buffer[5];
+	put_be<2>(buffer, g_uplink_spread.maxJitter());
+	put_be<2>(&buffer[2], g_uplink_spread.frame());
+	buffer[4] = g_uplink_spread.slots();
+	spread_file.open(spread_name, FILE_O_WRITE);
+	spread_file.write(buffer, sizeof(buffer));
+	spread_file.close();
+	MYLOG("USR_AT", "Created File for uplink jitter");
+}
+
+atcmd_t g_user_at_cmd_list_spread[] = {
+	/*|    CMD    |     AT+CMD?      |    AT+CMD=?    |  AT+CMD=value |  AT+CMD  |*/
+	// Uplink jitter and slot commands
+	{"+SPREAD", "Get/Set uplink jitter and P2P slots <max jitter s>,<slot frame s>,<slots>, 0 = disabled, the frame must divide one day", at_query_spread, at_exec_spread, NULL},
+};
+
+/** Number of user defined AT commands */
+uint8_t g_user_at_cmd_num = 0;
+
+/** Pointer to the combined user AT command structure */
+atcmd_t *g_user_at_cmd_list;
+
+/**
+ * @brief Initialize the user defined AT command list
+ *
+ */
+void init_user_at(void)
+{
+	uint16_t index_next_cmds = 0;
+	uint16_t required_structure_size = sizeof(g_user_at_cmd_list_gps);
+	MYLOG("USR_AT", "Structure size %d GNSS", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_batt);
+	MYLOG("USR_AT", "Structure size %d Battery", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_modules);
+	MYLOG("USR_AT", "Structure size %d Modules", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_dr);
+	MYLOG("USR_AT", "Structure size %d Dead reckoning", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_geofence);
+	MYLOG("USR_AT", "Structure size %d Geofence", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_hex);
+	MYLOG("USR_AT", "Structure size %d Mapper cells", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_link);
+	MYLOG("USR_AT", "Structure size %d Link map", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_batch);
+	MYLOG("USR_AT", "Structure size %d Batch", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_frag);
+	MYLOG("USR_AT", "Structure size %d Fragmentation", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_env);
+	MYLOG("USR_AT", "Structure size %d Environment", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_airtime);
+	MYLOG("USR_AT", "Structure size %d Airtime", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_queue);
+	MYLOG("USR_AT", "Structure size %d Queue", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_recovery);
+	MYLOG("USR_AT", "Structure size %d Recovery", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_session);
+	MYLOG("USR_AT", "Structure size %d Session", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_join);
+	MYLOG("USR_AT", "Structure size %d Join", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_confirm);
+	MYLOG("USR_AT", "Structure size %d Confirm", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_linkctl);
+	MYLOG("USR_AT", "Structure size %d Link controller", required_structure_size);
+	required_structure_size += sizeof(g_user_at_cmd_list_spread);
+	MYLOG("USR_AT", "Structure size %d Spread", required_structure_size);
+
+	// Reserve memory for the structure
+	g_user_at_cmd_list = (atcmd_t *)malloc(required_structure_size);
+
+	// Add AT commands to structure
+	MYLOG("USR_AT", "Adding battery check AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_batt) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_batt, sizeof(g_user_at_cmd_list_batt));
+	index_next_cmds += sizeof(g_user_at_cmd_list_batt) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding battery check %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding module AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_modules) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_modules, sizeof(g_user_at_cmd_list_modules));
+	index_next_cmds += sizeof(g_user_at_cmd_list_modules) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding modules %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding GNSS user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_gps) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_gps, sizeof(g_user_at_cmd_list_gps));
+	index_next_cmds += sizeof(g_user_at_cmd_list_gps) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding GNSS %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding dead reckoning user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_dr) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_dr, sizeof(g_user_at_cmd_list_dr));
+	index_next_cmds += sizeof(g_user_at_cmd_list_dr) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding dead reckoning %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding geofence user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_geofence) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_geofence, sizeof(g_user_at_cmd_list_geofence));
+	index_next_cmds += sizeof(g_user_at_cmd_list_geofence) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding geofence %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding mapper cell user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_hex) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_hex, sizeof(g_user_at_cmd_list_hex));
+	index_next_cmds += sizeof(g_user_at_cmd_list_hex) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding mapper cells %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding link map user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_link) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_link, sizeof(g_user_at_cmd_list_link));
+	index_next_cmds += sizeof(g_user_at_cmd_list_link) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding link map %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding batch user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_batch) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_batch, sizeof(g_user_at_cmd_list_batch));
+	index_next_cmds += sizeof(g_user_at_cmd_list_batch) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding batch %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding fragmentation user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_frag) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_frag, sizeof(g_user_at_cmd_list_frag));
+	index_next_cmds += sizeof(g_user_at_cmd_list_frag) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding fragmentation %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding environment user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_env) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_env, sizeof(g_user_at_cmd_list_env));
+	index_next_cmds += sizeof(g_user_at_cmd_list_env) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding environment %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding airtime user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_airtime) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_airtime, sizeof(g_user_at_cmd_list_airtime));
+	index_next_cmds += sizeof(g_user_at_cmd_list_airtime) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding airtime %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding queue user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_queue) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_queue, sizeof(g_user_at_cmd_list_queue));
+	index_next_cmds += sizeof(g_user_at_cmd_list_queue) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding queue %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding recovery user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_recovery) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_recovery, sizeof(g_user_at_cmd_list_recovery));
+	index_next_cmds += sizeof(g_user_at_cmd_list_recovery) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding recovery %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding session user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_session) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_session, sizeof(g_user_at_cmd_list_session));
+	index_next_cmds += sizeof(g_user_at_cmd_list_session) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding session %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding join backoff user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_join) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_join, sizeof(g_user_at_cmd_list_join));
+	index_next_cmds += sizeof(g_user_at_cmd_list_join) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding join backoff %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding confirmed uplink policy user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_confirm) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_confirm, sizeof(g_user_at_cmd_list_confirm));
+	index_next_cmds += sizeof(g_user_at_cmd_list_confirm) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding confirmed uplink policy %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding link controller user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_linkctl) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_linkctl, sizeof(g_user_at_cmd_list_linkctl));
+	index_next_cmds += sizeof(g_user_at_cmd_list_linkctl) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding link controller %d", index_next_cmds);
+
+	MYLOG("USR_AT", "Adding uplink jitter user AT commands");
+	g_user_at_cmd_num += sizeof(g_user_at_cmd_list_spread) / sizeof(atcmd_t);
+	memcpy((void *)&g_user_at_cmd_list[index_next_cmds], (void *)g_user_at_cmd_list_spread, sizeof(g_user_at_cmd_list_spread));
+	index_next_cmds += sizeof(g_user_at_cmd_list_spread) / sizeof(atcmd_t);
+	MYLOG("USR_AT", "Index after adding uplink jitter %d", index_next_cmds);
 }
 
 // /** Number of user defined AT commands */
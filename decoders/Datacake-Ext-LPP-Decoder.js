@@ -83,12 +83,12 @@ function lppDecode(bytes) {
 		for (var i = 0; i < stream.length; i++) {
 			if (stream[i] > 0xFF)
 				throw 'Byte value overflow!';
-			value = (value << 8) | stream[i];
+			value = value * 256 + stream[i];
 		}
 
 		if (is_signed) {
-			var edge = 1 << (stream.length) * 8;  // 0x1000..
-			var max = (edge - 1) >> 1;             // 0x0FFF.. >> 1
+			var edge = Math.pow(2, stream.length * 8); // 0x1000..
+			var max = edge / 2 - 1;                   // 0x0FFF.. >> 1
 			value = (value > max) ? value - edge : value;
 		}
 
@@ -209,8 +209,138 @@ function lppDecode(bytes) {
 
 }
 
+// batchDecode decodes a batch frame (fPort 12) into an array of locations, oldest first.
+// The first location is bit packed, the following are zigzag varint deltas.
+// age is the age of the location in seconds when the frame was sent.
+function batchDecode(bytes) {
+
+	var steps = [1, 10, 100, 1000];
+	if ((bytes.length < 1) || ((bytes[0] >> 6) != 0)) {
+		throw 'Batch version error!';
+	}
+	var pos_step = steps[(bytes[0] >> 3) & 0x07];
+	var alt_step = steps[bytes[0] & 0x07];
+
+	function bitWidth(value) {
+		var bits = 0;
+		while (value >= 1) {
+			bits++;
+			value = Math.floor(value / 2);
+		}
+		return bits;
+	}
+
+	var bit_pos = 8;
+	function readBits(count) {
+		var value = 0;
+		for (var b = 0; b < count; b++) {
+			if ((bit_pos >> 3) >= bytes.length)
+				throw 'Batch length error!';
+			value = value * 2 + ((bytes[bit_pos >> 3] >> (7 - (bit_pos & 7))) & 1);
+			bit_pos++;
+		}
+		return value;
+	}
+
+	var i = 0;
+	function readVarint() {
+		var value = 0;
+		var factor = 1;
+		while (i < bytes.length) {
+			var b = bytes[i++];
+			value += (b & 0x7F) * factor;
+			if ((b & 0x80) == 0)
+				return value;
+			factor *= 128;
+		}
+		throw 'Batch length error!';
+	}
+
+	function unzigzag(value) {
+		return (value % 2) ? -(value + 1) / 2 : value / 2;
+	}
+
+	var locations = [];
+	if (bytes.length == 1) {
+		return locations;
+	}
+
+	var lat = readBits(bitWidth(Math.floor(1800000000 / pos_step)));
+	var lon = readBits(bitWidth(Math.floor(3600000000 / pos_step)));
+	var alt = readBits(bitWidth(Math.floor(10000000 / alt_step)));
+	i = Math.ceil(bit_pos / 8);
+	var age = readVarint();
+	while (true) {
+		locations.push({
+			'latitude': (lat * pos_step - 900000000) / 10000000,
+			'longitude': (lon * pos_step - 1800000000) / 10000000,
+			'altitude': (alt * alt_step - 1000000) / 1000,
+			'age': age
+		});
+		if (i >= bytes.length)
+			break;
+		lat += unzigzag(readVarint());
+		lon += unzigzag(readVarint());
+		alt += unzigzag(readVarint());
+		age += unzigzag(readVarint());
+	}
+
+	return locations;
+
+}
+
+// linkMapDecode decodes a link quality frame (fPort 11) into an array of cells.
+// q and r are the signed axial coordinates of the hexagon cells with the edge length in meters.
+function linkMapDecode(bytes) {
+
+	if ((bytes.length < 15) || (((bytes.length - 2) % 13) != 0)) {
+		throw 'Link map length error!';
+	}
+	var edge = (bytes[0] << 8) | bytes[1];
+
+	function signed24(i) {
+		var value = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+		return value >= 0x800000 ? value - 0x1000000 : value;
+	}
+
+	function signed8(value) {
+		return value >= 0x80 ? value - 0x100 : value;
+	}
+
+	var cells = [];
+	for (var i = 2; i < bytes.length; i += 13) {
+		cells.push({
+			'edge': edge,
+			'q': signed24(i),
+			'r': signed24(i + 3),
+			'count': bytes[i + 6],
+			'rssi_min': -bytes[i + 7],
+			'rssi_mean': -bytes[i + 8],
+			'rssi_max': -bytes[i + 9],
+			'snr_min': signed8(bytes[i + 10]),
+			'snr_mean': signed8(bytes[i + 11]),
+			'snr_max': signed8(bytes[i + 12])
+		});
+	}
+
+	return cells;
+
+}
+
 // To use with Datacake
 function Decoder(bytes, fPort) {
+	if (fPort == 14) {
+		// Queued packet, 3 bytes age in seconds, original fPort, original packet
+		var queued = Decoder(bytes.slice(4), bytes[3]);
+		queued['age'] = (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+		return queued;
+	}
+	if (fPort == 11) {
+		return { 'cells': linkMapDecode(bytes) };
+	}
+	if (fPort == 12) {
+		return { 'locations': batchDecode(bytes) };
+	}
 
 	// flat output (like original decoder):
 	var response = {};
@@ -0,0 +1,134 @@
+/**
+ * @file field_bench.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Time to write a 6 digit location field with the field writers
+ *        and with the union byte copy the encoders used before
+ *        Usage: field_bench <locations>
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "field_writer.h"
+#include "lpp_schema.h"
+
+/** Layout of the old encoders */
+union old_field_u
+{
+	int32_t val;
+	uint8_t bytes[4];
+};
+
+struct location_s
+{
+	int32_t latitude;
+	int32_t longitude;
+	int32_t altitude;
+};
+
+static uint8_t old_gps6(uint8_t *buffer, const location_s &location)
+{
+	uint8_t cursor = 0;
+	old_field_u field;
+	buffer[cursor++] = LPP_CHANNEL_GPS;
+	buffer[cursor++] = LPP_GPS6;
+	field.val = location.latitude / 10;
+	buffer[cursor++] = field.bytes[3];
+	buffer[cursor++] = field.bytes[2];
+	buffer[cursor++] = field.bytes[1];
+	buffer[cursor++] = field.bytes[0];
+	field.val = location.longitude / 10;
+	buffer[cursor++] = field.bytes[3];
+	buffer[cursor++] = field.bytes[2];
+	buffer[cursor++] = field.bytes[1];
+	buffer[cursor++] = field.bytes[0];
+	field.val = location.altitude / 10;
+	buffer[cursor++] = field.bytes[2];
+	buffer[cursor++] = field.bytes[1];
+	buffer[cursor++] = field.bytes[0];
+	return cursor;
+}
+
+static uint8_t new_gps6(uint8_t *buffer, const location_s &location)
+{
+	uint8_t cursor = 0;
+	buffer[cursor++] = LPP_CHANNEL_GPS;
+	buffer[cursor++] = LPP_GPS6;
+	cursor += put_be_scaled<4, 10>(&buffer[cursor], location.latitude);
+	cursor += put_be_scaled<4, 10>(&buffer[cursor], location.longitude);
+	cursor += put_be_scaled<3, 10>(&buffer[cursor], location.altitude);
+	return cursor;
+}
+
+/**
+ * @brief Encode all locations into one buffer
+ *
+ * @return double seconds
+ */
+static double run(uint8_t (*encode)(uint8_t *, const location_s &), const std::vector<location_s> &locations,
+				  std::vector<uint8_t> *out)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	uint8_t *buffer = &(*out)[0];
+	for (size_t idx = 0; idx < locations.size(); idx++)
+	{
+		buffer += encode(buffer, locations[idx]);
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <locations>\n", argv[0]);
+		return 1;
+	}
+	uint32_t count = strtoul(argv[1], NULL, 0);
+	if (count == 0)
+	{
+		fprintf(stderr, "%s: no locations\n", argv[0]);
+		return 1;
+	}
+
+	srand(36);
+	std::vector<location_s> locations(count);
+	for (uint32_t idx = 0; idx < count; idx++)
+	{
+		locations[idx].latitude = (int32_t)((((int64_t)rand() << 16) ^ rand()) % 1800000000 - 900000000);
+		locations[idx].longitude = (int32_t)((((int64_t)rand() << 16) ^ rand()) % 3600000000LL - 1800000000);
+		locations[idx].altitude = rand() % 10000000 - 1000000;
+	}
+
+	std::vector<uint8_t> old_out(count * (2 + LPP_GPS6_SIZE));
+	std::vector<uint8_t> new_out(count * (2 + LPP_GPS6_SIZE));
+	// Warm up, then take the faster of 3 runs
+	run(old_gps6, locations, &old_out);
+	run(new_gps6, locations, &new_out);
+	double old_s = 1e9;
+	double new_s = 1e9;
+	for (int repeat = 0; repeat < 3; repeat++)
+	{
+		double seconds = run(old_gps6, locations, &old_out);
+		old_s = seconds < old_s ? seconds : old_s;
+		seconds = run(new_gps6, locations, &new_out);
+		new_s = seconds < new_s ? seconds : new_s;
+	}
+
+	printf("Union copy   : %u locations, %.2f ns/location\n", count, old_s / count * 1e9);
+	printf("Field writer : %u locations, %.2f ns/location\n", count, new_s / count * 1e9);
+	if (memcmp(&old_out[0], &new_out[0], old_out.size()) != 0)
+	{
+		fprintf(stderr, "Packets differ\n");
+		return 1;
+	}
+	printf("Packets are the same\n");
+	return 0;
+}
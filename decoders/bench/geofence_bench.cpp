@@ -0,0 +1,100 @@
+/**
+ * @file geofence_bench.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Time of a geofence check over random points and polygon sets
+ *        Usage: geofence_bench <points>
+ *        The host is much faster than the nRF52840, the numbers show how
+ *        the time grows with the number of zones and points.
+ * @version 0.1
+ * @date 2022-10-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "geofence.h"
+
+/** Area of the zones, about 11 x 11 km */
+#define AREA 1000000
+
+static Geofence fence;
+
+/**
+ * @brief Random star shaped zones in the area
+ */
+static void make_zones(uint8_t zones, uint16_t points, int32_t lat, int32_t lon)
+{
+	fence.clear();
+	for (uint8_t id = 0; id < zones; id++)
+	{
+		int32_t c_lat = lat + rand() % AREA;
+		int32_t c_lon = lon + rand() % AREA;
+		for (uint16_t idx = 0; idx < points; idx++)
+		{
+			double radius = (idx & 1) ? 5000 + rand() % 10000 : 20000 + rand() % 30000;
+			double angle = idx * 2 * M_PI / points;
+			fence.addPoint(id, 0, (int32_t)(c_lat + radius * sin(angle)), (int32_t)(c_lon + radius * cos(angle)));
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <points>\n", argv[0]);
+		return 1;
+	}
+	uint32_t count = strtoul(argv[1], NULL, 0);
+	if (count == 0)
+	{
+		fprintf(stderr, "%s: no points\n", argv[0]);
+		return 1;
+	}
+
+	static const uint16_t sets[][2] = {{1, 4}, {4, 8}, {8, 16}, {16, 16}, {32, 16}, {2, 256}};
+	int32_t lat = 481000000;
+	int32_t lon = 115000000;
+	srand(27);
+
+	// Half of the points in the area of the zones, half anywhere in the same country
+	std::vector<int32_t> p_lat(count);
+	std::vector<int32_t> p_lon(count);
+	for (uint32_t idx = 0; idx < count; idx++)
+	{
+		int32_t range = (idx & 1) ? AREA : 50 * AREA;
+		p_lat[idx] = lat + rand() % range - (range - AREA) / 2;
+		p_lon[idx] = lon + rand() % range - (range - AREA) / 2;
+	}
+
+	printf("zones points   check ns   distance ns   inside\n");
+	for (size_t set = 0; set < sizeof(sets) / sizeof(sets[0]); set++)
+	{
+		make_zones(sets[set][0], sets[set][1], lat, lon);
+
+		uint32_t inside = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (uint32_t idx = 0; idx < count; idx++)
+		{
+			inside += fence.check(p_lat[idx], p_lon[idx]) != 0;
+		}
+		double check_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+		uint64_t sum = 0;
+		start = std::chrono::steady_clock::now();
+		for (uint32_t idx = 0; idx < count; idx++)
+		{
+			sum += fence.boundaryDistance(p_lat[idx], p_lon[idx]);
+		}
+		double distance_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+
+		printf("%5d %6d %10.1f %13.1f %7.1f%% (%llu)\n", sets[set][0], fence.points(), check_ns, distance_ns,
+			   100.0 * inside / count, (unsigned long long)(sum & 0xFF));
+	}
+	return 0;
+}
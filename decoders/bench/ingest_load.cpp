@@ -0,0 +1,326 @@
+/**
+ * @file ingest_load.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Load generator for the ingest service
+ *        Usage: ingest_load <frames> <rate> [gateways] [workers] [frames file]
+ *        Runs the ingest service on a free UDP port and sends it the frames of
+ *        1000 devices from several simulated gateways over UDP. A frame is
+ *        received by 1 to <gateways> gateways, each sends its own PUSH_DATA.
+ *        <rate> is the number of frames per second, 0 sends as fast as possible.
+ *        The payloads are read from the frames file (one hex frame per line,
+ *        the first byte is the fPort, as for lpp_decode -p) and replayed in order
+ *        by every device, without a file location packets are generated.
+ *        The send time is the tmst of the frames, the latency is the time from
+ *        sending the first copy until the sink has the decoded values.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "ingest_service.h"
+#include "semtech_udp.h"
+#include "lpp_schema.h"
+#include "field_writer.h"
+
+/** Number of simulated devices */
+#define LOAD_DEVICES 1000
+/** First device address */
+#define LOAD_DEVADDR 0x26010000
+/** fPort of the generated application packets */
+#define LOAD_APP_PORT 2
+/** Max gateways */
+#define LOAD_MAX_GATEWAYS 16
+
+/** Payload with its fPort */
+struct load_payload_s
+{
+	uint8_t fport;
+	uint8_t size;
+	uint8_t data[LORAWAN_MAX_SIZE];
+};
+
+/**
+ * @brief Records the latency of every uplink
+ */
+class LatencySink : public IngestSink
+{
+public:
+	LatencySink(void) : _last_us(0) {}
+	void write(const ingest_uplink_s *uplink, const lpp_columns_s *values)
+	{
+		(void)values;
+		uint64_t now = ingest_now_us();
+		std::lock_guard<std::mutex> guard(_lock);
+		_latency.push_back((uint32_t)now - uplink->tmst);
+		_last_us = now;
+	}
+	std::vector<uint32_t> latency(void)
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		return _latency;
+	}
+	uint64_t last(void)
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		return _last_us;
+	}
+
+private:
+	std::mutex _lock;
+	std::vector<uint32_t> _latency;
+	uint64_t _last_us;
+};
+
+/** Location and battery like the tracker sends them, every 4th with the environment */
+static void make_payloads(std::vector<load_payload_s> *payloads)
+{
+	uint32_t seed = 1;
+	for (uint32_t idx = 0; idx < 64; idx++)
+	{
+		seed = seed * 1103515245 + 12345;
+		uint32_t random = seed >> 8;
+		load_payload_s payload;
+		payload.fport = LOAD_APP_PORT;
+		uint8_t *data = payload.data;
+		uint8_t size = 0;
+		data[size++] = LPP_CHANNEL_GPS;
+		data[size++] = LPP_GPS6;
+		size += put_be<4>(&data[size], (uint32_t)(481234567 + (int32_t)(random & 0xFFFF)));
+		size += put_be<4>(&data[size], (uint32_t)(117654321 - (int32_t)(random & 0xFFFF)));
+		size += put_be<3>(&data[size], 52000 + (random & 0xFF));
+		size += lpp_put<LPP_CHANNEL_BATT>(&data[size], 380 + (random & 0x1F));
+		if ((idx % 4) == 0)
+		{
+			size += lpp_put<LPP_CHANNEL_TEMP>(&data[size], 215);
+			size += lpp_put<LPP_CHANNEL_HUMID>(&data[size], 90);
+			size += lpp_put<LPP_CHANNEL_PRESS>(&data[size], 10132);
+		}
+		payload.size = size;
+		payloads->push_back(payload);
+	}
+}
+
+/** Read hex frames with the fPort as first byte */
+static bool read_payloads(const char *name, std::vector<load_payload_s> *payloads)
+{
+	FILE *file = fopen(name, "r");
+	if (file == NULL)
+	{
+		return false;
+	}
+	char line[2 * (LORAWAN_MAX_SIZE + 1) + 8];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		uint8_t bytes[LORAWAN_MAX_SIZE + 1];
+		size_t size = 0;
+		unsigned value;
+		for (char *hex = line; (size < sizeof(bytes)) && (sscanf(hex, "%2x", &value) == 1); hex += 2)
+		{
+			bytes[size++] = (uint8_t)value;
+		}
+		if ((size < 2) || (size - 1 > LORAWAN_MAX_SIZE - LORAWAN_OVERHEAD) || (bytes[0] == 0))
+		{
+			continue;
+		}
+		load_payload_s payload;
+		payload.fport = bytes[0];
+		payload.size = (uint8_t)(size - 1);
+		memcpy(payload.data, &bytes[1], size - 1);
+		payloads->push_back(payload);
+	}
+	fclose(file);
+	return !payloads->empty();
+}
+
+/** Read and count the PUSH_ACKs of a gateway */
+static uint32_t read_acks(int socket)
+{
+	uint32_t acks = 0;
+	uint8_t ack[64];
+	udp_header_s header;
+	ssize_t size;
+	while ((size = recv(socket, ack, sizeof(ack), MSG_DONTWAIT)) > 0)
+	{
+		if (udp_parse_header(ack, size, &header) && (header.identifier == UDP_PUSH_ACK))
+		{
+			acks++;
+		}
+	}
+	return acks;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <frames> <rate> [gateways] [workers] [frames file]\n", argv[0]);
+		return 1;
+	}
+	uint32_t frames = strtoul(argv[1], NULL, 0);
+	double rate = strtod(argv[2], NULL);
+	uint32_t gateways = argc > 3 ? strtoul(argv[3], NULL, 0) : 3;
+	uint8_t workers = argc > 4 ? (uint8_t)strtoul(argv[4], NULL, 0) : std::thread::hardware_concurrency();
+	gateways = gateways == 0 ? 1 : gateways > LOAD_MAX_GATEWAYS ? LOAD_MAX_GATEWAYS : gateways;
+	std::vector<load_payload_s> payloads;
+	if (argc <= 5)
+	{
+		make_payloads(&payloads);
+	}
+	else if (!read_payloads(argv[5], &payloads))
+	{
+		fprintf(stderr, "%s: no frames in %s\n", argv[0], argv[5]);
+		return 1;
+	}
+	if (frames == 0)
+	{
+		fprintf(stderr, "%s: no frames\n", argv[0]);
+		return 1;
+	}
+
+	ingest_options_s options;
+	memset(&options, 0, sizeof(options));
+	options.workers = workers;
+	options.dedup_ms = 200;
+	options.check_mic = true;
+	for (uint8_t idx = 0; idx < 16; idx++)
+	{
+		options.nwk_skey[idx] = 0x10 + idx;
+		options.app_skey[idx] = 0x20 + idx;
+	}
+	LatencySink sink;
+	IngestService service(&sink);
+	if (!service.begin(&options))
+	{
+		fprintf(stderr, "%s: can't start the ingest service\n", argv[0]);
+		return 1;
+	}
+	aes128_key_s nwk_skey;
+	aes128_key_s app_skey;
+	aes128_init(&nwk_skey, options.nwk_skey);
+	aes128_init(&app_skey, options.app_skey);
+
+	// One socket per gateway
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(service.port());
+	int sockets[LOAD_MAX_GATEWAYS];
+	for (uint32_t gateway = 0; gateway < gateways; gateway++)
+	{
+		sockets[gateway] = socket(AF_INET, SOCK_DGRAM, 0);
+		if ((sockets[gateway] < 0) || (connect(sockets[gateway], (sockaddr *)&address, sizeof(address)) != 0))
+		{
+			fprintf(stderr, "%s: can't connect to the ingest service\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<uint32_t> fcnt(LOAD_DEVICES, 0);
+	uint32_t seed = 7;
+	uint64_t datagrams = 0;
+	uint64_t acks = 0;
+	uint64_t send_errors = 0;
+	uint8_t datagram[1024];
+	udp_rxpk_s rxpk;
+	rxpk.stat = 1;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	uint64_t start_us = ingest_now_us();
+	for (uint32_t idx = 0; idx < frames; idx++)
+	{
+		if (rate > 0)
+		{
+			std::this_thread::sleep_until(start + std::chrono::microseconds((uint64_t)(idx * 1e6 / rate)));
+		}
+		// Every device replays the payloads in order
+		uint32_t device = idx % LOAD_DEVICES;
+		const load_payload_s &payload = payloads[fcnt[device] % payloads.size()];
+		rxpk.size = lorawan_build(&nwk_skey, &app_skey, LOAD_DEVADDR + device, fcnt[device]++, payload.fport,
+								  payload.data, payload.size, false, rxpk.data);
+		rxpk.tmst = (uint32_t)ingest_now_us();
+		seed = seed * 1103515245 + 12345;
+		uint32_t copies = 1 + (seed >> 8) % gateways;
+		for (uint32_t copy = 0; copy < copies; copy++)
+		{
+			uint32_t gateway = (device + copy) % gateways;
+			rxpk.rssi = -60 - (int16_t)(10 * copy);
+			rxpk.lsnr = 9.5f - 3 * copy;
+			size_t size = udp_build_push(datagram, sizeof(datagram), (uint16_t)idx, 0xAA555A0000000000ULL + gateway, &rxpk, 1);
+			if (send(sockets[gateway], datagram, size, 0) == (ssize_t)size)
+			{
+				datagrams++;
+			}
+			else
+			{
+				send_errors++;
+			}
+		}
+		if ((idx % 64) == 0)
+		{
+			for (uint32_t gateway = 0; gateway < gateways; gateway++)
+			{
+				acks += read_acks(sockets[gateway]);
+			}
+		}
+	}
+	double send_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Wait until the workers are done or nothing happened for a second
+	uint64_t handled = 0;
+	uint64_t last_progress = ingest_now_us();
+	while (ingest_now_us() - last_progress < 1000000)
+	{
+		ingest_stats_s stats = service.stats();
+		uint64_t now_handled = stats.uplinks + stats.decode_errors + stats.bad_mic + stats.bad_frames;
+		if (now_handled >= frames)
+		{
+			break;
+		}
+		if (now_handled != handled)
+		{
+			handled = now_handled;
+			last_progress = ingest_now_us();
+		}
+		usleep(1000);
+	}
+	usleep(10000);
+	for (uint32_t gateway = 0; gateway < gateways; gateway++)
+	{
+		acks += read_acks(sockets[gateway]);
+		close(sockets[gateway]);
+	}
+	service.end();
+
+	ingest_stats_s stats = service.stats();
+	std::vector<uint32_t> latency = sink.latency();
+	std::sort(latency.begin(), latency.end());
+	double ingest_time = (sink.last() - start_us) / 1e6;
+	printf("sent:    %u frames in %llu datagrams from %u gateways in %.2f s, %.0f frames/s offered\n", frames,
+		   (unsigned long long)datagrams, gateways, send_time, frames / send_time);
+	printf("ingest:  %llu uplinks, %llu duplicates dropped, %llu lost, %llu acks, %u workers, %.0f frames/s\n",
+		   (unsigned long long)stats.uplinks, (unsigned long long)stats.duplicates,
+		   (unsigned long long)(frames - (stats.uplinks + stats.decode_errors)), (unsigned long long)acks, workers,
+		   stats.uplinks / (ingest_time > 0 ? ingest_time : 1));
+	printf("errors:  %llu send, %llu bad frames, %llu bad MIC, %llu decode\n", (unsigned long long)send_errors,
+		   (unsigned long long)stats.bad_frames, (unsigned long long)stats.bad_mic,
+		   (unsigned long long)stats.decode_errors);
+	if (!latency.empty())
+	{
+		printf("latency: p50 %u us, p99 %u us, max %u us\n", latency[latency.size() / 2],
+			   latency[latency.size() * 99 / 100], latency.back());
+	}
+	return (stats.uplinks != 0) && (stats.bad_mic == 0) && (stats.bad_frames == 0) ? 0 : 1;
+}
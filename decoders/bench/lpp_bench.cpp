@@ -0,0 +1,136 @@
+/**
+ * @file lpp_bench.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Throughput of the native decoder with frames as the tracker sends them
+ *        Usage: lpp_bench <frames> [hex file]
+ *        The frames are written to the hex file for lpp_bench.js,
+ *        which measures the JS decoder with the same frames.
+ * @version 0.1
+ * @date 2022-10-03
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#include "ext_lpp_decoder.h"
+#include "lpp_schema.h"
+#include "field_writer.h"
+
+/** Number of frames decoded in one batch */
+#define CHUNK_FRAMES 1024
+/** Max values of one frame */
+#define MAX_VALUES 8
+
+/**
+ * @brief Create a frame like the tracker sends it, location and battery,
+ *        every 4th frame with the environment values
+ */
+static uint16_t make_frame(uint8_t *frame, uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	uint32_t random = *seed >> 8;
+	uint16_t size = 0;
+	frame[size++] = LPP_CHANNEL_GPS;
+	frame[size++] = LPP_GPS6;
+	size += put_be<4>(&frame[size], (uint32_t)(481234567 + (int32_t)(random & 0xFFFF)));
+	size += put_be<4>(&frame[size], (uint32_t)(117654321 - (int32_t)(random & 0xFFFF)));
+	size += put_be<3>(&frame[size], 52000 + (random & 0xFF));
+	frame[size++] = LPP_CHANNEL_BATT;
+	frame[size++] = 116;
+	size += put_be<2>(&frame[size], 380 + (random & 0x1F));
+	if ((random & 0x300) == 0)
+	{
+		frame[size++] = LPP_CHANNEL_TEMP;
+		frame[size++] = 103;
+		size += put_be<2>(&frame[size], 215);
+		frame[size++] = LPP_CHANNEL_HUMID;
+		frame[size++] = 104;
+		frame[size++] = 90;
+		frame[size++] = LPP_CHANNEL_PRESS;
+		frame[size++] = 115;
+		size += put_be<2>(&frame[size], 10132);
+	}
+	return size;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <frames> [hex file]\n", argv[0]);
+		return 1;
+	}
+	uint32_t count = strtoul(argv[1], NULL, 0);
+	if (count == 0)
+	{
+		fprintf(stderr, "%s: no frames\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<uint8_t> data(count * 32);
+	std::vector<const uint8_t *> frames(count);
+	std::vector<uint16_t> sizes(count);
+	uint32_t seed = 1;
+	uint64_t bytes = 0;
+	for (uint32_t idx = 0; idx < count; idx++)
+	{
+		frames[idx] = &data[idx * 32];
+		sizes[idx] = make_frame(&data[idx * 32], &seed);
+		bytes += sizes[idx];
+	}
+
+	if (argc > 2)
+	{
+		FILE *out = fopen(argv[2], "w");
+		if (out == NULL)
+		{
+			fprintf(stderr, "%s: cannot write\n", argv[2]);
+			return 1;
+		}
+		for (uint32_t idx = 0; idx < count; idx++)
+		{
+			for (uint16_t pos = 0; pos < sizes[idx]; pos++)
+			{
+				fprintf(out, "%02X", frames[idx][pos]);
+			}
+			fputc('\n', out);
+		}
+		fclose(out);
+	}
+
+	static uint32_t col_frame[CHUNK_FRAMES * MAX_VALUES];
+	static uint8_t col_channel[CHUNK_FRAMES * MAX_VALUES];
+	static uint8_t col_type[CHUNK_FRAMES * MAX_VALUES];
+	static double col_value[3][CHUNK_FRAMES * MAX_VALUES];
+	lpp_columns_s columns;
+	columns.capacity = CHUNK_FRAMES * MAX_VALUES;
+	columns.frame = col_frame;
+	columns.channel = col_channel;
+	columns.type = col_type;
+	for (int idx = 0; idx < 3; idx++)
+	{
+		columns.value[idx] = col_value[idx];
+	}
+
+	uint32_t errors = 0;
+	uint64_t values = 0;
+	double check = 0.0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t first = 0; first < count; first += CHUNK_FRAMES)
+	{
+		uint32_t chunk = count - first < CHUNK_FRAMES ? count - first : CHUNK_FRAMES;
+		columns.count = 0;
+		lpp_decode_batch(&frames[first], &sizes[first], chunk, first, false, &columns, &errors);
+		values += columns.count;
+		check += columns.value[0][0];
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("C++ : %u frames, %llu values, %u errors, %.3f s, %.0f frames/s, %.1f MB/s (check %.3f)\n", count,
+		   (unsigned long long)values, errors, seconds, count / seconds, bytes / seconds / 1e6, check);
+	return errors == 0 ? 0 : 2;
+}
@@ -0,0 +1,39 @@
+// Throughput of lppDecode() of a JS decoder with the frames written by lpp_bench
+// Usage: node lpp_bench.js <decoder.js> <hex file>
+var fs = require('fs');
+var vm = require('vm');
+
+if (process.argv.length < 4) {
+	console.error('usage: node lpp_bench.js <decoder.js> <hex file>');
+	process.exit(1);
+}
+
+var context = {};
+vm.createContext(context);
+vm.runInContext(fs.readFileSync(process.argv[2], 'utf8'), context);
+
+// Frames are converted before the measurement, the backend gets them as byte arrays
+var frames = fs.readFileSync(process.argv[3], 'utf8').split('\n').filter(function (line) {
+	return line.length > 0;
+}).map(function (line) {
+	var bytes = [];
+	for (var i = 0; i < line.length; i += 2) {
+		bytes.push(parseInt(line.substr(i, 2), 16));
+	}
+	return bytes;
+});
+
+var bytes = 0;
+frames.forEach(function (frame) {
+	bytes += frame.length;
+});
+
+var values = 0;
+var start = process.hrtime.bigint();
+for (var i = 0; i < frames.length; i++) {
+	values += context.lppDecode(frames[i]).length;
+}
+var seconds = Number(process.hrtime.bigint() - start) / 1e9;
+
+console.log('JS  : ' + frames.length + ' frames, ' + values + ' values, ' + seconds.toFixed(3) + ' s, ' +
+	(frames.length / seconds).toFixed(0) + ' frames/s, ' + (bytes / seconds / 1e6).toFixed(1) + ' MB/s');
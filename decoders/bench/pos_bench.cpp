@@ -0,0 +1,155 @@
+/**
+ * @file pos_bench.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Bytes per location and speed of the batch codec on a recorded track
+ *        Usage: pos_bench <track.csv> <repeats>
+ *        The locations are sent in frames of the max payload of a data rate,
+ *        compared with one LPP packet per location.
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#include "test_track.h"
+#include "pos_codec.h"
+#include "lpp_schema.h"
+
+/** LoRaWAN MAC header, FHDR without options, fPort and MIC */
+#define LORAWAN_OVERHEAD 13
+
+/**
+ * @brief Encode the track into frames of max_size bytes
+ *
+ * @return uint32_t number of frames, payload bytes in *bytes
+ */
+static uint32_t encode_track(const std::vector<pos_point_s> &points, uint8_t max_size, uint8_t pos_res, uint32_t *bytes)
+{
+	uint8_t frame[255];
+	uint32_t frames = 0;
+	*bytes = 0;
+	size_t next = 0;
+	while (next < points.size())
+	{
+		PosEncoder encoder;
+		encoder.begin(frame, max_size, pos_res, ALT_RES_M);
+		size_t first = next;
+		while ((next < points.size()) && encoder.add(&points[next]))
+		{
+			next++;
+		}
+		if (next == first)
+		{
+			// The first location doesn't fit
+			return 0;
+		}
+		*bytes += encoder.getSize();
+		frames++;
+	}
+	return frames;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <track.csv> <repeats>\n", argv[0]);
+		return 1;
+	}
+	std::vector<track_fix_s> track = read_track(argv[1]);
+	uint32_t repeats = strtoul(argv[2], NULL, 0);
+	if (track.empty() || (repeats == 0))
+	{
+		fprintf(stderr, "%s: no locations\n", argv[0]);
+		return 1;
+	}
+	std::vector<pos_point_s> points;
+	for (size_t idx = 0; idx < track.size(); idx++)
+	{
+		pos_point_s point = {track[idx].latitude, track[idx].longitude, 520000, track[idx].time};
+		points.push_back(point);
+	}
+	uint32_t count = points.size();
+
+	// One LPP packet per location, with the fix time like the batch frames
+	uint32_t gps4 = 2 + LPP_GPS4_SIZE + 2 + LPP_TIME_SIZE;
+	uint32_t gps6 = 2 + LPP_GPS6_SIZE + 2 + LPP_TIME_SIZE;
+	printf("%u locations, one every %us\n", count, (track.back().time - track.front().time) / (count - 1));
+	printf("LPP 4 digits     : %5.1f bytes/location, %5.1f with LoRaWAN overhead\n", (double)gps4,
+		   (double)(gps4 + LORAWAN_OVERHEAD));
+	printf("LPP 6 digits     : %5.1f bytes/location, %5.1f with LoRaWAN overhead\n", (double)gps6,
+		   (double)(gps6 + LORAWAN_OVERHEAD));
+
+	static const uint8_t sizes[] = {11, 51, 115, 242};
+	static const uint8_t resolutions[] = {POS_RES_1E4, POS_RES_1E6};
+	for (size_t res = 0; res < sizeof(resolutions) / sizeof(resolutions[0]); res++)
+	{
+		for (size_t size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++)
+		{
+			uint32_t bytes;
+			uint32_t frames = encode_track(points, sizes[size], resolutions[res], &bytes);
+			if (frames == 0)
+			{
+				printf("Batch %d digits %3u: location doesn't fit\n", resolutions[res] == POS_RES_1E4 ? 4 : 6, sizes[size]);
+				continue;
+			}
+			printf("Batch %d digits %3u: %5.1f bytes/location, %5.1f with LoRaWAN overhead, %4.1f locations/frame\n",
+				   resolutions[res] == POS_RES_1E4 ? 4 : 6, sizes[size], (double)bytes / count,
+				   (double)(bytes + frames * LORAWAN_OVERHEAD) / count, (double)count / frames);
+		}
+	}
+
+	// Speed of 242 byte frames, 6 digits
+	uint8_t frame[242];
+	uint32_t encoded = 0;
+	uint32_t frames = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t repeat = 0; repeat < repeats; repeat++)
+	{
+		size_t next = 0;
+		while (next < points.size())
+		{
+			PosEncoder encoder;
+			encoder.begin(frame, sizeof(frame), POS_RES_1E6, ALT_RES_M);
+			while ((next < points.size()) && encoder.add(&points[next]))
+			{
+				next++;
+				encoded++;
+			}
+			frames++;
+		}
+	}
+	double encode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	PosEncoder encoder;
+	encoder.begin(frame, sizeof(frame), POS_RES_1E6, ALT_RES_M);
+	for (size_t idx = 0; (idx < points.size()) && encoder.add(&points[idx]); idx++)
+	{
+	}
+	uint32_t decoded = 0;
+	int64_t checksum = 0;
+	start = std::chrono::steady_clock::now();
+	// About as many locations as encoded
+	for (uint32_t repeat = 0; repeat < frames; repeat++)
+	{
+		PosDecoder decoder;
+		decoder.begin(frame, encoder.getSize());
+		pos_point_s point;
+		while (decoder.next(&point))
+		{
+			checksum += point.latitude;
+			decoded++;
+		}
+	}
+	double decode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("Encode: %u locations, %.3f s, %.1f M locations/s\n", encoded, encode_s, encoded / encode_s / 1e6);
+	printf("Decode: %u locations, %.3f s, %.1f M locations/s (checksum %lld)\n", decoded, decode_s,
+		   decoded / decode_s / 1e6, (long long)checksum);
+	return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file store_bench.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Ingest and query speed and disk size of the track store
+ *        Usage: store_bench <rows> <devices> <folder>
+ *        The devices send a location every 30 s with some jitter, the rows are
+ *        written round robin like the uplinks arrive. Then the whole track of
+ *        one device is replayed and one hour of it is queried.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+#include "track_store.h"
+
+/** Small and fast random numbers, rand() would be half of the ingest time */
+static uint32_t rng_state = 2463534242u;
+static uint32_t next_random(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 4)
+	{
+		fprintf(stderr, "usage: %s <rows> <devices> <folder>\n", argv[0]);
+		return 1;
+	}
+	uint64_t rows = strtoull(argv[1], NULL, 0);
+	uint32_t devices = strtoul(argv[2], NULL, 0);
+	std::string folder = argv[3];
+	if ((rows == 0) || (devices == 0))
+	{
+		fprintf(stderr, "%s: no rows\n", argv[0]);
+		return 1;
+	}
+	mkdir(folder.c_str(), 0755);
+
+	// Ingest
+	std::vector<track_record_s> last(devices);
+	for (uint32_t device = 0; device < devices; device++)
+	{
+		track_record_s *record = &last[device];
+		record->time = 1664582400 + next_random() % 30;
+		record->latitude = 470000000 + next_random() % 50000000;
+		record->longitude = 60000000 + next_random() % 90000000;
+		record->altitude = 50000;
+		record->accuracy = 300;
+		record->battery = 4200;
+		record->temperature = 200;
+		record->humidity = 100;
+		record->pressure = 10130;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		TrackStore store(folder);
+		for (uint64_t row = 0; row < rows; row++)
+		{
+			uint32_t device = row % devices;
+			track_record_s *record = &last[device];
+			uint32_t random = next_random();
+			record->time += 28 + (random & 3);
+			record->latitude += (int32_t)((random >> 2) & 0x3FF) - 500;
+			record->longitude += (int32_t)((random >> 12) & 0x3FF) - 500;
+			record->altitude += (int32_t)((random >> 22) & 0x3F) - 32;
+			record->accuracy = 250 + ((random >> 28) << 4);
+			record->battery -= (row / devices) % 200 == 0;
+			record->temperature = 200 + (int16_t)((random >> 8) & 7);
+			record->pressure = 10130 + ((random >> 16) & 3);
+			if (!store.append(device, record))
+			{
+				fprintf(stderr, "%s: can't write to %s\n", argv[0], folder.c_str());
+				return 1;
+			}
+		}
+		store.flush();
+	}
+	double ingest = seconds_since(start);
+
+	uint64_t bytes = 0;
+	TrackStore store(folder);
+	for (uint32_t device = 0; device < devices; device++)
+	{
+		struct stat info;
+		if (stat(store.path(device).c_str(), &info) == 0)
+		{
+			bytes += info.st_size;
+		}
+	}
+	printf("ingest: %llu rows of %u devices in %.2f s, %.1f M rows/s\n", (unsigned long long)rows, devices, ingest,
+		   rows / ingest / 1e6);
+	printf("disk:   %.1f MB, %.2f bytes per row, %u bytes per raw record\n", bytes / 1e6, (double)bytes / rows,
+		   (unsigned)sizeof(track_record_s));
+
+	// Replay of the whole track of one device
+	std::vector<track_record_s> out;
+	TrackReader reader;
+	start = std::chrono::steady_clock::now();
+	if (!reader.open(store.path(0).c_str()))
+	{
+		fprintf(stderr, "%s: can't read %s\n", argv[0], store.path(0).c_str());
+		return 1;
+	}
+	reader.query(0, UINT32_MAX, &out);
+	double replay = seconds_since(start);
+	if (out.size() != reader.rows() || out.empty())
+	{
+		fprintf(stderr, "%s: %u of %llu rows read\n", argv[0], (unsigned)out.size(), (unsigned long long)reader.rows());
+		return 1;
+	}
+	printf("replay: %u rows, %.1f days of device 0 in %.2f ms, %.1f M rows/s\n", (unsigned)out.size(),
+		   (out.back().time - out.front().time) / 86400.0, replay * 1e3, out.size() / replay / 1e6);
+
+	// One hour in the middle of the track, most segments are skipped by their index
+	uint32_t from = out[out.size() / 2].time;
+	uint32_t queries = 1000;
+	uint64_t found = 0;
+	start = std::chrono::steady_clock::now();
+	for (uint32_t query = 0; query < queries; query++)
+	{
+		out.clear();
+		found += reader.query(from, from + 3599, &out);
+	}
+	double hour = seconds_since(start) / queries;
+	printf("hour:   %llu rows in %.1f us, %u of %u segments skipped\n", (unsigned long long)(found / queries),
+		   hour * 1e6, reader.lastSkipped(), reader.segments());
+	return 0;
+}
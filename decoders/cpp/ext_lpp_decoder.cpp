@@ -0,0 +1,422 @@
+/**
+ * @file ext_lpp_decoder.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Native decoder for the packets of the tracker for backend ingest
+ * @version 0.1
+ * @date 2022-09-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "ext_lpp_decoder.h"
+#include "../../PlatformIO/src/lpp_schema.h"
+#include "../../PlatformIO/src/field_writer.h"
+#include "../../PlatformIO/src/pos_codec.h"
+#include "../../PlatformIO/src/fragment.h"
+
+/** Decode information per type, indexed by the type byte */
+struct decode_type_s
+{
+	uint8_t size;
+	uint8_t values;
+	uint8_t value_size;
+	bool is_signed;
+	double scale[3];
+	const char *name;
+};
+
+/**
+ * @brief Lookup table of all types, built once from the schema
+ */
+class DecodeTable
+{
+public:
+	DecodeTable(void)
+	{
+		for (int idx = 0; idx < 256; idx++)
+		{
+			types[idx].size = 0;
+			types[idx].name = 0;
+		}
+		for (uint8_t idx = 0; idx < LPP_TYPE_NUM; idx++)
+		{
+			const lpp_type_s &schema = lpp_types[idx];
+			decode_type_s &type = types[schema.type];
+			type.size = schema.size;
+			type.values = schema.values;
+			type.value_size = schema.size / schema.values;
+			type.is_signed = schema.is_signed;
+			type.name = schema.name;
+			for (uint8_t value = 0; value < 3; value++)
+			{
+				uint32_t divisor = (schema.values == 3) && (schema.divisor[1] != 0) ? schema.divisor[value] : schema.divisor[0];
+				type.scale[value] = 1.0 / divisor;
+			}
+		}
+		// 136 and 137 have a different size for the altitude
+		types[LPP_GPS4].value_size = 3;
+		types[LPP_GPS6].value_size = 4;
+	}
+
+	decode_type_s types[256];
+};
+
+static const DecodeTable table;
+
+/**
+ * @brief Read a big endian value of 1 to 4 bytes
+ */
+static inline int64_t read_value(const uint8_t *data, uint8_t size, bool is_signed)
+{
+	uint32_t value = 0;
+	switch (size)
+	{
+	case 1:
+		value = get_be<1>(data);
+		return is_signed ? (int64_t)sign_extend<1>(value) : (int64_t)value;
+	case 2:
+		value = get_be<2>(data);
+		return is_signed ? (int64_t)sign_extend<2>(value) : (int64_t)value;
+	case 3:
+		value = get_be<3>(data);
+		return is_signed ? (int64_t)sign_extend<3>(value) : (int64_t)value;
+	default:
+		value = get_be<4>(data);
+		return is_signed ? (int64_t)(int32_t)value : (int64_t)value;
+	}
+}
+
+/**
+ * @brief Add one row, the caller checks the capacity
+ */
+static inline void add_row(lpp_columns_s *out, uint32_t frame, uint8_t channel, uint8_t type,
+						   double value0, double value1 = 0.0, double value2 = 0.0)
+{
+	uint32_t row = out->count++;
+	out->frame[row] = frame;
+	out->channel[row] = channel;
+	out->type[row] = type;
+	out->value[0][row] = value0;
+	out->value[1][row] = value1;
+	out->value[2][row] = value2;
+}
+
+/**
+ * @brief Get the name of a type
+ *
+ * @param type LPP type
+ * @return const char* name as used by the JS decoders, "unknown" if the type is not known
+ */
+const char *lpp_decode_name(uint8_t type)
+{
+	switch (type)
+	{
+	case LPP_DECODE_TYPE_ACCURACY:
+		return "accuracy";
+	case LPP_DECODE_TYPE_AGE:
+		return "age";
+	case LPP_DECODE_TYPE_LINK_EDGE:
+		return "cell_edge";
+	case LPP_DECODE_TYPE_LINK_CELL:
+		return "cell";
+	case LPP_DECODE_TYPE_LINK_RSSI:
+		return "rssi";
+	case LPP_DECODE_TYPE_LINK_SNR:
+		return "snr";
+	}
+	return table.types[type].name != 0 ? table.types[type].name : "unknown";
+}
+
+/**
+ * @brief Decode one extended Cayenne LPP frame
+ *        A frame with an error adds no values.
+ *
+ * @param data frame data
+ * @param size frame size
+ * @param frame frame number stored with the values
+ * @param out columns for the values
+ * @return int number of values added or LPP_DECODE_ERR_xxx
+ */
+int lpp_decode_frame(const uint8_t *data, uint16_t size, uint32_t frame, lpp_columns_s *out)
+{
+	uint32_t start = out->count;
+	uint16_t cursor = 0;
+	while (cursor < size)
+	{
+		if ((cursor + 2) > size)
+		{
+			out->count = start;
+			return LPP_DECODE_ERR_SIZE;
+		}
+		uint8_t channel = data[cursor];
+		const decode_type_s &type = table.types[data[cursor + 1]];
+		if (type.size == 0)
+		{
+			out->count = start;
+			return LPP_DECODE_ERR_TYPE;
+		}
+		if ((cursor + 2 + type.size) > size)
+		{
+			out->count = start;
+			return LPP_DECODE_ERR_SIZE;
+		}
+		if (out->count >= out->capacity)
+		{
+			out->count = start;
+			return LPP_DECODE_ERR_FULL;
+		}
+
+		uint32_t row = out->count++;
+		out->frame[row] = frame;
+		out->channel[row] = channel;
+		out->type[row] = data[cursor + 1];
+		const uint8_t *value_data = &data[cursor + 2];
+		if (type.values == 1)
+		{
+			out->value[0][row] = read_value(value_data, type.size, type.is_signed) * type.scale[0];
+			out->value[1][row] = 0.0;
+			out->value[2][row] = 0.0;
+		}
+		else
+		{
+			// GNSS locations have a 3 byte altitude after latitude and longitude
+			out->value[0][row] = read_value(value_data, type.value_size, type.is_signed) * type.scale[0];
+			out->value[1][row] = read_value(value_data + type.value_size, type.value_size, type.is_signed) * type.scale[1];
+			uint8_t last_size = type.size - 2 * type.value_size;
+			out->value[2][row] = read_value(value_data + 2 * type.value_size, last_size, type.is_signed) * type.scale[2];
+		}
+		cursor += 2 + type.size;
+	}
+	return out->count - start;
+}
+
+/**
+ * @brief Decode one Helium Mapper frame
+ *        4 byte latitude, 4 byte longitude (0.00001 °, LSB first),
+ *        2 byte altitude (1 m, LSB first), 2 byte accuracy (LSB first),
+ *        2 byte battery (mV, MSB first)
+ *        Adds the location on LPP_CHANNEL_GPS, the accuracy on LPP_DECODE_CHANNEL_ACCURACY
+ *        and the battery voltage on LPP_CHANNEL_BATT.
+ *
+ * @param data frame data
+ * @param size frame size
+ * @param frame frame number stored with the values
+ * @param out columns for the values
+ * @return int number of values added or LPP_DECODE_ERR_xxx
+ */
+int helium_decode_frame(const uint8_t *data, uint16_t size, uint32_t frame, lpp_columns_s *out)
+{
+	if (size != LPP_GPSH_SIZE)
+	{
+		return LPP_DECODE_ERR_SIZE;
+	}
+	if ((out->count + 3) > out->capacity)
+	{
+		return LPP_DECODE_ERR_FULL;
+	}
+
+	uint32_t row = out->count;
+	out->frame[row] = frame;
+	out->channel[row] = LPP_CHANNEL_GPS;
+	out->type[row] = LPP_GPS6;
+	out->value[0][row] = (int32_t)get_le<4>(&data[0]) / 100000.0;
+	out->value[1][row] = (int32_t)get_le<4>(&data[4]) / 100000.0;
+	out->value[2][row] = sign_extend<2>(get_le<2>(&data[8]));
+
+	row++;
+	out->frame[row] = frame;
+	out->channel[row] = LPP_DECODE_CHANNEL_ACCURACY;
+	out->type[row] = LPP_DECODE_TYPE_ACCURACY;
+	out->value[0][row] = get_le<2>(&data[10]);
+	out->value[1][row] = 0.0;
+	out->value[2][row] = 0.0;
+
+	row++;
+	out->frame[row] = frame;
+	out->channel[row] = LPP_CHANNEL_BATT;
+	out->type[row] = 116;
+	out->value[0][row] = get_be<2>(&data[12]) / 1000.0;
+	out->value[1][row] = 0.0;
+	out->value[2][row] = 0.0;
+
+	out->count = row + 1;
+	return 3;
+}
+
+/**
+ * @brief Decode one link map frame (fPort 11), format see LinkMap::pack()
+ *        Adds the cell edge length and per cell the cell, RSSI and SNR rows.
+ *
+ * @param data frame data
+ * @param size frame size
+ * @param frame frame number stored with the values
+ * @param out columns for the values
+ * @return int number of values added or LPP_DECODE_ERR_xxx
+ */
+int link_map_decode_frame(const uint8_t *data, uint16_t size, uint32_t frame, lpp_columns_s *out)
+{
+	// 2 bytes header, 13 bytes per cell
+	if ((size < 15) || (((size - 2) % 13) != 0))
+	{
+		return LPP_DECODE_ERR_SIZE;
+	}
+	uint32_t cells = (size - 2) / 13;
+	if ((out->count + 1 + 3 * cells) > out->capacity)
+	{
+		return LPP_DECODE_ERR_FULL;
+	}
+
+	add_row(out, frame, LPP_DECODE_PORT_LINK_MAP, LPP_DECODE_TYPE_LINK_EDGE, get_be<2>(data));
+	for (uint16_t cursor = 2; cursor < size; cursor += 13)
+	{
+		const uint8_t *cell = &data[cursor];
+		add_row(out, frame, LPP_DECODE_PORT_LINK_MAP, LPP_DECODE_TYPE_LINK_CELL,
+				sign_extend<3>(get_be<3>(&cell[0])), sign_extend<3>(get_be<3>(&cell[3])), cell[6]);
+		add_row(out, frame, LPP_DECODE_PORT_LINK_MAP, LPP_DECODE_TYPE_LINK_RSSI, -cell[7], -cell[8], -cell[9]);
+		add_row(out, frame, LPP_DECODE_PORT_LINK_MAP, LPP_DECODE_TYPE_LINK_SNR,
+				(int8_t)cell[10], (int8_t)cell[11], (int8_t)cell[12]);
+	}
+	return 1 + 3 * cells;
+}
+
+/**
+ * @brief Decode one batch frame (fPort 12), format see PosEncoder
+ *        Adds per location a LPP_GPS6 row and its age.
+ *
+ * @param data frame data
+ * @param size frame size
+ * @param frame frame number stored with the values
+ * @param out columns for the values
+ * @return int number of values added or LPP_DECODE_ERR_xxx
+ */
+int batch_decode_frame(const uint8_t *data, uint16_t size, uint32_t frame, lpp_columns_s *out)
+{
+	if (size > 255)
+	{
+		return LPP_DECODE_ERR_SIZE;
+	}
+	PosDecoder decoder;
+	if (!decoder.begin(data, (uint8_t)size))
+	{
+		return LPP_DECODE_ERR_FORMAT;
+	}
+	uint32_t start = out->count;
+	pos_point_s point;
+	while (decoder.next(&point))
+	{
+		if ((out->count + 2) > out->capacity)
+		{
+			out->count = start;
+			return LPP_DECODE_ERR_FULL;
+		}
+		add_row(out, frame, LPP_DECODE_PORT_BATCH, LPP_GPS6,
+				point.latitude / 10000000.0, point.longitude / 10000000.0, point.altitude / 1000.0);
+		add_row(out, frame, LPP_DECODE_PORT_BATCH, LPP_DECODE_TYPE_AGE, point.time);
+	}
+	return out->count - start;
+}
+
+/**
+ * @brief Decode one uplink by its fPort
+ *        Fragments (fPort 13) add values only when the last missing fragment
+ *        of a packet arrives, the values get the frame number of that fragment.
+ *        Queued packets (fPort 14) add their age, then the values of the original packet.
+ *        All other fPorts are application packets in Ext-LPP or Helium Mapper format.
+ *
+ * @param fport fPort of the uplink
+ * @param data frame data
+ * @param size frame size
+ * @param frame frame number stored with the values
+ * @param helium true if application packets are in Helium Mapper format
+ * @param frag reassembler for the fragments, NULL if fragments are not expected
+ * @param out columns for the values
+ * @return int number of values added or LPP_DECODE_ERR_xxx
+ */
+int lpp_decode_uplink(uint8_t fport, const uint8_t *data, uint16_t size, uint32_t frame, bool helium,
+					  FragReassembler *frag, lpp_columns_s *out)
+{
+	switch (fport)
+	{
+	case LPP_DECODE_PORT_LINK_MAP:
+		return link_map_decode_frame(data, size, frame, out);
+	case LPP_DECODE_PORT_BATCH:
+		return batch_decode_frame(data, size, frame, out);
+	case LPP_DECODE_PORT_FRAG:
+		if ((frag == 0) || (size > 255))
+		{
+			return LPP_DECODE_ERR_FORMAT;
+		}
+		if (!frag->add(data, (uint8_t)size))
+		{
+			return 0;
+		}
+		if ((frag->getFport() == LPP_DECODE_PORT_FRAG) || (frag->getFport() == LPP_DECODE_PORT_QUEUE))
+		{
+			return LPP_DECODE_ERR_FORMAT;
+		}
+		return lpp_decode_uplink(frag->getFport(), frag->getData(), frag->getSize(), frame, helium, 0, out);
+	case LPP_DECODE_PORT_QUEUE:
+	{
+		if (size < 4)
+		{
+			return LPP_DECODE_ERR_SIZE;
+		}
+		if (data[3] == LPP_DECODE_PORT_QUEUE)
+		{
+			return LPP_DECODE_ERR_FORMAT;
+		}
+		if (out->count >= out->capacity)
+		{
+			return LPP_DECODE_ERR_FULL;
+		}
+		uint32_t start = out->count;
+		add_row(out, frame, LPP_DECODE_PORT_QUEUE, LPP_DECODE_TYPE_AGE, get_be<3>(data));
+		int result = lpp_decode_uplink(data[3], &data[4], size - 4, frame, helium, frag, out);
+		if (result < 0)
+		{
+			out->count = start;
+			return result;
+		}
+		return result + 1;
+	}
+	default:
+		return helium ? helium_decode_frame(data, size, frame, out) : lpp_decode_frame(data, size, frame, out);
+	}
+}
+
+/**
+ * @brief Decode many frames
+ *        Stops when the columns are full, frames with errors are skipped.
+ *
+ * @param data pointers to the frames
+ * @param size sizes of the frames
+ * @param count number of frames
+ * @param first_frame frame number of the first frame
+ * @param helium true if the frames are in Helium Mapper format
+ * @param out columns for the values
+ * @param errors number of frames with errors, can be NULL
+ * @param fport fPorts of the frames, NULL if all are application packets
+ * @param frag reassembler for fragments, NULL if fragments are not expected
+ * @return uint32_t number of frames handled, less than count if the columns are full
+ */
+uint32_t lpp_decode_batch(const uint8_t *const *data, const uint16_t *size, uint32_t count,
+						  uint32_t first_frame, bool helium, lpp_columns_s *out, uint32_t *errors,
+						  const uint8_t *fport, FragReassembler *frag)
+{
+	uint32_t idx = 0;
+	for (; idx < count; idx++)
+	{
+		int result = fport != 0 ? lpp_decode_uplink(fport[idx], data[idx], size[idx], first_frame + idx, helium, frag, out)
+					 : helium	? helium_decode_frame(data[idx], size[idx], first_frame + idx, out)
+								: lpp_decode_frame(data[idx], size[idx], first_frame + idx, out);
+		if (result == LPP_DECODE_ERR_FULL)
+		{
+			break;
+		}
+		if ((result < 0) && (errors != 0))
+		{
+			(*errors)++;
+		}
+	}
+	return idx;
+}
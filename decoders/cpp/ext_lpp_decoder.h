@@ -0,0 +1,83 @@
+/**
+ * @file ext_lpp_decoder.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Native decoder for the packets of the tracker for backend ingest
+ *        Decodes the extended Cayenne LPP format (standard types, 136 and 137)
+ *        and the Helium Mapper format into columns provided by the caller.
+ *        The packets of the link map, batch, fragment and queue fPorts
+ *        are decoded into the same columns.
+ *        The type table is taken from lpp_schema.h, the same as the firmware uses.
+ *        No memory is allocated while decoding.
+ * @version 0.1
+ * @date 2022-09-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef EXT_LPP_DECODER_H
+#define EXT_LPP_DECODER_H
+
+#include <stdint.h>
+
+class FragReassembler;
+
+/** Pseudo type for the accuracy value of the Helium Mapper format */
+#define LPP_DECODE_TYPE_ACCURACY 255
+/** Channel of the accuracy value of the Helium Mapper format */
+#define LPP_DECODE_CHANNEL_ACCURACY 0
+
+/** fPorts of the tracker, the same as FPORT_xxx in app.h */
+#define LPP_DECODE_PORT_LINK_MAP 11
+#define LPP_DECODE_PORT_BATCH 12
+#define LPP_DECODE_PORT_FRAG 13
+#define LPP_DECODE_PORT_QUEUE 14
+
+/**
+ * Pseudo types of the values of the tracker fPorts, the channel is the fPort
+ * AGE: value[0] age in seconds, after each batch location and once per queued packet
+ * LINK_EDGE: value[0] cell edge length in meters
+ * LINK_CELL: value[0..2] q, r, number of downlinks
+ * LINK_RSSI: value[0..2] min, mean, max in dBm
+ * LINK_SNR: value[0..2] min, mean, max in dB
+ * Batch locations are type LPP_GPS6 on channel LPP_DECODE_PORT_BATCH.
+ */
+#define LPP_DECODE_TYPE_AGE 254
+#define LPP_DECODE_TYPE_LINK_EDGE 253
+#define LPP_DECODE_TYPE_LINK_CELL 252
+#define LPP_DECODE_TYPE_LINK_RSSI 251
+#define LPP_DECODE_TYPE_LINK_SNR 250
+
+/** Decode errors */
+#define LPP_DECODE_ERR_TYPE -1
+#define LPP_DECODE_ERR_SIZE -2
+#define LPP_DECODE_ERR_FULL -3
+#define LPP_DECODE_ERR_FORMAT -4
+
+/**
+ * @brief Decoded values as columns, all arrays have capacity entries
+ *        Types with one value use only value[0], GNSS locations have
+ *        latitude, longitude and altitude in value[0..2], accelerometer and
+ *        gyrometer x, y, z and colour r, g, b.
+ */
+struct lpp_columns_s
+{
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t *frame;
+	uint8_t *channel;
+	uint8_t *type;
+	double *value[3];
+};
+
+const char *lpp_decode_name(uint8_t type);
+int lpp_decode_frame(const uint8_t *data, uint16_t size, uint32_t frame, lpp_columns_s *out);
+int helium_decode_frame(const uint8_t *data, uint16_t size, uint32_t frame, lpp_columns_s *out);
+int link_map_decode_frame(const uint8_t *data, uint16_t size, uint32_t frame, lpp_columns_s *out);
+int batch_decode_frame(const uint8_t *data, uint16_t size, uint32_t frame, lpp_columns_s *out);
+int lpp_decode_uplink(uint8_t fport, const uint8_t *data, uint16_t size, uint32_t frame, bool helium,
+					  FragReassembler *frag, lpp_columns_s *out);
+uint32_t lpp_decode_batch(const uint8_t *const *data, const uint16_t *size, uint32_t count,
+						  uint32_t first_frame, bool helium, lpp_columns_s *out, uint32_t *errors,
+						  const uint8_t *fport = 0, FragReassembler *frag = 0);
+
+#endif
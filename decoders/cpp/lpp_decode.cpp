@@ -0,0 +1,260 @@
+/**
+ * @file lpp_decode.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Command line decoder for files with many frames, prints the values as CSV
+ *        Build with the CMake project in the decoders folder:
+ *        cmake -S . -B build && cmake --build build
+ *        Usage: lpp_decode [-b] [-H] [-p] <file>
+ *        -b file has binary records, 1 byte length followed by the frame,
+ *           default is one frame per line as hex string
+ *        -H frames are in Helium Mapper format
+ *        -p the first byte of each frame is the fPort, the tracker fPorts 11 to 14
+ *           are decoded by their format, fragments are put together
+ *        Hex lines with an odd number of digits, other characters than hex digits
+ *        and white space or more than 255 bytes are reported and counted as errors.
+ * @version 0.1
+ * @date 2022-09-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ext_lpp_decoder.h"
+#include "../../PlatformIO/src/fragment.h"
+
+/** Number of frames decoded in one batch */
+#define CHUNK_FRAMES 1024
+/** Max frame size */
+#define MAX_FRAME 256
+/** Max values of one frame, a batch location with its age needs at least 4 bytes for 2 values */
+#define MAX_VALUES_PER_FRAME (MAX_FRAME / 2)
+
+static uint8_t frame_data[CHUNK_FRAMES][MAX_FRAME];
+static const uint8_t *frame_ptr[CHUNK_FRAMES];
+static uint16_t frame_size[CHUNK_FRAMES];
+static uint8_t frame_port[CHUNK_FRAMES];
+static FragReassembler reassembler;
+
+static uint32_t col_frame[CHUNK_FRAMES * MAX_VALUES_PER_FRAME];
+static uint8_t col_channel[CHUNK_FRAMES * MAX_VALUES_PER_FRAME];
+static uint8_t col_type[CHUNK_FRAMES * MAX_VALUES_PER_FRAME];
+static double col_value[3][CHUNK_FRAMES * MAX_VALUES_PER_FRAME];
+
+/**
+ * @brief Value of a hex digit
+ *
+ * @return int 0 to 15, -1 if not a hex digit
+ */
+static inline int hex_digit(char c)
+{
+	if ((c >= '0') && (c <= '9'))
+	{
+		return c - '0';
+	}
+	if ((c >= 'a') && (c <= 'f'))
+	{
+		return c - 'a' + 10;
+	}
+	if ((c >= 'A') && (c <= 'F'))
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+/**
+ * @brief Decode the collected frames and print the values
+ *
+ * @param count number of frames
+ * @param first_frame number of the first frame
+ * @param helium frames are in Helium Mapper format
+ * @param ports frames start with the fPort
+ * @param errors counter for frames with errors
+ */
+static void flush(uint32_t count, uint32_t first_frame, bool helium, bool ports, uint32_t *errors)
+{
+	lpp_columns_s columns;
+	columns.capacity = CHUNK_FRAMES * MAX_VALUES_PER_FRAME;
+	columns.count = 0;
+	columns.frame = col_frame;
+	columns.channel = col_channel;
+	columns.type = col_type;
+	for (int idx = 0; idx < 3; idx++)
+	{
+		columns.value[idx] = col_value[idx];
+	}
+
+	lpp_decode_batch(frame_ptr, frame_size, count, first_frame, helium, &columns, errors,
+					 ports ? frame_port : NULL, &reassembler);
+	for (uint32_t row = 0; row < columns.count; row++)
+	{
+		printf("%u,%u,%u,%s,%.10g,%.10g,%.10g\n", columns.frame[row], columns.channel[row], columns.type[row],
+			   lpp_decode_name(columns.type[row]), columns.value[0][row], columns.value[1][row], columns.value[2][row]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool binary = false;
+	bool helium = false;
+	bool ports = false;
+	const char *name = NULL;
+	for (int idx = 1; idx < argc; idx++)
+	{
+		if (strcmp(argv[idx], "-b") == 0)
+		{
+			binary = true;
+		}
+		else if (strcmp(argv[idx], "-H") == 0)
+		{
+			helium = true;
+		}
+		else if (strcmp(argv[idx], "-p") == 0)
+		{
+			ports = true;
+		}
+		else
+		{
+			name = argv[idx];
+		}
+	}
+	if (name == NULL)
+	{
+		fprintf(stderr, "usage: %s [-b] [-H] [-p] <file>\n", argv[0]);
+		return 1;
+	}
+
+	int fd = open(name, O_RDONLY);
+	struct stat file_stat;
+	if ((fd < 0) || (fstat(fd, &file_stat) != 0))
+	{
+		fprintf(stderr, "%s: cannot open\n", name);
+		return 1;
+	}
+	size_t file_size = file_stat.st_size;
+	const char *file = NULL;
+	if (file_size != 0)
+	{
+		file = (const char *)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (file == MAP_FAILED)
+		{
+			fprintf(stderr, "%s: cannot map\n", name);
+			close(fd);
+			return 1;
+		}
+		madvise((void *)file, file_size, MADV_SEQUENTIAL);
+	}
+
+	printf("frame,channel,type,name,value0,value1,value2\n");
+	uint32_t frames = 0;
+	uint32_t errors = 0;
+	uint32_t chunk = 0;
+	uint32_t line = 0;
+	size_t pos = 0;
+	while (pos < file_size)
+	{
+		if (binary)
+		{
+			uint8_t len = (uint8_t)file[pos++];
+			if ((pos + len) > file_size)
+			{
+				fprintf(stderr, "%s: truncated record at byte %lu\n", name, (unsigned long)(pos - 1));
+				errors++;
+				break;
+			}
+			// Binary frames are decoded directly from the mapped file
+			frame_ptr[chunk] = (const uint8_t *)&file[pos];
+			frame_size[chunk] = len;
+			pos += len;
+		}
+		else
+		{
+			line++;
+			uint16_t len = 0;
+			uint32_t digits = 0;
+			int high = -1;
+			const char *error = NULL;
+			while ((pos < file_size) && (file[pos] != '\n'))
+			{
+				char c = file[pos++];
+				int digit = hex_digit(c);
+				if (digit < 0)
+				{
+					if ((c != ' ') && (c != '\t') && (c != '\r') && (error == NULL))
+					{
+						error = "invalid character";
+					}
+					continue;
+				}
+				digits++;
+				if (high < 0)
+				{
+					high = digit;
+				}
+				else if (len < MAX_FRAME - 1)
+				{
+					frame_data[chunk][len++] = (uint8_t)(high << 4 | digit);
+					high = -1;
+				}
+				else
+				{
+					high = -1;
+				}
+			}
+			pos++;
+			if ((error == NULL) && ((digits & 1) != 0))
+			{
+				error = "odd number of hex digits";
+			}
+			if ((error == NULL) && (digits / 2 > MAX_FRAME - 1))
+			{
+				error = "frame longer than 255 bytes";
+			}
+			if (error != NULL)
+			{
+				fprintf(stderr, "%s: line %u: %s\n", name, line, error);
+				errors++;
+				continue;
+			}
+			if (len == 0)
+			{
+				continue;
+			}
+			frame_ptr[chunk] = frame_data[chunk];
+			frame_size[chunk] = len;
+		}
+		if (ports)
+		{
+			if (frame_size[chunk] == 0)
+			{
+				continue;
+			}
+			frame_port[chunk] = frame_ptr[chunk][0];
+			frame_ptr[chunk]++;
+			frame_size[chunk]--;
+		}
+		chunk++;
+		if (chunk == CHUNK_FRAMES)
+		{
+			flush(chunk, frames, helium, ports, &errors);
+			frames += chunk;
+			chunk = 0;
+		}
+	}
+	flush(chunk, frames, helium, ports, &errors);
+	frames += chunk;
+
+	if (file != NULL)
+	{
+		munmap((void *)file, file_size);
+	}
+	close(fd);
+	fprintf(stderr, "%u frames, %u errors\n", frames, errors);
+	return errors == 0 ? 0 : 2;
+}
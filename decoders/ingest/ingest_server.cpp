@@ -0,0 +1,123 @@
+/**
+ * @file ingest_server.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Network server stand-in, the packet forwarders of the gateways point to it
+ *        Usage: ingest_server [-p port] [-w workers] [-d dedup ms] [-n NwkSKey] [-a AppSKey]
+ *                             [-m] [-H] [-s folder]
+ *        -p UDP port, default 1700
+ *        -w number of worker threads, default one per CPU
+ *        -d copies of a frame within this time are dropped, default 200 ms
+ *        -n -a session keys of all devices as 32 hex digits, default all 0
+ *        -m don't check the MIC
+ *        -H application packets are in Helium Mapper format
+ *        -s write the locations into the track store in this folder,
+ *           default is CSV on stdout
+ *        Runs until SIGINT or SIGTERM, then prints the counters.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include "ingest_service.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int)
+{
+	stop_requested = 1;
+}
+
+static int usage(const char *name)
+{
+	fprintf(stderr,
+			"usage: %s [-p port] [-w workers] [-d dedup ms] [-n NwkSKey] [-a AppSKey] [-m] [-H] [-s folder]\n",
+			name);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	ingest_options_s options;
+	memset(&options, 0, sizeof(options));
+	options.port = 1700;
+	options.workers = std::thread::hardware_concurrency();
+	options.dedup_ms = 200;
+	options.check_mic = true;
+	std::string folder;
+
+	int option;
+	while ((option = getopt(argc, argv, "p:w:d:n:a:mHs:")) != -1)
+	{
+		switch (option)
+		{
+		case 'p':
+			options.port = (uint16_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			options.workers = (uint8_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			options.dedup_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			if (!lorawan_parse_key(optarg, options.nwk_skey))
+			{
+				return usage(argv[0]);
+			}
+			break;
+		case 'a':
+			if (!lorawan_parse_key(optarg, options.app_skey))
+			{
+				return usage(argv[0]);
+			}
+			break;
+		case 'm':
+			options.check_mic = false;
+			break;
+		case 'H':
+			options.helium = true;
+			break;
+		case 's':
+			folder = optarg;
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+
+	CsvSink csv(stdout);
+	TrackSink *track = folder.empty() ? NULL : new TrackSink(folder);
+	IngestService service(track != NULL ? (IngestSink *)track : (IngestSink *)&csv);
+	if (!service.begin(&options))
+	{
+		fprintf(stderr, "%s: can't open UDP port %u\n", argv[0], options.port);
+		delete track;
+		return 1;
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	fprintf(stderr, "listening on UDP port %u with %u workers\n", service.port(), options.workers);
+	while (!stop_requested)
+	{
+		usleep(100000);
+	}
+	service.end();
+	delete track;
+
+	ingest_stats_s stats = service.stats();
+	fprintf(stderr,
+			"%llu datagrams, %llu frames, %llu duplicates, %llu bad frames, %llu bad MIC, %llu uplinks, "
+			"%llu decode errors, %llu values\n",
+			(unsigned long long)stats.datagrams, (unsigned long long)stats.frames, (unsigned long long)stats.duplicates,
+			(unsigned long long)stats.bad_frames, (unsigned long long)stats.bad_mic, (unsigned long long)stats.uplinks,
+			(unsigned long long)stats.decode_errors, (unsigned long long)stats.values);
+	return 0;
+}
@@ -0,0 +1,454 @@
+/**
+ * @file ingest_service.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Stand-in for the network server, for throughput tests of the uplink ingest
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "ingest_service.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <chrono>
+
+#include "semtech_udp.h"
+#include "lpp_schema.h"
+
+/** Receive buffer of the socket, bursts of many gateways */
+#define INGEST_SOCKET_BUFFER (8 * 1024 * 1024)
+/** Time the receiver waits for a datagram before it checks for the end */
+#define INGEST_POLL_MS 100
+
+/**
+ * @brief Steady clock in microseconds, the load generator uses it as tmst
+ */
+uint64_t ingest_now_us(void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+IngestService::IngestService(IngestSink *sink)
+	: _sink(sink), _socket(-1), _port(0), _running(false), _workers(0), _datagrams(0), _acks(0), _frames(0),
+	  _duplicates(0), _bad_frames(0), _bad_mic(0), _uplinks(0), _decode_errors(0), _values(0)
+{
+}
+
+/**
+ * @brief Open the UDP port and start the receiver and the workers
+ *
+ * @param options settings
+ * @return true if the service is running
+ */
+bool IngestService::begin(const ingest_options_s *options)
+{
+	if (_running)
+	{
+		return false;
+	}
+	_options = *options;
+	aes128_init(&_nwk_skey, _options.nwk_skey);
+	aes128_init(&_app_skey, _options.app_skey);
+
+	_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (_socket < 0)
+	{
+		return false;
+	}
+	int buffer = INGEST_SOCKET_BUFFER;
+	setsockopt(_socket, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+	timeval timeout = {0, INGEST_POLL_MS * 1000};
+	setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(_options.port);
+	socklen_t size = sizeof(address);
+	if ((bind(_socket, (sockaddr *)&address, sizeof(address)) != 0) ||
+		(getsockname(_socket, (sockaddr *)&address, &size) != 0))
+	{
+		close(_socket);
+		_socket = -1;
+		return false;
+	}
+	_port = ntohs(address.sin_port);
+
+	_running = true;
+	_workers = _options.workers == 0 ? 1 : _options.workers > INGEST_MAX_WORKERS ? INGEST_MAX_WORKERS : _options.workers;
+	for (uint8_t idx = 0; idx < _workers; idx++)
+	{
+		_worker[idx] = new ingest_worker_s;
+		_worker[idx]->thread = std::thread(&IngestService::work, this, _worker[idx]);
+	}
+	_receiver = std::thread(&IngestService::receive, this);
+	return true;
+}
+
+/**
+ * @brief Stop the receiver, let the workers finish their queues and flush the sink
+ *
+ */
+void IngestService::end(void)
+{
+	if (!_running)
+	{
+		return;
+	}
+	_running = false;
+	_receiver.join();
+	close(_socket);
+	_socket = -1;
+	for (uint8_t idx = 0; idx < _workers; idx++)
+	{
+		{
+			std::lock_guard<std::mutex> guard(_worker[idx]->lock);
+			_worker[idx]->ready.notify_one();
+		}
+		_worker[idx]->thread.join();
+		delete _worker[idx];
+	}
+	_workers = 0;
+	_seen.clear();
+	_seen_order.clear();
+	_sink->flush();
+}
+
+/**
+ * @brief Get the counters
+ *
+ * @return ingest_stats_s counters since the start
+ */
+ingest_stats_s IngestService::stats(void)
+{
+	ingest_stats_s stats;
+	stats.datagrams = _datagrams;
+	stats.acks = _acks;
+	stats.frames = _frames;
+	stats.duplicates = _duplicates;
+	stats.bad_frames = _bad_frames;
+	stats.bad_mic = _bad_mic;
+	stats.uplinks = _uplinks;
+	stats.decode_errors = _decode_errors;
+	stats.values = _values;
+	return stats;
+}
+
+/**
+ * @brief Receiver thread
+ *
+ */
+void IngestService::receive(void)
+{
+	std::vector<uint8_t> datagram(UDP_MAX_SIZE);
+	while (_running)
+	{
+		sockaddr_in from;
+		socklen_t from_size = sizeof(from);
+		ssize_t size = recvfrom(_socket, &datagram[0], UDP_MAX_SIZE, 0, (sockaddr *)&from, &from_size);
+		if (size <= 0)
+		{
+			continue;
+		}
+		handle(&datagram[0], size, (const sockaddr *)&from, from_size);
+	}
+}
+
+/**
+ * @brief Answer a datagram and queue its frames
+ *
+ * @param data datagram
+ * @param size size
+ * @param from address of the gateway
+ * @param from_size size of the address
+ */
+void IngestService::handle(const uint8_t *data, size_t size, const struct sockaddr *from, unsigned from_size)
+{
+	uint64_t now_us = ingest_now_us();
+	udp_header_s header;
+	if (!udp_parse_header(data, size, &header))
+	{
+		return;
+	}
+	_datagrams++;
+	uint8_t ack[UDP_HEADER_SIZE];
+	uint8_t ack_size = udp_build_ack(ack, &header);
+	if ((ack_size != 0) && (sendto(_socket, ack, ack_size, 0, from, from_size) == ack_size))
+	{
+		_acks++;
+	}
+	if (header.identifier != UDP_PUSH_DATA)
+	{
+		return;
+	}
+
+	udp_rxpk_s rxpk[UDP_MAX_RXPK];
+	int count = udp_parse_rxpk((const char *)&data[UDP_DATA_HEADER_SIZE], size - UDP_DATA_HEADER_SIZE, rxpk, UDP_MAX_RXPK);
+	for (int idx = 0; idx < count; idx++)
+	{
+		if (rxpk[idx].stat != 1)
+		{
+			continue;
+		}
+		_frames++;
+		lorawan_frame_s frame;
+		if (!lorawan_parse(rxpk[idx].data, rxpk[idx].size, &frame))
+		{
+			_bad_frames++;
+			continue;
+		}
+		if (duplicate(frame.devaddr, frame.mic, now_us / 1000))
+		{
+			_duplicates++;
+			continue;
+		}
+
+		// The worker checks the MIC and decrypts the PHYPayload
+		ingest_worker_s *worker = _worker[frame.devaddr % _workers];
+		std::unique_lock<std::mutex> guard(worker->lock);
+		worker->queue.push_back(ingest_uplink_s());
+		ingest_uplink_s *uplink = &worker->queue.back();
+		uplink->devaddr = frame.devaddr;
+		uplink->gateway = header.eui;
+		uplink->tmst = rxpk[idx].tmst;
+		uplink->rssi = rxpk[idx].rssi;
+		uplink->snr = rxpk[idx].lsnr;
+		uplink->rx_us = now_us;
+		uplink->rx_time = time(NULL);
+		uplink->size = (uint8_t)rxpk[idx].size;
+		memcpy(uplink->data, rxpk[idx].data, rxpk[idx].size);
+		bool wake = worker->queue.size() == 1;
+		guard.unlock();
+		if (wake)
+		{
+			worker->ready.notify_one();
+		}
+	}
+}
+
+/**
+ * @brief Check for a copy of a frame another gateway received
+ *        The MIC is the same for all copies and different for every frame.
+ *
+ * @param devaddr device address
+ * @param mic MIC of the frame
+ * @param now_ms receive time
+ * @return true if the frame was seen within the dedup time
+ */
+bool IngestService::duplicate(uint32_t devaddr, uint32_t mic, uint64_t now_ms)
+{
+	while (!_seen_order.empty() && (_seen_order.front().first <= now_ms))
+	{
+		std::unordered_map<uint64_t, uint64_t>::iterator it = _seen.find(_seen_order.front().second);
+		if ((it != _seen.end()) && (it->second <= now_ms))
+		{
+			_seen.erase(it);
+		}
+		_seen_order.pop_front();
+	}
+	uint64_t key = ((uint64_t)devaddr << 32) | mic;
+	uint64_t expire = now_ms + _options.dedup_ms;
+	std::pair<std::unordered_map<uint64_t, uint64_t>::iterator, bool> result = _seen.insert(std::make_pair(key, expire));
+	if (!result.second)
+	{
+		return true;
+	}
+	_seen_order.push_back(std::make_pair(expire, key));
+	return false;
+}
+
+/**
+ * @brief Worker thread, handles its queue until the service ends
+ *
+ * @param worker queue and devices of the worker
+ */
+void IngestService::work(ingest_worker_s *worker)
+{
+	std::vector<uint32_t> col_frame(INGEST_MAX_VALUES);
+	std::vector<uint8_t> col_channel(INGEST_MAX_VALUES);
+	std::vector<uint8_t> col_type(INGEST_MAX_VALUES);
+	std::vector<double> col_value(3 * INGEST_MAX_VALUES);
+	lpp_columns_s columns = {INGEST_MAX_VALUES,
+							 0,
+							 &col_frame[0],
+							 &col_channel[0],
+							 &col_type[0],
+							 {&col_value[0], &col_value[INGEST_MAX_VALUES], &col_value[2 * INGEST_MAX_VALUES]}};
+
+	std::deque<ingest_uplink_s> batch;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(worker->lock);
+			while (worker->queue.empty() && _running)
+			{
+				worker->ready.wait(guard);
+			}
+			if (worker->queue.empty())
+			{
+				return;
+			}
+			batch.swap(worker->queue);
+		}
+		for (size_t idx = 0; idx < batch.size(); idx++)
+		{
+			process(worker, &batch[idx], &columns);
+		}
+		batch.clear();
+	}
+}
+
+/**
+ * @brief Check, decrypt and decode one uplink and pass it to the sink
+ *
+ * @param worker worker of the device
+ * @param uplink uplink with the PHYPayload, replaced by the FRMPayload
+ * @param columns columns for the values
+ */
+void IngestService::process(ingest_worker_s *worker, ingest_uplink_s *uplink, lpp_columns_s *columns)
+{
+	lorawan_frame_s frame;
+	if (!lorawan_parse(uplink->data, uplink->size, &frame))
+	{
+		_bad_frames++;
+		return;
+	}
+	ingest_device_s *device = &worker->devices[frame.devaddr];
+	uint32_t fcnt = lorawan_extend_fcnt(device->fcnt, frame.fcnt);
+	if (_options.check_mic && (lorawan_mic(&_nwk_skey, uplink->data, uplink->size - 4, frame.devaddr, fcnt) != frame.mic))
+	{
+		_bad_mic++;
+		return;
+	}
+	device->fcnt = fcnt;
+	if (frame.fport <= 0)
+	{
+		// MAC commands only
+		return;
+	}
+
+	uplink->fcnt = fcnt;
+	uplink->fport = (uint8_t)frame.fport;
+	uint8_t size = frame.payload_size;
+	memmove(uplink->data, frame.payload, size);
+	uplink->size = size;
+	lorawan_crypt(&_app_skey, uplink->data, size, frame.devaddr, fcnt);
+
+	columns->count = 0;
+	int result = lpp_decode_uplink(uplink->fport, uplink->data, size, fcnt, _options.helium, &device->frag, columns);
+	if (result < 0)
+	{
+		_decode_errors++;
+		return;
+	}
+	_values += result;
+	_uplinks++;
+	_sink->write(uplink, columns);
+}
+
+/**
+ * @brief Write the values of an uplink as CSV lines
+ *
+ * @param uplink uplink
+ * @param values decoded values
+ */
+void CsvSink::write(const ingest_uplink_s *uplink, const lpp_columns_s *values)
+{
+	char lines[INGEST_MAX_VALUES * 96];
+	size_t size = 0;
+	for (uint32_t idx = 0; idx < values->count; idx++)
+	{
+		size += snprintf(&lines[size], sizeof(lines) - size, "%08X,%u,%u,%u,%u,%s,%.7g,%.7g,%.7g\n", uplink->devaddr,
+						 uplink->fcnt, uplink->fport, values->channel[idx], values->type[idx],
+						 lpp_decode_name(values->type[idx]), values->value[0][idx], values->value[1][idx],
+						 values->value[2][idx]);
+		if (size >= sizeof(lines))
+		{
+			size = sizeof(lines) - 1;
+			break;
+		}
+	}
+	std::lock_guard<std::mutex> guard(_lock);
+	fwrite(lines, 1, size, _file);
+}
+
+void CsvSink::flush(void)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	fflush(_file);
+}
+
+/**
+ * @brief Write the locations of an uplink into the track store
+ *        The time is the fix time if the packet has one, otherwise the
+ *        receive time minus the age of batch and queued locations.
+ *
+ * @param uplink uplink
+ * @param values decoded values
+ */
+void TrackSink::write(const ingest_uplink_s *uplink, const lpp_columns_s *values)
+{
+	track_record_s common;
+	memset(&common, 0, sizeof(common));
+	uint32_t fix_time = 0;
+	uint32_t queue_age = 0;
+	for (uint32_t idx = 0; idx < values->count; idx++)
+	{
+		double value = values->value[0][idx];
+		switch (values->channel[idx])
+		{
+		case LPP_CHANNEL_BATT:
+			common.battery = (uint16_t)(value * 1000 + 0.5);
+			break;
+		case LPP_CHANNEL_TEMP:
+			common.temperature = (int16_t)(value * 10 + (value < 0 ? -0.5 : 0.5));
+			break;
+		case LPP_CHANNEL_HUMID:
+			common.humidity = (uint16_t)(value * 2 + 0.5);
+			break;
+		case LPP_CHANNEL_PRESS:
+			common.pressure = (uint16_t)(value * 10 + 0.5);
+			break;
+		case LPP_CHANNEL_TIME:
+			fix_time = (uint32_t)value;
+			break;
+		case LPP_DECODE_PORT_QUEUE:
+			queue_age = (uint32_t)value;
+			break;
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(_lock);
+	for (uint32_t idx = 0; idx < values->count; idx++)
+	{
+		if ((values->type[idx] != LPP_GPS4) && (values->type[idx] != LPP_GPS6))
+		{
+			continue;
+		}
+		track_record_s record = common;
+		record.latitude = (int32_t)(values->value[0][idx] * 1e7 + (values->value[0][idx] < 0 ? -0.5 : 0.5));
+		record.longitude = (int32_t)(values->value[1][idx] * 1e7 + (values->value[1][idx] < 0 ? -0.5 : 0.5));
+		record.altitude = (int32_t)(values->value[2][idx] * 100 + (values->value[2][idx] < 0 ? -0.5 : 0.5));
+		record.time = fix_time != 0 ? fix_time : uplink->rx_time - queue_age;
+		// Batch locations are followed by their age
+		if ((values->channel[idx] == LPP_DECODE_PORT_BATCH) && (idx + 1 < values->count) &&
+			(values->type[idx + 1] == LPP_DECODE_TYPE_AGE))
+		{
+			record.time = uplink->rx_time - queue_age - (uint32_t)values->value[0][idx + 1];
+		}
+		_store.append(uplink->devaddr, &record);
+	}
+}
+
+void TrackSink::flush(void)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_store.flush();
+}
@@ -0,0 +1,194 @@
+/**
+ * @file ingest_service.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Stand-in for the network server, for throughput tests of the uplink ingest
+ *        A receiver thread reads PUSH_DATA of the gateways, answers with PUSH_ACK
+ *        and drops the copies of a frame that more gateways received. The frames
+ *        go to a pool of workers by device address, so each device is handled
+ *        by one worker in the order of its frames. The worker checks the MIC,
+ *        decrypts the payload, decodes it with the backend decoder and passes
+ *        the values to the sink.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef INGEST_SERVICE_H
+#define INGEST_SERVICE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "lorawan.h"
+#include "ext_lpp_decoder.h"
+#include "fragment.h"
+#include "track_store.h"
+
+/** Max number of worker threads */
+#define INGEST_MAX_WORKERS 64
+/** Max decoded values of one uplink */
+#define INGEST_MAX_VALUES 256
+
+/** Settings of the service */
+struct ingest_options_s
+{
+	uint16_t port;			// UDP port, 0 for any free port
+	uint8_t workers;		// number of worker threads
+	uint32_t dedup_ms;		// copies of a frame within this time are dropped
+	uint8_t nwk_skey[16];	// session keys of all devices
+	uint8_t app_skey[16];
+	bool check_mic;			// false to accept frames of unknown keys
+	bool helium;			// application packets are in Helium Mapper format
+};
+
+/** One uplink as the sink gets it */
+struct ingest_uplink_s
+{
+	uint32_t devaddr;
+	uint32_t fcnt; // 32 bit frame counter
+	uint8_t fport;
+	uint64_t gateway;
+	uint32_t tmst;	 // gateway time of the first copy
+	int16_t rssi;
+	float snr;
+	uint64_t rx_us;	 // receive time, steady clock
+	uint32_t rx_time; // receive time, Unix time
+	uint8_t size;
+	uint8_t data[LORAWAN_MAX_SIZE]; // decrypted FRMPayload
+};
+
+/** Counters of the service */
+struct ingest_stats_s
+{
+	uint64_t datagrams;
+	uint64_t acks;
+	uint64_t frames;	   // rxpk entries with a valid CRC
+	uint64_t duplicates;   // copies dropped by the dedup
+	uint64_t bad_frames;   // not an uplink data frame
+	uint64_t bad_mic;
+	uint64_t uplinks;	   // passed to the sink
+	uint64_t decode_errors;
+	uint64_t values;
+};
+
+/**
+ * @brief Receives the decoded uplinks, called from all workers at the same time
+ */
+class IngestSink
+{
+public:
+	virtual ~IngestSink(void) {}
+	virtual void write(const ingest_uplink_s *uplink, const lpp_columns_s *values) = 0;
+	virtual void flush(void) {}
+};
+
+/**
+ * @brief Writes the values as CSV lines
+ *        devaddr,fcnt,fport,channel,type,name,value0,value1,value2
+ */
+class CsvSink : public IngestSink
+{
+public:
+	CsvSink(FILE *file) : _file(file) {}
+	void write(const ingest_uplink_s *uplink, const lpp_columns_s *values);
+	void flush(void);
+
+private:
+	FILE *_file;
+	std::mutex _lock;
+};
+
+/**
+ * @brief Writes the locations into the track store, with the battery and
+ *        environment values of the same uplink. The device is the DevAddr.
+ */
+class TrackSink : public IngestSink
+{
+public:
+	TrackSink(const std::string &folder) : _store(folder) {}
+	void write(const ingest_uplink_s *uplink, const lpp_columns_s *values);
+	void flush(void);
+
+private:
+	TrackStore _store;
+	std::mutex _lock;
+};
+
+/** State of one device in its worker */
+struct ingest_device_s
+{
+	ingest_device_s(void) : fcnt(0) {}
+
+	uint32_t fcnt;
+	FragReassembler frag;
+};
+
+/** Queue and state of one worker thread */
+struct ingest_worker_s
+{
+	std::thread thread;
+	std::mutex lock;
+	std::condition_variable ready;
+	std::deque<ingest_uplink_s> queue;
+	std::map<uint32_t, ingest_device_s> devices;
+};
+
+/**
+ * @brief Receiver thread, dedup and worker pool, see the file description
+ */
+class IngestService
+{
+public:
+	IngestService(IngestSink *sink);
+	~IngestService(void) { end(); }
+
+	bool begin(const ingest_options_s *options);
+	void end(void);
+	uint16_t port(void) { return _port; }
+	ingest_stats_s stats(void);
+
+private:
+	void receive(void);
+	void handle(const uint8_t *data, size_t size, const struct sockaddr *from, unsigned from_size);
+	bool duplicate(uint32_t devaddr, uint32_t mic, uint64_t now_ms);
+	void work(ingest_worker_s *worker);
+	void process(ingest_worker_s *worker, ingest_uplink_s *uplink, lpp_columns_s *columns);
+
+	IngestSink *_sink;
+	ingest_options_s _options;
+	aes128_key_s _nwk_skey;
+	aes128_key_s _app_skey;
+	int _socket;
+	uint16_t _port;
+	std::atomic<bool> _running;
+	std::thread _receiver;
+	ingest_worker_s *_worker[INGEST_MAX_WORKERS];
+	uint8_t _workers;
+
+	// Dedup, only used by the receiver thread
+	std::unordered_map<uint64_t, uint64_t> _seen;
+	std::deque<std::pair<uint64_t, uint64_t>> _seen_order;
+
+	std::atomic<uint64_t> _datagrams;
+	std::atomic<uint64_t> _acks;
+	std::atomic<uint64_t> _frames;
+	std::atomic<uint64_t> _duplicates;
+	std::atomic<uint64_t> _bad_frames;
+	std::atomic<uint64_t> _bad_mic;
+	std::atomic<uint64_t> _uplinks;
+	std::atomic<uint64_t> _decode_errors;
+	std::atomic<uint64_t> _values;
+};
+
+uint64_t ingest_now_us(void);
+
+#endif
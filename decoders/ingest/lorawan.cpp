@@ -0,0 +1,363 @@
+/**
+ * @file lorawan.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief LoRaWAN 1.0.x data frames for the ingest service
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "lorawan.h"
+
+#include <string.h>
+
+static const uint8_t sbox[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16};
+
+/** Multiply by x in GF(2^8) */
+static inline uint8_t xtime(uint8_t value)
+{
+	return (uint8_t)((value << 1) ^ ((value & 0x80) ? 0x1b : 0x00));
+}
+
+/**
+ * @brief Expand a key
+ *
+ * @param key expanded key
+ * @param raw 16 byte key
+ */
+void aes128_init(aes128_key_s *key, const uint8_t *raw)
+{
+	uint8_t *words = key->round_keys;
+	memcpy(words, raw, 16);
+	uint8_t rcon = 1;
+	for (uint8_t idx = 16; idx < 176; idx += 4)
+	{
+		uint8_t temp[4];
+		memcpy(temp, &words[idx - 4], 4);
+		if ((idx % 16) == 0)
+		{
+			uint8_t first = temp[0];
+			temp[0] = sbox[temp[1]] ^ rcon;
+			temp[1] = sbox[temp[2]];
+			temp[2] = sbox[temp[3]];
+			temp[3] = sbox[first];
+			rcon = xtime(rcon);
+		}
+		for (uint8_t byte = 0; byte < 4; byte++)
+		{
+			words[idx + byte] = words[idx - 16 + byte] ^ temp[byte];
+		}
+	}
+}
+
+/**
+ * @brief Encrypt one block
+ *
+ * @param key expanded key
+ * @param in 16 bytes
+ * @param out 16 bytes, can be the same as in
+ */
+void aes128_encrypt(const aes128_key_s *key, const uint8_t *in, uint8_t *out)
+{
+	uint8_t state[16];
+	for (uint8_t idx = 0; idx < 16; idx++)
+	{
+		state[idx] = in[idx] ^ key->round_keys[idx];
+	}
+	for (uint8_t round = 1; round <= 10; round++)
+	{
+		// SubBytes and ShiftRows, byte row + 4 * column
+		uint8_t shifted[16];
+		for (uint8_t column = 0; column < 4; column++)
+		{
+			for (uint8_t row = 0; row < 4; row++)
+			{
+				shifted[row + 4 * column] = sbox[state[row + 4 * ((column + row) & 3)]];
+			}
+		}
+		if (round == 10)
+		{
+			memcpy(state, shifted, 16);
+		}
+		else
+		{
+			// MixColumns
+			for (uint8_t column = 0; column < 16; column += 4)
+			{
+				uint8_t *col = &shifted[column];
+				uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+				state[column] = col[0] ^ all ^ xtime(col[0] ^ col[1]);
+				state[column + 1] = col[1] ^ all ^ xtime(col[1] ^ col[2]);
+				state[column + 2] = col[2] ^ all ^ xtime(col[2] ^ col[3]);
+				state[column + 3] = col[3] ^ all ^ xtime(col[3] ^ col[0]);
+			}
+		}
+		for (uint8_t idx = 0; idx < 16; idx++)
+		{
+			state[idx] ^= key->round_keys[16 * round + idx];
+		}
+	}
+	memcpy(out, state, 16);
+}
+
+/** Shift a block one bit left, the subkey step of CMAC */
+static void cmac_subkey(uint8_t *block)
+{
+	uint8_t carry = block[0] & 0x80;
+	for (uint8_t idx = 0; idx < 15; idx++)
+	{
+		block[idx] = (uint8_t)((block[idx] << 1) | (block[idx + 1] >> 7));
+	}
+	block[15] = (uint8_t)(block[15] << 1);
+	if (carry)
+	{
+		block[15] ^= 0x87;
+	}
+}
+
+/**
+ * @brief AES-CMAC (RFC 4493)
+ *
+ * @param key expanded key
+ * @param data message
+ * @param size message size
+ * @param mac 16 bytes
+ */
+void aes_cmac(const aes128_key_s *key, const uint8_t *data, size_t size, uint8_t *mac)
+{
+	uint8_t subkey[16] = {0};
+	aes128_encrypt(key, subkey, subkey);
+	cmac_subkey(subkey);
+
+	size_t blocks = size == 0 ? 1 : (size + 15) / 16;
+	bool complete = (size != 0) && ((size % 16) == 0);
+	if (!complete)
+	{
+		cmac_subkey(subkey);
+	}
+
+	uint8_t state[16] = {0};
+	for (size_t block = 0; block < blocks - 1; block++)
+	{
+		for (uint8_t idx = 0; idx < 16; idx++)
+		{
+			state[idx] ^= data[16 * block + idx];
+		}
+		aes128_encrypt(key, state, state);
+	}
+	size_t last = 16 * (blocks - 1);
+	for (uint8_t idx = 0; idx < 16; idx++)
+	{
+		uint8_t byte = last + idx < size ? data[last + idx] : last + idx == size ? 0x80 : 0x00;
+		state[idx] ^= byte ^ subkey[idx];
+	}
+	aes128_encrypt(key, state, mac);
+}
+
+/** B0 and Ai blocks of an uplink */
+static void uplink_block(uint8_t *block, uint8_t first, uint32_t devaddr, uint32_t fcnt, uint8_t last)
+{
+	memset(block, 0, 16);
+	block[0] = first;
+	// Direction 0 is uplink
+	for (uint8_t idx = 0; idx < 4; idx++)
+	{
+		block[6 + idx] = (uint8_t)(devaddr >> (8 * idx));
+		block[10 + idx] = (uint8_t)(fcnt >> (8 * idx));
+	}
+	block[15] = last;
+}
+
+/**
+ * @brief Parse an uplink data frame
+ *
+ * @param data PHYPayload
+ * @param size size
+ * @param frame the fields, payload points into data
+ * @return true if it is an uplink data frame with a valid length
+ */
+bool lorawan_parse(const uint8_t *data, uint16_t size, lorawan_frame_s *frame)
+{
+	if ((size < LORAWAN_OVERHEAD - 1) || (size > LORAWAN_MAX_SIZE))
+	{
+		return false;
+	}
+	frame->mtype = data[0] >> 5;
+	if (((frame->mtype != LORAWAN_UNCONFIRMED_UP) && (frame->mtype != LORAWAN_CONFIRMED_UP)) || ((data[0] & 0x03) != 0))
+	{
+		return false;
+	}
+	frame->devaddr = data[1] | (data[2] << 8) | (data[3] << 16) | ((uint32_t)data[4] << 24);
+	frame->fctrl = data[5];
+	frame->fcnt = data[6] | (data[7] << 8);
+	uint16_t cursor = 8 + (frame->fctrl & 0x0F);
+	if (cursor + 4 > size)
+	{
+		return false;
+	}
+	frame->fport = -1;
+	frame->payload = &data[cursor];
+	frame->payload_size = 0;
+	if (cursor + 4 < size)
+	{
+		frame->fport = data[cursor];
+		frame->payload = &data[cursor + 1];
+		frame->payload_size = (uint8_t)(size - cursor - 5);
+	}
+	frame->mic = data[size - 4] | (data[size - 3] << 8) | (data[size - 2] << 16) | ((uint32_t)data[size - 1] << 24);
+	return true;
+}
+
+/**
+ * @brief MIC of an uplink
+ *
+ * @param nwk_skey network session key
+ * @param data PHYPayload without the MIC
+ * @param size size without the MIC
+ * @param devaddr device address
+ * @param fcnt 32 bit frame counter
+ * @return uint32_t MIC in the byte order of the frame
+ */
+uint32_t lorawan_mic(const aes128_key_s *nwk_skey, const uint8_t *data, uint16_t size, uint32_t devaddr, uint32_t fcnt)
+{
+	uint8_t message[16 + LORAWAN_MAX_SIZE];
+	uplink_block(message, 0x49, devaddr, fcnt, (uint8_t)size);
+	memcpy(&message[16], data, size);
+	uint8_t mac[16];
+	aes_cmac(nwk_skey, message, 16 + size, mac);
+	return mac[0] | (mac[1] << 8) | (mac[2] << 16) | ((uint32_t)mac[3] << 24);
+}
+
+/**
+ * @brief Encrypt or decrypt the FRMPayload of an uplink
+ *
+ * @param app_skey application session key, or network session key for fPort 0
+ * @param data payload, changed in place
+ * @param size payload size
+ * @param devaddr device address
+ * @param fcnt 32 bit frame counter
+ */
+void lorawan_crypt(const aes128_key_s *app_skey, uint8_t *data, uint8_t size, uint32_t devaddr, uint32_t fcnt)
+{
+	uint8_t block[16];
+	uint8_t stream[16];
+	for (uint16_t start = 0; start < size; start += 16)
+	{
+		uplink_block(block, 0x01, devaddr, fcnt, (uint8_t)(start / 16 + 1));
+		aes128_encrypt(app_skey, block, stream);
+		for (uint16_t idx = start; (idx < size) && (idx < start + 16); idx++)
+		{
+			data[idx] ^= stream[idx - start];
+		}
+	}
+}
+
+/**
+ * @brief 32 bit frame counter from the 16 bits in the frame
+ *
+ * @param last last 32 bit counter of the device
+ * @param fcnt 16 bit counter of the frame
+ * @return uint32_t the counter closest to last
+ */
+uint32_t lorawan_extend_fcnt(uint32_t last, uint16_t fcnt)
+{
+	uint32_t value = (last & 0xFFFF0000) | fcnt;
+	if (value + 0x8000 < last)
+	{
+		value += 0x10000;
+	}
+	else if ((value > last + 0x8000) && (value >= 0x10000))
+	{
+		// Late frame from before the last roll over
+		value -= 0x10000;
+	}
+	return value;
+}
+
+/**
+ * @brief Build an uplink data frame, as the load generator sends it
+ *
+ * @param nwk_skey network session key
+ * @param app_skey application session key
+ * @param devaddr device address
+ * @param fcnt 32 bit frame counter
+ * @param fport fPort, 1 to 223
+ * @param payload FRMPayload in plain text
+ * @param size payload size, max LORAWAN_MAX_SIZE - LORAWAN_OVERHEAD
+ * @param confirmed confirmed uplink
+ * @param out PHYPayload, LORAWAN_MAX_SIZE bytes
+ * @return uint16_t size of the PHYPayload, 0 if the payload is too large
+ */
+uint16_t lorawan_build(const aes128_key_s *nwk_skey, const aes128_key_s *app_skey, uint32_t devaddr, uint32_t fcnt,
+					   uint8_t fport, const uint8_t *payload, uint8_t size, bool confirmed, uint8_t *out)
+{
+	if (size > LORAWAN_MAX_SIZE - LORAWAN_OVERHEAD)
+	{
+		return 0;
+	}
+	uint16_t cursor = 0;
+	out[cursor++] = (confirmed ? LORAWAN_CONFIRMED_UP : LORAWAN_UNCONFIRMED_UP) << 5;
+	for (uint8_t idx = 0; idx < 4; idx++)
+	{
+		out[cursor++] = (uint8_t)(devaddr >> (8 * idx));
+	}
+	out[cursor++] = 0x00;
+	out[cursor++] = (uint8_t)fcnt;
+	out[cursor++] = (uint8_t)(fcnt >> 8);
+	out[cursor++] = fport;
+	memcpy(&out[cursor], payload, size);
+	lorawan_crypt(app_skey, &out[cursor], size, devaddr, fcnt);
+	cursor += size;
+	uint32_t mic = lorawan_mic(nwk_skey, out, cursor, devaddr, fcnt);
+	for (uint8_t idx = 0; idx < 4; idx++)
+	{
+		out[cursor++] = (uint8_t)(mic >> (8 * idx));
+	}
+	return cursor;
+}
+
+/**
+ * @brief Read a key as 32 hex digits
+ *
+ * @param hex text
+ * @param key 16 bytes
+ * @return true if the text is a valid key
+ */
+bool lorawan_parse_key(const char *hex, uint8_t *key)
+{
+	if (strlen(hex) != 32)
+	{
+		return false;
+	}
+	for (uint8_t idx = 0; idx < 32; idx++)
+	{
+		char c = hex[idx];
+		int digit = ((c >= '0') && (c <= '9'))	 ? c - '0'
+					: ((c >= 'a') && (c <= 'f')) ? c - 'a' + 10
+					: ((c >= 'A') && (c <= 'F')) ? c - 'A' + 10
+												 : -1;
+		if (digit < 0)
+		{
+			return false;
+		}
+		key[idx / 2] = (idx & 1) ? (uint8_t)(key[idx / 2] | digit) : (uint8_t)(digit << 4);
+	}
+	return true;
+}
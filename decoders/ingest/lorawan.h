@@ -0,0 +1,61 @@
+/**
+ * @file lorawan.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief LoRaWAN 1.0.x data frames for the ingest service
+ *        AES-128, AES-CMAC, the MIC and the FRMPayload encryption of uplinks,
+ *        parsing and building of the PHYPayload.
+ *        The session keys are the same for all devices (ABP test setup),
+ *        there is no join server.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef LORAWAN_H
+#define LORAWAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Message types in the MHDR */
+#define LORAWAN_UNCONFIRMED_UP 2
+#define LORAWAN_CONFIRMED_UP 4
+
+/** MHDR, DevAddr, FCtrl, FCnt, FPort and MIC */
+#define LORAWAN_OVERHEAD 13
+/** Max size of a PHYPayload */
+#define LORAWAN_MAX_SIZE 255
+
+/** Expanded AES-128 key */
+struct aes128_key_s
+{
+	uint8_t round_keys[176];
+};
+
+void aes128_init(aes128_key_s *key, const uint8_t *raw);
+void aes128_encrypt(const aes128_key_s *key, const uint8_t *in, uint8_t *out);
+void aes_cmac(const aes128_key_s *key, const uint8_t *data, size_t size, uint8_t *mac);
+
+/** Fields of an uplink data frame, payload points into the parsed buffer */
+struct lorawan_frame_s
+{
+	uint8_t mtype;
+	uint32_t devaddr;
+	uint8_t fctrl;
+	uint16_t fcnt;
+	int16_t fport; // -1 without FPort
+	const uint8_t *payload;
+	uint8_t payload_size;
+	uint32_t mic;
+};
+
+bool lorawan_parse(const uint8_t *data, uint16_t size, lorawan_frame_s *frame);
+uint32_t lorawan_mic(const aes128_key_s *nwk_skey, const uint8_t *data, uint16_t size, uint32_t devaddr, uint32_t fcnt);
+void lorawan_crypt(const aes128_key_s *app_skey, uint8_t *data, uint8_t size, uint32_t devaddr, uint32_t fcnt);
+uint32_t lorawan_extend_fcnt(uint32_t last, uint16_t fcnt);
+bool lorawan_parse_key(const char *hex, uint8_t *key);
+uint16_t lorawan_build(const aes128_key_s *nwk_skey, const aes128_key_s *app_skey, uint32_t devaddr, uint32_t fcnt,
+					   uint8_t fport, const uint8_t *payload, uint8_t size, bool confirmed, uint8_t *out);
+
+#endif
@@ -0,0 +1,494 @@
+/**
+ * @file semtech_udp.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Semtech UDP packet forwarder protocol, version 2
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "semtech_udp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * @brief Encode to base64 with padding
+ *
+ * @param data data
+ * @param size size
+ * @param out text, 4 * ((size + 2) / 3) characters, not terminated
+ * @return size_t number of characters
+ */
+size_t base64_encode(const uint8_t *data, size_t size, char *out)
+{
+	size_t length = 0;
+	for (size_t idx = 0; idx < size; idx += 3)
+	{
+		uint32_t group = data[idx] << 16;
+		if (idx + 1 < size)
+		{
+			group |= data[idx + 1] << 8;
+		}
+		if (idx + 2 < size)
+		{
+			group |= data[idx + 2];
+		}
+		out[length++] = base64_chars[(group >> 18) & 0x3F];
+		out[length++] = base64_chars[(group >> 12) & 0x3F];
+		out[length++] = idx + 1 < size ? base64_chars[(group >> 6) & 0x3F] : '=';
+		out[length++] = idx + 2 < size ? base64_chars[group & 0x3F] : '=';
+	}
+	return length;
+}
+
+/** Value of a base64 character, -1 if invalid */
+static inline int base64_value(char c)
+{
+	if ((c >= 'A') && (c <= 'Z'))
+	{
+		return c - 'A';
+	}
+	if ((c >= 'a') && (c <= 'z'))
+	{
+		return c - 'a' + 26;
+	}
+	if ((c >= '0') && (c <= '9'))
+	{
+		return c - '0' + 52;
+	}
+	if (c == '+')
+	{
+		return 62;
+	}
+	if (c == '/')
+	{
+		return 63;
+	}
+	return -1;
+}
+
+/**
+ * @brief Decode base64, the padding is optional
+ *
+ * @param text text
+ * @param size number of characters
+ * @param out data
+ * @param max size of out
+ * @return int number of bytes, -1 if the text is invalid or too long
+ */
+int base64_decode(const char *text, size_t size, uint8_t *out, size_t max)
+{
+	while ((size > 0) && (text[size - 1] == '='))
+	{
+		size--;
+	}
+	if ((size % 4) == 1)
+	{
+		return -1;
+	}
+	size_t length = 0;
+	uint32_t group = 0;
+	uint8_t bits = 0;
+	for (size_t idx = 0; idx < size; idx++)
+	{
+		int value = base64_value(text[idx]);
+		if (value < 0)
+		{
+			return -1;
+		}
+		group = (group << 6) | value;
+		bits += 6;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			if (length >= max)
+			{
+				return -1;
+			}
+			out[length++] = (uint8_t)(group >> bits);
+		}
+	}
+	return (int)length;
+}
+
+/**
+ * @brief Parse the header of a datagram
+ *
+ * @param data datagram
+ * @param size size
+ * @param header identifier, token and the EUI of data datagrams
+ * @return true if it is a version 2 datagram
+ */
+bool udp_parse_header(const uint8_t *data, size_t size, udp_header_s *header)
+{
+	if ((size < UDP_HEADER_SIZE) || (data[0] != UDP_VERSION))
+	{
+		return false;
+	}
+	header->token = (data[1] << 8) | data[2];
+	header->identifier = data[3];
+	header->eui = 0;
+	if ((header->identifier == UDP_PUSH_DATA) || (header->identifier == UDP_PULL_DATA))
+	{
+		if (size < UDP_DATA_HEADER_SIZE)
+		{
+			return false;
+		}
+		for (uint8_t idx = 4; idx < UDP_DATA_HEADER_SIZE; idx++)
+		{
+			header->eui = (header->eui << 8) | data[idx];
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Build the answer to PUSH_DATA or PULL_DATA
+ *
+ * @param buffer 4 bytes
+ * @param header header of the datagram
+ * @return uint8_t size, 0 if the datagram needs no answer
+ */
+uint8_t udp_build_ack(uint8_t *buffer, const udp_header_s *header)
+{
+	if ((header->identifier != UDP_PUSH_DATA) && (header->identifier != UDP_PULL_DATA))
+	{
+		return 0;
+	}
+	buffer[0] = UDP_VERSION;
+	buffer[1] = (uint8_t)(header->token >> 8);
+	buffer[2] = (uint8_t)header->token;
+	buffer[3] = header->identifier == UDP_PUSH_DATA ? UDP_PUSH_ACK : UDP_PULL_ACK;
+	return UDP_HEADER_SIZE;
+}
+
+/** Read position in the JSON text */
+struct json_cursor_s
+{
+	const char *text;
+	size_t size;
+	size_t pos;
+};
+
+static void skip_space(json_cursor_s *cursor)
+{
+	while ((cursor->pos < cursor->size) && ((cursor->text[cursor->pos] == ' ') || (cursor->text[cursor->pos] == '\t') ||
+											(cursor->text[cursor->pos] == '\n') || (cursor->text[cursor->pos] == '\r')))
+	{
+		cursor->pos++;
+	}
+}
+
+static bool next_is(json_cursor_s *cursor, char c)
+{
+	skip_space(cursor);
+	if ((cursor->pos < cursor->size) && (cursor->text[cursor->pos] == c))
+	{
+		cursor->pos++;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Read a string, escapes are kept as they are
+ *
+ * @return true if the string is complete, start and length of the content
+ */
+static bool read_string(json_cursor_s *cursor, const char **start, size_t *length)
+{
+	if (!next_is(cursor, '"'))
+	{
+		return false;
+	}
+	*start = &cursor->text[cursor->pos];
+	while (cursor->pos < cursor->size)
+	{
+		char c = cursor->text[cursor->pos++];
+		if (c == '"')
+		{
+			*length = &cursor->text[cursor->pos - 1] - *start;
+			return true;
+		}
+		if (c == '\\')
+		{
+			cursor->pos++;
+		}
+	}
+	return false;
+}
+
+static bool read_number(json_cursor_s *cursor, double *value)
+{
+	skip_space(cursor);
+	char number[32];
+	size_t length = 0;
+	while ((cursor->pos < cursor->size) && (length < sizeof(number) - 1) &&
+		   (strchr("+-.0123456789eE", cursor->text[cursor->pos]) != NULL))
+	{
+		number[length++] = cursor->text[cursor->pos++];
+	}
+	number[length] = 0;
+	char *end;
+	*value = strtod(number, &end);
+	return (length != 0) && (*end == 0);
+}
+
+/** Skip a value of any type */
+static bool skip_value(json_cursor_s *cursor)
+{
+	skip_space(cursor);
+	if (cursor->pos >= cursor->size)
+	{
+		return false;
+	}
+	const char *start;
+	size_t length;
+	char c = cursor->text[cursor->pos];
+	if (c == '"')
+	{
+		return read_string(cursor, &start, &length);
+	}
+	if ((c == '{') || (c == '['))
+	{
+		uint16_t depth = 0;
+		while (cursor->pos < cursor->size)
+		{
+			c = cursor->text[cursor->pos];
+			if (c == '"')
+			{
+				if (!read_string(cursor, &start, &length))
+				{
+					return false;
+				}
+				continue;
+			}
+			cursor->pos++;
+			if ((c == '{') || (c == '['))
+			{
+				depth++;
+			}
+			else if ((c == '}') || (c == ']'))
+			{
+				if (--depth == 0)
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+	// Number, true, false or null
+	size_t first = cursor->pos;
+	while ((cursor->pos < cursor->size) && (strchr(",}] \t\r\n", cursor->text[cursor->pos]) == NULL))
+	{
+		cursor->pos++;
+	}
+	return cursor->pos > first;
+}
+
+static bool key_is(const char *key, size_t length, const char *name)
+{
+	return (strlen(name) == length) && (memcmp(key, name, length) == 0);
+}
+
+/**
+ * @brief Read one object of the rxpk array
+ *
+ * @return true if the object is valid and has data
+ */
+static bool read_rxpk(json_cursor_s *cursor, udp_rxpk_s *rxpk)
+{
+	if (!next_is(cursor, '{'))
+	{
+		return false;
+	}
+	memset(rxpk, 0, sizeof(udp_rxpk_s));
+	bool has_data = false;
+	if (next_is(cursor, '}'))
+	{
+		return false;
+	}
+	do
+	{
+		const char *key;
+		size_t length;
+		if (!read_string(cursor, &key, &length) || !next_is(cursor, ':'))
+		{
+			return false;
+		}
+		double number;
+		if (key_is(key, length, "data"))
+		{
+			const char *text;
+			size_t text_length;
+			if (!read_string(cursor, &text, &text_length))
+			{
+				return false;
+			}
+			int size = base64_decode(text, text_length, rxpk->data, sizeof(rxpk->data));
+			if (size < 0)
+			{
+				return false;
+			}
+			rxpk->size = size;
+			has_data = true;
+		}
+		else if (key_is(key, length, "tmst") || key_is(key, length, "rssi") || key_is(key, length, "lsnr") ||
+				 key_is(key, length, "stat"))
+		{
+			if (!read_number(cursor, &number))
+			{
+				return false;
+			}
+			if (key[0] == 't')
+			{
+				rxpk->tmst = (uint32_t)number;
+			}
+			else if (key[0] == 'r')
+			{
+				rxpk->rssi = (int16_t)number;
+			}
+			else if (key[0] == 'l')
+			{
+				rxpk->lsnr = (float)number;
+			}
+			else
+			{
+				rxpk->stat = (int8_t)number;
+			}
+		}
+		else if (!skip_value(cursor))
+		{
+			return false;
+		}
+	} while (next_is(cursor, ','));
+	return next_is(cursor, '}') && has_data;
+}
+
+/**
+ * @brief Get the received packets of the JSON part of PUSH_DATA
+ *
+ * @param json JSON object after the header
+ * @param size size
+ * @param rxpk received packets
+ * @param max size of rxpk, further packets are skipped
+ * @return int number of packets, -1 if the JSON is invalid
+ */
+int udp_parse_rxpk(const char *json, size_t size, udp_rxpk_s *rxpk, uint8_t max)
+{
+	json_cursor_s cursor = {json, size, 0};
+	if (!next_is(&cursor, '{'))
+	{
+		return -1;
+	}
+	int count = 0;
+	if (next_is(&cursor, '}'))
+	{
+		return 0;
+	}
+	do
+	{
+		const char *key;
+		size_t length;
+		if (!read_string(&cursor, &key, &length) || !next_is(&cursor, ':'))
+		{
+			return -1;
+		}
+		if (!key_is(key, length, "rxpk"))
+		{
+			if (!skip_value(&cursor))
+			{
+				return -1;
+			}
+			continue;
+		}
+		if (!next_is(&cursor, '['))
+		{
+			return -1;
+		}
+		if (next_is(&cursor, ']'))
+		{
+			continue;
+		}
+		do
+		{
+			if (count < max)
+			{
+				if (!read_rxpk(&cursor, &rxpk[count]))
+				{
+					return -1;
+				}
+				count++;
+			}
+			else if (!skip_value(&cursor))
+			{
+				return -1;
+			}
+		} while (next_is(&cursor, ','));
+		if (!next_is(&cursor, ']'))
+		{
+			return -1;
+		}
+	} while (next_is(&cursor, ','));
+	return next_is(&cursor, '}') ? count : -1;
+}
+
+/**
+ * @brief Build PUSH_DATA as a packet forwarder sends it
+ *
+ * @param buffer datagram
+ * @param max size of buffer
+ * @param token random token
+ * @param eui gateway EUI
+ * @param rxpk received packets
+ * @param count number of packets
+ * @return size_t size of the datagram, 0 if the buffer is too small
+ */
+size_t udp_build_push(uint8_t *buffer, size_t max, uint16_t token, uint64_t eui, const udp_rxpk_s *rxpk, uint8_t count)
+{
+	if (max < UDP_DATA_HEADER_SIZE)
+	{
+		return 0;
+	}
+	buffer[0] = UDP_VERSION;
+	buffer[1] = (uint8_t)(token >> 8);
+	buffer[2] = (uint8_t)token;
+	buffer[3] = UDP_PUSH_DATA;
+	for (uint8_t idx = 0; idx < 8; idx++)
+	{
+		buffer[4 + idx] = (uint8_t)(eui >> (56 - 8 * idx));
+	}
+	size_t size = UDP_DATA_HEADER_SIZE;
+	char *json = (char *)buffer;
+	int length = snprintf(&json[size], max - size, "{\"rxpk\":[");
+	size += length;
+	for (uint8_t idx = 0; idx < count; idx++)
+	{
+		// Base64 of the data, the quote, the closing brackets and the terminator
+		if (size + 200 + 4 * ((rxpk[idx].size + 2) / 3) > max)
+		{
+			return 0;
+		}
+		size += snprintf(&json[size], max - size,
+						 "%s{\"tmst\":%u,\"chan\":0,\"rfch\":0,\"freq\":868.100000,\"stat\":%d,\"modu\":\"LORA\","
+						 "\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"lsnr\":%.1f,\"rssi\":%d,\"size\":%u,\"data\":\"",
+						 idx == 0 ? "" : ",", rxpk[idx].tmst, rxpk[idx].stat, rxpk[idx].lsnr, rxpk[idx].rssi,
+						 rxpk[idx].size);
+		size += base64_encode(rxpk[idx].data, rxpk[idx].size, &json[size]);
+		json[size++] = '"';
+		json[size++] = '}';
+	}
+	if (size + 3 > max)
+	{
+		return 0;
+	}
+	json[size++] = ']';
+	json[size++] = '}';
+	return size;
+}
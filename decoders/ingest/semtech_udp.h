@@ -0,0 +1,64 @@
+/**
+ * @file semtech_udp.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Semtech UDP packet forwarder protocol, version 2
+ *        Only the uplink part: PUSH_DATA with its rxpk array is parsed,
+ *        PUSH_ACK and PULL_ACK are the answers. The JSON parser reads only the
+ *        rxpk fields the ingest service needs and skips all others.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef SEMTECH_UDP_H
+#define SEMTECH_UDP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UDP_VERSION 2
+#define UDP_PUSH_DATA 0x00
+#define UDP_PUSH_ACK 0x01
+#define UDP_PULL_DATA 0x02
+#define UDP_PULL_RESP 0x03
+#define UDP_PULL_ACK 0x04
+#define UDP_TX_ACK 0x05
+
+/** Version, token, identifier */
+#define UDP_HEADER_SIZE 4
+/** Header and gateway EUI of PUSH_DATA and PULL_DATA */
+#define UDP_DATA_HEADER_SIZE 12
+/** Max size of a datagram from the packet forwarder */
+#define UDP_MAX_SIZE 65507
+/** Max rxpk entries used of one PUSH_DATA */
+#define UDP_MAX_RXPK 16
+
+/** One received packet of the rxpk array */
+struct udp_rxpk_s
+{
+	uint32_t tmst; // gateway time in us
+	int16_t rssi;  // dBm
+	float lsnr;	   // dB
+	int8_t stat;   // CRC status, 1 = OK
+	uint16_t size;
+	uint8_t data[256];
+};
+
+/** Header of a datagram */
+struct udp_header_s
+{
+	uint8_t identifier;
+	uint16_t token;
+	uint64_t eui; // only PUSH_DATA and PULL_DATA
+};
+
+bool udp_parse_header(const uint8_t *data, size_t size, udp_header_s *header);
+int udp_parse_rxpk(const char *json, size_t size, udp_rxpk_s *rxpk, uint8_t max);
+uint8_t udp_build_ack(uint8_t *buffer, const udp_header_s *header);
+size_t udp_build_push(uint8_t *buffer, size_t max, uint16_t token, uint64_t eui, const udp_rxpk_s *rxpk, uint8_t count);
+
+size_t base64_encode(const uint8_t *data, size_t size, char *out);
+int base64_decode(const char *text, size_t size, uint8_t *out, size_t max);
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * @file generate_decoders.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host tool to write the LPP type table from lpp_schema.h into the JS decoders
+ *        The firmware encoders are generated by the compiler from the same
+ *        tables, see lpp_put() in lpp_schema.h.
+ *        Build and run from the decoders folder:
+ *        cmake -S . -B build && cmake --build build
+ *        ./build/generate_decoders *-Ext-LPP-Decoder.js
+ *        With -c the decoders are only checked, the result is 1 if a type table
+ *        is not up to date. The ArduinoIDE copy of lpp_schema.h must be the same
+ *        as the PlatformIO one, otherwise nothing is written.
+ * @version 0.1
+ * @date 2022-09-23
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdio.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include "lpp_schema.h"
+
+/**
+ * @brief Create the JS type table
+ *
+ * @param eol line ending of the decoder file
+ * @return std::string JS code
+ */
+static std::string type_table(const std::string &eol)
+{
+	std::ostringstream out;
+	out << "\tvar sensor_types = {" << eol;
+	for (size_t idx = 0; idx < LPP_TYPE_NUM; idx++)
+	{
+		const lpp_type_s &type = lpp_types[idx];
+		out << "\t\t" << (int)type.type << ": { 'size': " << (int)type.size << ", 'name': '" << type.name
+			<< "', 'signed': " << (type.is_signed ? "true" : "false") << ", 'divisor': ";
+		if ((type.values == 3) && (type.divisor[1] != 0))
+		{
+			out << "[" << type.divisor[0] << ", " << type.divisor[1] << ", " << type.divisor[2] << "]";
+		}
+		else
+		{
+			out << type.divisor[0];
+		}
+		out << " }," << eol;
+	}
+	out << "\t};";
+	return out.str();
+}
+
+/**
+ * @brief Read a whole file
+ *
+ * @param name file name
+ * @param content file content
+ * @return true if the file was read
+ */
+static bool read_file(const char *name, std::string *content)
+{
+	std::ifstream in(name, std::ios::binary);
+	if (!in)
+	{
+		fprintf(stderr, "%s: cannot read\n", name);
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	*content = buffer.str();
+	return true;
+}
+
+/**
+ * @brief Check that the ArduinoIDE copy of the schema is the same as the PlatformIO one
+ *        Line endings are ignored.
+ *
+ * @return true if both files are the same
+ */
+static bool schema_copies_match(void)
+{
+	std::string firmware;
+	std::string arduino;
+	if (!read_file(FIRMWARE_SCHEMA, &firmware) || !read_file(ARDUINO_SCHEMA, &arduino))
+	{
+		return false;
+	}
+	std::string *copies[] = {&firmware, &arduino};
+	for (int idx = 0; idx < 2; idx++)
+	{
+		size_t pos;
+		while ((pos = copies[idx]->find("\r\n")) != std::string::npos)
+		{
+			copies[idx]->erase(pos, 1);
+		}
+	}
+	if (firmware != arduino)
+	{
+		fprintf(stderr, "%s differs from %s\n", ARDUINO_SCHEMA, FIRMWARE_SCHEMA);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Replace the type table in a decoder file
+ *
+ * @param name file name
+ * @param check_only only compare the type table, don't write the file
+ * @return true if the table was replaced or is up to date
+ */
+static bool update_decoder(const char *name, bool check_only)
+{
+	std::string content;
+	if (!read_file(name, &content))
+	{
+		return false;
+	}
+
+	std::string eol = content.find("\r\n") != std::string::npos ? "\r\n" : "\n";
+	size_t start = content.find("\tvar sensor_types = {");
+	size_t end = content.find("\t};", start);
+	if ((start == std::string::npos) || (end == std::string::npos))
+	{
+		fprintf(stderr, "%s: type table not found\n", name);
+		return false;
+	}
+	std::string table = type_table(eol);
+	if (check_only)
+	{
+		if (content.compare(start, end + 3 - start, table) != 0)
+		{
+			fprintf(stderr, "%s: type table is not up to date\n", name);
+			return false;
+		}
+		printf("%s: %d types up to date\n", name, (int)LPP_TYPE_NUM);
+		return true;
+	}
+	content.replace(start, end + 3 - start, table);
+
+	std::ofstream out(name, std::ios::binary);
+	out << content;
+	printf("%s: %d types\n", name, (int)LPP_TYPE_NUM);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	bool check_only = (argc > 1) && (std::string(argv[1]) == "-c");
+	int first = check_only ? 2 : 1;
+	if (argc <= first)
+	{
+		fprintf(stderr, "usage: %s [-c] <decoder.js> ...\n", argv[0]);
+		return 1;
+	}
+	if (!schema_copies_match())
+	{
+		return 1;
+	}
+	int result = 0;
+	for (int idx = first; idx < argc; idx++)
+	{
+		if (!update_decoder(argv[idx], check_only))
+		{
+			result = 1;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,560 @@
+/**
+ * @file track_store.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Columnar on-disk store of the decoded tracker positions
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "track_store.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** Extra bytes after the packed deltas, a 64 bit read never leaves the segment */
+#define TRACK_PACK_SLACK 8
+
+/**
+ * @brief Get a column of a record
+ *
+ * @param record record
+ * @param column TRACK_COL_xxx
+ * @return int64_t value
+ */
+int64_t track_get_column(const track_record_s *record, uint8_t column)
+{
+	switch (column)
+	{
+	case TRACK_COL_TIME:
+		return record->time;
+	case TRACK_COL_LAT:
+		return record->latitude;
+	case TRACK_COL_LON:
+		return record->longitude;
+	case TRACK_COL_ALT:
+		return record->altitude;
+	case TRACK_COL_ACCURACY:
+		return record->accuracy;
+	case TRACK_COL_BATTERY:
+		return record->battery;
+	case TRACK_COL_TEMP:
+		return record->temperature;
+	case TRACK_COL_HUMID:
+		return record->humidity;
+	case TRACK_COL_PRESS:
+		return record->pressure;
+	}
+	return 0;
+}
+
+/**
+ * @brief Set a column of a record
+ *
+ * @param record record
+ * @param column TRACK_COL_xxx
+ * @param value value
+ */
+void track_set_column(track_record_s *record, uint8_t column, int64_t value)
+{
+	switch (column)
+	{
+	case TRACK_COL_TIME:
+		record->time = (uint32_t)value;
+		break;
+	case TRACK_COL_LAT:
+		record->latitude = (int32_t)value;
+		break;
+	case TRACK_COL_LON:
+		record->longitude = (int32_t)value;
+		break;
+	case TRACK_COL_ALT:
+		record->altitude = (int32_t)value;
+		break;
+	case TRACK_COL_ACCURACY:
+		record->accuracy = (uint16_t)value;
+		break;
+	case TRACK_COL_BATTERY:
+		record->battery = (uint16_t)value;
+		break;
+	case TRACK_COL_TEMP:
+		record->temperature = (int16_t)value;
+		break;
+	case TRACK_COL_HUMID:
+		record->humidity = (uint16_t)value;
+		break;
+	case TRACK_COL_PRESS:
+		record->pressure = (uint16_t)value;
+		break;
+	}
+}
+
+/**
+ * @brief Number of bits needed for a value
+ */
+static uint8_t bit_width(uint64_t value)
+{
+	uint8_t bits = 0;
+	while (value != 0)
+	{
+		bits++;
+		value >>= 1;
+	}
+	return bits;
+}
+
+/**
+ * @brief Encode records into one segment
+ *
+ * @param records records, at least one
+ * @param rows number of records, max TRACK_SEGMENT_ROWS
+ * @param out segment, the old content is replaced
+ * @return size_t size of the segment, 0 if rows is out of range
+ */
+size_t track_encode_segment(const track_record_s *records, uint32_t rows, std::vector<uint8_t> *out)
+{
+	if ((rows == 0) || (rows > TRACK_SEGMENT_ROWS))
+	{
+		return 0;
+	}
+
+	track_segment_s header;
+	memset(&header, 0, sizeof(header));
+	header.magic = TRACK_SEGMENT_MAGIC;
+	header.rows = rows;
+
+	// Column headers first, they give the size of the packed columns
+	size_t size = (sizeof(track_segment_s) + 7) & ~(size_t)7;
+	for (uint8_t column = 0; column < TRACK_COLUMNS; column++)
+	{
+		track_column_s *col = &header.columns[column];
+		int64_t value = track_get_column(&records[0], column);
+		col->first = value;
+		col->min = value;
+		col->max = value;
+		col->delta_min = 0;
+		int64_t delta_max = 0;
+		for (uint32_t row = 1; row < rows; row++)
+		{
+			int64_t next = track_get_column(&records[row], column);
+			int64_t delta = next - value;
+			value = next;
+			col->min = value < col->min ? value : col->min;
+			col->max = value > col->max ? value : col->max;
+			if ((row == 1) || (delta < col->delta_min))
+			{
+				col->delta_min = delta;
+			}
+			if ((row == 1) || (delta > delta_max))
+			{
+				delta_max = delta;
+			}
+		}
+		col->bits = bit_width((uint64_t)(delta_max - col->delta_min));
+		col->offset = (uint32_t)size;
+		size += (((uint64_t)(rows - 1) * col->bits + 63) / 64) * 8;
+	}
+	size += TRACK_PACK_SLACK;
+	header.size = (uint32_t)size;
+
+	out->assign(size, 0);
+	memcpy(&(*out)[0], &header, sizeof(header));
+	for (uint8_t column = 0; column < TRACK_COLUMNS; column++)
+	{
+		const track_column_s *col = &header.columns[column];
+		if (col->bits == 0)
+		{
+			continue;
+		}
+		uint8_t *packed = &(*out)[col->offset];
+		uint64_t bit_pos = 0;
+		int64_t value = col->first;
+		for (uint32_t row = 1; row < rows; row++)
+		{
+			int64_t next = track_get_column(&records[row], column);
+			uint64_t packed_delta = (uint64_t)(next - value - col->delta_min);
+			value = next;
+			uint64_t word;
+			uint32_t byte = (uint32_t)(bit_pos >> 6) * 8;
+			uint8_t shift = bit_pos & 63;
+			memcpy(&word, &packed[byte], 8);
+			word |= packed_delta << shift;
+			memcpy(&packed[byte], &word, 8);
+			if ((shift + col->bits) > 64)
+			{
+				memcpy(&word, &packed[byte + 8], 8);
+				word |= packed_delta >> (64 - shift);
+				memcpy(&packed[byte + 8], &word, 8);
+			}
+			bit_pos += col->bits;
+		}
+	}
+	return size;
+}
+
+/**
+ * @brief Decode rows of one column of a segment
+ *
+ * @param segment segment, checked when the file was opened
+ * @param column TRACK_COL_xxx
+ * @param first first row
+ * @param count number of rows
+ * @param values decoded values, count entries
+ * @return true if the rows are in the segment
+ */
+bool track_decode_column(const track_segment_s *segment, uint8_t column, uint32_t first, uint32_t count, int64_t *values)
+{
+	if ((column >= TRACK_COLUMNS) || (first + count > segment->rows) || (first + count < first))
+	{
+		return false;
+	}
+	if (count == 0)
+	{
+		return true;
+	}
+	const track_column_s *col = &segment->columns[column];
+	if (col->bits == 0)
+	{
+		// Constant delta
+		for (uint32_t row = 0; row < count; row++)
+		{
+			values[row] = col->first + (int64_t)(first + row) * col->delta_min;
+		}
+		return true;
+	}
+
+	// The deltas before the first row are needed for its value
+	const uint8_t *packed = (const uint8_t *)segment + col->offset;
+	uint64_t mask = col->bits == 64 ? ~0ULL : (1ULL << col->bits) - 1;
+	int64_t value = col->first;
+	uint64_t bit_pos = 0;
+	uint32_t last = first + count;
+	for (uint32_t row = 0; row < last; row++)
+	{
+		if (row != 0)
+		{
+			uint64_t word;
+			uint32_t byte = (uint32_t)(bit_pos >> 6) * 8;
+			uint8_t shift = bit_pos & 63;
+			memcpy(&word, &packed[byte], 8);
+			uint64_t delta = word >> shift;
+			if ((shift + col->bits) > 64)
+			{
+				memcpy(&word, &packed[byte + 8], 8);
+				delta |= word << (64 - shift);
+			}
+			value += (int64_t)(delta & mask) + col->delta_min;
+			bit_pos += col->bits;
+		}
+		if (row >= first)
+		{
+			values[row - first] = value;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Check a segment header against the file
+ *
+ * @param segment segment
+ * @param available bytes from the segment start to the end of the file
+ * @return true if the segment is complete and its columns are inside
+ */
+static bool segment_valid(const track_segment_s *segment, size_t available)
+{
+	if ((available < sizeof(track_segment_s)) || (segment->magic != TRACK_SEGMENT_MAGIC) || (segment->rows == 0) ||
+		(segment->rows > TRACK_SEGMENT_ROWS) || (segment->size > available) || (segment->size < sizeof(track_segment_s)) ||
+		((segment->size & 7) != 0))
+	{
+		return false;
+	}
+	for (uint8_t column = 0; column < TRACK_COLUMNS; column++)
+	{
+		const track_column_s *col = &segment->columns[column];
+		uint64_t packed = (((uint64_t)(segment->rows - 1) * col->bits + 63) / 64) * 8;
+		if ((col->bits > 64) || (col->offset < sizeof(track_segment_s)) ||
+			((uint64_t)col->offset + packed + TRACK_PACK_SLACK > segment->size) || ((col->offset & 7) != 0))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Add a record
+ *        A full segment is written to the file.
+ *
+ * @param record record
+ * @return true if the record was added
+ * @return false if a full segment could not be written
+ */
+bool TrackWriter::append(const track_record_s *record)
+{
+	_rows.push_back(*record);
+	if (_rows.size() < TRACK_SEGMENT_ROWS)
+	{
+		return true;
+	}
+	return flush();
+}
+
+/**
+ * @brief Write the buffered records as a segment
+ *
+ * @return true if the segment was written or there was nothing to write
+ */
+bool TrackWriter::flush(void)
+{
+	if (_rows.empty())
+	{
+		return true;
+	}
+	size_t size = track_encode_segment(&_rows[0], _rows.size(), &_segment);
+	FILE *file = fopen(_name.c_str(), "ab");
+	if (file == NULL)
+	{
+		return false;
+	}
+	bool ok = fwrite(&_segment[0], 1, size, file) == size;
+	ok = (fclose(file) == 0) && ok;
+	if (ok)
+	{
+		_written += _rows.size();
+		_rows.clear();
+	}
+	return ok;
+}
+
+/**
+ * @brief Map a file and read the segment headers
+ *
+ * @param name file name
+ * @return true if the file was mapped, check damaged() for an incomplete last segment
+ */
+bool TrackReader::open(const char *name)
+{
+	close();
+	_fd = ::open(name, O_RDONLY);
+	if (_fd < 0)
+	{
+		return false;
+	}
+	struct stat info;
+	if (fstat(_fd, &info) != 0)
+	{
+		close();
+		return false;
+	}
+	_size = info.st_size;
+	if (_size == 0)
+	{
+		return true;
+	}
+	void *data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	_data = (const uint8_t *)data;
+
+	size_t offset = 0;
+	while (offset < _size)
+	{
+		const track_segment_s *segment = (const track_segment_s *)&_data[offset];
+		if (!segment_valid(segment, _size - offset))
+		{
+			_damaged = true;
+			break;
+		}
+		_segments.push_back(segment);
+		_rows += segment->rows;
+		offset += segment->size;
+	}
+	return true;
+}
+
+/**
+ * @brief Unmap the file
+ *
+ */
+void TrackReader::close(void)
+{
+	if (_data != 0)
+	{
+		munmap((void *)_data, _size);
+		_data = 0;
+	}
+	if (_fd >= 0)
+	{
+		::close(_fd);
+		_fd = -1;
+	}
+	_size = 0;
+	_segments.clear();
+	_rows = 0;
+	_damaged = false;
+}
+
+/**
+ * @brief Get the records of a time range
+ *        Segments outside of the range are skipped by their min/max time,
+ *        records come in file order.
+ *
+ * @param from first time
+ * @param to last time
+ * @param out the records are appended
+ * @return uint64_t number of records appended
+ */
+uint64_t TrackReader::query(uint32_t from, uint32_t to, std::vector<track_record_s> *out)
+{
+	_skipped = 0;
+	uint64_t found = 0;
+	int64_t values[TRACK_SEGMENT_ROWS];
+	int64_t times[TRACK_SEGMENT_ROWS];
+	for (size_t idx = 0; idx < _segments.size(); idx++)
+	{
+		const track_segment_s *segment = _segments[idx];
+		const track_column_s *time = &segment->columns[TRACK_COL_TIME];
+		if ((time->max < from) || (time->min > to))
+		{
+			_skipped++;
+			continue;
+		}
+
+		// Rows in time order need only the rows of the range
+		uint32_t first = 0;
+		uint32_t count = segment->rows;
+		track_decode_column(segment, TRACK_COL_TIME, 0, segment->rows, times);
+		if (time->delta_min >= 0)
+		{
+			while ((first < count) && (times[first] < from))
+			{
+				first++;
+			}
+			while ((count > first) && (times[count - 1] > to))
+			{
+				count--;
+			}
+			count -= first;
+		}
+
+		size_t base = out->size();
+		out->resize(base + count);
+		track_record_s *records = &(*out)[base];
+		for (uint32_t row = 0; row < count; row++)
+		{
+			track_set_column(&records[row], TRACK_COL_TIME, times[first + row]);
+		}
+		for (uint8_t column = 1; column < TRACK_COLUMNS; column++)
+		{
+			track_decode_column(segment, column, first, count, values);
+			for (uint32_t row = 0; row < count; row++)
+			{
+				track_set_column(&records[row], column, values[row]);
+			}
+		}
+
+		// Unsorted segments are filtered row by row
+		if (time->delta_min < 0)
+		{
+			size_t kept = base;
+			for (size_t row = base; row < out->size(); row++)
+			{
+				if (((*out)[row].time >= from) && ((*out)[row].time <= to))
+				{
+					(*out)[kept++] = (*out)[row];
+				}
+			}
+			out->resize(kept);
+			count = kept - base;
+		}
+		found += count;
+	}
+	return found;
+}
+
+/**
+ * @brief Write the buffered records of all devices
+ *
+ */
+TrackStore::~TrackStore(void)
+{
+	flush();
+	for (std::map<uint64_t, TrackWriter *>::iterator it = _writers.begin(); it != _writers.end(); ++it)
+	{
+		delete it->second;
+	}
+}
+
+/**
+ * @brief File name of a device
+ *
+ * @param device device address or EUI
+ * @return std::string file name
+ */
+std::string TrackStore::path(uint64_t device)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llX.trk", (unsigned long long)device);
+	return _folder + name;
+}
+
+/**
+ * @brief Add a record of a device
+ *
+ * @param device device address or EUI
+ * @param record record
+ * @return true if the record was added
+ */
+bool TrackStore::append(uint64_t device, const track_record_s *record)
+{
+	std::map<uint64_t, TrackWriter *>::iterator it = _writers.find(device);
+	if (it == _writers.end())
+	{
+		it = _writers.insert(std::make_pair(device, new TrackWriter(path(device)))).first;
+	}
+	return it->second->append(record);
+}
+
+/**
+ * @brief Write the buffered records of all devices
+ *
+ * @return true if all records were written
+ */
+bool TrackStore::flush(void)
+{
+	bool ok = true;
+	for (std::map<uint64_t, TrackWriter *>::iterator it = _writers.begin(); it != _writers.end(); ++it)
+	{
+		ok = it->second->flush() && ok;
+	}
+	return ok;
+}
+
+/**
+ * @brief Get the records of a device in a time range
+ *        Records that are not flushed yet are not found.
+ *
+ * @param device device address or EUI
+ * @param from first time
+ * @param to last time
+ * @param out the records are appended
+ * @return uint64_t number of records appended
+ */
+uint64_t TrackStore::query(uint64_t device, uint32_t from, uint32_t to, std::vector<track_record_s> *out)
+{
+	TrackReader reader;
+	if (!reader.open(path(device).c_str()))
+	{
+		return 0;
+	}
+	return reader.query(from, to, out);
+}
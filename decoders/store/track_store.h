@@ -0,0 +1,157 @@
+/**
+ * @file track_store.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Columnar on-disk store of the decoded tracker positions
+ *        One file per device, the file is a sequence of segments of up to
+ *        TRACK_SEGMENT_ROWS records. Each column of a segment is stored as
+ *        the deltas between the rows, minus the smallest delta and bit packed
+ *        with the width of the largest one. A constant time interval or an
+ *        unchanged value needs 0 bits per row.
+ *        The segment header has min and max of every column, a time range
+ *        query reads only the headers of the segments outside of the range.
+ *        Files are read with mmap, in the byte order of the host.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef TRACK_STORE_H
+#define TRACK_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Max number of records in one segment */
+#define TRACK_SEGMENT_ROWS 4096
+/** Number of columns of a record */
+#define TRACK_COLUMNS 9
+/** Start of every segment, "TRK1" */
+#define TRACK_SEGMENT_MAGIC 0x314B5254
+
+/** Column numbers */
+#define TRACK_COL_TIME 0
+#define TRACK_COL_LAT 1
+#define TRACK_COL_LON 2
+#define TRACK_COL_ALT 3
+#define TRACK_COL_ACCURACY 4
+#define TRACK_COL_BATTERY 5
+#define TRACK_COL_TEMP 6
+#define TRACK_COL_HUMID 7
+#define TRACK_COL_PRESS 8
+
+/** One position record in the units of the packets */
+struct track_record_s
+{
+	uint32_t time;		 // Unix time in seconds
+	int32_t latitude;	 // 1e-7 degree
+	int32_t longitude;	 // 1e-7 degree
+	int32_t altitude;	 // cm
+	uint16_t accuracy;	 // cm
+	uint16_t battery;	 // mV
+	int16_t temperature; // 0.1 °C
+	uint16_t humidity;	 // 0.5 %
+	uint16_t pressure;	 // 0.1 hPa
+};
+
+/** Encoding and index of one column of a segment */
+struct track_column_s
+{
+	int64_t min;
+	int64_t max;
+	int64_t first;
+	int64_t delta_min;
+	uint32_t offset; // start of the packed deltas from the segment start
+	uint8_t bits;	 // bits per delta
+	uint8_t reserved[3];
+};
+
+/** Segment header, followed by the packed columns */
+struct track_segment_s
+{
+	uint32_t magic;
+	uint32_t rows;
+	uint32_t size; // size of the segment including the header, multiple of 8
+	uint32_t reserved;
+	track_column_s columns[TRACK_COLUMNS];
+};
+
+int64_t track_get_column(const track_record_s *record, uint8_t column);
+void track_set_column(track_record_s *record, uint8_t column, int64_t value);
+size_t track_encode_segment(const track_record_s *records, uint32_t rows, std::vector<uint8_t> *out);
+bool track_decode_column(const track_segment_s *segment, uint8_t column, uint32_t first, uint32_t count, int64_t *values);
+
+/**
+ * @brief Appends the records of one device to its file
+ *        The records are buffered until a segment is full or flush() is called.
+ *        The file is only opened to append a segment, many writers can be used at the same time.
+ */
+class TrackWriter
+{
+public:
+	TrackWriter(const std::string &name) : _name(name) { _rows.reserve(TRACK_SEGMENT_ROWS); }
+	~TrackWriter(void) { flush(); }
+
+	bool append(const track_record_s *record);
+	bool flush(void);
+	uint64_t written(void) { return _written; }
+
+private:
+	std::string _name;
+	std::vector<track_record_s> _rows;
+	std::vector<uint8_t> _segment;
+	uint64_t _written = 0;
+};
+
+/**
+ * @brief Reads the file of one device with mmap
+ *        A damaged or incomplete segment ends the file, the segments before it are readable.
+ */
+class TrackReader
+{
+public:
+	TrackReader(void) {}
+	~TrackReader(void) { close(); }
+
+	bool open(const char *name);
+	void close(void);
+	uint32_t segments(void) { return _segments.size(); }
+	const track_segment_s *segment(uint32_t idx) { return _segments[idx]; }
+	uint64_t rows(void) { return _rows; }
+	bool damaged(void) { return _damaged; }
+	uint64_t query(uint32_t from, uint32_t to, std::vector<track_record_s> *out);
+	uint32_t lastSkipped(void) { return _skipped; }
+
+private:
+	int _fd = -1;
+	const uint8_t *_data = 0;
+	size_t _size = 0;
+	std::vector<const track_segment_s *> _segments;
+	uint64_t _rows = 0;
+	bool _damaged = false;
+	uint32_t _skipped = 0;
+};
+
+/**
+ * @brief Files of many devices in one folder, named by the device address
+ */
+class TrackStore
+{
+public:
+	TrackStore(const std::string &folder) : _folder(folder) {}
+	~TrackStore(void);
+
+	std::string path(uint64_t device);
+	bool append(uint64_t device, const track_record_s *record);
+	bool flush(void);
+	uint64_t query(uint64_t device, uint32_t from, uint32_t to, std::vector<track_record_s> *out);
+
+private:
+	std::string _folder;
+	std::map<uint64_t, TrackWriter *> _writers;
+};
+
+#endif
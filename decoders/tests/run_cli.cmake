@@ -0,0 +1,20 @@
+# Runs a command line tool and checks its output
+#   cmake -DCOMMAND="tool;arg" -DSTDOUT="regex;..." -DSTDERR="regex;..." -DRESULT=code -P run_cli.cmake
+# Every regular expression must match, RESULT is the expected exit code.
+execute_process(COMMAND ${COMMAND}
+	OUTPUT_VARIABLE out
+	ERROR_VARIABLE err
+	RESULT_VARIABLE result)
+if(DEFINED RESULT AND NOT result EQUAL RESULT)
+	message(FATAL_ERROR "exit code ${result}, expected ${RESULT}\n${err}")
+endif()
+foreach(regex IN LISTS STDOUT)
+	if(NOT out MATCHES "${regex}")
+		message(FATAL_ERROR "stdout does not match '${regex}':\n${out}")
+	endif()
+endforeach()
+foreach(regex IN LISTS STDERR)
+	if(NOT err MATCHES "${regex}")
+		message(FATAL_ERROR "stderr does not match '${regex}':\n${err}")
+	endif()
+endforeach()
@@ -0,0 +1,277 @@
+/**
+ * @file test_airtime.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the time on air, the duty cycle budget and the daily airtime budget
+ * @version 0.1
+ * @date 2022-10-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <deque>
+
+#include "test_util.h"
+#include "airtime.h"
+
+/** Region numbers as used in g_lorawan_settings.lora_region */
+#define REGION_AS923 0
+#define REGION_AU915 1
+#define REGION_EU868 5
+#define REGION_US915 8
+
+/** EU868 sub-bands */
+#define BAND_G1 1
+#define BAND_G2 2
+#define BAND_G3 3
+
+/**
+ * Time on air of a 10 byte application payload (23 byte PHY payload),
+ * CR 4/5, 8 preamble symbols, explicit header and CRC, in us,
+ * same values as the Semtech LoRa calculator and the TTN airtime calculator.
+ */
+static const uint32_t toa_10_bytes[6] = {61696, 113152, 205824, 370688, 823296, 1482752};
+
+static void test_known_toa(void)
+{
+	for (uint8_t sf = 7; sf <= 12; sf++)
+	{
+		CHECK_EQ(airtime_toa(sf, 125, 1, 23), toa_10_bytes[sf - 7]);
+	}
+	// Empty uplink, 13 byte LoRaWAN overhead only
+	CHECK_EQ(airtime_toa(7, 125, 1, 13), 46336);
+	CHECK_EQ(airtime_toa(12, 125, 1, 13), 1155072);
+	// 51 byte application payload, max of EU868 DR0
+	CHECK_EQ(airtime_toa(12, 125, 1, 64), 2793472);
+	CHECK_EQ(airtime_toa(7, 125, 1, 64), 118016);
+	// Max PHY payload at SF12
+	CHECK_EQ(airtime_toa(12, 125, 1, 255), 9019392);
+	// Other bandwidths and coding rates
+	CHECK_EQ(airtime_toa(7, 250, 1, 23), 30848);
+	CHECK_EQ(airtime_toa(8, 500, 1, 23), 28288);
+	CHECK_EQ(airtime_toa(7, 125, 4, 23), 86272);
+	// Preamble, implicit header and no CRC
+	CHECK_EQ(airtime_toa(7, 125, 1, 23, 16, true, false), 59648);
+
+	// Invalid parameters
+	CHECK_EQ(airtime_toa(6, 125, 1, 23), 0);
+	CHECK_EQ(airtime_toa(13, 125, 1, 23), 0);
+	CHECK_EQ(airtime_toa(7, 0, 1, 23), 0);
+	CHECK_EQ(airtime_toa(7, 125, 5, 23), 0);
+}
+
+static void test_datarates(void)
+{
+	// EU868 DR0 to DR5 are SF12 to SF7
+	for (uint8_t datarate = 0; datarate <= 5; datarate++)
+	{
+		CHECK_EQ(airtime_uplink(REGION_EU868, datarate, 10), toa_10_bytes[5 - datarate]);
+	}
+	CHECK_EQ(airtime_uplink(REGION_EU868, 6, 10), 30848);
+	// FSK has no LoRa time on air
+	CHECK_EQ(airtime_uplink(REGION_EU868, 7, 10), 0);
+	CHECK_EQ(airtime_uplink(REGION_AS923, 2, 10), toa_10_bytes[3]);
+
+	// US915 DR0 to DR3 are SF10 to SF7, DR4 is SF8 with 500 kHz
+	for (uint8_t datarate = 0; datarate <= 3; datarate++)
+	{
+		CHECK_EQ(airtime_uplink(REGION_US915, datarate, 10), toa_10_bytes[3 - datarate]);
+	}
+	CHECK_EQ(airtime_uplink(REGION_US915, 4, 10), 28288);
+	CHECK_EQ(airtime_uplink(REGION_US915, 5, 10), 0);
+}
+
+static void test_join(void)
+{
+	// The stack starts every join with DR5 in EU868, the lower data rates come only after 8 trials
+	const uint8_t eu868_dr[] = {5, 5, 5, 5, 5, 5, 5, 4};
+	for (uint8_t trial = 1; trial <= sizeof(eu868_dr); trial++)
+	{
+		CHECK_EQ(airtime_join_dr(REGION_EU868, trial), eu868_dr[trial - 1]);
+	}
+	CHECK_EQ(airtime_join_dr(REGION_EU868, 16), 3);
+	CHECK_EQ(airtime_join_dr(REGION_EU868, 48), 0);
+	// US915 alternates between SF8 with 500 kHz and SF10
+	CHECK_EQ(airtime_join_dr(REGION_US915, 1), 4);
+	CHECK_EQ(airtime_join_dr(REGION_US915, 2), 0);
+	CHECK_EQ(airtime_join_dr(REGION_AS923, 3), 2);
+
+	// A join request has the same 23 byte PHY payload as a 10 byte uplink
+	CHECK_EQ(airtime_join(REGION_EU868, 1), toa_10_bytes[0]);
+	CHECK_EQ(airtime_join(REGION_EU868, 8), 7 * toa_10_bytes[0] + toa_10_bytes[1]);
+	CHECK_EQ(airtime_join(REGION_US915, 2), 28288 + toa_10_bytes[3]);
+	CHECK_EQ(airtime_join(REGION_EU868, 0), 0);
+}
+
+static void test_rx1(void)
+{
+	CHECK_EQ(airtime_rx1_dr(REGION_EU868, 5, 0), 5);
+	CHECK_EQ(airtime_rx1_dr(REGION_EU868, 5, 2), 3);
+	CHECK_EQ(airtime_rx1_dr(REGION_EU868, 1, 3), 0);
+	// US915 DR0 uplinks get DR10 downlinks, SF10 with 500 kHz
+	CHECK_EQ(airtime_rx1_dr(REGION_US915, 0, 0), 10);
+	CHECK_EQ(airtime_rx1_dr(REGION_US915, 4, 0), 13);
+	CHECK_EQ(airtime_rx1_dr(REGION_US915, 0, 3), 8);
+	CHECK_EQ(airtime_rx1_dr(REGION_AU915, 2, 1), 9);
+	CHECK_EQ(airtime_rx1_dr(REGION_AS923, 4, 7), 5);
+	CHECK_EQ(airtime_rx1_dr(REGION_AS923, 2, 6), 3);
+	uint8_t sf;
+	uint16_t bw_khz;
+	CHECK(airtime_dr_params(REGION_US915, airtime_rx1_dr(REGION_US915, 0, 0), &sf, &bw_khz));
+	CHECK_EQ(sf, 10);
+	CHECK_EQ(bw_khz, 500);
+}
+
+static void test_bands(void)
+{
+	CHECK_EQ(airtime_band(REGION_EU868, 0), BAND_G1);
+	CHECK_EQ(airtime_band(REGION_EU868, 868100000), BAND_G1);
+	CHECK_EQ(airtime_band(REGION_EU868, 867100000), 0);
+	CHECK_EQ(airtime_band(REGION_EU868, 868800000), BAND_G2);
+	CHECK_EQ(airtime_band(REGION_EU868, 869525000), BAND_G3);
+	CHECK_EQ(airtime_band(REGION_US915, 902300000), 0);
+
+	CHECK_EQ(airtime_duty_limit(REGION_EU868, BAND_G1), 100);
+	CHECK_EQ(airtime_duty_limit(REGION_EU868, BAND_G2), 1000);
+	CHECK_EQ(airtime_duty_limit(REGION_EU868, BAND_G3), 10);
+	CHECK_EQ(airtime_duty_limit(REGION_US915, 0), 0);
+	CHECK_EQ(airtime_duty_limit(REGION_AS923, 0), 0);
+}
+
+/**
+ * @brief Send as often as the duty cycle allows for some hours
+ *        An independent log of the sends checks that no hour has more airtime
+ *        than allowed.
+ *
+ * @param toa time on air per packet in us
+ * @param interval wanted time between packets in ms
+ * @param hours simulated time
+ * @param throttled number of packets that had to wait
+ * @return uint32_t number of packets sent
+ */
+static uint32_t run_duty_cycle(uint32_t toa, uint32_t interval, uint32_t hours, uint32_t *throttled)
+{
+	DutyCycle duty;
+	uint32_t now = 0xFFF00000;
+	uint32_t start = now;
+	duty.begin(REGION_EU868, now);
+	uint32_t allowed = duty.allowance(BAND_G1);
+	std::deque<uint32_t> sent;
+	uint32_t count = 0;
+	*throttled = 0;
+	while ((now - start) < hours * AIRTIME_WINDOW)
+	{
+		uint32_t wait = duty.nextAllowed(now, BAND_G1, toa);
+		if (wait != 0)
+		{
+			(*throttled)++;
+			now += wait;
+			CHECK_EQ(duty.nextAllowed(now, BAND_G1, toa), 0);
+		}
+		duty.add(now, BAND_G1, toa);
+		sent.push_back(now);
+		while ((now - sent.front()) >= AIRTIME_WINDOW)
+		{
+			sent.pop_front();
+		}
+		CHECK((uint64_t)sent.size() * toa <= allowed);
+		count++;
+		now += interval;
+	}
+	return count;
+}
+
+static void test_duty_cycle(void)
+{
+	DutyCycle duty;
+	duty.begin(REGION_EU868, 1000);
+	CHECK_EQ(duty.allowance(BAND_G1), 36000000);
+	CHECK_EQ(duty.allowance(BAND_G2), 3600000);
+	CHECK_EQ(duty.allowance(BAND_G3), 360000000);
+
+	// 24 packets of 1.48 s fit into the 36 s of 1 %
+	uint32_t toa = toa_10_bytes[5];
+	for (uint8_t idx = 0; idx < 24; idx++)
+	{
+		CHECK_EQ(duty.nextAllowed(1000 + idx * 1000, BAND_G1, toa), 0);
+		duty.add(1000 + idx * 1000, BAND_G1, toa);
+	}
+	CHECK_EQ(duty.used(30000, BAND_G1), 24 * toa);
+	// The 25th waits until the slot of the first ones is older than one hour
+	CHECK_EQ(duty.nextAllowed(30000, BAND_G1, toa), 1000 + AIRTIME_WINDOW - 30000);
+	// Other bands have their own budget
+	CHECK_EQ(duty.nextAllowed(30000, BAND_G3, toa), 0);
+	CHECK_EQ(duty.used(30000, BAND_G3), 0);
+	CHECK_EQ(duty.used(1000 + AIRTIME_WINDOW, BAND_G1), 0);
+
+	// A packet longer than the whole allowance never fits
+	CHECK_EQ(duty.nextAllowed(30000, BAND_G2, airtime_toa(12, 125, 1, 255)), AIRTIME_WINDOW);
+
+	// No limit outside of the duty cycle regions
+	duty.begin(REGION_US915, 0);
+	duty.add(0, 0, 100000000);
+	CHECK_EQ(duty.nextAllowed(0, 0, toa_10_bytes[3]), 0);
+
+	// At SF7 a packet every 30 s is never throttled
+	uint32_t throttled;
+	uint32_t count = run_duty_cycle(toa_10_bytes[0], 30000, 3, &throttled);
+	CHECK_EQ(throttled, 0);
+	CHECK_EQ(count, 3 * 120);
+
+	// At SF12 a packet every 30 s breaks the 1 %, the budget is kept and mostly used
+	count = run_duty_cycle(toa_10_bytes[5], 30000, 3, &throttled);
+	printf("SF12 every 30 s: %u packets in 3 hours, %u throttled, 1 %% allows %u per hour\n", count, throttled,
+		   36000000 / toa_10_bytes[5]);
+	CHECK(throttled > 0);
+	CHECK(count <= 3 * (36000000 / toa_10_bytes[5]) + 24);
+	CHECK(count >= 3 * (36000000 / toa_10_bytes[5]) * 3 / 4);
+}
+
+static void test_budget(void)
+{
+	AirtimeBudget budget;
+	CHECK_EQ(budget.level(0, false), BUDGET_OK);
+
+	// 30 s per day, the bucket holds 7.5 s
+	budget.begin(30000, 0);
+	CHECK_EQ(budget.capacity(), 7500000);
+	CHECK_EQ(budget.tokens(0), 7500000);
+	budget.spend(0, 4000000);
+	CHECK_EQ(budget.level(0, false), BUDGET_COARSE);
+	CHECK_EQ(budget.level(0, true), BUDGET_OK);
+	budget.spend(0, 2000000);
+	CHECK_EQ(budget.level(0, false), BUDGET_BATCH);
+	budget.spend(0, 1000000);
+	CHECK_EQ(budget.level(0, false), BUDGET_STRETCH);
+	CHECK_EQ(budget.level(0, true), BUDGET_BATCH);
+	budget.spend(0, 200000);
+	CHECK_EQ(budget.level(0, true), BUDGET_STRETCH);
+
+	// One hour adds 30 s / 24, refill in small steps loses nothing
+	uint32_t now = 0;
+	for (uint32_t step = 0; step < 3600; step++)
+	{
+		now += 1000;
+		budget.tokens(now);
+	}
+	CHECK_EQ(budget.tokens(now), 300000 + 1250000);
+
+	// Full after 6 hours, never more than the capacity
+	CHECK_EQ(budget.tokens(now + 6 * 3600000), 7500000);
+
+	budget.restore(100000000, 0);
+	CHECK_EQ(budget.tokens(0), 7500000);
+	budget.restore(1000, 0);
+	CHECK_EQ(budget.tokens(0), 1000);
+}
+
+int main(void)
+{
+	test_known_toa();
+	test_datarates();
+	test_join();
+	test_rx1();
+	test_bands();
+	test_duty_cycle();
+	test_budget();
+	return TEST_RESULT();
+}
@@ -0,0 +1,248 @@
+/**
+ * @file test_confirm_policy.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the confirmed uplink policy and a simulation of the saved downlink airtime
+ * @version 0.1
+ * @date 2022-10-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+
+#include "test_util.h"
+#include "confirm_policy.h"
+#include "airtime.h"
+
+/** Simulated day, one uplink per minute with SF9 */
+#define SIM_UPLINKS 1440
+#define SIM_SF 9
+#define SIM_PAYLOAD 20
+/** Uplinks of the fade with low SNR and of the outage without any link */
+#define FADE_START 600
+#define FADE_END 720
+#define OUTAGE_START 1000
+#define OUTAGE_END 1060
+
+/** Simulated policies */
+#define SIM_UNCONFIRMED 0
+#define SIM_CONFIRMED 1
+#define SIM_ADAPTIVE 2
+
+struct sim_result_s
+{
+	uint32_t confirmed;
+	uint32_t downlinks;
+	uint64_t downlink_airtime; // us of gateway airtime for the acknowledges
+	uint64_t uplink_airtime;   // us
+	uint32_t fade_confirmed;   // confirmed uplinks during the fade
+	int32_t outage_detected;   // uplinks from the start of the outage until a failed confirmation, -1 if never
+	int32_t outage_recovered;  // uplinks from the end of the outage until the escalation ends, -1 if never
+};
+
+static void test_snr_floor(void)
+{
+	CHECK_EQ(confirm_snr_floor(7), -7);
+	CHECK_EQ(confirm_snr_floor(9), -12);
+	CHECK_EQ(confirm_snr_floor(12), -20);
+	CHECK_EQ(confirm_snr_floor(5), -7);
+	CHECK_EQ(confirm_snr_floor(14), -20);
+}
+
+static void test_fixed(void)
+{
+	ConfirmPolicy policy;
+	CHECK_EQ(policy.mode(), CONFIRM_FIXED);
+	CHECK(policy.confirm(true));
+	CHECK(!policy.confirm(false));
+	policy.acked(false);
+	CHECK(!policy.confirm(false));
+}
+
+static void test_adaptive(void)
+{
+	ConfirmPolicy policy;
+	policy.begin(CONFIRM_ADAPTIVE, 4, 5);
+
+	// Every 4th uplink without downlink
+	for (uint8_t idx = 0; idx < 3; idx++)
+	{
+		CHECK(!policy.confirm(true));
+		policy.sent(false);
+	}
+	CHECK(policy.confirm(false));
+	policy.sent(true);
+	policy.acked(true);
+	CHECK(!policy.confirm(false));
+
+	// A downlink restarts the count
+	policy.sent(false);
+	policy.sent(false);
+	policy.downlink(10);
+	CHECK(!policy.confirm(false));
+	int8_t margin;
+	CHECK(policy.margin(&margin));
+	CHECK_EQ(margin, 10);
+
+	// Low average margin of the last CONFIRM_WINDOW downlinks
+	policy.downlink(2);
+	CHECK(policy.margin(&margin));
+	CHECK_EQ(margin, 6);
+	CHECK(!policy.confirm(false));
+	policy.downlink(0);
+	CHECK(policy.confirm(false));
+	for (uint8_t idx = 0; idx < CONFIRM_WINDOW; idx++)
+	{
+		policy.downlink(8);
+	}
+	CHECK(!policy.confirm(false));
+
+	// A missing acknowledge escalates until the next one
+	policy.sent(true);
+	policy.acked(false);
+	CHECK(policy.escalated());
+	for (uint8_t idx = 0; idx < 10; idx++)
+	{
+		CHECK(policy.confirm(false));
+		policy.sent(true);
+		policy.acked(false);
+	}
+	policy.acked(true);
+	CHECK(!policy.escalated());
+	CHECK(!policy.confirm(false));
+	CHECK_EQ(policy.confirmed(), 12);
+	CHECK_EQ(policy.unconfirmed(), 5);
+
+	// begin() clears the counts and the link state
+	policy.begin(CONFIRM_ADAPTIVE, 0, 5);
+	CHECK_EQ(policy.confirmed(), 0);
+	CHECK(!policy.margin(&margin));
+	for (uint8_t idx = 0; idx < 20; idx++)
+	{
+		CHECK(!policy.confirm(false));
+		policy.sent(false);
+	}
+}
+
+/**
+ * @brief SNR of the link at an uplink
+ *        Good link with 12 dB margin, a fade with 1 dB margin and an outage.
+ *
+ * @param uplink number of the uplink
+ * @return int8_t SNR in dB
+ */
+static int8_t trace_snr(uint32_t uplink)
+{
+	int8_t floor = confirm_snr_floor(SIM_SF);
+	int8_t noise = (int8_t)(rand() % 7) - 3;
+	if ((uplink >= OUTAGE_START) && (uplink < OUTAGE_END))
+	{
+		return floor - 20;
+	}
+	if ((uplink >= FADE_START) && (uplink < FADE_END))
+	{
+		return floor + 1 + noise;
+	}
+	return floor + 12 + noise;
+}
+
+/**
+ * @brief Run the simulated day with one policy
+ *        The acknowledge of a confirmed uplink is the only downlink, it has the SNR of the uplink.
+ *        A packet below the SNR floor of the data rate is lost.
+ *
+ * @param mode SIM_UNCONFIRMED, SIM_CONFIRMED or SIM_ADAPTIVE
+ * @param result counts of the day
+ */
+static void run_day(uint8_t mode, sim_result_s *result)
+{
+	ConfirmPolicy policy;
+	policy.begin(mode == SIM_ADAPTIVE ? CONFIRM_ADAPTIVE : CONFIRM_FIXED, CONFIRM_EVERY, CONFIRM_MIN_MARGIN);
+	uint32_t uplink_toa = airtime_toa(SIM_SF, 125, 1, SIM_PAYLOAD + AIRTIME_LORAWAN_OVERHEAD);
+	// Acknowledge without FPort and payload, downlinks have no CRC
+	uint32_t ack_toa = airtime_toa(SIM_SF, 125, 1, AIRTIME_LORAWAN_OVERHEAD - 1, 8, false, false);
+	int8_t floor = confirm_snr_floor(SIM_SF);
+
+	*result = sim_result_s();
+	result->outage_detected = -1;
+	result->outage_recovered = -1;
+	srand(48);
+	for (uint32_t uplink = 0; uplink < SIM_UPLINKS; uplink++)
+	{
+		bool confirmed = policy.confirm(mode == SIM_CONFIRMED);
+		policy.sent(confirmed);
+		result->uplink_airtime += uplink_toa;
+		int8_t snr = trace_snr(uplink);
+		bool received = snr >= floor;
+		if (confirmed)
+		{
+			result->confirmed++;
+			if ((uplink >= FADE_START) && (uplink < FADE_END))
+			{
+				result->fade_confirmed++;
+			}
+			if (received)
+			{
+				result->downlinks++;
+				result->downlink_airtime += ack_toa;
+				policy.downlink(snr - floor);
+			}
+			policy.acked(received);
+			if (!received && (uplink >= OUTAGE_START) && (result->outage_detected < 0))
+			{
+				result->outage_detected = uplink - OUTAGE_START;
+			}
+		}
+		if ((uplink >= OUTAGE_END) && (result->outage_recovered < 0) && !policy.escalated() && (result->outage_detected >= 0))
+		{
+			result->outage_recovered = uplink - OUTAGE_END;
+		}
+	}
+}
+
+static void test_simulated_day(void)
+{
+	sim_result_s unconfirmed;
+	sim_result_s confirmed;
+	sim_result_s adaptive;
+	run_day(SIM_UNCONFIRMED, &unconfirmed);
+	run_day(SIM_CONFIRMED, &confirmed);
+	run_day(SIM_ADAPTIVE, &adaptive);
+
+	printf("%d uplinks with SF%d, %d with low margin, %d without link\n", SIM_UPLINKS, SIM_SF, FADE_END - FADE_START,
+		   OUTAGE_END - OUTAGE_START);
+	printf("always confirmed: %u downlinks, %.1f s gateway airtime, outage found after %d uplinks\n",
+		   confirmed.downlinks, confirmed.downlink_airtime / 1e6, confirmed.outage_detected);
+	printf("adaptive:         %u downlinks, %.1f s gateway airtime, outage found after %d uplinks\n",
+		   adaptive.downlinks, adaptive.downlink_airtime / 1e6, adaptive.outage_detected);
+	printf("never confirmed:  %u downlinks, outage %s\n", unconfirmed.downlinks,
+		   unconfirmed.outage_detected < 0 ? "never found" : "found");
+	printf("adaptive saves %.0f %% of the downlink airtime\n",
+		   100.0 - 100.0 * adaptive.downlink_airtime / confirmed.downlink_airtime);
+
+	// Uplink airtime is the same, only the downlinks change
+	CHECK_EQ(adaptive.uplink_airtime, confirmed.uplink_airtime);
+	CHECK_EQ(unconfirmed.confirmed, 0);
+	CHECK(unconfirmed.outage_detected < 0);
+	CHECK_EQ(confirmed.confirmed, SIM_UPLINKS);
+	CHECK_EQ(confirmed.outage_detected, 0);
+
+	// Adaptive needs less than a quarter of the downlinks
+	CHECK(adaptive.downlinks * 4 < confirmed.downlinks);
+	// but finds the outage within CONFIRM_EVERY uplinks
+	CHECK(adaptive.outage_detected >= 0);
+	CHECK(adaptive.outage_detected < CONFIRM_EVERY);
+	// and stays escalated until the link is back
+	CHECK_EQ(adaptive.outage_recovered, 0);
+	// With low margin most uplinks are confirmed
+	CHECK(adaptive.fade_confirmed > (FADE_END - FADE_START) * 3 / 4);
+}
+
+int main(void)
+{
+	test_snr_floor();
+	test_fixed();
+	test_adaptive();
+	test_simulated_day();
+	return TEST_RESULT();
+}
@@ -0,0 +1,294 @@
+/**
+ * @file test_dead_reckoning.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the position predictor and the distance helpers
+ *        Replays a track through the tracker and the backend side of the
+ *        predictor and counts the suppressed locations.
+ * @version 0.1
+ * @date 2022-10-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+
+#include "test_util.h"
+#include "test_track.h"
+#include "dead_reckoning.h"
+#include "geo_math.h"
+#include "lpp_schema.h"
+#include "field_writer.h"
+
+/** Location as the tracker sends it, 6 digit location, with the time for the predictor */
+static uint8_t location_packet(uint8_t *packet, const track_fix_s &fix, bool anchor)
+{
+	uint8_t size = 0;
+	packet[size++] = LPP_CHANNEL_GPS;
+	packet[size++] = LPP_GPS6;
+	size += put_be<4>(&packet[size], (uint32_t)(fix.latitude / 10));
+	size += put_be<4>(&packet[size], (uint32_t)(fix.longitude / 10));
+	size += put_be<3>(&packet[size], 52000);
+	if (!anchor)
+	{
+		return size;
+	}
+	packet[size++] = LPP_CHANNEL_TIME;
+	packet[size++] = LPP_TIME;
+	size += put_be<4>(&packet[size], fix.time);
+	return size;
+}
+
+static void test_geo(void)
+{
+	// One degree latitude, one degree longitude at the equator and at 60°
+	CHECK_NEAR(geo_distance(0, 0, 10000000, 0), 111319, 1);
+	CHECK_NEAR(geo_distance(0, 0, 0, 10000000), 111319, 5);
+	CHECK_NEAR(geo_distance(600000000, 0, 600000000, 10000000), 55660, 5);
+
+	// 20m over the 180° meridian, in both directions
+	CHECK(geo_distance(0, 1799999100, 0, -1799999100) <= 21);
+	CHECK(geo_distance(0, -1799999100, 0, 1799999100) <= 21);
+	int32_t east;
+	int32_t north;
+	geo_offset(0, 1799999100, 0, -1799999100, &east, &north);
+	CHECK_NEAR(east, 20, 1);
+	CHECK_EQ(north, 0);
+
+	// Largest possible offsets do not overflow
+	geo_offset(0, -1800000000, 0, 1800000000, &east, &north);
+	CHECK_EQ(east, 0);
+	geo_offset(-900000000, 0, 900000000, 1800000000, &east, &north);
+	CHECK_NEAR(north, 20037420, 10);
+	geo_offset(0, 0, 0, 1800000000, &east, &north);
+	CHECK_NEAR(east, 20037420, 1000);
+
+	CHECK_EQ(geo_wrap_lon(1800000001), -1799999999);
+	CHECK_EQ(geo_wrap_lon(-1800000001), 1799999999);
+	CHECK_EQ(geo_wrap_lon(1800000000), 1800000000);
+	CHECK_EQ(geo_wrap_lon(7200000123LL), 123);
+}
+
+static void test_predict(void)
+{
+	DeadReckoning predictor;
+	int32_t lat;
+	int32_t lon;
+	CHECK(!predictor.predict(0, &lat, &lon));
+	CHECK_EQ(predictor.error(0, 0, 0), UINT32_MAX);
+
+	// One position, standing still
+	predictor.addSent(481370000, 115750000, 100);
+	CHECK(predictor.predict(200, &lat, &lon));
+	CHECK_EQ(lat, 481370000);
+	CHECK_EQ(lon, 115750000);
+
+	// Constant velocity, integer division truncates towards zero
+	predictor.addSent(481380000, 115740000, 110);
+	CHECK(predictor.predict(115, &lat, &lon));
+	CHECK_EQ(lat, 481385000);
+	CHECK_EQ(lon, 115735000);
+	predictor.addSent(481380000, 115740000, 113);
+	CHECK(predictor.predict(114, &lat, &lon));
+	CHECK_EQ(lat, 481380000);
+
+	// Same time twice, no speed
+	predictor.reset();
+	predictor.addSent(1, 2, 50);
+	predictor.addSent(3, 4, 50);
+	CHECK(predictor.predict(60, &lat, &lon));
+	CHECK_EQ(lat, 3);
+	CHECK_EQ(lon, 4);
+
+	// Moving east over the 180° meridian
+	predictor.reset();
+	predictor.addSent(0, 1799990000, 0);
+	predictor.addSent(0, 1799995000, 10);
+	CHECK(predictor.predict(30, &lat, &lon));
+	CHECK_EQ(lon, -1799995000);
+	CHECK(predictor.error(0, -1799995000, 30) <= 1);
+
+	// Extrapolation stops at the pole
+	predictor.reset();
+	predictor.addSent(890000000, 0, 0);
+	predictor.addSent(895000000, 0, 10);
+	CHECK(predictor.predict(100, &lat, &lon));
+	CHECK_EQ(lat, 900000000);
+}
+
+static void test_anchors(void)
+{
+	DeadReckoning predictor;
+	// Every location is an anchor until there are two positions
+	CHECK(predictor.anchorDue(4));
+	predictor.sent();
+	CHECK(predictor.anchorDue(4));
+	predictor.addSent(1, 2, 10);
+	CHECK(predictor.anchorDue(4));
+	predictor.sent();
+	predictor.addSent(3, 4, 20);
+	CHECK(!predictor.anchorDue(4));
+
+	// Then every 4th sent location
+	for (uint8_t idx = 0; idx < 3; idx++)
+	{
+		predictor.sent();
+		CHECK_EQ(predictor.anchorDue(4), idx == 2);
+	}
+	// A failed anchor makes the next one an anchor too
+	predictor.sent();
+	CHECK(predictor.anchorDue(4));
+	predictor.addSent(5, 6, 30);
+	CHECK(!predictor.anchorDue(4));
+
+	// 0 and 1 make every location an anchor
+	CHECK(predictor.anchorDue(1));
+	CHECK(predictor.anchorDue(0));
+	predictor.reset();
+	CHECK(predictor.anchorDue(8));
+}
+
+static void test_read_fix(void)
+{
+	uint8_t packet[32];
+	track_fix_s fix = {1234, -337654321, 1511234567};
+	uint8_t size = location_packet(packet, fix, true);
+	int32_t lat;
+	int32_t lon;
+	uint32_t time;
+	CHECK(dr_read_fix(packet, size, &lat, &lon, &time));
+	CHECK_EQ(lat, -337654320);
+	CHECK_EQ(lon, 1511234560);
+	CHECK_EQ(time, 1234);
+
+	// Without the time the location cannot be used
+	CHECK(!dr_read_fix(packet, size - 6, &lat, &lon, &time));
+	// Broken packet
+	CHECK(!dr_read_fix(packet, size - 1, &lat, &lon, &time));
+
+	// 4 digit location
+	uint8_t coarse[32] = {LPP_CHANNEL_GPS, LPP_GPS4};
+	size = 2;
+	size += put_be<3>(&coarse[size], (uint32_t)-337654);
+	size += put_be<3>(&coarse[size], (uint32_t)1511234);
+	size += put_be<3>(&coarse[size], 100);
+	coarse[size++] = LPP_CHANNEL_TIME;
+	coarse[size++] = LPP_TIME;
+	size += put_be<4>(&coarse[size], 99);
+	CHECK(dr_read_fix(coarse, size, &lat, &lon, &time));
+	CHECK_EQ(lat, -337654000);
+	CHECK_EQ(lon, 1511234000);
+	CHECK_EQ(time, 99);
+}
+
+/**
+ * @brief Replay a track, the tracker skips the locations the backend can predict
+ *        Only anchors carry their time, they are confirmed and fed to both predictors.
+ *        Every lost_every uplink is lost, neither side uses it.
+ *
+ * @param anchors returns the number of anchors, the confirmed uplinks
+ * @return uint32_t number of locations sent
+ */
+static uint32_t replay(const std::vector<track_fix_s> &track, uint16_t tolerance, uint8_t max_skip, uint32_t lost_every,
+					   uint8_t anchor_every, uint32_t *anchors)
+{
+	DeadReckoning tracker;
+	DeadReckoning backend;
+	uint8_t skipped = 0;
+	uint32_t sent = 0;
+	uint32_t worst = 0;
+	*anchors = 0;
+	for (size_t idx = 0; idx < track.size(); idx++)
+	{
+		const track_fix_s &fix = track[idx];
+		uint32_t error = tracker.error(fix.latitude, fix.longitude, fix.time);
+		if ((skipped < max_skip) && (error <= tolerance))
+		{
+			skipped++;
+			// The backend knows the location within the tolerance
+			int32_t lat;
+			int32_t lon;
+			CHECK(backend.predict(fix.time, &lat, &lon));
+			uint32_t backend_error = geo_distance(lat, lon, fix.latitude, fix.longitude);
+			CHECK(backend_error <= tolerance);
+			worst = backend_error > worst ? backend_error : worst;
+			continue;
+		}
+
+		skipped = 0;
+		sent++;
+		bool anchor = tracker.anchorDue(anchor_every);
+		tracker.sent();
+		*anchors += anchor ? 1 : 0;
+		if ((lost_every != 0) && ((sent % lost_every) == 0))
+		{
+			// Not received, an anchor is not confirmed and the tracker does not use it
+			continue;
+		}
+		uint8_t packet[32];
+		uint8_t size = location_packet(packet, fix, anchor);
+		int32_t lat;
+		int32_t lon;
+		uint32_t time;
+		// Locations without time are not used by the backend
+		if (dr_read_fix(packet, size, &lat, &lon, &time))
+		{
+			CHECK(anchor);
+			backend.addSent(lat, lon, time);
+			tracker.addSent(lat, lon, time);
+		}
+	}
+	printf("tolerance %3dm, max skip %2d, lost 1/%u, anchor 1/%u: %3u of %3u sent, %2.0f%% suppressed, %3u confirmed, "
+		   "worst error %um\n",
+		   tolerance, max_skip, lost_every, anchor_every, sent, (unsigned)track.size(),
+		   100.0 * (track.size() - sent) / track.size(), *anchors, worst);
+	return sent;
+}
+
+static void test_replay(void)
+{
+	std::vector<track_fix_s> track = read_track(TEST_DATA_DIR "/highway_track.csv");
+	CHECK(track.size() > 400);
+	if (track.empty())
+	{
+		return;
+	}
+	uint32_t anchors;
+	uint32_t all = replay(track, 0, 0, 0, 1, &anchors);
+	CHECK_EQ(all, track.size());
+	uint32_t sent_25 = replay(track, 25, 10, 0, 1, &anchors);
+	uint32_t sent_50 = replay(track, 50, 10, 0, 1, &anchors);
+	CHECK_EQ(anchors, sent_50);
+	uint32_t sent_100 = replay(track, 100, 10, 0, 1, &anchors);
+	replay(track, 50, 10, 5, 1, &anchors);
+	CHECK(sent_25 >= sent_50);
+	CHECK(sent_50 >= sent_100);
+	// Most locations of a drive with long straight parts are predicted
+	CHECK(sent_50 * 2 < track.size());
+	// The max skip count limits the suppression
+	CHECK(sent_100 >= track.size() / 11);
+
+	// Anchors every Nth location need fewer confirmed uplinks for some more locations
+	uint32_t last_sent = sent_50;
+	uint32_t last_anchors = sent_50;
+	for (uint8_t every = 2; every <= 8; every *= 2)
+	{
+		uint32_t sent = replay(track, 50, 10, 0, every, &anchors);
+		CHECK(anchors * 2 <= sent + 2);
+		CHECK(anchors < last_anchors);
+		CHECK(sent >= last_sent);
+		CHECK(sent < track.size());
+		last_sent = sent;
+		last_anchors = anchors;
+	}
+	replay(track, 50, 10, 5, DR_ANCHOR_EVERY, &anchors);
+}
+
+int main(void)
+{
+	test_geo();
+	test_predict();
+	test_anchors();
+	test_read_fix();
+	test_replay();
+	return TEST_RESULT();
+}
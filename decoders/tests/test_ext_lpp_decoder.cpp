@@ -0,0 +1,265 @@
+/**
+ * @file test_ext_lpp_decoder.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the native decoder with packets made by the firmware encoders
+ * @version 0.1
+ * @date 2022-10-03
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "test_util.h"
+#include "ext_lpp_decoder.h"
+#include "lpp_schema.h"
+#include "field_writer.h"
+#include "pos_codec.h"
+#include "fragment.h"
+#include "link_map.h"
+#include "hex_cell.h"
+
+#define CAPACITY 256
+
+static uint32_t col_frame[CAPACITY];
+static uint8_t col_channel[CAPACITY];
+static uint8_t col_type[CAPACITY];
+static double col_value[3][CAPACITY];
+
+static lpp_columns_s columns(uint32_t capacity = CAPACITY)
+{
+	lpp_columns_s out;
+	out.capacity = capacity;
+	out.count = 0;
+	out.frame = col_frame;
+	out.channel = col_channel;
+	out.type = col_type;
+	for (int idx = 0; idx < 3; idx++)
+	{
+		out.value[idx] = col_value[idx];
+	}
+	return out;
+}
+
+/** Location with battery as the firmware sends it */
+static uint8_t location_frame(uint8_t *frame)
+{
+	uint8_t size = 0;
+	frame[size++] = LPP_CHANNEL_GPS;
+	frame[size++] = LPP_GPS6;
+	size += put_be<4>(&frame[size], (uint32_t)-33765432);
+	size += put_be<4>(&frame[size], (uint32_t)151123456);
+	size += put_be<3>(&frame[size], (uint32_t)-1250);
+	frame[size++] = LPP_CHANNEL_BATT;
+	frame[size++] = 116;
+	size += put_be<2>(&frame[size], 412);
+	return size;
+}
+
+static void test_lpp(void)
+{
+	uint8_t frame[32];
+	uint8_t size = location_frame(frame);
+	lpp_columns_s out = columns();
+	CHECK_EQ(lpp_decode_frame(frame, size, 7, &out), 2);
+	CHECK_EQ(out.frame[0], 7);
+	CHECK_EQ(out.channel[0], LPP_CHANNEL_GPS);
+	CHECK_NEAR(out.value[0][0], -33.765432, 1e-9);
+	CHECK_NEAR(out.value[1][0], 151.123456, 1e-9);
+	CHECK_NEAR(out.value[2][0], -12.5, 1e-9);
+	CHECK_NEAR(out.value[0][1], 4.12, 1e-9);
+
+	// Truncated and unknown types add nothing
+	CHECK_EQ(lpp_decode_frame(frame, size - 1, 8, &out), LPP_DECODE_ERR_SIZE);
+	frame[1] = 200;
+	CHECK_EQ(lpp_decode_frame(frame, size, 8, &out), LPP_DECODE_ERR_TYPE);
+	CHECK_EQ(out.count, 2);
+
+	// Full columns keep the values of earlier frames
+	size = location_frame(frame);
+	out = columns(3);
+	CHECK_EQ(lpp_decode_frame(frame, size, 0, &out), 2);
+	CHECK_EQ(lpp_decode_frame(frame, size, 1, &out), LPP_DECODE_ERR_FULL);
+	CHECK_EQ(out.count, 2);
+}
+
+static void test_channels(void)
+{
+	// Values written with the schema encoders come back scaled by the type divisors
+	uint8_t frame[64];
+	uint8_t size = 0;
+	size += lpp_put<LPP_CHANNEL_BATT>(&frame[size], 412);
+	size += lpp_put<LPP_CHANNEL_ZONES>(&frame[size], (int32_t)0x80000001);
+	size += lpp_put<LPP_CHANNEL_TIME>(&frame[size], 1664900000);
+	size += lpp_put<LPP_CHANNEL_HUMID>(&frame[size], 131);
+	size += lpp_put<LPP_CHANNEL_TEMP>(&frame[size], -125);
+	size += lpp_put<LPP_CHANNEL_PRESS>(&frame[size], 10132);
+	size += lpp_put<LPP_CHANNEL_GAS>(&frame[size], 12345);
+	CHECK_EQ(size, lpp_channel_size(LPP_CHANNEL_BATT) + lpp_channel_size(LPP_CHANNEL_ZONES) + lpp_channel_size(LPP_CHANNEL_TIME) +
+					   lpp_channel_size(LPP_CHANNEL_HUMID) + lpp_channel_size(LPP_CHANNEL_TEMP) +
+					   lpp_channel_size(LPP_CHANNEL_PRESS) + lpp_channel_size(LPP_CHANNEL_GAS));
+	CHECK_EQ(lpp_channel_size(LPP_CHANNEL_ZONES), 2 + LPP_ZONES_SIZE);
+	CHECK_EQ(lpp_channel_type(LPP_CHANNEL_GPS), LPP_GPS6);
+	CHECK_EQ(lpp_channel_type(200), 0);
+
+	lpp_columns_s out = columns();
+	CHECK_EQ(lpp_decode_frame(frame, size, 0, &out), 7);
+	CHECK_EQ(out.channel[0], LPP_CHANNEL_BATT);
+	CHECK_NEAR(out.value[0][0], 4.12, 1e-9);
+	CHECK_EQ(out.value[0][1], 0x80000001UL);
+	CHECK_EQ(out.value[0][2], 1664900000);
+	CHECK_NEAR(out.value[0][3], 65.5, 1e-9);
+	CHECK_NEAR(out.value[0][4], -12.5, 1e-9);
+	CHECK_NEAR(out.value[0][5], 1013.2, 1e-9);
+	CHECK_NEAR(out.value[0][6], 123.45, 1e-9);
+}
+
+static void test_link_map(void)
+{
+	uint64_t cell = hex_cell(-337654321, 1511234567, 460);
+	LinkMap map;
+	map.add(cell, -110, -12);
+	map.add(cell, -90, 4);
+	uint8_t frame[64];
+	uint8_t size = map.pack(frame, sizeof(frame), 460);
+
+	lpp_columns_s out = columns();
+	CHECK_EQ(lpp_decode_uplink(LPP_DECODE_PORT_LINK_MAP, frame, size, 3, false, 0, &out), 4);
+	CHECK_EQ(out.type[0], LPP_DECODE_TYPE_LINK_EDGE);
+	CHECK_EQ(out.value[0][0], 460);
+	CHECK_EQ(out.type[1], LPP_DECODE_TYPE_LINK_CELL);
+	CHECK_EQ(out.value[0][1], hex_cell_q(cell));
+	CHECK_EQ(out.value[1][1], hex_cell_r(cell));
+	CHECK_EQ(out.value[2][1], 2);
+	CHECK_EQ(out.value[0][2], -110);
+	CHECK_EQ(out.value[1][2], -100);
+	CHECK_EQ(out.value[2][2], -90);
+	CHECK_EQ(out.value[0][3], -12);
+	CHECK_EQ(out.value[1][3], -4);
+	CHECK_EQ(out.value[2][3], 4);
+	CHECK_EQ(link_map_decode_frame(frame, size - 1, 0, &out), LPP_DECODE_ERR_SIZE);
+
+	// 1m cells far from the prime meridian don't fit into 3 bytes
+	LinkMap small;
+	CHECK(!small.add(hex_cell(0, 1790000000, 1), -100, 0));
+	CHECK(!small.add(hex_cell(0, -1790000000, 1), -100, 0));
+	CHECK_EQ(small.count(), 0);
+
+	// 2m cells fit everywhere, the largest coordinates keep their sign
+	uint64_t east = hex_cell(0, 1799999999, 2);
+	uint64_t west = hex_cell(-10000000, -1799999999, 2);
+	CHECK(small.add(east, -100, 0));
+	CHECK(small.add(west, -100, 0));
+	size = small.pack(frame, sizeof(frame), 2);
+	out = columns();
+	CHECK_EQ(lpp_decode_uplink(LPP_DECODE_PORT_LINK_MAP, frame, size, 0, false, 0, &out), 7);
+	CHECK_EQ(out.value[0][1], hex_cell_q(east));
+	CHECK_EQ(out.value[1][1], hex_cell_r(east));
+	CHECK_EQ(out.value[0][4], hex_cell_q(west));
+	CHECK_EQ(out.value[1][4], hex_cell_r(west));
+	CHECK(out.value[0][1] > 5000000);
+	CHECK(out.value[0][4] < -5000000);
+}
+
+static void test_batch(void)
+{
+	pos_point_s points[3] = {{-337654321, 1511234567, 12000, 300},
+							 {-337654000, 1511235000, 13000, 200},
+							 {-337650000, 1511239000, 11000, 100}};
+	uint8_t frame[64];
+	PosEncoder encoder;
+	encoder.begin(frame, sizeof(frame), POS_RES_1E6, ALT_RES_M);
+	for (int idx = 0; idx < 3; idx++)
+	{
+		CHECK(encoder.add(&points[idx]));
+	}
+
+	lpp_columns_s out = columns();
+	CHECK_EQ(lpp_decode_uplink(LPP_DECODE_PORT_BATCH, frame, encoder.getSize(), 0, false, 0, &out), 6);
+	for (int idx = 0; idx < 3; idx++)
+	{
+		CHECK_EQ(out.type[2 * idx], LPP_GPS6);
+		CHECK_NEAR(out.value[0][2 * idx], points[idx].latitude / 1e7, 1e-6);
+		CHECK_NEAR(out.value[1][2 * idx], points[idx].longitude / 1e7, 1e-6);
+		CHECK_NEAR(out.value[2][2 * idx], points[idx].altitude / 1000.0, 1.0);
+		CHECK_EQ(out.type[2 * idx + 1], LPP_DECODE_TYPE_AGE);
+		CHECK_EQ(out.value[0][2 * idx + 1], points[idx].time);
+	}
+	frame[0] = 0xC0;
+	CHECK_EQ(batch_decode_frame(frame, encoder.getSize(), 0, &out), LPP_DECODE_ERR_FORMAT);
+}
+
+static void test_fragments_and_queue(void)
+{
+	uint8_t packet[32];
+	uint8_t size = location_frame(packet);
+	Fragmenter fragmenter;
+	CHECK(fragmenter.begin(2, packet, size, 8));
+	uint8_t fragments[FRAG_MAX_COUNT][8];
+	uint8_t sizes[FRAG_MAX_COUNT];
+	uint8_t count = 0;
+	while ((sizes[count] = fragmenter.next(fragments[count])) != 0)
+	{
+		count++;
+	}
+	CHECK(count > 2);
+
+	// Last fragment first, values come with the fragment that completes the packet
+	FragReassembler reassembler;
+	lpp_columns_s out = columns();
+	CHECK_EQ(lpp_decode_uplink(LPP_DECODE_PORT_FRAG, fragments[count - 1], sizes[count - 1], 0, false, &reassembler, &out), 0);
+	for (uint8_t idx = 0; idx < count - 1; idx++)
+	{
+		int result = lpp_decode_uplink(LPP_DECODE_PORT_FRAG, fragments[idx], sizes[idx], 1 + idx, false, &reassembler, &out);
+		CHECK_EQ(result, idx == count - 2 ? 2 : 0);
+	}
+	CHECK_EQ(out.frame[0], count - 1);
+	CHECK_NEAR(out.value[0][1], 4.12, 1e-9);
+	CHECK_EQ(lpp_decode_uplink(LPP_DECODE_PORT_FRAG, fragments[0], sizes[0], 0, false, 0, &out), LPP_DECODE_ERR_FORMAT);
+
+	// Queued packet, age and original fPort in front
+	uint8_t queued[40];
+	put_be<3>(queued, 0x012345);
+	queued[3] = 2;
+	for (uint8_t idx = 0; idx < size; idx++)
+	{
+		queued[4 + idx] = packet[idx];
+	}
+	out = columns();
+	CHECK_EQ(lpp_decode_uplink(LPP_DECODE_PORT_QUEUE, queued, size + 4, 0, false, 0, &out), 3);
+	CHECK_EQ(out.type[0], LPP_DECODE_TYPE_AGE);
+	CHECK_EQ(out.channel[0], LPP_DECODE_PORT_QUEUE);
+	CHECK_EQ(out.value[0][0], 0x012345);
+	CHECK_EQ(out.type[1], LPP_GPS6);
+
+	// A broken original packet adds no age
+	CHECK_EQ(lpp_decode_uplink(LPP_DECODE_PORT_QUEUE, queued, size + 3, 0, false, 0, &out), LPP_DECODE_ERR_SIZE);
+	CHECK_EQ(out.count, 3);
+	CHECK_EQ(lpp_decode_uplink(LPP_DECODE_PORT_QUEUE, queued, 3, 0, false, 0, &out), LPP_DECODE_ERR_SIZE);
+}
+
+static void test_batch_api(void)
+{
+	uint8_t packet[32];
+	uint8_t size = location_frame(packet);
+	uint8_t broken[2] = {1, 200};
+	const uint8_t *data[3] = {packet, broken, packet};
+	uint16_t sizes[3] = {size, 2, 3};
+	uint8_t ports[3] = {2, 2, 14};
+	uint32_t errors = 0;
+	lpp_columns_s out = columns();
+	CHECK_EQ(lpp_decode_batch(data, sizes, 3, 10, false, &out, &errors, ports), 3);
+	// The third frame is too short for a queued packet
+	CHECK_EQ(errors, 2);
+	CHECK_EQ(out.count, 2);
+	CHECK_EQ(out.frame[1], 10);
+}
+
+int main(void)
+{
+	test_lpp();
+	test_channels();
+	test_link_map();
+	test_batch();
+	test_fragments_and_queue();
+	test_batch_api();
+	return TEST_RESULT();
+}
@@ -0,0 +1,124 @@
+/**
+ * @file test_field_writer.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the field writers and readers
+ *        All 3 byte signed values are compared with the union byte copy
+ *        the encoders used before.
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "test_util.h"
+#include "field_writer.h"
+
+/** Layout of the old encoders, only valid on a little endian host */
+union old_field_u
+{
+	int32_t val;
+	uint8_t bytes[4];
+};
+
+static bool little_endian(void)
+{
+	old_field_u probe;
+	probe.val = 1;
+	return probe.bytes[0] == 1;
+}
+
+static void test_3_byte_signed(void)
+{
+	bool compare_old = little_endian();
+	uint32_t errors = 0;
+	for (int32_t value = -(1 << 23); value < (1 << 23); value++)
+	{
+		uint8_t be[3];
+		uint8_t le[3];
+		put_be<3>(be, (uint32_t)value);
+		put_le<3>(le, (uint32_t)value);
+		bool ok = (sign_extend<3>(get_be<3>(be)) == value) && (sign_extend<3>(get_le<3>(le)) == value);
+		ok = ok && (be[0] == le[2]) && (be[1] == le[1]) && (be[2] == le[0]);
+		if (compare_old)
+		{
+			old_field_u old;
+			old.val = value;
+			ok = ok && (be[0] == old.bytes[2]) && (be[1] == old.bytes[1]) && (be[2] == old.bytes[0]);
+		}
+		if (!ok)
+		{
+			if (errors < 10)
+			{
+				fprintf(stderr, "3 byte value %d: %02X%02X%02X\n", value, be[0], be[1], be[2]);
+			}
+			errors++;
+		}
+	}
+	CHECK_EQ(errors, 0);
+
+	// Boundaries
+	uint8_t buffer[4];
+	put_be<3>(buffer, (uint32_t)-1);
+	CHECK_EQ(get_be<3>(buffer), 0xFFFFFF);
+	put_be<3>(buffer, (uint32_t)-8388608);
+	CHECK_EQ(get_be<3>(buffer), 0x800000);
+	CHECK_EQ(sign_extend<3>(0x800000), -8388608);
+	CHECK_EQ(sign_extend<3>(0x7FFFFF), 8388607);
+	// Values outside of the range are truncated to 3 bytes
+	put_be<3>(buffer, (uint32_t)8388608);
+	CHECK_EQ(sign_extend<3>(get_be<3>(buffer)), -8388608);
+	put_be<3>(buffer, 0x12345678);
+	CHECK_EQ(get_be<3>(buffer), 0x345678);
+}
+
+static void test_scaled(void)
+{
+	uint8_t buffer[4];
+	// Division truncates towards zero for negative values
+	put_be_scaled<3, 10>(buffer, -1259);
+	CHECK_EQ(sign_extend<3>(get_be<3>(buffer)), -125);
+	put_be_scaled<3, 10>(buffer, 1259);
+	CHECK_EQ(sign_extend<3>(get_be<3>(buffer)), 125);
+	put_be_scaled<3, 10>(buffer, -9);
+	CHECK_EQ(sign_extend<3>(get_be<3>(buffer)), 0);
+
+	// Full range of the coordinates
+	put_be_scaled<4, 10>(buffer, -1800000000);
+	CHECK_EQ(sign_extend<4>(get_be<4>(buffer)), -180000000);
+	put_be_scaled<4, 10>(buffer, INT32_MIN);
+	CHECK_EQ(sign_extend<4>(get_be<4>(buffer)), -214748364);
+	put_be_scaled<3, 1000>(buffer, -900000000);
+	CHECK_EQ(sign_extend<3>(get_be<3>(buffer)), -900000);
+	put_be_scaled<3, 1000>(buffer, 1800000000);
+	CHECK_EQ(sign_extend<3>(get_be<3>(buffer)), 1800000);
+	put_le_scaled<2, 1000>(buffer, -1234567);
+	CHECK_EQ(sign_extend<2>(get_le<2>(buffer)), -1234);
+	put_le_scaled<4, 100>(buffer, -1799999999);
+	CHECK_EQ(sign_extend<4>(get_le<4>(buffer)), -17999999);
+}
+
+static void test_sizes(void)
+{
+	uint8_t buffer[4] = {0};
+	CHECK_EQ(put_be<1>(buffer, 0x1FF), 1);
+	CHECK_EQ(buffer[0], 0xFF);
+	CHECK_EQ(buffer[1], 0);
+	CHECK_EQ(put_le<2>(buffer, 0xABCD), 2);
+	CHECK_EQ(buffer[0], 0xCD);
+	CHECK_EQ(buffer[1], 0xAB);
+	CHECK_EQ(put_be<4>(buffer, 0x01020304), 4);
+	CHECK_EQ(buffer[0], 1);
+	CHECK_EQ(buffer[3], 4);
+	CHECK_EQ(get_le<4>(buffer), 0x04030201);
+	CHECK_EQ(sign_extend<1>(0x80), -128);
+	CHECK_EQ(sign_extend<2>(0xFFFF), -1);
+	CHECK_EQ(sign_extend<4>(0xFFFFFFFF), -1);
+}
+
+int main(void)
+{
+	test_3_byte_signed();
+	test_scaled();
+	test_sizes();
+	return TEST_RESULT();
+}
@@ -0,0 +1,261 @@
+/**
+ * @file test_fragment.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the fragmentation with lost, repeated and reordered fragments
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "test_util.h"
+#include "fragment.h"
+
+struct sent_packet_s
+{
+	uint8_t fport;
+	uint8_t size;
+	uint8_t data[255];
+	std::vector<std::vector<uint8_t> > fragments;
+};
+
+static uint32_t random_below(uint32_t limit)
+{
+	return (uint32_t)rand() % limit;
+}
+
+/**
+ * @brief Make a random packet and split it
+ */
+static void make_packet(Fragmenter *fragmenter, sent_packet_s *packet, uint8_t max_fragment)
+{
+	packet->fport = 1 + random_below(223);
+	// Max 16 fragments
+	uint16_t max_size = 16 * (max_fragment - FRAG_HEADER_SIZE) - 1;
+	packet->size = 1 + random_below(max_size < 255 ? max_size : 255);
+	for (uint8_t idx = 0; idx < packet->size; idx++)
+	{
+		packet->data[idx] = random_below(256);
+	}
+	CHECK(fragmenter->begin(packet->fport, packet->data, packet->size, max_fragment));
+	packet->fragments.clear();
+	uint8_t buffer[FRAG_MAX_SIZE];
+	uint8_t size;
+	while ((size = fragmenter->next(buffer)) != 0)
+	{
+		CHECK(size <= max_fragment);
+		packet->fragments.push_back(std::vector<uint8_t>(buffer, buffer + size));
+	}
+	CHECK(!fragmenter->pending());
+}
+
+static bool same_packet(FragReassembler *reassembler, const sent_packet_s *packet)
+{
+	return (reassembler->getFport() == packet->fport) && (reassembler->getSize() == packet->size) &&
+		   (memcmp(reassembler->getData(), packet->data, packet->size) == 0);
+}
+
+static void test_split(void)
+{
+	Fragmenter fragmenter;
+	uint8_t data[255];
+	for (int idx = 0; idx < 255; idx++)
+	{
+		data[idx] = idx;
+	}
+	// The fPort byte is part of the data, 255 bytes + fPort need 16 fragments of 16 bytes
+	CHECK(fragmenter.begin(2, data, 255, 18));
+	CHECK(!fragmenter.begin(2, data, 255, 17));
+	CHECK(!fragmenter.begin(2, data, 10, FRAG_HEADER_SIZE));
+
+	// Same sizes except the last fragment
+	CHECK(fragmenter.begin(2, data, 100, 53));
+	uint8_t buffer[FRAG_MAX_SIZE];
+	CHECK_EQ(fragmenter.next(buffer), 53);
+	CHECK_EQ(buffer[1], 0x01);
+	CHECK_EQ(buffer[2], 2);
+	CHECK_EQ(fragmenter.next(buffer), 2 + 101 - 51);
+	CHECK_EQ(buffer[1], 0x11);
+	CHECK_EQ(fragmenter.next(buffer), 0);
+
+	// A retried fragment is the same again
+	CHECK(fragmenter.begin(2, data, 100, 53));
+	uint8_t first[FRAG_MAX_SIZE];
+	uint8_t size = fragmenter.next(first);
+	fragmenter.retry();
+	CHECK_EQ(fragmenter.next(buffer), size);
+	CHECK(memcmp(first, buffer, size) == 0);
+	fragmenter.cancel();
+	CHECK(!fragmenter.pending());
+}
+
+static void test_reorder(void)
+{
+	srand(34);
+	Fragmenter fragmenter;
+	FragReassembler reassembler;
+	sent_packet_s packet;
+	for (int test = 0; test < 2000; test++)
+	{
+		make_packet(&fragmenter, &packet, 11 + random_below(243));
+		std::random_shuffle(packet.fragments.begin(), packet.fragments.end(), random_below);
+		for (size_t idx = 0; idx < packet.fragments.size(); idx++)
+		{
+			bool complete = reassembler.add(&packet.fragments[idx][0], packet.fragments[idx].size());
+			CHECK_EQ(complete, idx == packet.fragments.size() - 1);
+		}
+		CHECK(same_packet(&reassembler, &packet));
+
+		// Repeated fragments of a complete packet are ignored
+		CHECK(!reassembler.add(&packet.fragments[0][0], packet.fragments[0].size()));
+	}
+	CHECK_EQ(reassembler.lost(), 0);
+}
+
+static void test_interleaved(void)
+{
+	// Fragments of FRAG_SLOTS packets mixed, all packets complete
+	srand(341);
+	Fragmenter fragmenter;
+	FragReassembler reassembler;
+	for (int test = 0; test < 500; test++)
+	{
+		sent_packet_s packets[FRAG_SLOTS];
+		std::vector<std::pair<uint8_t, size_t> > order;
+		for (uint8_t idx = 0; idx < FRAG_SLOTS; idx++)
+		{
+			make_packet(&fragmenter, &packets[idx], 11 + random_below(40));
+			for (size_t frag = 0; frag < packets[idx].fragments.size(); frag++)
+			{
+				order.push_back(std::make_pair(idx, frag));
+			}
+		}
+		std::random_shuffle(order.begin(), order.end(), random_below);
+		uint8_t complete = 0;
+		for (size_t idx = 0; idx < order.size(); idx++)
+		{
+			std::vector<uint8_t> &fragment = packets[order[idx].first].fragments[order[idx].second];
+			if (reassembler.add(&fragment[0], fragment.size()))
+			{
+				CHECK(same_packet(&reassembler, &packets[order[idx].first]));
+				complete++;
+			}
+		}
+		CHECK_EQ(complete, FRAG_SLOTS);
+	}
+	CHECK_EQ(reassembler.lost(), 0);
+}
+
+static void test_loss(void)
+{
+	// Fragments get lost or repeated, neighbouring fragments swap places.
+	// Every complete packet is delivered once and unchanged, incomplete packets are counted as lost.
+	srand(342);
+	Fragmenter fragmenter;
+	FragReassembler reassembler;
+	static sent_packet_s packets[256];
+	uint32_t delivered = 0;
+	uint32_t expected = 0;
+	uint32_t incomplete = 0;
+	static const uint8_t loss_percent[] = {0, 5, 20, 50};
+	for (size_t loss = 0; loss < sizeof(loss_percent) / sizeof(loss_percent[0]); loss++)
+	{
+		reassembler.clear();
+		delivered = 0;
+		expected = 0;
+		incomplete = 0;
+		for (int test = 0; test < 3000; test++)
+		{
+			sent_packet_s *packet = &packets[test % 256];
+			make_packet(&fragmenter, packet, 11 + random_below(60));
+			std::vector<size_t> sent;
+			for (size_t idx = 0; idx < packet->fragments.size(); idx++)
+			{
+				if (random_below(100) >= loss_percent[loss])
+				{
+					sent.push_back(idx);
+					if (random_below(10) == 0)
+					{
+						sent.push_back(idx);
+					}
+				}
+			}
+			for (size_t idx = 1; idx < sent.size(); idx++)
+			{
+				if (random_below(3) == 0)
+				{
+					std::swap(sent[idx - 1], sent[idx]);
+				}
+			}
+			std::vector<bool> received(packet->fragments.size(), false);
+			for (size_t idx = 0; idx < sent.size(); idx++)
+			{
+				received[sent[idx]] = true;
+			}
+			size_t count = std::count(received.begin(), received.end(), true);
+			if (count == packet->fragments.size())
+			{
+				expected++;
+			}
+			else if (count != 0)
+			{
+				incomplete++;
+			}
+
+			uint32_t complete = 0;
+			for (size_t idx = 0; idx < sent.size(); idx++)
+			{
+				std::vector<uint8_t> &fragment = packet->fragments[sent[idx]];
+				if (reassembler.add(&fragment[0], fragment.size()))
+				{
+					CHECK(same_packet(&reassembler, packet));
+					complete++;
+				}
+			}
+			CHECK(complete <= 1);
+			delivered += complete;
+		}
+		CHECK_EQ(delivered, expected);
+		// The last incomplete packets are still waiting for their fragments
+		CHECK(reassembler.lost() <= incomplete);
+		CHECK(reassembler.lost() + FRAG_SLOTS >= incomplete);
+	}
+}
+
+static void test_invalid(void)
+{
+	FragReassembler reassembler;
+	uint8_t fragment[FRAG_MAX_SIZE] = {1, 0x21, 5};
+	// Header only, index beyond the count
+	CHECK(!reassembler.add(fragment, FRAG_HEADER_SIZE));
+	CHECK(!reassembler.add(fragment, 3));
+
+	// Other fragment sizes than the first one are rejected
+	fragment[1] = 0x02;
+	CHECK(!reassembler.add(fragment, 12));
+	fragment[1] = 0x12;
+	CHECK(!reassembler.add(fragment, 11));
+	// Changed count of the same packet
+	fragment[1] = 0x23;
+	CHECK(!reassembler.add(fragment, 5));
+	fragment[1] = 0x22;
+	CHECK(!reassembler.add(fragment, 5));
+	fragment[1] = 0x12;
+	CHECK(reassembler.add(fragment, 12));
+	CHECK_EQ(reassembler.getSize(), 10 + 10 + 3 - 1);
+}
+
+int main(void)
+{
+	test_split();
+	test_reorder();
+	test_interleaved();
+	test_loss();
+	test_invalid();
+	return TEST_RESULT();
+}
@@ -0,0 +1,292 @@
+/**
+ * @file test_geofence.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the geofence zones, boundary cases and a floating point reference
+ * @version 0.1
+ * @date 2022-10-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+#include <math.h>
+
+#include "test_util.h"
+#include "geofence.h"
+#include "geo_math.h"
+
+/** Edge length of the test tiles, about 110m */
+#define TILE 10000
+
+static Geofence fence;
+
+static void add_square(uint8_t id, uint8_t flags, int32_t lat, int32_t lon, int32_t size, bool clockwise)
+{
+	if (clockwise)
+	{
+		fence.addPoint(id, flags, lat, lon);
+		fence.addPoint(id, flags, lat + size, lon);
+		fence.addPoint(id, flags, lat + size, lon + size);
+		fence.addPoint(id, flags, lat, lon + size);
+	}
+	else
+	{
+		fence.addPoint(id, flags, lat, lon);
+		fence.addPoint(id, flags, lat, lon + size);
+		fence.addPoint(id, flags, lat + size, lon + size);
+		fence.addPoint(id, flags, lat + size, lon);
+	}
+}
+
+static void test_square(void)
+{
+	fence.clear();
+	int32_t lat = 481370000;
+	int32_t lon = 115750000;
+	add_square(3, 0, lat, lon, TILE, true);
+	CHECK_EQ(fence.zones(), 1);
+	CHECK_EQ(fence.points(), 4);
+
+	CHECK_EQ(fence.check(lat + TILE / 2, lon + TILE / 2), 1UL << 3);
+	// 1e-7 degree inside and outside of each edge
+	CHECK_EQ(fence.check(lat + 1, lon + TILE / 2), 1UL << 3);
+	CHECK_EQ(fence.check(lat - 1, lon + TILE / 2), 0);
+	CHECK_EQ(fence.check(lat + TILE - 1, lon + TILE / 2), 1UL << 3);
+	CHECK_EQ(fence.check(lat + TILE + 1, lon + TILE / 2), 0);
+	CHECK_EQ(fence.check(lat + TILE / 2, lon + 1), 1UL << 3);
+	CHECK_EQ(fence.check(lat + TILE / 2, lon - 1), 0);
+	CHECK_EQ(fence.check(lat + TILE / 2, lon + TILE - 1), 1UL << 3);
+	CHECK_EQ(fence.check(lat + TILE / 2, lon + TILE + 1), 0);
+	// Far away, rejected by the bounding box
+	CHECK_EQ(fence.check(-lat, -lon), 0);
+
+	CHECK_NEAR(fence.boundaryDistance(lat + TILE / 2, lon + TILE / 2), 37, 1);
+	CHECK_NEAR(fence.boundaryDistance(lat - TILE, lon + TILE / 2), 111, 1);
+	CHECK_EQ(fence.boundaryDistance(lat, lon), 0);
+
+	// Too few points is not a zone
+	fence.clear();
+	fence.addPoint(1, 0, lat, lon);
+	fence.addPoint(1, 0, lat + TILE, lon);
+	CHECK_EQ(fence.check(lat + TILE / 2, lon), 0);
+	CHECK(fence.boundaryDistance(0, 0) != UINT32_MAX);
+	fence.clear();
+	CHECK_EQ(fence.boundaryDistance(0, 0), UINT32_MAX);
+}
+
+/**
+ * @brief Points on an edge shared by two zones belong to exactly one of them,
+ *        a grid of tiles covers every point exactly once
+ */
+static void test_shared_edges(bool clockwise)
+{
+	fence.clear();
+	int32_t lat = -337650000;
+	int32_t lon = 1511230000;
+	uint8_t id = 0;
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			add_square(id++, 0, lat + row * TILE, lon + col * TILE, TILE, clockwise);
+		}
+	}
+	CHECK_EQ(fence.zones(), 16);
+
+	srand(27);
+	uint32_t twice = 0;
+	uint32_t missing = 0;
+	for (int test = 0; test < 20000; test++)
+	{
+		// Half of the points exactly on grid lines
+		int32_t p_lat = lat + rand() % (4 * TILE);
+		int32_t p_lon = lon + rand() % (4 * TILE);
+		if (test & 1)
+		{
+			p_lat -= (p_lat - lat) % TILE;
+		}
+		if (test & 2)
+		{
+			p_lon -= (p_lon - lon) % TILE;
+		}
+		uint32_t mask = fence.check(p_lat, p_lon);
+		if (mask == 0)
+		{
+			missing++;
+		}
+		else if ((mask & (mask - 1)) != 0)
+		{
+			twice++;
+		}
+	}
+	CHECK_EQ(twice, 0);
+	CHECK_EQ(missing, 0);
+
+	// Shared corner of 4 tiles
+	uint32_t mask = fence.check(lat + TILE, lon + TILE);
+	CHECK(mask != 0);
+	CHECK_EQ(mask & (mask - 1), 0);
+}
+
+/** Floating point crossing number reference */
+static bool reference_inside(const double *lat, const double *lon, int count, double p_lat, double p_lon)
+{
+	bool inside = false;
+	for (int idx = 0, prev = count - 1; idx < count; prev = idx++)
+	{
+		if (((lat[idx] > p_lat) != (lat[prev] > p_lat)) &&
+			(p_lon < (lon[prev] - lon[idx]) * (p_lat - lat[idx]) / (lat[prev] - lat[idx]) + lon[idx]))
+		{
+			inside = !inside;
+		}
+	}
+	return inside;
+}
+
+/** Distance of a point to a segment in units of the coordinates */
+static double segment_distance(double a_lat, double a_lon, double b_lat, double b_lon, double p_lat, double p_lon)
+{
+	double d_lat = b_lat - a_lat;
+	double d_lon = b_lon - a_lon;
+	double len2 = d_lat * d_lat + d_lon * d_lon;
+	double t = len2 == 0 ? 0 : ((p_lat - a_lat) * d_lat + (p_lon - a_lon) * d_lon) / len2;
+	t = t < 0 ? 0 : (t > 1 ? 1 : t);
+	return hypot(a_lat + t * d_lat - p_lat, a_lon + t * d_lon - p_lon);
+}
+
+static void test_reference(void)
+{
+	// Concave star polygons with 24 points
+	srand(2027);
+	for (int poly = 0; poly < 20; poly++)
+	{
+		fence.clear();
+		double lat[24];
+		double lon[24];
+		int32_t c_lat = (rand() % 1600000000) - 800000000;
+		int32_t c_lon = (rand() % 3400000000U) - 1700000000;
+		for (int idx = 0; idx < 24; idx++)
+		{
+			double radius = (idx & 1) ? 20000 + rand() % 20000 : 60000 + rand() % 40000;
+			double angle = idx * 2 * M_PI / 24;
+			lat[idx] = (int32_t)(c_lat + radius * sin(angle));
+			lon[idx] = (int32_t)(c_lon + radius * cos(angle));
+			CHECK(fence.addPoint(poly & 31, 0, (int32_t)lat[idx], (int32_t)lon[idx]));
+		}
+
+		uint32_t mismatch = 0;
+		for (int test = 0; test < 2000; test++)
+		{
+			int32_t p_lat = c_lat + (rand() % 240000) - 120000;
+			int32_t p_lon = c_lon + (rand() % 240000) - 120000;
+			double nearest = 1e12;
+			for (int idx = 0, prev = 23; idx < 24; prev = idx++)
+			{
+				double distance = segment_distance(lat[prev], lon[prev], lat[idx], lon[idx], p_lat, p_lon);
+				nearest = distance < nearest ? distance : nearest;
+			}
+			if (nearest < 2)
+			{
+				// Rounding of the reference decides points on the edge
+				continue;
+			}
+			bool expected = reference_inside(lat, lon, 24, p_lat, p_lon);
+			if ((fence.check(p_lat, p_lon) != 0) != expected)
+			{
+				mismatch++;
+			}
+		}
+		CHECK_EQ(mismatch, 0);
+	}
+}
+
+static void test_circle(void)
+{
+	fence.clear();
+	int32_t lat = 144220000;
+	int32_t lon = 1210070000;
+	CHECK(fence.addCircle(5, GEOFENCE_HOME, lat, lon, 100));
+	CHECK_EQ(fence.homeMask(), 1UL << 5);
+	// 100m north is about 8983 units
+	CHECK_EQ(fence.check(lat + 8900, lon), 1UL << 5);
+	CHECK_EQ(fence.check(lat + 9100, lon), 0);
+	CHECK_EQ(fence.check(lat, lon + 9200), 1UL << 5);
+	CHECK_EQ(fence.check(lat, lon + 9400), 0);
+	CHECK_NEAR(fence.boundaryDistance(lat, lon), 100, 1);
+	// A circle has only one point
+	CHECK(!fence.addPoint(5, 0, lat, lon));
+	CHECK(!fence.addCircle(6, 0, lat, lon, 0));
+	// Replaced with the same ID
+	CHECK(fence.addCircle(5, 0, lat, lon, 200));
+	CHECK_EQ(fence.zones(), 1);
+	CHECK_EQ(fence.homeMask(), 0);
+	CHECK_EQ(fence.check(lat + 9100, lon), 1UL << 5);
+}
+
+static void test_circle_wrap(void)
+{
+	// Across the antimeridian, the box must not overflow or invert
+	fence.clear();
+	CHECK(fence.addCircle(1, 0, 0, 1799990000, 1000));
+	CHECK_EQ(fence.check(0, 1799990000), 1UL << 1);
+	CHECK_EQ(fence.check(0, -1799990000), 1UL << 1);
+	CHECK_EQ(fence.check(0, 1799700000), 0);
+	CHECK_EQ(fence.check(0, -1799700000), 0);
+	CHECK_EQ(fence.check(200000, 1799990000), 0);
+
+	// Around the poles all longitudes are in the box
+	fence.clear();
+	CHECK(fence.addCircle(2, 0, 899950000, 0, 5000));
+	CHECK(fence.addCircle(3, 0, -899950000, 1790000000, 5000));
+	CHECK_EQ(fence.check(899950000, 900000000), 1UL << 2);
+	CHECK_EQ(fence.check(899950000, -1800000000), 1UL << 2);
+	CHECK_EQ(fence.check(-899950000, -900000000), 1UL << 3);
+	CHECK_EQ(fence.check(899000000, 0), 0);
+	CHECK_EQ(fence.check(-899000000, 1790000000), 0);
+}
+
+static void test_limits(void)
+{
+	fence.clear();
+	CHECK(!fence.addPoint(GEOFENCE_MAX_ZONES, 0, 0, 0));
+	for (uint8_t id = 0; id < GEOFENCE_MAX_ZONES; id++)
+	{
+		add_square(id, id == 31 ? GEOFENCE_HOME : 0, id * TILE, 0, TILE / 2, true);
+	}
+	CHECK_EQ(fence.zones(), GEOFENCE_MAX_ZONES);
+	CHECK_EQ(fence.homeMask(), 1UL << 31);
+	CHECK_EQ(fence.check(31 * TILE + 1, 1), 1UL << 31);
+
+	// Points of the last zone, then the point limit
+	uint16_t added = fence.points();
+	while (fence.addPoint(0, 0, 2, 2))
+	{
+		added++;
+	}
+	CHECK_EQ(added, GEOFENCE_MAX_POINTS);
+
+	// Removing a zone in the middle keeps the other zones
+	CHECK(fence.remove(10));
+	CHECK(!fence.remove(10));
+	CHECK_EQ(fence.check(10 * TILE + 1, 1), 0);
+	CHECK_EQ(fence.check(11 * TILE + 1, 1), 1UL << 11);
+	CHECK_EQ(fence.check(31 * TILE + 1, 1), 1UL << 31);
+
+	// Overlapping zones set both bits
+	fence.clear();
+	add_square(1, 0, 0, 0, TILE, true);
+	add_square(2, 0, TILE / 2, TILE / 2, TILE, false);
+	CHECK_EQ(fence.check(TILE * 3 / 4, TILE * 3 / 4), (1UL << 1) | (1UL << 2));
+}
+
+int main(void)
+{
+	test_square();
+	test_shared_edges(true);
+	test_shared_edges(false);
+	test_reference();
+	test_circle();
+	test_circle_wrap();
+	test_limits();
+	return TEST_RESULT();
+}
@@ -0,0 +1,189 @@
+/**
+ * @file test_hex_cell.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the hexagon cell index against a floating point reference
+ *        and of the recently mapped cells
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+#include <math.h>
+
+#include "test_util.h"
+#include "hex_cell.h"
+#include "geo_math.h"
+
+/** Centimeters per degree, the same as GEO_M_PER_DEG */
+#define REF_CM_PER_DEG (GEO_M_PER_DEG * 100.0)
+
+/**
+ * @brief Reference cell of a point of the sinusoidal projection
+ *        Standard cube rounding of pointy top axial coordinates
+ */
+static void reference_cell(double x, double y, double edge_cm, int64_t *q, int64_t *r)
+{
+	double frac_q = (sqrt(3.0) / 3.0 * x - y / 3.0) / edge_cm;
+	double frac_r = (2.0 / 3.0 * y) / edge_cm;
+	double frac_s = -frac_q - frac_r;
+	double round_q = round(frac_q);
+	double round_r = round(frac_r);
+	double round_s = round(frac_s);
+	double diff_q = fabs(round_q - frac_q);
+	double diff_r = fabs(round_r - frac_r);
+	double diff_s = fabs(round_s - frac_s);
+	if ((diff_q > diff_r) && (diff_q > diff_s))
+	{
+		round_q = -round_r - round_s;
+	}
+	else if (diff_r > diff_s)
+	{
+		round_r = -round_q - round_s;
+	}
+	*q = (int64_t)round_q;
+	*r = (int64_t)round_r;
+}
+
+/**
+ * @brief Check a location against the reference
+ *        A difference is accepted only within 50cm of a cell boundary,
+ *        the integer cosine and the truncation to centimeters move the point that much.
+ *
+ * @return true if the cell is the same as the reference or the location is on a boundary
+ */
+static bool matches_reference(int32_t latitude, int32_t longitude, uint16_t edge, bool *on_boundary)
+{
+	double lat = latitude / 1e7;
+	double y = lat * REF_CM_PER_DEG;
+	double x = longitude / 1e7 * REF_CM_PER_DEG * cos(lat * M_PI / 180.0);
+	int64_t q;
+	int64_t r;
+	reference_cell(x, y, edge * 100.0, &q, &r);
+	uint64_t cell = hex_cell(latitude, longitude, edge);
+	*on_boundary = false;
+	if ((hex_cell_q(cell) == q) && (hex_cell_r(cell) == r))
+	{
+		return true;
+	}
+	static const double shift[8][2] = {{50, 0}, {-50, 0}, {0, 50}, {0, -50}, {35, 35}, {-35, 35}, {35, -35}, {-35, -35}};
+	for (int idx = 0; idx < 8; idx++)
+	{
+		int64_t other_q;
+		int64_t other_r;
+		reference_cell(x + shift[idx][0], y + shift[idx][1], edge * 100.0, &other_q, &other_r);
+		if ((hex_cell_q(cell) == other_q) && (hex_cell_r(cell) == other_r))
+		{
+			*on_boundary = true;
+			return true;
+		}
+	}
+	fprintf(stderr, "lat %d lon %d edge %d: q %d r %d, reference q %lld r %lld\n", latitude, longitude, edge,
+			hex_cell_q(cell), hex_cell_r(cell), (long long)q, (long long)r);
+	return false;
+}
+
+static void test_reference(void)
+{
+	static const uint16_t edges[] = {5, 25, 100, 460, 1000, 10000, 65535};
+	srand(29);
+	for (size_t edge = 0; edge < sizeof(edges) / sizeof(edges[0]); edge++)
+	{
+		uint32_t mismatch = 0;
+		uint32_t boundary = 0;
+		for (int test = 0; test < 50000; test++)
+		{
+			// Up to 89.9°, the cells close to the poles are very wide
+			int32_t latitude = (int32_t)((rand() % 1798000001) - 899000000);
+			int32_t longitude = (int32_t)(((int64_t)rand() * 2 + (rand() & 1)) % 3600000001LL - 1800000000);
+			bool on_boundary;
+			if (!matches_reference(latitude, longitude, edges[edge], &on_boundary))
+			{
+				mismatch++;
+			}
+			boundary += on_boundary;
+		}
+		CHECK_EQ(mismatch, 0);
+		// Only few points are that close to a boundary, about 1% with 5m cells
+		CHECK(boundary < 1000);
+	}
+}
+
+static void test_cells(void)
+{
+	// Same cell for close points, neighbors for a cell width apart
+	int32_t lat = 481370000;
+	int32_t lon = 115750000;
+	uint64_t cell = hex_cell(lat, lon, 460);
+	CHECK_EQ(hex_cell(lat, lon, 460), cell);
+	CHECK_EQ(hex_cell_q(cell), hex_cell_q(cell));
+	uint32_t same = 0;
+	for (int32_t d_lat = -3000; d_lat <= 3000; d_lat += 1000)
+	{
+		same += hex_cell(lat + d_lat, lon, 460) == cell;
+	}
+	CHECK(same >= 5);
+
+	// Negative coordinates keep their sign
+	uint64_t south_west = hex_cell(-337650000, -700000000, 100);
+	CHECK(hex_cell_q(south_west) < 0);
+	CHECK(hex_cell_r(south_west) < 0);
+
+	// Edge 0 is handled as 1m
+	CHECK_EQ(hex_cell(lat, lon, 0), hex_cell(lat, lon, 1));
+
+	// Both sides of the 180° meridian are valid cells
+	uint64_t east = hex_cell(0, 1799999999, 460);
+	uint64_t west = hex_cell(0, -1799999999, 460);
+	CHECK(hex_cell_q(east) > 0);
+	CHECK(hex_cell_q(west) < 0);
+}
+
+static void test_cache(void)
+{
+	HexCellCache cache;
+	uint32_t now = 1664900000;
+	CHECK(!cache.isFresh(1, now, 3600));
+	cache.add(1, now);
+	CHECK(cache.isFresh(1, now + 3599, 3600));
+	CHECK(!cache.isFresh(1, now + 3600, 3600));
+	CHECK(!cache.isFresh(2, now, 3600));
+
+	// Adding again refreshes the time
+	cache.add(1, now + 3000);
+	CHECK(cache.isFresh(1, now + 6000, 3600));
+	CHECK_EQ(cache.count(), 1);
+
+	// Full set replaces the least recently mapped cell
+	cache.clear();
+	for (uint32_t cell = 0; cell < HEX_CACHE_SIZE; cell++)
+	{
+		cache.add(cell, now + cell);
+	}
+	CHECK_EQ(cache.count(), HEX_CACHE_SIZE);
+	cache.add(0, now + 100);
+	cache.add(1000, now + 101);
+	CHECK_EQ(cache.count(), HEX_CACHE_SIZE);
+	CHECK(cache.isFresh(0, now + 101, 3600));
+	CHECK(!cache.isFresh(1, now + 101, 3600));
+	CHECK(cache.isFresh(2, now + 101, 3600));
+	CHECK(cache.isFresh(1000, now + 101, 3600));
+
+	// Cells restored after a long time off are stale
+	HexCellCache restored;
+	for (uint8_t idx = 0; idx < cache.count(); idx++)
+	{
+		restored.add(cache.getEntry(idx)->cell, cache.getEntry(idx)->time);
+	}
+	CHECK(restored.isFresh(1000, now + 200, 3600));
+	CHECK(!restored.isFresh(1000, now + 86400, 3600));
+}
+
+int main(void)
+{
+	test_reference();
+	test_cells();
+	test_cache();
+	return TEST_RESULT();
+}
@@ -0,0 +1,330 @@
+/**
+ * @file test_ingest.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the ingest service
+ *        AES, CMAC and LoRaWAN frames against published vectors, the packet
+ *        forwarder protocol and the service over UDP on the loopback interface.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "test_util.h"
+#include "ingest_service.h"
+#include "semtech_udp.h"
+#include "lpp_schema.h"
+
+/** Hex string to bytes */
+static size_t from_hex(const char *hex, uint8_t *out)
+{
+	size_t size = 0;
+	unsigned value;
+	while ((hex[0] != 0) && (sscanf(hex, "%2x", &value) == 1))
+	{
+		out[size++] = (uint8_t)value;
+		hex += 2;
+	}
+	return size;
+}
+
+static void test_crypto(void)
+{
+	// FIPS-197 appendix C.1
+	uint8_t raw[16];
+	uint8_t block[16];
+	uint8_t expected[16];
+	aes128_key_s key;
+	from_hex("000102030405060708090a0b0c0d0e0f", raw);
+	from_hex("00112233445566778899aabbccddeeff", block);
+	from_hex("69c4e0d86a7b0430d8cdb78070b4c55a", expected);
+	aes128_init(&key, raw);
+	aes128_encrypt(&key, block, block);
+	CHECK(memcmp(block, expected, 16) == 0);
+
+	// RFC 4493 examples 1 to 4
+	from_hex("2b7e151628aed2a6abf7158809cf4f3c", raw);
+	aes128_init(&key, raw);
+	uint8_t message[64];
+	from_hex("6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+			 "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710",
+			 message);
+	const char *macs[] = {"bb1d6929e95937287fa37d129b756746", "070a16b46b4d4144f79bdd9dd04a287c",
+						  "dfa66747de9ae63030ca32611497c827", "51f0bebf7e3b9d92fc49741779363cfe"};
+	size_t sizes[] = {0, 16, 40, 64};
+	for (uint8_t idx = 0; idx < 4; idx++)
+	{
+		uint8_t mac[16];
+		aes_cmac(&key, message, sizes[idx], mac);
+		from_hex(macs[idx], expected);
+		CHECK(memcmp(mac, expected, 16) == 0);
+	}
+}
+
+static void test_frame(void)
+{
+	// Published example uplink, FRMPayload "test"
+	uint8_t phy[LORAWAN_MAX_SIZE];
+	size_t size = from_hex("40F17DBE4900020001954378762B11FF0D", phy);
+	uint8_t raw[16];
+	aes128_key_s nwk_skey;
+	aes128_key_s app_skey;
+	CHECK(lorawan_parse_key("44024241ed4ce9a68c6a8bc055233fd3", raw));
+	aes128_init(&nwk_skey, raw);
+	CHECK(lorawan_parse_key("ec925802ae430ca77fd3dd73cb2cc588", raw));
+	aes128_init(&app_skey, raw);
+	CHECK(!lorawan_parse_key("ec925802ae430ca77fd3dd73cb2cc58", raw));
+	CHECK(!lorawan_parse_key("ec925802ae430ca77fd3dd73cb2cc58x", raw));
+
+	lorawan_frame_s frame;
+	CHECK(lorawan_parse(phy, size, &frame));
+	CHECK_EQ(frame.mtype, LORAWAN_UNCONFIRMED_UP);
+	CHECK_EQ(frame.devaddr, 0x49BE7DF1);
+	CHECK_EQ(frame.fcnt, 2);
+	CHECK_EQ(frame.fport, 1);
+	CHECK_EQ(frame.payload_size, 4);
+	CHECK_EQ(lorawan_mic(&nwk_skey, phy, size - 4, frame.devaddr, frame.fcnt), frame.mic);
+	uint8_t payload[4];
+	memcpy(payload, frame.payload, 4);
+	lorawan_crypt(&app_skey, payload, 4, frame.devaddr, frame.fcnt);
+	CHECK(memcmp(payload, "test", 4) == 0);
+
+	// Built the same
+	uint8_t built[LORAWAN_MAX_SIZE];
+	CHECK_EQ(lorawan_build(&nwk_skey, &app_skey, 0x49BE7DF1, 2, 1, (const uint8_t *)"test", 4, false, built), size);
+	CHECK(memcmp(built, phy, size) == 0);
+
+	// Long payload over several blocks
+	uint8_t long_payload[100];
+	for (uint8_t idx = 0; idx < sizeof(long_payload); idx++)
+	{
+		long_payload[idx] = idx;
+	}
+	size = lorawan_build(&nwk_skey, &app_skey, 0x26011234, 0x12345, 12, long_payload, 100, true, built);
+	CHECK_EQ(size, 100 + LORAWAN_OVERHEAD);
+	CHECK(lorawan_parse(built, size, &frame));
+	CHECK_EQ(frame.mtype, LORAWAN_CONFIRMED_UP);
+	CHECK_EQ(frame.fcnt, 0x2345);
+	CHECK_EQ(lorawan_mic(&nwk_skey, built, size - 4, frame.devaddr, lorawan_extend_fcnt(0x12000, frame.fcnt)), frame.mic);
+	CHECK(lorawan_mic(&nwk_skey, built, size - 4, frame.devaddr, frame.fcnt) != frame.mic);
+	lorawan_crypt(&app_skey, &built[9], 100, frame.devaddr, 0x12345);
+	CHECK(memcmp(&built[9], long_payload, 100) == 0);
+
+	// Not an uplink, too short, FOpts longer than the frame
+	phy[0] = 0x60;
+	CHECK(!lorawan_parse(phy, 17, &frame));
+	phy[0] = 0x40;
+	CHECK(!lorawan_parse(phy, 11, &frame));
+	phy[5] = 0x0F;
+	CHECK(!lorawan_parse(phy, 17, &frame));
+	// Without FPort
+	phy[5] = 0x00;
+	CHECK(lorawan_parse(phy, 12, &frame));
+	CHECK_EQ(frame.fport, -1);
+
+	// Counter roll over
+	CHECK_EQ(lorawan_extend_fcnt(0, 5), 5);
+	CHECK_EQ(lorawan_extend_fcnt(0xFFF0, 0x0003), 0x10003);
+	CHECK_EQ(lorawan_extend_fcnt(0x10003, 0xFFFE), 0xFFFE);
+	CHECK_EQ(lorawan_extend_fcnt(0x2FFFF, 0x0000), 0x30000);
+}
+
+static void test_udp(void)
+{
+	// Base64 of RFC 4648
+	char text[16];
+	CHECK_EQ(base64_encode((const uint8_t *)"foob", 4, text), 8);
+	CHECK(memcmp(text, "Zm9vYg==", 8) == 0);
+	uint8_t data[8];
+	CHECK_EQ(base64_decode("Zm9vYmFy", 8, data, sizeof(data)), 6);
+	CHECK(memcmp(data, "foobar", 6) == 0);
+	CHECK_EQ(base64_decode("Zm9vYg", 6, data, sizeof(data)), 4);
+	CHECK_EQ(base64_decode("Zm9v!g==", 8, data, sizeof(data)), -1);
+	CHECK_EQ(base64_decode("Zm9vYmFy", 8, data, 5), -1);
+
+	// PUSH_DATA of a packet forwarder, with fields that are skipped
+	const char *json = "{\"rxpk\":[{\"time\":\"2022-10-06T10:11:12.000000Z\",\"tmst\":3512348611,\"chan\":2,\"rfch\":0,"
+					   "\"freq\":866.349812,\"stat\":1,\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/6\","
+					   "\"rssi\":-35,\"lsnr\":5.1,\"size\":4,\"data\":\"Zm9vYg==\",\"rsig\":[{\"ant\":0,\"chan\":7}]},"
+					   " {\"tmst\":1,\"stat\":-1,\"rssi\":-120,\"lsnr\":-20,\"data\":\"AA==\"}],"
+					   "\"stat\":{\"time\":\"x\\\"y\",\"rxnb\":2}}";
+	udp_rxpk_s rxpk[4];
+	CHECK_EQ(udp_parse_rxpk(json, strlen(json), rxpk, 4), 2);
+	CHECK_EQ(rxpk[0].tmst, 3512348611u);
+	CHECK_EQ(rxpk[0].rssi, -35);
+	CHECK_NEAR(rxpk[0].lsnr, 5.1, 1e-6);
+	CHECK_EQ(rxpk[0].stat, 1);
+	CHECK_EQ(rxpk[0].size, 4);
+	CHECK(memcmp(rxpk[0].data, "foob", 4) == 0);
+	CHECK_EQ(rxpk[1].stat, -1);
+	CHECK_EQ(rxpk[1].size, 1);
+	CHECK_EQ(udp_parse_rxpk(json, strlen(json), rxpk, 1), 1);
+
+	// Only the gateway status, broken JSON
+	CHECK_EQ(udp_parse_rxpk("{\"stat\":{\"rxnb\":0}}", 19, rxpk, 4), 0);
+	CHECK_EQ(udp_parse_rxpk(json, strlen(json) - 1, rxpk, 4), -1);
+	CHECK_EQ(udp_parse_rxpk("{\"rxpk\":[{\"tmst\":1}]}", 21, rxpk, 4), -1);
+
+	// Built and parsed again
+	uint8_t datagram[1024];
+	rxpk[0].lsnr = -7.5;
+	size_t size = udp_build_push(datagram, sizeof(datagram), 0x1234, 0xAA555A0000000001ULL, rxpk, 2);
+	CHECK(size > UDP_DATA_HEADER_SIZE);
+	udp_header_s header;
+	CHECK(udp_parse_header(datagram, size, &header));
+	CHECK_EQ(header.identifier, UDP_PUSH_DATA);
+	CHECK_EQ(header.token, 0x1234);
+	CHECK(header.eui == 0xAA555A0000000001ULL);
+	udp_rxpk_s parsed[2];
+	CHECK_EQ(udp_parse_rxpk((const char *)&datagram[UDP_DATA_HEADER_SIZE], size - UDP_DATA_HEADER_SIZE, parsed, 2), 2);
+	CHECK_EQ(parsed[0].tmst, rxpk[0].tmst);
+	CHECK_NEAR(parsed[0].lsnr, -7.5, 1e-6);
+	CHECK_EQ(parsed[1].size, 1);
+	CHECK_EQ(udp_build_push(datagram, 100, 0x1234, 0, rxpk, 2), 0);
+
+	uint8_t ack[UDP_HEADER_SIZE];
+	CHECK_EQ(udp_build_ack(ack, &header), UDP_HEADER_SIZE);
+	CHECK_EQ(ack[3], UDP_PUSH_ACK);
+	CHECK_EQ(ack[1], 0x12);
+	header.identifier = UDP_TX_ACK;
+	CHECK_EQ(udp_build_ack(ack, &header), 0);
+	uint8_t pull[UDP_DATA_HEADER_SIZE] = {UDP_VERSION, 0, 1, UDP_PULL_DATA};
+	CHECK(udp_parse_header(pull, sizeof(pull), &header));
+	CHECK_EQ(udp_build_ack(ack, &header), UDP_HEADER_SIZE);
+	CHECK_EQ(ack[3], UDP_PULL_ACK);
+	CHECK(!udp_parse_header(pull, 8, &header));
+	pull[0] = 1;
+	CHECK(!udp_parse_header(pull, sizeof(pull), &header));
+}
+
+/** Sends one frame from a gateway socket and waits for the PUSH_ACK */
+static bool send_frame(int socket, uint64_t eui, const uint8_t *phy, uint16_t size)
+{
+	udp_rxpk_s rxpk;
+	memset(&rxpk, 0, sizeof(rxpk));
+	rxpk.stat = 1;
+	rxpk.tmst = 1000;
+	rxpk.rssi = -80;
+	rxpk.size = size;
+	memcpy(rxpk.data, phy, size);
+	uint8_t datagram[1024];
+	size_t length = udp_build_push(datagram, sizeof(datagram), 7, eui, &rxpk, 1);
+	if (send(socket, datagram, length, 0) != (ssize_t)length)
+	{
+		return false;
+	}
+	uint8_t ack[16];
+	udp_header_s header;
+	ssize_t received = recv(socket, ack, sizeof(ack), 0);
+	return (received > 0) && udp_parse_header(ack, received, &header) && (header.identifier == UDP_PUSH_ACK);
+}
+
+/** Wait until the service handled count frames */
+static void wait_for(IngestService *service, uint64_t count)
+{
+	for (uint16_t loop = 0; loop < 1000; loop++)
+	{
+		ingest_stats_s stats = service->stats();
+		if (stats.uplinks + stats.bad_mic + stats.decode_errors >= count)
+		{
+			return;
+		}
+		usleep(1000);
+	}
+}
+
+static void test_service(void)
+{
+	ingest_options_s options;
+	memset(&options, 0, sizeof(options));
+	options.workers = 2;
+	options.dedup_ms = 60000;
+	options.check_mic = true;
+	memset(options.nwk_skey, 0x11, 16);
+	memset(options.app_skey, 0x22, 16);
+	aes128_key_s nwk_skey;
+	aes128_key_s app_skey;
+	aes128_init(&nwk_skey, options.nwk_skey);
+	aes128_init(&app_skey, options.app_skey);
+
+	FILE *csv = tmpfile();
+	CsvSink sink(csv);
+	IngestService service(&sink);
+	CHECK(service.begin(&options));
+	CHECK(service.port() != 0);
+
+	int sockets[2];
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(service.port());
+	timeval timeout = {1, 0};
+	for (uint8_t idx = 0; idx < 2; idx++)
+	{
+		sockets[idx] = socket(AF_INET, SOCK_DGRAM, 0);
+		setsockopt(sockets[idx], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		CHECK_EQ(connect(sockets[idx], (sockaddr *)&address, sizeof(address)), 0);
+	}
+
+	// Battery packet, received by both gateways, then the next one after the roll over of the 16 bit counter
+	uint8_t payload[16];
+	uint8_t size = lpp_put<LPP_CHANNEL_BATT>(payload, 390);
+	uint8_t phy[LORAWAN_MAX_SIZE];
+	uint16_t phy_size = lorawan_build(&nwk_skey, &app_skey, 0x26010001, 0xFFFF, 2, payload, size, false, phy);
+	CHECK(send_frame(sockets[0], 1, phy, phy_size));
+	CHECK(send_frame(sockets[1], 2, phy, phy_size));
+	phy_size = lorawan_build(&nwk_skey, &app_skey, 0x26010001, 0x10000, 2, payload, size, false, phy);
+	CHECK(send_frame(sockets[1], 2, phy, phy_size));
+
+	// Wrong key
+	aes128_key_s wrong;
+	memset(payload, 0x33, 16);
+	aes128_init(&wrong, payload);
+	size = lpp_put<LPP_CHANNEL_BATT>(payload, 391);
+	phy_size = lorawan_build(&wrong, &app_skey, 0x26010002, 1, 2, payload, size, false, phy);
+	CHECK(send_frame(sockets[0], 1, phy, phy_size));
+
+	// Not a data frame
+	phy[0] = 0x00;
+	CHECK(send_frame(sockets[1], 2, phy, phy_size));
+	wait_for(&service, 3);
+	service.end();
+
+	ingest_stats_s stats = service.stats();
+	CHECK_EQ(stats.datagrams, 5);
+	CHECK_EQ(stats.acks, 5);
+	CHECK_EQ(stats.frames, 5);
+	CHECK_EQ(stats.duplicates, 1);
+	CHECK_EQ(stats.bad_frames, 1);
+	CHECK_EQ(stats.bad_mic, 1);
+	CHECK_EQ(stats.uplinks, 2);
+	CHECK_EQ(stats.values, 2);
+
+	char line[128] = {0};
+	rewind(csv);
+	CHECK(fgets(line, sizeof(line), csv) != NULL);
+	CHECK(strcmp(line, "26010001,65535,2,1,116,voltage,3.9,0,0\n") == 0);
+	CHECK(fgets(line, sizeof(line), csv) != NULL);
+	CHECK(strcmp(line, "26010001,65536,2,1,116,voltage,3.9,0,0\n") == 0);
+	CHECK(fgets(line, sizeof(line), csv) == NULL);
+	fclose(csv);
+	close(sockets[0]);
+	close(sockets[1]);
+}
+
+int main(void)
+{
+	test_crypto();
+	test_frame();
+	test_udp();
+	test_service();
+	return TEST_RESULT();
+}
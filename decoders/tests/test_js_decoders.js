@@ -0,0 +1,75 @@
+// Decodes the fPort 11, 12 and 14 frames of ports.txt with all JS decoders and compares the results
+// Usage: node test_js_decoders.js <decoders folder>
+var fs = require('fs');
+var vm = require('vm');
+var path = require('path');
+
+var folder = process.argv[2];
+var failures = 0;
+
+function check(name, cond, message) {
+	if (!cond) {
+		console.error(name + ': ' + message);
+		failures++;
+	}
+}
+
+function hexToBytes(hex) {
+	var bytes = [];
+	for (var i = 0; i < hex.length; i += 2) {
+		bytes.push(parseInt(hex.substr(i, 2), 16));
+	}
+	return bytes;
+}
+
+var LINK_MAP = hexToBytes('01CCFFF51F001E5402656361FD0105');
+var BATCH = hexToBytes('03A4A7EF0EE49A2A622F801E');
+
+// Each integration has its own entry point and result wrapper
+var decoders = {
+	'TTN-Ext-LPP-Decoder.js': function (c, port, bytes) { return c.Decoder(bytes, port).data; },
+	'Helium-Ext-LPP-Decoder.js': function (c, port, bytes) { return c.Decoder(bytes, port, {}).data; },
+	'Chirpstack-Ext-LPP-Decoder.js': function (c, port, bytes) { return c.Decode(port, bytes, {}).data; },
+	'Datacake-Ext-LPP-Decoder.js': function (c, port, bytes) { return c.Decoder(bytes, port); }
+};
+
+Object.keys(decoders).forEach(function (file) {
+	var context = {};
+	vm.createContext(context);
+	vm.runInContext(fs.readFileSync(path.join(folder, file), 'utf8'), context);
+	var decode = function (port, bytes) {
+		return decoders[file](context, port, bytes);
+	};
+
+	var cells = decode(11, LINK_MAP).cells;
+	check(file, cells.length == 1, 'fPort 11 cells ' + cells.length);
+	var cell = cells[0];
+	check(file, (cell.edge == 460) && (cell.q == -2785) && (cell.r == 7764) && (cell.count == 2),
+		'fPort 11 cell ' + JSON.stringify(cell));
+	check(file, (cell.rssi_min == -101) && (cell.rssi_mean == -99) && (cell.rssi_max == -97),
+		'fPort 11 RSSI ' + JSON.stringify(cell));
+	check(file, (cell.snr_min == -3) && (cell.snr_mean == 1) && (cell.snr_max == 5),
+		'fPort 11 SNR ' + JSON.stringify(cell));
+
+	var threw = false;
+	try {
+		decode(11, LINK_MAP.slice(0, 14));
+	} catch (e) {
+		threw = true;
+	}
+	check(file, threw, 'fPort 11 short frame accepted');
+
+	var locations = decode(12, BATCH).locations;
+	check(file, locations.length == 1, 'fPort 12 locations ' + locations.length);
+	check(file, (Math.abs(locations[0].latitude - 48.1234567) < 1e-6) && (locations[0].age == 30),
+		'fPort 12 location ' + JSON.stringify(locations[0]));
+
+	var queued = decode(14, [0x00, 0x01, 0x02, 11].concat(LINK_MAP));
+	check(file, (queued.age == 258) && (queued.cells.length == 1), 'fPort 14 ' + JSON.stringify(queued));
+});
+
+if (failures > 0) {
+	console.error(failures + ' failures');
+	process.exit(1);
+}
+console.log('JS decoders OK');
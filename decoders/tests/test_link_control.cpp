@@ -0,0 +1,230 @@
+/**
+ * @file test_link_control.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the data rate and TX power controller with synthetic link traces
+ * @version 0.1
+ * @date 2022-10-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+
+#include "test_util.h"
+#include "link_control.h"
+#include "airtime.h"
+
+/** EU868, DR0 to DR5 are SF12 to SF7 with 125 kHz */
+#define REGION_EU868 5
+#define SIM_MIN_DR 0
+#define SIM_MAX_DR 5
+#define SIM_PAYLOAD 20
+
+/** Link traces, margin of the path at DR0 and full power in dB */
+#define TRACE_STATIC 0	// 30 dB, 1 dB noise
+#define TRACE_FADE 1	// tracker drives away, 30 dB down to 4 dB and back
+#define TRACE_BUILDING 2 // 30 dB, then 3 dB inside a building, then 30 dB again
+#define TRACE_NOISY 3	// 20 dB with 3 dB noise
+
+#define SIM_UPLINKS 600
+
+struct sim_result_s
+{
+	uint32_t delivered;
+	uint32_t changes;		 // uplinks with other settings than the one before
+	uint32_t fallbacks;		 // robust settings after missed ACKs
+	uint64_t airtime;		 // us
+	uint8_t last_dr;
+	uint8_t last_power;
+	int32_t building_lost;	 // uplinks lost after entering the building
+};
+
+/**
+ * @brief Margin of the path at DR0 and full power
+ *
+ * @param trace TRACE_STATIC, TRACE_FADE, TRACE_BUILDING or TRACE_NOISY
+ * @param uplink number of the uplink
+ * @return double margin in dB
+ */
+static double trace_margin(uint8_t trace, uint32_t uplink)
+{
+	double noise = (rand() % 201 - 100) / 100.0;
+	switch (trace)
+	{
+	case TRACE_FADE:
+		if (uplink < 300)
+		{
+			return 30 - 26.0 * uplink / 300 + noise;
+		}
+		return 4 + 26.0 * (uplink - 300) / 300 + noise;
+	case TRACE_BUILDING:
+		return ((uplink >= 200) && (uplink < 400) ? 3 : 30) + noise;
+	case TRACE_NOISY:
+		return 20 + 3 * noise;
+	default:
+		return 30 + noise;
+	}
+}
+
+/**
+ * @brief Send SIM_UPLINKS confirmed uplinks over a trace
+ *        The margin with the selected settings is the path margin minus 2.5 dB
+ *        per data rate step and 2 dB per TX power step. An uplink and its ACK
+ *        get through if the margin is not negative, the ACK brings a margin sample.
+ *
+ * @param trace link trace
+ * @param adaptive true for the controller, false for DR0 and full power
+ * @param hysteresis hysteresis of the controller in dB
+ * @param result counts of the run
+ */
+static void run_trace(uint8_t trace, bool adaptive, uint8_t hysteresis, sim_result_s *result)
+{
+	LinkControl control;
+	control.begin(adaptive ? LINK_CTL_ADAPTIVE : LINK_CTL_OFF, LINK_CTL_TARGET, hysteresis);
+	control.setRange(SIM_MIN_DR, SIM_MAX_DR, LINK_CTL_POWER_STEPS);
+
+	*result = sim_result_s();
+	result->building_lost = 0;
+	srand(49);
+	for (uint32_t uplink = 0; uplink < SIM_UPLINKS; uplink++)
+	{
+		uint8_t old_dr = control.datarate();
+		uint8_t old_power = control.power();
+		control.update();
+		if ((control.datarate() != old_dr) || (control.power() != old_power))
+		{
+			result->changes++;
+		}
+		result->airtime += airtime_uplink(REGION_EU868, control.datarate(), SIM_PAYLOAD);
+
+		double margin = trace_margin(trace, uplink) - 2.5 * (control.datarate() - SIM_MIN_DR) - 2.0 * control.power();
+		bool ack = margin >= 0;
+		if (ack)
+		{
+			result->delivered++;
+			control.sample((int8_t)(margin + 0.5));
+		}
+		else if ((trace == TRACE_BUILDING) && (uplink >= 200) && (uplink < 400))
+		{
+			result->building_lost++;
+		}
+		if (control.acked(ack))
+		{
+			result->fallbacks++;
+			CHECK_EQ(control.datarate(), SIM_MIN_DR);
+			CHECK_EQ(control.power(), 0);
+		}
+	}
+	result->last_dr = control.datarate();
+	result->last_power = control.power();
+}
+
+static void test_steps(void)
+{
+	LinkControl control;
+	control.begin(LINK_CTL_ADAPTIVE, 10, 3);
+	control.setRange(0, 5, 3);
+	CHECK_EQ(control.datarate(), 0);
+	CHECK_EQ(control.power(), 0);
+	int8_t margin;
+	CHECK(!control.estimate(&margin));
+	CHECK(!control.update());
+
+	// 20 dB at DR0: 10 dB spare, DR up while 2.5 dB plus 3 dB hysteresis are left
+	control.sample(20);
+	CHECK(control.update());
+	CHECK_EQ(control.datarate(), 2);
+	CHECK_EQ(control.power(), 0);
+	CHECK(control.estimate(&margin));
+	CHECK_EQ(margin, 15);
+
+	// The lower of average and last sample, a falling link is followed at once
+	control.sample(6);
+	CHECK(control.update());
+	CHECK_EQ(control.datarate(), 0);
+	CHECK(control.estimate(&margin));
+	CHECK_EQ(margin, 11);
+
+	// Plenty of margin, highest DR first, then less power
+	control.reset(0, 0);
+	control.sample(40);
+	CHECK(control.update());
+	CHECK_EQ(control.datarate(), 5);
+	CHECK_EQ(control.power(), 3);
+	CHECK(!control.update());
+
+	// Range limits of reset()
+	control.reset(9, 9);
+	CHECK_EQ(control.datarate(), 5);
+	CHECK_EQ(control.power(), 3);
+	CHECK(!control.estimate(&margin));
+
+	// Missed ACKs fall back to the robust settings
+	CHECK(!control.acked(false));
+	CHECK(control.acked(false));
+	CHECK_EQ(control.datarate(), 0);
+	CHECK_EQ(control.power(), 0);
+	CHECK(!control.acked(false));
+	CHECK(!control.acked(true));
+
+	// Off mode never changes the settings
+	control.begin(LINK_CTL_OFF, 10, 3);
+	control.reset(3, 0);
+	control.sample(40);
+	CHECK(!control.update());
+	CHECK(!control.acked(false));
+	CHECK(!control.acked(false));
+	CHECK_EQ(control.datarate(), 3);
+
+	CHECK_EQ(link_ctl_max_power(REGION_EU868), 7);
+	CHECK_EQ(link_ctl_max_power(200), 0);
+}
+
+static void test_traces(void)
+{
+	static const char *names[] = {"static", "fade", "building", "noisy"};
+	sim_result_s fixed;
+	sim_result_s adaptive;
+	for (uint8_t trace = TRACE_STATIC; trace <= TRACE_NOISY; trace++)
+	{
+		run_trace(trace, false, LINK_CTL_HYSTERESIS, &fixed);
+		run_trace(trace, true, LINK_CTL_HYSTERESIS, &adaptive);
+		printf("%-8s  DR0: %u delivered, %.0f s airtime  adaptive: %u delivered, %.0f s airtime, %u changes, %u fallbacks\n",
+			   names[trace], fixed.delivered, fixed.airtime / 1e6, adaptive.delivered, adaptive.airtime / 1e6,
+			   adaptive.changes, adaptive.fallbacks);
+
+		CHECK_EQ(fixed.changes, 0);
+		// Less airtime than DR0, a quarter of it on good links, and almost nothing lost
+		CHECK(adaptive.airtime * 2 < fixed.airtime);
+		CHECK((trace == TRACE_FADE) || (trace == TRACE_BUILDING) || (adaptive.airtime * 4 < fixed.airtime));
+		CHECK(adaptive.delivered >= fixed.delivered * 97 / 100);
+	}
+
+	// Good static link ends at the fastest DR with less power and does not hunt
+	run_trace(TRACE_STATIC, true, LINK_CTL_HYSTERESIS, &adaptive);
+	CHECK_EQ(adaptive.last_dr, SIM_MAX_DR);
+	CHECK(adaptive.last_power > 0);
+	CHECK(adaptive.changes <= 4);
+	CHECK_EQ(adaptive.fallbacks, 0);
+
+	// Inside the building the robust settings are used after LINK_CTL_MISSED lost uplinks
+	run_trace(TRACE_BUILDING, true, LINK_CTL_HYSTERESIS, &adaptive);
+	CHECK(adaptive.fallbacks >= 1);
+	CHECK(adaptive.building_lost <= LINK_CTL_MISSED);
+	CHECK_EQ(adaptive.last_dr, SIM_MAX_DR);
+
+	// The hysteresis keeps a noisy link from changing the settings all the time
+	sim_result_s no_hysteresis;
+	run_trace(TRACE_NOISY, true, LINK_CTL_HYSTERESIS, &adaptive);
+	run_trace(TRACE_NOISY, true, 0, &no_hysteresis);
+	printf("noisy link: %u changes with %d dB hysteresis, %u without\n", adaptive.changes, LINK_CTL_HYSTERESIS,
+		   no_hysteresis.changes);
+	CHECK(adaptive.changes * 2 < no_hysteresis.changes);
+}
+
+int main(void)
+{
+	test_steps();
+	test_traces();
+	return TEST_RESULT();
+}
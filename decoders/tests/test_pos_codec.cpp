@@ -0,0 +1,220 @@
+/**
+ * @file test_pos_codec.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Round trip tests of the batch location codec
+ *        Every decoded location must be within half a step of the original,
+ *        for random locations, the range limits and a recorded track.
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+
+#include "test_util.h"
+#include "test_track.h"
+#include "pos_codec.h"
+
+static const int32_t pos_steps[] = {1, 10, 100, 1000};
+static const int32_t alt_steps[] = {1, 10, 100, 1000};
+
+static int32_t random_range(int32_t min, int32_t max)
+{
+	uint32_t random = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+	return (int32_t)(min + (int64_t)(random % ((uint64_t)max - min + 1)));
+}
+
+/**
+ * @brief Encode the points into as many frames as needed and check the decoded points
+ *
+ * @return uint32_t number of frames
+ */
+static uint32_t round_trip(const pos_point_s *points, uint32_t count, uint8_t max_size, uint8_t pos_res, uint8_t alt_res)
+{
+	uint8_t frame[255];
+	uint32_t frames = 0;
+	uint32_t next = 0;
+	while (next < count)
+	{
+		PosEncoder encoder;
+		encoder.begin(frame, max_size, pos_res, alt_res);
+		uint32_t first = next;
+		while ((next < count) && encoder.add(&points[next]))
+		{
+			next++;
+		}
+		if (next == first)
+		{
+			fprintf(stderr, "point %u does not fit into %u bytes\n", next, max_size);
+			test_failures++;
+			return frames;
+		}
+		CHECK(encoder.getSize() <= max_size);
+		CHECK_EQ(encoder.count(), next - first);
+		frames++;
+
+		PosDecoder decoder;
+		CHECK(decoder.begin(frame, encoder.getSize()));
+		pos_point_s point;
+		for (uint32_t idx = first; idx < next; idx++)
+		{
+			if (!decoder.next(&point))
+			{
+				fprintf(stderr, "point %u missing\n", idx);
+				test_failures++;
+				return frames;
+			}
+			CHECK_NEAR(point.latitude, points[idx].latitude, pos_steps[pos_res] / 2);
+			CHECK_NEAR(point.longitude, points[idx].longitude, pos_steps[pos_res] / 2);
+			CHECK_NEAR(point.altitude, points[idx].altitude, alt_steps[alt_res] / 2);
+			CHECK_EQ(point.time, points[idx].time);
+		}
+		CHECK(!decoder.next(&point));
+	}
+	return frames;
+}
+
+static void test_random(void)
+{
+	srand(31);
+	static pos_point_s points[2000];
+	for (uint8_t pos_res = POS_RES_1E7; pos_res <= POS_RES_1E4; pos_res++)
+	{
+		for (uint8_t alt_res = ALT_RES_MM; alt_res <= ALT_RES_M; alt_res++)
+		{
+			// Random walk with steps of all sizes, from GNSS noise to jumps around the world
+			pos_point_s point = {0, 0, 0, 1664900000};
+			for (uint32_t idx = 0; idx < 2000; idx++)
+			{
+				int32_t jump = (int32_t)1 << (rand() % 31);
+				point.latitude = random_range(-900000000, 900000000);
+				if (idx % 4 != 0)
+				{
+					point.latitude = points[idx - 1].latitude + random_range(-jump / 2, jump / 2);
+					point.latitude = point.latitude > 900000000 ? 900000000 : point.latitude;
+					point.latitude = point.latitude < -900000000 ? -900000000 : point.latitude;
+				}
+				point.longitude = random_range(-1800000000, 1800000000);
+				point.altitude = random_range(-1000000, 9000000);
+				point.time += rand() % 3600;
+				points[idx] = point;
+			}
+			round_trip(points, 2000, 51, pos_res, alt_res);
+			round_trip(points, 2000, 242, pos_res, alt_res);
+		}
+	}
+}
+
+static void test_limits(void)
+{
+	// Largest possible deltas between the corners of the ranges
+	pos_point_s points[6] = {
+		{-900000000, -1800000000, -1000000, 0},
+		{900000000, 1800000000, 9000000, 0xFFFFFFFF},
+		{-900000000, -1800000000, -1000000, 0},
+		{900000000, -1800000000, 9000000, 1},
+		{0, 0, 0, 0x80000000},
+		{-900000000, 1800000000, -1000000, 0x7FFFFFFF},
+	};
+	for (uint8_t pos_res = POS_RES_1E7; pos_res <= POS_RES_1E4; pos_res++)
+	{
+		CHECK_EQ(round_trip(points, 6, 255, pos_res, ALT_RES_MM), 1);
+	}
+
+	// Values outside of the ranges are clamped
+	uint8_t frame[32];
+	PosEncoder encoder;
+	encoder.begin(frame, sizeof(frame), POS_RES_1E7, ALT_RES_MM);
+	pos_point_s outside = {INT32_MAX, INT32_MIN, -2000000, 5};
+	CHECK(encoder.add(&outside));
+	PosDecoder decoder;
+	CHECK(decoder.begin(frame, encoder.getSize()));
+	pos_point_s point;
+	CHECK(decoder.next(&point));
+	CHECK_EQ(point.latitude, 900000000);
+	CHECK_EQ(point.longitude, -1800000000);
+	CHECK_EQ(point.altitude, -1000000);
+}
+
+static void test_full_and_truncated(void)
+{
+	// A location that does not fit leaves the frame unchanged
+	uint8_t frame[20];
+	PosEncoder encoder;
+	encoder.begin(frame, sizeof(frame), POS_RES_1E6, ALT_RES_M);
+	pos_point_s first = {481234567, 117654321, 520000, 100};
+	pos_point_s far = {-337654321, -1511234567, 10000, 200};
+	CHECK(encoder.add(&first));
+	uint8_t size = encoder.getSize();
+	while (encoder.add(&far))
+	{
+		size = encoder.getSize();
+		far.latitude = -far.latitude;
+	}
+	CHECK_EQ(encoder.getSize(), size);
+
+	// Every truncation stops the decoder without reading beyond the end
+	uint8_t copy[20];
+	for (uint8_t length = 0; length < size; length++)
+	{
+		for (uint8_t idx = 0; idx < length; idx++)
+		{
+			copy[idx] = frame[idx];
+		}
+		PosDecoder decoder;
+		pos_point_s point;
+		uint8_t decoded = 0;
+		if (decoder.begin(copy, length))
+		{
+			while (decoder.next(&point))
+			{
+				decoded++;
+			}
+		}
+		CHECK(decoded < encoder.count());
+	}
+
+	// The first 6 digit location needs 11 bytes including the header, nothing is added to a smaller frame
+	uint8_t small_frame[11];
+	PosEncoder small;
+	small.begin(small_frame, 10, POS_RES_1E6, ALT_RES_M);
+	CHECK(!small.add(&first));
+	CHECK_EQ(small.count(), 0);
+	CHECK_EQ(small.getSize(), 1);
+	small.begin(small_frame, 11, POS_RES_1E6, ALT_RES_M);
+	CHECK(small.add(&first));
+
+	// Unknown version and resolution
+	uint8_t header = 0x40;
+	PosDecoder decoder;
+	CHECK(!decoder.begin(&header, 1));
+	header = 0x07 << 3;
+	CHECK(!decoder.begin(&header, 1));
+}
+
+static void test_track(void)
+{
+	std::vector<track_fix_s> track = read_track(TEST_DATA_DIR "/highway_track.csv");
+	CHECK(track.size() > 400);
+	std::vector<pos_point_s> points;
+	for (size_t idx = 0; idx < track.size(); idx++)
+	{
+		pos_point_s point = {track[idx].latitude, track[idx].longitude, 520000 + (int32_t)idx * 100, track[idx].time};
+		points.push_back(point);
+	}
+	// 6 digit locations in 51 byte frames (US915 DR1), 10s fixes need about 6 bytes each
+	uint32_t frames = round_trip(&points[0], points.size(), 51, POS_RES_1E6, ALT_RES_M);
+	CHECK(frames > 0);
+	CHECK(points.size() / frames >= 6);
+	round_trip(&points[0], points.size(), 242, POS_RES_1E7, ALT_RES_MM);
+}
+
+int main(void)
+{
+	test_random();
+	test_limits();
+	test_full_and_truncated();
+	test_track();
+	return TEST_RESULT();
+}
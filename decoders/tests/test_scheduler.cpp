@@ -0,0 +1,202 @@
+/**
+ * @file test_scheduler.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the job scheduler driven by a simulated clock
+ * @version 0.1
+ * @date 2022-10-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+
+#include "test_util.h"
+#include "scheduler.h"
+
+/** Jobs of the simulated device, same roles as in the firmware */
+#define JOB_POSITION 0
+#define JOB_SENSOR 1
+#define JOB_HEARTBEAT 2
+#define JOB_NUM 3
+
+/** Simulated clock in ms, the device sleeps until the next wake time */
+struct sim_clock_s
+{
+	uint32_t now;
+	uint32_t wakeups;
+};
+
+static void test_single_jobs(void)
+{
+	Scheduler scheduler;
+	uint32_t delay = 0;
+	CHECK(!scheduler.nextWake(0, &delay));
+	CHECK_EQ(scheduler.due(0), 0);
+
+	scheduler.in(3, 1000, 500);
+	scheduler.at(7, 1200);
+	CHECK(scheduler.pending(3));
+	CHECK(scheduler.pending(7));
+	CHECK(!scheduler.pending(4));
+	CHECK(scheduler.nextWake(1000, &delay));
+	CHECK_EQ(delay, 200);
+
+	// Setting a deadline again replaces it
+	scheduler.at(7, 2000);
+	CHECK(scheduler.nextWake(1000, &delay));
+	CHECK_EQ(delay, 500);
+
+	CHECK_EQ(scheduler.due(1499), 0);
+	CHECK_EQ(scheduler.due(1500), SCHED_BIT(3));
+	CHECK(!scheduler.pending(3));
+
+	// An overdue job wakes immediately
+	CHECK(scheduler.nextWake(2500, &delay));
+	CHECK_EQ(delay, 0);
+
+	scheduler.cancel(7);
+	CHECK(!scheduler.nextWake(2500, &delay));
+	CHECK_EQ(scheduler.due(2500), 0);
+
+	// Out of range jobs are ignored
+	scheduler.at(SCHED_MAX_JOBS, 100);
+	scheduler.cancel(SCHED_MAX_JOBS);
+	CHECK(!scheduler.pending(SCHED_MAX_JOBS));
+	CHECK(!scheduler.nextWake(0, &delay));
+}
+
+static void test_merge(void)
+{
+	Scheduler scheduler;
+	scheduler.setMergeWindow(5000);
+	scheduler.at(0, 10000);
+	scheduler.at(1, 14000);
+	scheduler.at(2, 15001);
+
+	// Nothing is taken before the first deadline, even with jobs in the window
+	CHECK_EQ(scheduler.due(9999), 0);
+	CHECK_EQ(scheduler.due(10000), SCHED_BIT(0) | SCHED_BIT(1));
+	CHECK(scheduler.pending(2));
+	uint32_t delay;
+	CHECK(scheduler.nextWake(10000, &delay));
+	CHECK_EQ(delay, 5001);
+
+	// The window is kept by clear()
+	scheduler.clear();
+	scheduler.at(4, 20000);
+	scheduler.at(5, 25000);
+	CHECK_EQ(scheduler.due(20000), SCHED_BIT(4) | SCHED_BIT(5));
+
+	// Exact jobs are not taken early, but other jobs merge into them
+	scheduler.setExact(SCHED_BIT(3));
+	scheduler.at(3, 30000);
+	scheduler.at(6, 32000);
+	scheduler.at(7, 34000);
+	CHECK_EQ(scheduler.due(29000), 0);
+	scheduler.at(8, 28000);
+	CHECK_EQ(scheduler.due(28000), SCHED_BIT(8) | SCHED_BIT(6));
+	CHECK(scheduler.pending(3));
+	CHECK(scheduler.nextWake(28000, &delay));
+	CHECK_EQ(delay, 2000);
+	CHECK_EQ(scheduler.due(30000), SCHED_BIT(3) | SCHED_BIT(7));
+	CHECK(!scheduler.nextWake(30000, &delay));
+}
+
+static void test_wrap_around(void)
+{
+	Scheduler scheduler;
+	scheduler.setMergeWindow(100);
+	uint32_t now = 0xFFFFFF00;
+	scheduler.in(0, now, 0x200);
+	scheduler.in(1, now, 0x150);
+	uint32_t delay;
+	CHECK(scheduler.nextWake(now, &delay));
+	CHECK_EQ(delay, 0x150);
+	CHECK_EQ(scheduler.due(now), 0);
+	CHECK_EQ(scheduler.due(now + 0x150), SCHED_BIT(1));
+	CHECK(scheduler.nextWake(now + 0x150, &delay));
+	CHECK_EQ(delay, 0xB0);
+	CHECK_EQ(scheduler.due(now + 0x1FF), 0);
+	CHECK_EQ(scheduler.due(now + 0x200), SCHED_BIT(0));
+}
+
+/**
+ * @brief Run a device for a simulated day
+ *        Position every 60 s, sensor every 45 s, heartbeat every hour, each
+ *        rescheduled from the time it really ran plus a random delay of up to 2 s,
+ *        like a GNSS fix or a sensor that takes a while.
+ *
+ * @param window merge window in ms
+ * @param runs number of runs per job
+ * @return uint32_t number of wakeups
+ */
+static uint32_t run_day(uint32_t window, uint32_t *runs)
+{
+	static const uint32_t period[JOB_NUM] = {60000, 45000, 3600000};
+	Scheduler scheduler;
+	scheduler.setMergeWindow(window);
+	sim_clock_s clock = {0x80000000, 0};
+	uint32_t start = clock.now;
+	uint32_t deadline[JOB_NUM];
+	for (uint8_t job = 0; job < JOB_NUM; job++)
+	{
+		deadline[job] = clock.now + period[job];
+		scheduler.at(job, deadline[job]);
+		runs[job] = 0;
+	}
+
+	uint32_t delay;
+	while ((clock.now - start) < 24 * 3600000UL)
+	{
+		CHECK(scheduler.nextWake(clock.now, &delay));
+		clock.now += delay;
+		clock.wakeups++;
+		uint32_t jobs = scheduler.due(clock.now);
+		CHECK(jobs != 0);
+		for (uint8_t job = 0; job < JOB_NUM; job++)
+		{
+			if ((jobs & SCHED_BIT(job)) == 0)
+			{
+				continue;
+			}
+			// Jobs are never late and never earlier than the merge window
+			int32_t early = (int32_t)(deadline[job] - clock.now);
+			CHECK(early >= 0);
+			CHECK(early <= (int32_t)window);
+			runs[job]++;
+			deadline[job] = clock.now + period[job] + (uint32_t)rand() % 2000;
+			scheduler.at(job, deadline[job]);
+		}
+	}
+	return clock.wakeups;
+}
+
+static void test_simulated_day(void)
+{
+	uint32_t runs_single[JOB_NUM];
+	uint32_t runs_merged[JOB_NUM];
+	srand(41);
+	uint32_t single = run_day(0, runs_single);
+	srand(41);
+	uint32_t merged = run_day(5000, runs_merged);
+	printf("wakeups per day: %u without merging, %u with 5 s merge window\n", single, merged);
+
+	// Without merging almost every job needs its own wakeup
+	CHECK(single > (runs_single[JOB_POSITION] + runs_single[JOB_SENSOR]) * 9 / 10);
+	// Merged jobs run a bit early, so they run a bit more often
+	for (uint8_t job = 0; job < JOB_NUM; job++)
+	{
+		CHECK(runs_merged[job] >= runs_single[job]);
+		CHECK(runs_merged[job] <= runs_single[job] * 110 / 100);
+	}
+	CHECK(merged < single * 9 / 10);
+}
+
+int main(void)
+{
+	test_single_jobs();
+	test_merge();
+	test_wrap_around();
+	test_simulated_day();
+	return TEST_RESULT();
+}
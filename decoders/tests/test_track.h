@@ -0,0 +1,55 @@
+/**
+ * @file test_track.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Reader of the simulated tracks in tests/data
+ *        One fix per line: time in s, latitude and longitude in 1e-7 degree,
+ *        lines starting with # are comments.
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef TEST_TRACK_H
+#define TEST_TRACK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+struct track_fix_s
+{
+	uint32_t time;
+	int32_t latitude;
+	int32_t longitude;
+};
+
+static std::vector<track_fix_s> read_track(const char *name)
+{
+	std::vector<track_fix_s> track;
+	FILE *file = fopen(name, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "%s: cannot read\n", name);
+		return track;
+	}
+	char line[128];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		track_fix_s fix;
+		long long lat;
+		long long lon;
+		unsigned long time;
+		if ((line[0] != '#') && (sscanf(line, "%lu,%lld,%lld", &time, &lat, &lon) == 3))
+		{
+			fix.time = time;
+			fix.latitude = (int32_t)lat;
+			fix.longitude = (int32_t)lon;
+			track.push_back(fix);
+		}
+	}
+	fclose(file);
+	return track;
+}
+
+#endif
@@ -0,0 +1,285 @@
+/**
+ * @file test_track_store.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the columnar track store
+ *        Segment round trips with random and extreme values, files with
+ *        several segments, time range queries and a damaged file end.
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_util.h"
+#include "track_store.h"
+
+/** Record of a device driving with a fix every interval seconds */
+static track_record_s make_record(uint32_t row, uint32_t interval)
+{
+	track_record_s record;
+	record.time = 1664582400 + row * interval;
+	record.latitude = 481370000 + (int32_t)(row * 37) + rand() % 50;
+	record.longitude = 115750000 - (int32_t)(row * 21) + rand() % 50;
+	record.altitude = 52000 + rand() % 300;
+	record.accuracy = 250 + rand() % 100;
+	record.battery = 4100 - row / 100;
+	record.temperature = 215 + rand() % 5;
+	record.humidity = 90;
+	record.pressure = 10132 + rand() % 3;
+	return record;
+}
+
+static bool same_record(const track_record_s &a, const track_record_s &b)
+{
+	for (uint8_t column = 0; column < TRACK_COLUMNS; column++)
+	{
+		if (track_get_column(&a, column) != track_get_column(&b, column))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Encode records and decode all columns again */
+static bool round_trip(const std::vector<track_record_s> &records)
+{
+	std::vector<uint8_t> segment;
+	size_t size = track_encode_segment(&records[0], records.size(), &segment);
+	if ((size == 0) || (size != segment.size()) || ((size & 7) != 0))
+	{
+		return false;
+	}
+	const track_segment_s *header = (const track_segment_s *)&segment[0];
+	std::vector<int64_t> values(records.size());
+	for (uint8_t column = 0; column < TRACK_COLUMNS; column++)
+	{
+		if (!track_decode_column(header, column, 0, records.size(), &values[0]))
+		{
+			return false;
+		}
+		for (size_t row = 0; row < records.size(); row++)
+		{
+			if (values[row] != track_get_column(&records[row], column))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void test_segment(void)
+{
+	std::vector<track_record_s> records;
+	for (uint32_t row = 0; row < TRACK_SEGMENT_ROWS; row++)
+	{
+		records.push_back(make_record(row, 30));
+	}
+	CHECK(round_trip(records));
+
+	std::vector<uint8_t> segment;
+	size_t size = track_encode_segment(&records[0], records.size(), &segment);
+	const track_segment_s *header = (const track_segment_s *)&segment[0];
+	CHECK_EQ(header->rows, TRACK_SEGMENT_ROWS);
+	CHECK_EQ(header->size, size);
+	// Constant interval and constant humidity need no bits
+	CHECK_EQ(header->columns[TRACK_COL_TIME].bits, 0);
+	CHECK_EQ(header->columns[TRACK_COL_TIME].delta_min, 30);
+	CHECK_EQ(header->columns[TRACK_COL_HUMID].bits, 0);
+	CHECK_EQ(header->columns[TRACK_COL_TIME].min, records[0].time);
+	CHECK_EQ(header->columns[TRACK_COL_TIME].max, records.back().time);
+	// Less than a quarter of the 28 byte records
+	printf("%u rows in %u bytes, %.2f bytes per row\n", header->rows, header->size, (double)size / header->rows);
+	CHECK(size * 4 < records.size() * sizeof(track_record_s));
+
+	// Part of a column
+	int64_t values[10];
+	CHECK(track_decode_column(header, TRACK_COL_LAT, 1000, 10, values));
+	for (uint32_t row = 0; row < 10; row++)
+	{
+		CHECK_EQ(values[row], records[1000 + row].latitude);
+	}
+	CHECK(track_decode_column(header, TRACK_COL_LAT, TRACK_SEGMENT_ROWS - 1, 1, values));
+	CHECK_EQ(values[0], records.back().latitude);
+	CHECK(!track_decode_column(header, TRACK_COL_LAT, TRACK_SEGMENT_ROWS - 1, 2, values));
+	CHECK(!track_decode_column(header, TRACK_COLUMNS, 0, 1, values));
+
+	// Row count limits
+	CHECK_EQ(track_encode_segment(&records[0], 0, &segment), 0);
+	CHECK_EQ(track_encode_segment(&records[0], TRACK_SEGMENT_ROWS + 1, &segment), 0);
+
+	// One row
+	std::vector<track_record_s> one(records.begin(), records.begin() + 1);
+	CHECK(round_trip(one));
+
+	// Extreme values, deltas up to 33 bits
+	for (uint32_t run = 0; run < 20; run++)
+	{
+		std::vector<track_record_s> extreme;
+		uint32_t rows = 1 + rand() % 200;
+		for (uint32_t row = 0; row < rows; row++)
+		{
+			track_record_s record;
+			for (uint8_t column = 0; column < TRACK_COLUMNS; column++)
+			{
+				int64_t value = ((int64_t)rand() << 16) ^ rand();
+				if ((rand() % 4) == 0)
+				{
+					value = (rand() % 2) ? -1 : 0x7FFFFFFF;
+				}
+				track_set_column(&record, column, value);
+			}
+			extreme.push_back(record);
+		}
+		CHECK(round_trip(extreme));
+	}
+}
+
+/** Temporary folder of the test files */
+static std::string temp_folder(void)
+{
+	char name[] = "/tmp/track_store_XXXXXX";
+	return mkdtemp(name) != NULL ? name : "/tmp";
+}
+
+static void test_file(const std::string &folder)
+{
+	std::string name = folder + "/device.trk";
+	std::vector<track_record_s> records;
+	{
+		TrackWriter writer(name);
+		for (uint32_t row = 0; row < 3 * TRACK_SEGMENT_ROWS + 100; row++)
+		{
+			records.push_back(make_record(row, 60));
+			CHECK(writer.append(&records.back()));
+		}
+		CHECK_EQ(writer.written(), 3 * TRACK_SEGMENT_ROWS);
+		CHECK(writer.flush());
+		CHECK_EQ(writer.written(), records.size());
+	}
+
+	TrackReader reader;
+	CHECK(reader.open(name.c_str()));
+	CHECK_EQ(reader.segments(), 4);
+	CHECK_EQ(reader.rows(), records.size());
+	CHECK(!reader.damaged());
+
+	// All records
+	std::vector<track_record_s> out;
+	CHECK_EQ(reader.query(0, UINT32_MAX, &out), records.size());
+	bool same = out.size() == records.size();
+	for (size_t row = 0; same && (row < out.size()); row++)
+	{
+		same = same_record(out[row], records[row]);
+	}
+	CHECK(same);
+	CHECK_EQ(reader.lastSkipped(), 0);
+
+	// One hour in the third segment, the other segments are skipped
+	uint32_t from = records[2 * TRACK_SEGMENT_ROWS + 10].time;
+	out.clear();
+	CHECK_EQ(reader.query(from, from + 3599, &out), 60);
+	CHECK_EQ(reader.lastSkipped(), 3);
+	CHECK(same_record(out[0], records[2 * TRACK_SEGMENT_ROWS + 10]));
+	CHECK(same_record(out[59], records[2 * TRACK_SEGMENT_ROWS + 69]));
+
+	// Over a segment border
+	from = records[TRACK_SEGMENT_ROWS - 5].time;
+	out.clear();
+	CHECK_EQ(reader.query(from, from + 9 * 60, &out), 10);
+	CHECK_EQ(reader.lastSkipped(), 2);
+	CHECK(same_record(out[9], records[TRACK_SEGMENT_ROWS + 4]));
+
+	// Outside of the track
+	out.clear();
+	CHECK_EQ(reader.query(0, records[0].time - 1, &out), 0);
+	CHECK_EQ(reader.lastSkipped(), 4);
+	uint32_t first_size = reader.segment(0)->size;
+	reader.close();
+
+	// Damaged end, the complete segments are still readable
+	CHECK_EQ(truncate(name.c_str(), first_size + 100), 0);
+	CHECK(reader.open(name.c_str()));
+	CHECK(reader.damaged());
+	CHECK_EQ(reader.segments(), 1);
+	out.clear();
+	CHECK_EQ(reader.query(0, UINT32_MAX, &out), reader.rows());
+	for (size_t row = 0; row < out.size(); row++)
+	{
+		CHECK(same_record(out[row], records[row]));
+	}
+
+	// Missing file
+	CHECK(!reader.open((folder + "/missing.trk").c_str()));
+	unlink(name.c_str());
+}
+
+static void test_unsorted(const std::string &folder)
+{
+	// Late uplinks from the queue are stored out of time order
+	std::string name = folder + "/unsorted.trk";
+	TrackWriter writer(name);
+	uint32_t times[] = {1000, 1060, 1120, 900, 960, 1180};
+	for (uint32_t idx = 0; idx < 6; idx++)
+	{
+		track_record_s record = make_record(idx, 60);
+		record.time = times[idx];
+		writer.append(&record);
+	}
+	CHECK(writer.flush());
+
+	TrackReader reader;
+	CHECK(reader.open(name.c_str()));
+	std::vector<track_record_s> out;
+	CHECK_EQ(reader.query(950, 1070, &out), 3);
+	CHECK_EQ(out[0].time, 1000);
+	CHECK_EQ(out[1].time, 1060);
+	CHECK_EQ(out[2].time, 960);
+	reader.close();
+	unlink(name.c_str());
+}
+
+static void test_store(const std::string &folder)
+{
+	std::vector<track_record_s> out;
+	{
+		TrackStore store(folder);
+		for (uint32_t row = 0; row < 5000; row++)
+		{
+			for (uint64_t device = 1; device <= 3; device++)
+			{
+				track_record_s record = make_record(row, 30);
+				record.battery = device;
+				CHECK(store.append(device, &record));
+			}
+		}
+		// Only the full segments are written
+		CHECK_EQ(store.query(2, 0, UINT32_MAX, &out), TRACK_SEGMENT_ROWS);
+		CHECK(store.flush());
+		out.clear();
+		CHECK_EQ(store.query(2, 0, UINT32_MAX, &out), 5000);
+		CHECK_EQ(out[4999].battery, 2);
+		CHECK_EQ(store.query(4, 0, UINT32_MAX, &out), 0);
+	}
+	for (uint64_t device = 1; device <= 3; device++)
+	{
+		unlink(TrackStore(folder).path(device).c_str());
+	}
+}
+
+int main(void)
+{
+	srand(7);
+	test_segment();
+	std::string folder = temp_folder();
+	test_file(folder);
+	test_unsorted(folder);
+	test_store(folder);
+	rmdir(folder.c_str());
+	return TEST_RESULT();
+}
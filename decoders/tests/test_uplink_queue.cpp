@@ -0,0 +1,271 @@
+/**
+ * @file test_uplink_queue.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the uplink queue on a log in RAM
+ * @version 0.1
+ * @date 2022-10-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <string.h>
+
+#include "test_util.h"
+#include "uplink_queue.h"
+
+/** Log in RAM instead of the file in the flash */
+static uint8_t log_ram[QUEUE_LOG_SIZE];
+
+static bool ram_read(uint32_t offset, uint8_t *data, uint16_t size)
+{
+	if (offset + size > QUEUE_LOG_SIZE)
+	{
+		return false;
+	}
+	memcpy(data, &log_ram[offset], size);
+	return true;
+}
+
+static bool ram_write(uint32_t offset, const uint8_t *data, uint16_t size)
+{
+	if (offset + size > QUEUE_LOG_SIZE)
+	{
+		return false;
+	}
+	memcpy(&log_ram[offset], data, size);
+	return true;
+}
+
+/**
+ * @brief Empty log and a queue on it, like init_uplink_queue() on a new device
+ *
+ */
+static void format(UplinkQueue &queue)
+{
+	memset(log_ram, 0xFF, QUEUE_LOG_SIZE);
+	queue.begin(ram_read, ram_write);
+}
+
+/**
+ * @brief Queue a packet with its number as content
+ *
+ */
+static bool push_packet(UplinkQueue &queue, uint32_t now, uint8_t priority, uint8_t number)
+{
+	uint8_t data[3] = {number, 0x55, 0xAA};
+	return queue.push(now, priority, 2, data, sizeof(data), 24 * 3600);
+}
+
+/**
+ * @brief Number of the next packet to send, 0xFF if the queue is empty
+ *
+ */
+static uint8_t peek_packet(UplinkQueue &queue, uint32_t now)
+{
+	uint8_t fport;
+	uint8_t data[QUEUE_MAX_DATA];
+	uint32_t age;
+	uint8_t size = queue.peek(now, &fport, data, &age);
+	if (size == 0)
+	{
+		return 0xFF;
+	}
+	CHECK_EQ(size, 3);
+	CHECK_EQ(fport, 2);
+	CHECK_EQ(data[2], 0xAA);
+	return data[0];
+}
+
+static void test_order(void)
+{
+	UplinkQueue queue;
+	format(queue);
+	CHECK_EQ(queue.count(), 0);
+	CHECK_EQ(peek_packet(queue, 100), 0xFF);
+
+	CHECK(push_packet(queue, 100, QUEUE_PRIO_PERIODIC, 1));
+	CHECK(push_packet(queue, 110, QUEUE_PRIO_MOTION, 2));
+	CHECK(push_packet(queue, 120, QUEUE_PRIO_PERIODIC, 3));
+	CHECK(push_packet(queue, 130, QUEUE_PRIO_ALARM, 4));
+	CHECK(push_packet(queue, 140, QUEUE_PRIO_MOTION, 5));
+	CHECK_EQ(queue.count(), 5);
+
+	// Highest priority first, oldest first in each priority
+	const uint8_t expected[] = {4, 2, 5, 1, 3};
+	for (uint8_t idx = 0; idx < sizeof(expected); idx++)
+	{
+		CHECK_EQ(peek_packet(queue, 150), expected[idx]);
+		// Not sent yet, peek returns the same packet again
+		CHECK_EQ(peek_packet(queue, 150), expected[idx]);
+		queue.pop();
+	}
+	CHECK_EQ(queue.count(), 0);
+	CHECK_EQ(peek_packet(queue, 150), 0xFF);
+
+	// Too big packets are not queued
+	uint8_t big[QUEUE_MAX_DATA + 1] = {0};
+	CHECK(!queue.push(150, QUEUE_PRIO_ALARM, 2, big, QUEUE_MAX_DATA + 1, 60));
+}
+
+static void test_reboot(void)
+{
+	UplinkQueue queue;
+	format(queue);
+	for (uint8_t number = 1; number <= 6; number++)
+	{
+		CHECK(push_packet(queue, 1000 + number, number == 4 ? QUEUE_PRIO_ALARM : QUEUE_PRIO_PERIODIC, number));
+	}
+	CHECK_EQ(peek_packet(queue, 1010), 4);
+	queue.pop();
+	CHECK_EQ(peek_packet(queue, 1010), 1);
+	queue.pop();
+
+	// The index is rebuilt from the log, sent packets stay removed
+	UplinkQueue rebooted;
+	rebooted.begin(ram_read, ram_write);
+	CHECK_EQ(rebooted.count(), 4);
+	CHECK_EQ(rebooted.lastTime(), 1006);
+
+	// New packets go after the newest one, not over the sent slots at the start of the log
+	CHECK(push_packet(rebooted, 1020, QUEUE_PRIO_PERIODIC, 7));
+	CHECK_EQ(log_ram[6 * QUEUE_SLOT_SIZE + QUEUE_HEADER_SIZE], 7);
+	const uint8_t expected[] = {2, 3, 5, 6, 7};
+	for (uint8_t idx = 0; idx < sizeof(expected); idx++)
+	{
+		CHECK_EQ(peek_packet(rebooted, 1030), expected[idx]);
+		rebooted.pop();
+	}
+	CHECK_EQ(rebooted.count(), 0);
+
+	// Nothing queued after a reboot either
+	UplinkQueue empty;
+	empty.begin(ram_read, ram_write);
+	CHECK_EQ(empty.count(), 0);
+	CHECK_EQ(empty.lastTime(), 1020);
+}
+
+static void test_wrap(void)
+{
+	UplinkQueue queue;
+	format(queue);
+
+	// Three rounds through the log, sending each packet before the next one is queued
+	for (uint8_t number = 1; number <= 3 * QUEUE_SLOTS + 5; number++)
+	{
+		CHECK(push_packet(queue, number, QUEUE_PRIO_PERIODIC, number));
+		if (number <= 3 * QUEUE_SLOTS)
+		{
+			CHECK_EQ(peek_packet(queue, number), number);
+			queue.pop();
+		}
+	}
+	CHECK_EQ(queue.count(), 5);
+	// The head wrapped around, the last packet is in slot 4
+	CHECK_EQ(log_ram[4 * QUEUE_SLOT_SIZE + QUEUE_HEADER_SIZE], 3 * QUEUE_SLOTS + 5);
+
+	// After a reboot the head is found in the middle of the log
+	UplinkQueue rebooted;
+	rebooted.begin(ram_read, ram_write);
+	CHECK_EQ(rebooted.count(), 5);
+	CHECK(push_packet(rebooted, 100, QUEUE_PRIO_PERIODIC, 100));
+	CHECK_EQ(log_ram[5 * QUEUE_SLOT_SIZE + QUEUE_HEADER_SIZE], 100);
+	for (uint8_t number = 3 * QUEUE_SLOTS + 1; number <= 3 * QUEUE_SLOTS + 5; number++)
+	{
+		CHECK_EQ(peek_packet(rebooted, 100), number);
+		rebooted.pop();
+	}
+	CHECK_EQ(peek_packet(rebooted, 100), 100);
+}
+
+static void test_overwrite(void)
+{
+	UplinkQueue queue;
+	format(queue);
+
+	// Full log, one packet with higher priority
+	for (uint8_t number = 1; number <= QUEUE_SLOTS; number++)
+	{
+		CHECK(push_packet(queue, number, number == 1 ? QUEUE_PRIO_MOTION : QUEUE_PRIO_PERIODIC, number));
+	}
+	CHECK_EQ(queue.count(), QUEUE_SLOTS);
+
+	// The oldest packet with the lowest priority is replaced
+	CHECK(push_packet(queue, 20, QUEUE_PRIO_ALARM, 20));
+	CHECK_EQ(queue.count(), QUEUE_SLOTS);
+	CHECK_EQ(log_ram[1 * QUEUE_SLOT_SIZE + QUEUE_HEADER_SIZE], 20);
+	CHECK(push_packet(queue, 21, QUEUE_PRIO_PERIODIC, 21));
+	CHECK_EQ(log_ram[2 * QUEUE_SLOT_SIZE + QUEUE_HEADER_SIZE], 21);
+
+	// Only alarms and the motion packet left, a periodic packet does not get in
+	for (uint8_t number = 22; number < 22 + QUEUE_SLOTS - 2; number++)
+	{
+		CHECK(push_packet(queue, number, QUEUE_PRIO_ALARM, number));
+	}
+	CHECK(!push_packet(queue, 40, QUEUE_PRIO_PERIODIC, 40));
+	CHECK_EQ(peek_packet(queue, 40), 20);
+
+	// A motion packet replaces the only other motion packet
+	CHECK(push_packet(queue, 41, QUEUE_PRIO_MOTION, 41));
+	CHECK(!push_packet(queue, 42, QUEUE_PRIO_PERIODIC, 42));
+	CHECK_EQ(log_ram[0 * QUEUE_SLOT_SIZE + QUEUE_HEADER_SIZE], 41);
+
+	// With alarms only, the oldest alarm is replaced, even if it was just peeked
+	CHECK(push_packet(queue, 50, QUEUE_PRIO_ALARM, 50));
+	CHECK_EQ(peek_packet(queue, 60), 20);
+	CHECK(push_packet(queue, 61, QUEUE_PRIO_ALARM, 61));
+	CHECK_EQ(log_ram[1 * QUEUE_SLOT_SIZE + QUEUE_HEADER_SIZE], 61);
+	// pop() does not remove the new packet in the slot of the peeked one
+	queue.pop();
+	CHECK_EQ(queue.count(), QUEUE_SLOTS);
+	CHECK_EQ(peek_packet(queue, 60), 22);
+}
+
+static void test_expiry(void)
+{
+	UplinkQueue queue;
+	format(queue);
+	uint8_t data[1] = {1};
+	CHECK(queue.push(1000, QUEUE_PRIO_ALARM, 2, data, 1, 60));
+	data[0] = 2;
+	// Rounded up to 2 minutes
+	CHECK(queue.push(1000, QUEUE_PRIO_PERIODIC, 2, data, 1, 61));
+
+	uint8_t fport;
+	uint32_t age;
+	CHECK_EQ(queue.peek(1060, &fport, data, &age), 1);
+	CHECK_EQ(data[0], 1);
+	CHECK_EQ(age, 60);
+
+	// The first packet expired, it is dropped and the next one is returned
+	CHECK_EQ(queue.peek(1061, &fport, data, &age), 1);
+	CHECK_EQ(data[0], 2);
+	CHECK_EQ(queue.count(), 1);
+	CHECK_EQ(queue.peek(1121, &fport, data, &age), 0);
+	CHECK_EQ(queue.count(), 0);
+
+	// The expiry survives a reboot
+	data[0] = 3;
+	CHECK(queue.push(2000, QUEUE_PRIO_MOTION, 2, data, 1, 120));
+	UplinkQueue rebooted;
+	rebooted.begin(ram_read, ram_write);
+	CHECK_EQ(rebooted.peek(2120, &fport, data, &age), 1);
+	CHECK_EQ(rebooted.peek(2121, &fport, data, &age), 0);
+
+	// clear() drops everything
+	CHECK(queue.push(3000, QUEUE_PRIO_MOTION, 2, data, 1, 120));
+	CHECK(queue.push(3000, QUEUE_PRIO_MOTION, 2, data, 1, 120));
+	queue.clear();
+	CHECK_EQ(queue.count(), 0);
+	rebooted.begin(ram_read, ram_write);
+	CHECK_EQ(rebooted.count(), 0);
+}
+
+int main(void)
+{
+	test_order();
+	test_reboot();
+	test_wrap();
+	test_overwrite();
+	test_expiry();
+	return TEST_RESULT();
+}
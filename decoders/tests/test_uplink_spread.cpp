@@ -0,0 +1,276 @@
+/**
+ * @file test_uplink_spread.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Tests of the uplink jitter and slots and a simulation of the collisions in a fleet
+ * @version 0.1
+ * @date 2022-10-07
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#include "test_util.h"
+#include "uplink_spread.h"
+#include "airtime.h"
+
+/** Simulated hour after a power restore, all trackers send every minute on one P2P channel */
+#define SIM_PERIOD 60000
+#define SIM_TIME 3600000
+/** Trackers boot within this time after the power is back, in ms */
+#define SIM_BOOT_SPREAD 500
+/** Max jitter in s */
+#define SIM_JITTER 30
+/** Slot frame in s and slots per frame */
+#define SIM_FRAME 60
+#define SIM_SLOTS 250
+
+/** Simulated spreading */
+#define SIM_NONE 0
+#define SIM_JITTERED 1
+#define SIM_SLOTTED 2
+
+struct transmission_s
+{
+	uint32_t start;
+	uint32_t end;
+	uint16_t device;
+};
+
+static bool earlier(const transmission_s &a, const transmission_s &b)
+{
+	return a.start < b.start;
+}
+
+static void make_eui(uint16_t device, uint8_t *dev_eui)
+{
+	static const uint8_t base[8] = {0xAC, 0x1F, 0x09, 0xFF, 0xFE, 0x05, 0x00, 0x00};
+	for (uint8_t idx = 0; idx < 8; idx++)
+	{
+		dev_eui[idx] = base[idx];
+	}
+	dev_eui[6] = device >> 8;
+	dev_eui[7] = device & 0xFF;
+}
+
+static void test_seed(void)
+{
+	uint8_t eui_a[8];
+	uint8_t eui_b[8];
+	make_eui(1, eui_a);
+	make_eui(2, eui_b);
+	CHECK_EQ(spread_seed(eui_a), spread_seed(eui_a));
+	CHECK(spread_seed(eui_a) != spread_seed(eui_b));
+	// FNV-1a of 8 zero bytes
+	uint8_t zero[8] = {0};
+	CHECK_EQ(spread_seed(zero), 0x9BE17165);
+}
+
+static void test_jitter(void)
+{
+	UplinkSpread spread;
+	spread.begin(1234);
+	CHECK_EQ(spread.jitter(30000), 0);
+
+	spread.setJitter(20);
+	uint32_t sequence[10];
+	uint32_t max_seen = 0;
+	for (uint8_t idx = 0; idx < 10; idx++)
+	{
+		sequence[idx] = spread.jitter(60000);
+		CHECK(sequence[idx] <= 20000);
+	}
+	for (uint16_t idx = 0; idx < 1000; idx++)
+	{
+		uint32_t delay = spread.jitter(60000);
+		max_seen = delay > max_seen ? delay : max_seen;
+	}
+	CHECK(max_seen > 19000);
+
+	// Limited to the limit of the caller, half the send interval
+	for (uint8_t idx = 0; idx < 100; idx++)
+	{
+		CHECK(spread.jitter(5000) <= 5000);
+	}
+
+	// The same sequence after a reset
+	spread.begin(1234);
+	spread.setJitter(20);
+	for (uint8_t idx = 0; idx < 10; idx++)
+	{
+		CHECK_EQ(spread.jitter(60000), sequence[idx]);
+	}
+}
+
+static void test_slots(void)
+{
+	UplinkSpread spread;
+	spread.begin(1000 * 7 + 3);
+	CHECK(!spread.slotted());
+	CHECK_EQ(spread.slotWait(12345), 0);
+
+	// 7 s does not divide one day
+	spread.setSlots(7, 10);
+	CHECK(!spread.slotted());
+	spread.setSlots(60, 0);
+	CHECK(!spread.slotted());
+
+	// Slot 3 of 10 in a 60 s frame starts at 18 s
+	spread.setSlots(60, 10);
+	CHECK(spread.slotted());
+	CHECK_EQ(spread.slot(), 3);
+	CHECK_EQ(spread.slotWait(0), 18000);
+	CHECK_EQ(spread.slotWait(18000), 0);
+	CHECK_EQ(spread.slotWait(18001), 59999);
+	CHECK_EQ(spread.slotWait(5 * 60000 + 10000), 8000);
+	CHECK_EQ(spread.slotWait(SPREAD_DAY * 1000 - 1), 18001);
+}
+
+/**
+ * @brief Simulate a fleet for one hour and count the lost uplinks
+ *        The DevEUIs are numbered like the trackers of one delivery. The periodic timers of all trackers start when they booted after the power
+ *        restore, their clocks are off by up to 50 ppm. An uplink is lost if it
+ *        overlaps another one. Like in the firmware a newer location replaces one
+ *        that still waits for its slot.
+ *
+ * @param devices fleet size
+ * @param mode SIM_NONE, SIM_JITTERED or SIM_SLOTTED
+ * @param sent number of uplinks
+ * @return uint32_t number of lost uplinks
+ */
+static uint32_t run_fleet(uint16_t devices, uint8_t mode, uint32_t *sent)
+{
+	uint32_t toa = airtime_toa(7, 125, 1, 20) / 1000;
+	std::vector<transmission_s> air;
+	srand(50);
+	for (uint16_t device = 0; device < devices; device++)
+	{
+		uint8_t dev_eui[8];
+		make_eui(device, dev_eui);
+		UplinkSpread spread;
+		spread.begin(spread_seed(dev_eui));
+		if (mode == SIM_JITTERED)
+		{
+			spread.setJitter(SIM_JITTER);
+		}
+		else if (mode == SIM_SLOTTED)
+		{
+			spread.setSlots(SIM_FRAME, SIM_SLOTS);
+		}
+
+		uint32_t boot = rand() % SIM_BOOT_SPREAD;
+		int32_t ppm = rand() % 101 - 50;
+		// GNSS time of day of the power restore
+		uint32_t time_of_day = 8 * 3600000UL;
+		for (uint32_t period = 1; period < SIM_TIME / SIM_PERIOD; period++)
+		{
+			uint32_t tick = boot + period * (SIM_PERIOD + SIM_PERIOD / 1000000.0 * ppm);
+			uint32_t start = tick;
+			if (mode == SIM_JITTERED)
+			{
+				start += spread.jitter(SIM_PERIOD / 2);
+			}
+			else if (mode == SIM_SLOTTED)
+			{
+				start += spread.slotWait(time_of_day + tick);
+			}
+			transmission_s transmission = {start, start + toa, device};
+			if ((period > 1) && (tick <= air.back().start))
+			{
+				air.back() = transmission;
+			}
+			else
+			{
+				air.push_back(transmission);
+			}
+		}
+	}
+
+	std::sort(air.begin(), air.end(), earlier);
+	std::vector<bool> lost(air.size(), false);
+	for (size_t idx = 0; idx < air.size(); idx++)
+	{
+		for (size_t other = idx + 1; (other < air.size()) && (air[other].start < air[idx].end); other++)
+		{
+			lost[idx] = true;
+			lost[other] = true;
+		}
+	}
+	*sent = air.size();
+	return std::count(lost.begin(), lost.end(), true);
+}
+
+static void test_fleet(void)
+{
+	static const uint16_t fleet[] = {10, 25, 50, 100, 200};
+	double rate[3][sizeof(fleet) / sizeof(fleet[0])];
+	printf("lost uplinks in the hour after a power restore, SF7 P2P, one uplink per minute\n");
+	printf("devices      none  jitter %ds  %d slots\n", SIM_JITTER, SIM_SLOTS);
+	for (uint8_t size = 0; size < sizeof(fleet) / sizeof(fleet[0]); size++)
+	{
+		for (uint8_t mode = SIM_NONE; mode <= SIM_SLOTTED; mode++)
+		{
+			uint32_t sent;
+			uint32_t lost = run_fleet(fleet[size], mode, &sent);
+			CHECK(sent <= fleet[size] * (SIM_TIME / SIM_PERIOD - 1));
+			CHECK((mode == SIM_SLOTTED) || (sent == fleet[size] * (SIM_TIME / SIM_PERIOD - 1)));
+			rate[mode][size] = 100.0 * lost / sent;
+		}
+		printf("%7u  %7.1f %%  %8.1f %%  %7.1f %%\n", fleet[size], rate[SIM_NONE][size], rate[SIM_JITTERED][size],
+			   rate[SIM_SLOTTED][size]);
+
+		// Jitter and slots lose far fewer uplinks than synchronized timers,
+		// until the jitter window is too short for the fleet
+		CHECK(rate[SIM_JITTERED][size] < rate[SIM_NONE][size]);
+		CHECK((fleet[size] > 100) || (rate[SIM_JITTERED][size] * 3 < rate[SIM_NONE][size]));
+		CHECK(rate[SIM_SLOTTED][size] * 3 < rate[SIM_NONE][size]);
+		if (size > 0)
+		{
+			CHECK(rate[SIM_JITTERED][size] > rate[SIM_JITTERED][size - 1]);
+		}
+	}
+	// Without spreading most uplinks of a large fleet are lost
+	CHECK(rate[SIM_NONE][4] > 80);
+}
+
+/**
+ * @brief Slotted trackers lose uplinks only if they share a slot
+ *
+ */
+static void test_slot_collisions(void)
+{
+	uint16_t devices = 200;
+	std::vector<uint16_t> per_slot(SIM_SLOTS, 0);
+	for (uint16_t device = 0; device < devices; device++)
+	{
+		uint8_t dev_eui[8];
+		make_eui(device, dev_eui);
+		UplinkSpread spread;
+		spread.begin(spread_seed(dev_eui));
+		spread.setSlots(SIM_FRAME, SIM_SLOTS);
+		per_slot[spread.slot()]++;
+	}
+	uint32_t shared = 0;
+	for (uint16_t slot = 0; slot < SIM_SLOTS; slot++)
+	{
+		shared += per_slot[slot] > 1 ? per_slot[slot] : 0;
+	}
+	CHECK(shared > 0);
+	uint32_t sent;
+	uint32_t lost = run_fleet(devices, SIM_SLOTTED, &sent);
+	// A drifting clock can skip one frame when the timer passes the start of the slot
+	CHECK(lost <= shared * (SIM_TIME / SIM_PERIOD - 1));
+	CHECK(lost >= shared * (SIM_TIME / SIM_PERIOD - 3));
+}
+
+int main(void)
+{
+	test_seed();
+	test_jitter();
+	test_slots();
+	test_fleet();
+	test_slot_collisions();
+	return TEST_RESULT();
+}
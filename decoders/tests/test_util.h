@@ -0,0 +1,58 @@
+/**
+ * @file test_util.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Checks for the host tests
+ *        A failed check prints its location and the test returns 1 from TEST_RESULT().
+ * @version 0.1
+ * @date 2022-10-03
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdio.h>
+#include <math.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                                   \
+	do                                                                                \
+	{                                                                                 \
+		if (!(cond))                                                                  \
+		{                                                                             \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			test_failures++;                                                          \
+		}                                                                             \
+	} while (0)
+
+#define CHECK_EQ(a, b)                                                                                     \
+	do                                                                                                     \
+	{                                                                                                      \
+		long long check_a = (long long)(a);                                                                \
+		long long check_b = (long long)(b);                                                                \
+		if (check_a != check_b)                                                                            \
+		{                                                                                                  \
+			fprintf(stderr, "%s:%d: %s == %s failed, %lld != %lld\n", __FILE__, __LINE__, #a, #b, check_a, \
+					check_b);                                                                              \
+			test_failures++;                                                                               \
+		}                                                                                                  \
+	} while (0)
+
+#define CHECK_NEAR(a, b, eps)                                                                         \
+	do                                                                                                \
+	{                                                                                                 \
+		double check_a = (double)(a);                                                                 \
+		double check_b = (double)(b);                                                                 \
+		if (fabs(check_a - check_b) > (eps))                                                          \
+		{                                                                                             \
+			fprintf(stderr, "%s:%d: %s ~ %s failed, %.9g != %.9g\n", __FILE__, __LINE__, #a, #b, check_a, \
+					check_b);                                                                         \
+			test_failures++;                                                                          \
+		}                                                                                             \
+	} while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+#endif